@@ -114,7 +114,7 @@ PendingVariant *AbstractInterface::internalRequestProperty(const QString &name)
     QDBusMessage msg = QDBusMessage::createMethodCall(service(), path(),
             TP_QT_IFACE_PROPERTIES, QLatin1String("Get"));
     msg << interface() << name;
-    QDBusPendingCall pendingCall = connection().asyncCall(msg);
+    QDBusPendingCall pendingCall = internalAsyncCall(msg);
     DBusProxy *proxy = qobject_cast<DBusProxy*>(parent());
     return new PendingVariant(pendingCall, DBusProxyPtr(proxy));
 }
@@ -125,7 +125,7 @@ PendingOperation *AbstractInterface::internalSetProperty(const QString &name,
     QDBusMessage msg = QDBusMessage::createMethodCall(service(), path(),
             TP_QT_IFACE_PROPERTIES, QLatin1String("Set"));
     msg << interface() << name << QVariant::fromValue(QDBusVariant(newValue));
-    QDBusPendingCall pendingCall = connection().asyncCall(msg);
+    QDBusPendingCall pendingCall = internalAsyncCall(msg);
     DBusProxy *proxy = qobject_cast<DBusProxy*>(parent());
     return new PendingVoid(pendingCall, DBusProxyPtr(proxy));
 }
@@ -135,11 +135,33 @@ PendingVariantMap *AbstractInterface::internalRequestAllProperties() const
     QDBusMessage msg = QDBusMessage::createMethodCall(service(), path(),
             TP_QT_IFACE_PROPERTIES, QLatin1String("GetAll"));
     msg << interface();
-    QDBusPendingCall pendingCall = connection().asyncCall(msg);
+    QDBusPendingCall pendingCall = internalAsyncCall(msg);
     DBusProxy *proxy = qobject_cast<DBusProxy*>(parent());
     return new PendingVariantMap(pendingCall, DBusProxyPtr(proxy));
 }
 
+/**
+ * Make an asynchronous D-Bus method call on the remote object.
+ *
+ * This is what all the generated method wrappers use, so that the call can be recorded in the
+ * timeline of the DBusProxy this interface belongs to, if profiling is enabled for it.
+ *
+ * \param message The method call message.
+ * \param timeout The timeout in milliseconds, or -1 for the D-Bus default.
+ * \return The pending call.
+ * \sa DBusProxy::setProfilingEnabled()
+ */
+QDBusPendingCall AbstractInterface::internalAsyncCall(const QDBusMessage &message,
+        int timeout) const
+{
+    QDBusPendingCall pendingCall = connection().asyncCall(message, timeout);
+    DBusProxy *proxy = qobject_cast<DBusProxy*>(parent());
+    if (proxy && proxy->isProfilingEnabled()) {
+        proxy->profileCall(message, pendingCall);
+    }
+    return pendingCall;
+}
+
 /**
  * Sets whether this abstract interface will be monitoring properties or not. If it's set to monitor,
  * the signal propertiesChanged will be emitted whenever a property on this interface will
@@ -30,6 +30,8 @@
 #include <TelepathyQt/Global>
 
 #include <QDBusAbstractInterface>
+#include <QDBusMessage>
+#include <QDBusPendingCall>
 
 namespace Tp
 {
@@ -72,6 +74,8 @@ protected:
     PendingOperation *internalSetProperty(const QString &name, const QVariant &newValue);
     PendingVariantMap *internalRequestAllProperties() const;
 
+    QDBusPendingCall internalAsyncCall(const QDBusMessage &message, int timeout = -1) const;
+
 private Q_SLOTS:
     TP_QT_NO_EXPORT void onPropertiesChanged(const QString &interface,
             const QVariantMap &changedProperties,
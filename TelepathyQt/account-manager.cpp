@@ -37,8 +37,11 @@
 #include <TelepathyQt/PendingReady>
 #include <TelepathyQt/ReadinessHelper>
 
+#include <QDataStream>
+#include <QFile>
 #include <QQueue>
 #include <QSet>
+#include <QTemporaryFile>
 #include <QTimer>
 
 namespace Tp
@@ -60,7 +63,16 @@ struct TP_QT_NO_EXPORT AccountManager::Private
 
     QSet<QString> getAccountPathsFromProp(const QVariant &prop);
     QSet<QString> getAccountPathsFromProps(const QVariantMap &props);
-    void addAccountForPath(const QString &accountObjectPath);
+    void addAccountForPath(const QString &accountObjectPath,
+            const QVariantMap &snapshotProperties = QVariantMap());
+
+    AccountSetPtr sharedAccountSet(const QString &key, const QVariantMap &filter);
+    AccountSetPtr sharedCapabilityAccountSet(const QString &key,
+            const RequestableChannelClassSpec &spec);
+    void removeStaleAccounts(const QSet<QString> &paths);
+
+    bool loadSnapshot();
+    void saveSnapshot();
 
     // Public object
     AccountManager *parent;
@@ -84,11 +96,22 @@ struct TP_QT_NO_EXPORT AccountManager::Private
     QHash<QString, AccountPtr> incompleteAccounts;
     QHash<QString, AccountPtr> accounts;
     QStringList supportedAccountProperties;
+
+    // The views returned by validAccounts() and friends, shared for as long as someone holds them
+    QHash<QString, WeakPtr<AccountSet> > accountSets;
+
+    // Warm start
+    QString snapshotFileName;
+    bool triedSnapshot;
+    bool revalidatingSnapshot;
 };
 
 static const int maxReintrospectionRetries = 5;
 static const int reintrospectionRetryInterval = 3;
 
+static const quint32 snapshotMagic = 0x54504153; // "TPAS"
+static const quint32 snapshotVersion = 2;
+
 AccountManager::Private::Private(AccountManager *parent,
         const AccountFactoryConstPtr &accFactory, const ConnectionFactoryConstPtr &connFactory,
         const ChannelFactoryConstPtr &chanFactory, const ContactFactoryConstPtr &contactFactory)
@@ -101,7 +124,9 @@ AccountManager::Private::Private(AccountManager *parent,
       chanFactory(chanFactory),
       contactFactory(contactFactory),
       reintrospectionRetries(0),
-      gotInitialAccounts(false)
+      gotInitialAccounts(false),
+      triedSnapshot(false),
+      revalidatingSnapshot(false)
 {
     debug() << "Creating new AccountManager:" << parent->busName();
 
@@ -155,6 +180,16 @@ void AccountManager::Private::init()
 
 void AccountManager::Private::introspectMain(AccountManager::Private *self)
 {
+    if (!self->snapshotFileName.isEmpty() && !self->triedSnapshot) {
+        self->triedSnapshot = true;
+        if (self->loadSnapshot()) {
+            // The accounts from the snapshot are being made ready without D-Bus round trips,
+            // GetAll is still called below to find out what changed while we weren't looking
+            self->revalidatingSnapshot = true;
+            self->checkIntrospectionCompleted();
+        }
+    }
+
     debug() << "Calling Properties::GetAll(AccountManager)";
     QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(
             self->properties->GetAll(
@@ -170,6 +205,11 @@ void AccountManager::Private::checkIntrospectionCompleted()
     if (!parent->isReady(FeatureCore) &&
         incompleteAccounts.size() == 0) {
         readinessHelper->setIntrospectCompleted(FeatureCore, true);
+
+        // Save what we've got as soon as we have it all, unless it came from the snapshot itself
+        if (!snapshotFileName.isEmpty() && !revalidatingSnapshot) {
+            saveSnapshot();
+        }
     }
 }
 
@@ -208,7 +248,8 @@ QSet<QString> AccountManager::Private::getAccountPathsFromProps(
             getAccountPathsFromProp(props[QLatin1String("InvalidAccounts")]));
 }
 
-void AccountManager::Private::addAccountForPath(const QString &path)
+void AccountManager::Private::addAccountForPath(const QString &path,
+        const QVariantMap &snapshotProperties)
 {
     // Also check incompleteAccounts, because otherwise we end up introspecting an account twice
     // when getting an AccountValidityChanged signal for a new account before we get the initial
@@ -223,12 +264,158 @@ void AccountManager::Private::addAccountForPath(const QString &path)
     AccountPtr account(AccountPtr::qObjectCast(readyOp->proxy()));
     Q_ASSERT(!account.isNull());
 
+    if (!snapshotProperties.isEmpty()) {
+        account->setSnapshotProperties(snapshotProperties);
+    }
+
     parent->connect(readyOp,
             SIGNAL(finished(Tp::PendingOperation*)),
             SLOT(onAccountReady(Tp::PendingOperation*)));
     incompleteAccounts.insert(path, account);
 }
 
+AccountSetPtr AccountManager::Private::sharedAccountSet(const QString &key,
+        const QVariantMap &filter)
+{
+    if (!parent->isReady(FeatureCore)) {
+        // Don't keep the empty set filterAccounts() gives us in this case
+        return parent->filterAccounts(filter);
+    }
+
+    AccountSetPtr set(accountSets.value(key));
+    if (!set) {
+        set = parent->filterAccounts(filter);
+        accountSets.insert(key, WeakPtr<AccountSet>(set));
+    }
+    return set;
+}
+
+AccountSetPtr AccountManager::Private::sharedCapabilityAccountSet(const QString &key,
+        const RequestableChannelClassSpec &spec)
+{
+    AccountSetPtr set(accountSets.value(key));
+    if (!set) {
+        AccountCapabilityFilterPtr filter = AccountCapabilityFilter::create();
+        filter->addRequestableChannelClassSubset(spec);
+        set = parent->filterAccounts(filter);
+        if (parent->isReady(FeatureCore)) {
+            accountSets.insert(key, WeakPtr<AccountSet>(set));
+        }
+    }
+    return set;
+}
+
+void AccountManager::Private::removeStaleAccounts(const QSet<QString> &paths)
+{
+    // Accounts from the snapshot which the AccountManager doesn't have anymore were removed while
+    // we weren't running, so let them go the same way as if we had seen them being removed
+    QList<AccountPtr> stale;
+    foreach (const AccountPtr &account, accounts) {
+        if (!paths.contains(account->objectPath())) {
+            stale << account;
+        }
+    }
+    foreach (const AccountPtr &account, incompleteAccounts) {
+        if (!paths.contains(account->objectPath())) {
+            stale << account;
+        }
+    }
+
+    foreach (const AccountPtr &account, stale) {
+        debug() << "Account" << account->objectPath() << "from the snapshot is gone";
+        accounts.remove(account->objectPath());
+        incompleteAccounts.remove(account->objectPath());
+        account->onRemoved();
+    }
+}
+
+bool AccountManager::Private::loadSnapshot()
+{
+    QFile file(snapshotFileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        debug() << "No account snapshot to warm start from at" << snapshotFileName;
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_6);
+
+    quint32 magic = 0, version = 0;
+    stream >> magic >> version;
+    if (stream.status() != QDataStream::Ok || magic != snapshotMagic ||
+            version != snapshotVersion) {
+        warning() << "Ignoring account snapshot" << snapshotFileName << "in an unknown format";
+        return false;
+    }
+
+    QStringList interfaces;
+    QStringList supportedProperties;
+    QMap<QString, QVariantMap> accountProperties;
+    stream >> interfaces >> supportedProperties >> accountProperties;
+    if (stream.status() != QDataStream::Ok) {
+        warning() << "Ignoring truncated account snapshot" << snapshotFileName;
+        return false;
+    }
+
+    debug() << "Warm starting AccountManager from snapshot" << snapshotFileName << "with" <<
+        accountProperties.size() << "accounts";
+
+    parent->setInterfaces(interfaces);
+    readinessHelper->setInterfaces(parent->interfaces());
+    supportedAccountProperties = supportedProperties;
+    gotInitialAccounts = true;
+
+    QMap<QString, QVariantMap>::const_iterator i;
+    for (i = accountProperties.constBegin(); i != accountProperties.constEnd(); ++i) {
+        addAccountForPath(i.key(), i.value());
+    }
+
+    return true;
+}
+
+void AccountManager::Private::saveSnapshot()
+{
+    QMap<QString, QVariantMap> accountProperties;
+    foreach (const AccountPtr &account, accounts) {
+        if (account->isValid()) {
+            accountProperties.insert(account->objectPath(), account->snapshotProperties());
+        }
+    }
+
+    // Write to a temporary file next to the snapshot and move it in place when done, so a reader
+    // never sees half a snapshot. The account names and nicknames identify the user, so keep it
+    // readable by its owner only.
+    QTemporaryFile file(snapshotFileName);
+    if (!file.open()) {
+        warning() << "Unable to write account snapshot" << snapshotFileName << "-" <<
+            file.errorString();
+        return;
+    }
+    file.setPermissions(QFile::ReadOwner | QFile::WriteOwner);
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_6);
+    stream << snapshotMagic << snapshotVersion << parent->interfaces() <<
+        supportedAccountProperties << accountProperties;
+
+    if (stream.status() != QDataStream::Ok || !file.flush()) {
+        warning() << "Unable to write account snapshot" << file.fileName() << "-" <<
+            file.errorString();
+        return;
+    }
+
+    file.setAutoRemove(false);
+    QFile::remove(snapshotFileName);
+    if (!file.rename(snapshotFileName)) {
+        warning() << "Unable to move account snapshot in place at" << snapshotFileName;
+        file.remove();
+        return;
+    }
+
+    debug() << "Saved account snapshot" << snapshotFileName << "with" <<
+        accountProperties.size() << "accounts";
+}
+
 /**
  * \class AccountManager
  * \ingroup clientam
@@ -255,6 +442,12 @@ void AccountManager::Private::addAccountForPath(const QString &path)
  *
  * A signal is emitted to indicate that accounts are added. See newCreated() for more details.
  *
+ * The account sets returned by validAccounts(), onlineAccounts(), textChatAccounts(),
+ * accountsByProtocol() and the other predefined views are shared: as long as a view is held,
+ * asking for it again returns the same AccountSet object rather than a new one following all the
+ * accounts again. Sets returned by filterAccounts() are always new, as the filter passed in may
+ * still be changed by the caller.
+ *
  * \section am_usage_sec Usage
  *
  * \subsection am_create_sec Creating an AccountManager object
@@ -444,6 +637,12 @@ AccountManager::AccountManager(const QDBusConnection &bus,
  */
 AccountManager::~AccountManager()
 {
+    // The accounts have been kept up to date with their change signals since the snapshot was
+    // loaded or last saved, so this is the most recent state we can leave for the next run
+    if (!mPriv->snapshotFileName.isEmpty() && isReady(FeatureCore)) {
+        mPriv->saveSnapshot();
+    }
+
     delete mPriv;
 }
 
@@ -536,7 +735,7 @@ AccountSetPtr AccountManager::validAccounts() const
 {
     QVariantMap filter;
     filter.insert(QLatin1String("valid"), true);
-    return filterAccounts(filter);
+    return mPriv->sharedAccountSet(QLatin1String("valid=true"), filter);
 }
 
 /**
@@ -550,7 +749,7 @@ AccountSetPtr AccountManager::invalidAccounts() const
 {
     QVariantMap filter;
     filter.insert(QLatin1String("valid"), false);
-    return filterAccounts(filter);
+    return mPriv->sharedAccountSet(QLatin1String("valid=false"), filter);
 }
 
 /**
@@ -564,7 +763,7 @@ AccountSetPtr AccountManager::enabledAccounts() const
 {
     QVariantMap filter;
     filter.insert(QLatin1String("enabled"), true);
-    return filterAccounts(filter);
+    return mPriv->sharedAccountSet(QLatin1String("enabled=true"), filter);
 }
 
 /**
@@ -578,7 +777,7 @@ AccountSetPtr AccountManager::disabledAccounts() const
 {
     QVariantMap filter;
     filter.insert(QLatin1String("enabled"), false);
-    return filterAccounts(filter);
+    return mPriv->sharedAccountSet(QLatin1String("enabled=false"), filter);
 }
 
 /**
@@ -592,7 +791,7 @@ AccountSetPtr AccountManager::onlineAccounts() const
 {
     QVariantMap filter;
     filter.insert(QLatin1String("online"), true);
-    return filterAccounts(filter);
+    return mPriv->sharedAccountSet(QLatin1String("online=true"), filter);
 }
 
 /**
@@ -606,7 +805,7 @@ AccountSetPtr AccountManager::offlineAccounts() const
 {
     QVariantMap filter;
     filter.insert(QLatin1String("online"), false);
-    return filterAccounts(filter);
+    return mPriv->sharedAccountSet(QLatin1String("online=false"), filter);
 }
 
 /**
@@ -628,9 +827,8 @@ AccountSetPtr AccountManager::textChatAccounts() const
         return filterAccounts(AccountFilterConstPtr());
     }
 
-    AccountCapabilityFilterPtr filter = AccountCapabilityFilter::create();
-    filter->addRequestableChannelClassSubset(RequestableChannelClassSpec::textChat());
-    return filterAccounts(filter);
+    return mPriv->sharedCapabilityAccountSet(QLatin1String("textChat"),
+            RequestableChannelClassSpec::textChat());
 }
 
 /**
@@ -652,9 +850,8 @@ AccountSetPtr AccountManager::textChatroomAccounts() const
         return filterAccounts(AccountFilterConstPtr());
     }
 
-    AccountCapabilityFilterPtr filter = AccountCapabilityFilter::create();
-    filter->addRequestableChannelClassSubset(RequestableChannelClassSpec::textChatroom());
-    return filterAccounts(filter);
+    return mPriv->sharedCapabilityAccountSet(QLatin1String("textChatroom"),
+            RequestableChannelClassSpec::textChatroom());
 }
 
 /**
@@ -676,9 +873,8 @@ AccountSetPtr AccountManager::audioCallAccounts() const
         return filterAccounts(AccountFilterConstPtr());
     }
 
-    AccountCapabilityFilterPtr filter = AccountCapabilityFilter::create();
-    filter->addRequestableChannelClassSubset(RequestableChannelClassSpec::audioCall());
-    return filterAccounts(filter);
+    return mPriv->sharedCapabilityAccountSet(QLatin1String("audioCall"),
+            RequestableChannelClassSpec::audioCall());
 }
 
 /**
@@ -700,9 +896,8 @@ AccountSetPtr AccountManager::videoCallAccounts() const
         return filterAccounts(AccountFilterConstPtr());
     }
 
-    AccountCapabilityFilterPtr filter = AccountCapabilityFilter::create();
-    filter->addRequestableChannelClassSubset(RequestableChannelClassSpec::videoCall());
-    return filterAccounts(filter);
+    return mPriv->sharedCapabilityAccountSet(QLatin1String("videoCall"),
+            RequestableChannelClassSpec::videoCall());
 }
 
 /**
@@ -724,9 +919,8 @@ AccountSetPtr AccountManager::streamedMediaCallAccounts() const
         return filterAccounts(AccountFilterConstPtr());
     }
 
-    AccountCapabilityFilterPtr filter = AccountCapabilityFilter::create();
-    filter->addRequestableChannelClassSubset(RequestableChannelClassSpec::streamedMediaCall());
-    return filterAccounts(filter);
+    return mPriv->sharedCapabilityAccountSet(QLatin1String("streamedMediaCall"),
+            RequestableChannelClassSpec::streamedMediaCall());
 }
 
 /**
@@ -748,9 +942,8 @@ AccountSetPtr AccountManager::streamedMediaAudioCallAccounts() const
         return filterAccounts(AccountFilterConstPtr());
     }
 
-    AccountCapabilityFilterPtr filter = AccountCapabilityFilter::create();
-    filter->addRequestableChannelClassSubset(RequestableChannelClassSpec::streamedMediaAudioCall());
-    return filterAccounts(filter);
+    return mPriv->sharedCapabilityAccountSet(QLatin1String("streamedMediaAudioCall"),
+            RequestableChannelClassSpec::streamedMediaAudioCall());
 }
 
 /**
@@ -772,9 +965,8 @@ AccountSetPtr AccountManager::streamedMediaVideoCallAccounts() const
         return filterAccounts(AccountFilterConstPtr());
     }
 
-    AccountCapabilityFilterPtr filter = AccountCapabilityFilter::create();
-    filter->addRequestableChannelClassSubset(RequestableChannelClassSpec::streamedMediaVideoCall());
-    return filterAccounts(filter);
+    return mPriv->sharedCapabilityAccountSet(QLatin1String("streamedMediaVideoCall"),
+            RequestableChannelClassSpec::streamedMediaVideoCall());
 }
 
 /**
@@ -796,10 +988,8 @@ AccountSetPtr AccountManager::streamedMediaVideoCallWithAudioAccounts() const
         return filterAccounts(AccountFilterConstPtr());
     }
 
-    AccountCapabilityFilterPtr filter = AccountCapabilityFilter::create();
-    filter->addRequestableChannelClassSubset(
+    return mPriv->sharedCapabilityAccountSet(QLatin1String("streamedMediaVideoCallWithAudio"),
             RequestableChannelClassSpec::streamedMediaVideoCallWithAudio());
-    return filterAccounts(filter);
 }
 
 /**
@@ -821,9 +1011,8 @@ AccountSetPtr AccountManager::fileTransferAccounts() const
         return filterAccounts(AccountFilterConstPtr());
     }
 
-    AccountCapabilityFilterPtr filter = AccountCapabilityFilter::create();
-    filter->addRequestableChannelClassSubset(RequestableChannelClassSpec::fileTransfer());
-    return filterAccounts(filter);
+    return mPriv->sharedCapabilityAccountSet(QLatin1String("fileTransfer"),
+            RequestableChannelClassSpec::fileTransfer());
 }
 
 /**
@@ -845,7 +1034,7 @@ AccountSetPtr AccountManager::accountsByProtocol(
 
     QVariantMap filter;
     filter.insert(QLatin1String("protocolName"), protocolName);
-    return filterAccounts(filter);
+    return mPriv->sharedAccountSet(QLatin1String("protocolName=") + protocolName, filter);
 }
 
 /**
@@ -991,6 +1180,44 @@ QList<AccountPtr> AccountManager::accountsForPaths(const QStringList &paths) con
     return accountsForObjectPaths(paths);
 }
 
+/**
+ * Return the name of the file the account snapshot is kept in, as set by setSnapshotFileName().
+ *
+ * \return The snapshot file name, or an empty string if no snapshot is used.
+ * \sa setSnapshotFileName()
+ */
+QString AccountManager::snapshotFileName() const
+{
+    return mPriv->snapshotFileName;
+}
+
+/**
+ * Set the name of the file to keep a snapshot of the accounts in, to warm start from it.
+ *
+ * With hundreds of accounts, making AccountManager::FeatureCore ready takes a D-Bus round trip
+ * per account. When a snapshot saved by a previous run is available, FeatureCore is instead made
+ * ready with the accounts and properties from it, and these are then revalidated against the
+ * account manager in the background. Anything which changed in the meantime is signalled by the
+ * usual change notification signals, such as Account::displayNameChanged() or
+ * Account::removed().
+ *
+ * The snapshot is written once FeatureCore is ready when it was made ready from D-Bus, and when
+ * this object is destroyed. It holds, for each account object path, the Account::FeatureCore
+ * properties which stay meaningful across runs. Account parameters are never saved, as they may hold passwords; nor
+ * are the account connection and current presence, which only come with the revalidation.
+ *
+ * Note that this method must be called right after the object is created, before returning to
+ * the main loop, for the snapshot to be used for FeatureCore; features of the AccountFactory
+ * other than Account::FeatureCore still need to be introspected from D-Bus.
+ *
+ * \param fileName The snapshot file name, or an empty string not to use a snapshot.
+ * \sa snapshotFileName()
+ */
+void AccountManager::setSnapshotFileName(const QString &fileName)
+{
+    mPriv->snapshotFileName = fileName;
+}
+
 /**
  * Return a list of the fully qualified names of properties that can be set
  * when calling createAccount().
@@ -1071,6 +1298,11 @@ void AccountManager::gotMainProperties(QDBusPendingCallWatcher *watcher)
         }
 
         QSet<QString> paths = mPriv->getAccountPathsFromProps(props);
+        if (mPriv->revalidatingSnapshot) {
+            debug() << "Revalidating account snapshot against" << paths.size() << "accounts";
+            mPriv->revalidatingSnapshot = false;
+            mPriv->removeStaleAccounts(paths);
+        }
         foreach (const QString &path, paths) {
             mPriv->addAccountForPath(path);
         }
@@ -1083,6 +1315,11 @@ void AccountManager::gotMainProperties(QDBusPendingCallWatcher *watcher)
                 retryInterval = 0;
             }
             QTimer::singleShot(retryInterval, this, SLOT(introspectMain()));
+        } else if (mPriv->revalidatingSnapshot) {
+            warning() << "GetAll(AccountManager) failed with" <<
+                reply.error().name() << ":" << reply.error().message() <<
+                "- keeping the accounts from the snapshot";
+            mPriv->revalidatingSnapshot = false;
         } else {
             warning() << "GetAll(AccountManager) failed with" <<
                 reply.error().name() << ":" << reply.error().message();
@@ -117,6 +117,9 @@ public:
     QList<AccountPtr> accountsForObjectPaths(const QStringList &paths) const;
     TP_QT_DEPRECATED QList<AccountPtr> accountsForPaths(const QStringList &paths) const;
 
+    QString snapshotFileName() const;
+    void setSnapshotFileName(const QString &fileName);
+
     QStringList supportedAccountProperties() const;
     PendingAccount *createAccount(const QString &connectionManager,
             const QString &protocol, const QString &displayName,
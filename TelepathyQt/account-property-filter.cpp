@@ -27,7 +27,10 @@
 #include <QLatin1String>
 #include <QStringList>
 #include <QMetaObject>
+#include <QMetaProperty>
+#include <QSet>
 #include <QVariantMap>
+#include <QVector>
 
 namespace Tp
 {
@@ -44,10 +47,144 @@ struct TP_QT_NO_EXPORT AccountPropertyFilter::Private
         }
     }
 
-    static QStringList supportedAccountProperties;
+    // One filter entry, resolved to what is needed to check it against an account
+    struct Condition
+    {
+        enum Kind {
+            BoolGetter,
+            StringGetter,
+            MetaProperty,
+            DynamicProperty
+        };
+
+        Kind kind;
+        bool (Account::*boolGetter)() const;
+        QString (Account::*stringGetter)() const;
+        int propertyIndex;
+        QByteArray propertyName;
+        bool boolValue;
+        QString stringValue;
+        QVariant value;
+    };
+
+    void compile(const QVariantMap &filter);
+    bool matches(Account *account) const;
+
+    static QSet<QString> supportedAccountProperties;
+
+    // The filter the conditions were compiled from. GenericPropertyFilter only changes its filter
+    // by assigning or inserting into it, which detaches it from this copy, so whether we're still
+    // up to date is only a matter of whether the two are still shared.
+    QVariantMap compiledFilter;
+    QVector<Condition> conditions;
 };
 
-QStringList AccountPropertyFilter::Private::supportedAccountProperties;
+QSet<QString> AccountPropertyFilter::Private::supportedAccountProperties;
+
+void AccountPropertyFilter::Private::compile(const QVariantMap &filter)
+{
+    compiledFilter = filter;
+    conditions.clear();
+    conditions.reserve(filter.size());
+
+    const QMetaObject *mo = &Account::staticMetaObject;
+    QVariantMap::const_iterator i;
+    for (i = filter.constBegin(); i != filter.constEnd(); ++i) {
+        Condition condition;
+        condition.boolGetter = 0;
+        condition.stringGetter = 0;
+        condition.propertyName = i.key().toLatin1();
+        condition.propertyIndex = mo->indexOfProperty(condition.propertyName.constData());
+        condition.boolValue = false;
+        condition.value = i.value();
+
+        // Bools and strings compared to values of the very same type can go through the accessors
+        // directly, anything else is left to QVariant comparison as QObject::property() would be
+        const QString &name = i.key();
+        if (condition.value.type() == QVariant::Bool) {
+            if (name == QLatin1String("valid")) {
+                condition.boolGetter = &Account::isValidAccount;
+            } else if (name == QLatin1String("enabled")) {
+                condition.boolGetter = &Account::isEnabled;
+            } else if (name == QLatin1String("online")) {
+                condition.boolGetter = &Account::isOnline;
+            } else if (name == QLatin1String("connectsAutomatically")) {
+                condition.boolGetter = &Account::connectsAutomatically;
+            } else if (name == QLatin1String("hasBeenOnline")) {
+                condition.boolGetter = &Account::hasBeenOnline;
+            } else if (name == QLatin1String("changingPresence")) {
+                condition.boolGetter = &Account::isChangingPresence;
+            }
+            condition.boolValue = condition.value.toBool();
+        } else if (condition.value.type() == QVariant::String) {
+            if (name == QLatin1String("cmName")) {
+                condition.stringGetter = &Account::cmName;
+            } else if (name == QLatin1String("protocolName")) {
+                condition.stringGetter = &Account::protocolName;
+            } else if (name == QLatin1String("serviceName")) {
+                condition.stringGetter = &Account::serviceName;
+            } else if (name == QLatin1String("displayName")) {
+                condition.stringGetter = &Account::displayName;
+            } else if (name == QLatin1String("iconName")) {
+                condition.stringGetter = &Account::iconName;
+            } else if (name == QLatin1String("nickname")) {
+                condition.stringGetter = &Account::nickname;
+            } else if (name == QLatin1String("normalizedName")) {
+                condition.stringGetter = &Account::normalizedName;
+            } else if (name == QLatin1String("uniqueIdentifier")) {
+                condition.stringGetter = &Account::uniqueIdentifier;
+            } else if (name == QLatin1String("connectionError")) {
+                condition.stringGetter = &Account::connectionError;
+            }
+            condition.stringValue = condition.value.toString();
+        }
+
+        if (condition.boolGetter) {
+            condition.kind = Condition::BoolGetter;
+        } else if (condition.stringGetter) {
+            condition.kind = Condition::StringGetter;
+        } else if (condition.propertyIndex >= 0) {
+            condition.kind = Condition::MetaProperty;
+        } else {
+            condition.kind = Condition::DynamicProperty;
+        }
+
+        conditions.append(condition);
+    }
+}
+
+bool AccountPropertyFilter::Private::matches(Account *account) const
+{
+    const QMetaObject *mo = &Account::staticMetaObject;
+    const Condition *condition = conditions.constData();
+    const Condition *end = condition + conditions.size();
+    for (; condition != end; ++condition) {
+        switch (condition->kind) {
+            case Condition::BoolGetter:
+                if ((account->*condition->boolGetter)() != condition->boolValue) {
+                    return false;
+                }
+                break;
+            case Condition::StringGetter:
+                if ((account->*condition->stringGetter)() != condition->stringValue) {
+                    return false;
+                }
+                break;
+            case Condition::MetaProperty:
+                if (mo->property(condition->propertyIndex).read(account) != condition->value) {
+                    return false;
+                }
+                break;
+            case Condition::DynamicProperty:
+                if (account->property(condition->propertyName.constData()) != condition->value) {
+                    return false;
+                }
+                break;
+        }
+    }
+
+    return true;
+}
 
 /**
  * \class Tp::AccountPropertyFilter
@@ -91,4 +228,14 @@ bool AccountPropertyFilter::isValid() const
     return true;
 }
 
+bool AccountPropertyFilter::matches(const AccountPtr &account) const
+{
+    QVariantMap currentFilter = filter();
+    if (!mPriv->compiledFilter.isSharedWith(currentFilter)) {
+        mPriv->compile(currentFilter);
+    }
+
+    return mPriv->matches(account.data());
+}
+
 } // Tp
@@ -45,6 +45,7 @@ public:
     ~AccountPropertyFilter();
 
     bool isValid() const;
+    bool matches(const AccountPtr &account) const;
 
 private:
     AccountPropertyFilter();
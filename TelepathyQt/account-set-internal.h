@@ -22,6 +22,8 @@
 
 #include <TelepathyQt/AccountPropertyFilter>
 
+#include <QSet>
+
 namespace Tp
 {
 
@@ -37,6 +39,7 @@ struct TP_QT_NO_EXPORT AccountSet::Private
             const QVariantMap &filter);
 
     void init();
+    void computeFilterDependencies();
     void connectSignals();
     void insertAccounts();
     void insertAccount(const AccountPtr &account);
@@ -44,10 +47,18 @@ struct TP_QT_NO_EXPORT AccountSet::Private
     void wrapAccount(const AccountPtr &account);
     void filterAccount(const AccountPtr &account);
     bool accountMatchFilter(AccountWrapper *account);
+    bool filterDependsOn(const QString &propertyName);
 
     AccountSet *parent;
     AccountManagerPtr accountManager;
     AccountFilterConstPtr filter;
+    // The account properties whose changes can change whether an account matches the filter,
+    // unless filterDependsOnAll is set because we can't tell which ones they are
+    QSet<QString> filterDependencies;
+    bool filterDependsOnAll;
+    // The property filter map the dependencies were computed from, as the caller may still add
+    // properties to the filter afterwards
+    QVariantMap filterDependenciesMap;
     QHash<QString, AccountWrapper *> wrappers;
     QHash<QString, AccountPtr> accounts;
     bool ready;
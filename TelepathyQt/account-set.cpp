@@ -29,11 +29,14 @@
 #include "TelepathyQt/debug-internal.h"
 
 #include <TelepathyQt/Account>
+#include <TelepathyQt/AccountCapabilityFilter>
 #include <TelepathyQt/AccountFilter>
 #include <TelepathyQt/AccountManager>
 #include <TelepathyQt/ConnectionCapabilities>
 #include <TelepathyQt/ConnectionManager>
 
+#include <QMetaProperty>
+
 namespace Tp
 {
 
@@ -43,6 +46,7 @@ AccountSet::Private::Private(AccountSet *parent,
     : parent(parent),
       accountManager(accountManager),
       filter(filter),
+      filterDependsOnAll(true),
       ready(false)
 {
     init();
@@ -53,6 +57,7 @@ AccountSet::Private::Private(AccountSet *parent,
         const QVariantMap &filterMap)
     : parent(parent),
       accountManager(accountManager),
+      filterDependsOnAll(true),
       ready(false)
 {
     AccountPropertyFilterPtr propertyFilter = AccountPropertyFilter::create();
@@ -67,12 +72,64 @@ AccountSet::Private::Private(AccountSet *parent,
 void AccountSet::Private::init()
 {
     if (filter->isValid()) {
+        computeFilterDependencies();
         connectSignals();
         insertAccounts();
         ready = true;
     }
 }
 
+void AccountSet::Private::computeFilterDependencies()
+{
+    filterDependencies.clear();
+    filterDependsOnAll = true;
+
+    // Only the filters we know can tell which properties they look at. Anything else is checked
+    // again whenever any property changes.
+    if (const AccountPropertyFilter *propertyFilter =
+            dynamic_cast<const AccountPropertyFilter *>(filter.data())) {
+        filterDependenciesMap = propertyFilter->filter();
+
+        const QMetaObject *mo = &Account::staticMetaObject;
+        QSet<QString> dependencies;
+        foreach (const QString &propertyName, filterDependenciesMap.keys()) {
+            int index = mo->indexOfProperty(propertyName.toLatin1().constData());
+            if (index < 0) {
+                return;
+            }
+
+            QMetaProperty property = mo->property(index);
+            if (property.isConstant()) {
+                continue;
+            } else if (!property.hasNotifySignal()) {
+                // It may still change, we just wouldn't know when
+                return;
+            }
+            dependencies.insert(propertyName);
+        }
+
+        filterDependencies = dependencies;
+        filterDependsOnAll = false;
+    } else if (dynamic_cast<const AccountCapabilityFilter *>(filter.data())) {
+        filterDependencies.insert(QLatin1String("capabilities"));
+        filterDependsOnAll = false;
+    }
+}
+
+bool AccountSet::Private::filterDependsOn(const QString &propertyName)
+{
+    // The filter can't tell us when it is changed, so notice it like AccountPropertyFilter does
+    // for its compiled form: any change detaches its map from the one we keep
+    if (const AccountPropertyFilter *propertyFilter =
+            dynamic_cast<const AccountPropertyFilter *>(filter.data())) {
+        if (!filterDependenciesMap.isSharedWith(propertyFilter->filter())) {
+            computeFilterDependencies();
+        }
+    }
+
+    return filterDependsOnAll || filterDependencies.contains(propertyName);
+}
+
 void AccountSet::Private::connectSignals()
 {
     parent->connect(accountManager.data(),
@@ -116,10 +173,10 @@ void AccountSet::Private::wrapAccount(const AccountPtr &account)
             SLOT(onAccountRemoved(Tp::AccountPtr)));
     parent->connect(wrapper,
             SIGNAL(accountPropertyChanged(Tp::AccountPtr,QString)),
-            SLOT(onAccountChanged(Tp::AccountPtr)));
+            SLOT(onAccountPropertyChanged(Tp::AccountPtr,QString)));
     parent->connect(wrapper,
             SIGNAL(accountCapabilitiesChanged(Tp::AccountPtr,Tp::ConnectionCapabilities)),
-            SLOT(onAccountChanged(Tp::AccountPtr)));
+            SLOT(onAccountCapabilitiesChanged(Tp::AccountPtr)));
     wrappers.insert(account->objectPath(), wrapper);
 }
 
@@ -410,9 +467,19 @@ void AccountSet::onAccountRemoved(const AccountPtr &account)
     mPriv->removeAccount(account);
 }
 
-void AccountSet::onAccountChanged(const AccountPtr &account)
+void AccountSet::onAccountPropertyChanged(const AccountPtr &account,
+        const QString &propertyName)
 {
-    mPriv->filterAccount(account);
+    if (mPriv->filterDependsOn(propertyName)) {
+        mPriv->filterAccount(account);
+    }
+}
+
+void AccountSet::onAccountCapabilitiesChanged(const AccountPtr &account)
+{
+    if (mPriv->filterDependsOn(QLatin1String("capabilities"))) {
+        mPriv->filterAccount(account);
+    }
 }
 
 } // Tp
@@ -66,7 +66,9 @@ Q_SIGNALS:
 private Q_SLOTS:
     TP_QT_NO_EXPORT void onNewAccount(const Tp::AccountPtr &account);
     TP_QT_NO_EXPORT void onAccountRemoved(const Tp::AccountPtr &account);
-    TP_QT_NO_EXPORT void onAccountChanged(const Tp::AccountPtr &account);
+    TP_QT_NO_EXPORT void onAccountPropertyChanged(const Tp::AccountPtr &account,
+            const QString &propertyName);
+    TP_QT_NO_EXPORT void onAccountCapabilitiesChanged(const Tp::AccountPtr &account);
 
 private:
     struct Private;
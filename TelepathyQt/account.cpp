@@ -542,6 +542,28 @@ QVariantMap contactSearchRequest(const ConnectionCapabilities &capabilities,
     return request;
 }
 
+// The presences are kept as plain lists in snapshots, so they can be written out with QDataStream
+// without the D-Bus types having stream operators
+QVariant presenceToSnapshot(const Presence &presence)
+{
+    return QVariantList() << (uint) presence.type() << presence.status() <<
+        presence.statusMessage();
+}
+
+QVariant presenceFromSnapshot(const QVariant &value)
+{
+    QVariantList list = value.toList();
+    if (list.size() != 3) {
+        return QVariant();
+    }
+
+    SimplePresence presence;
+    presence.type = list[0].toUInt();
+    presence.status = list[1].toString();
+    presence.statusMessage = list[2].toString();
+    return QVariant::fromValue(presence);
+}
+
 } // anonymous namespace
 
 struct TP_QT_NO_EXPORT Account::Private
@@ -612,6 +634,10 @@ struct TP_QT_NO_EXPORT Account::Private
     bool usingConnectionCaps;
     ConnectionCapabilities customCaps;
 
+    // Warm start
+    QVariantMap snapshotProperties;
+    bool revalidatingSnapshot;
+
     // The contexts should never be removed from the map, to guarantee O(1) CD introspections per bus
     struct DispatcherContext;
     static QHash<QString, QSharedPointer<DispatcherContext> > dispatcherContexts;
@@ -660,6 +686,7 @@ Account::Private::Private(Account *parent, const ConnectionFactoryConstPtr &conn
       connectionStatus(ConnectionStatusDisconnected),
       connectionStatusReason(ConnectionStatusReasonNoneSpecified),
       usingConnectionCaps(false),
+      revalidatingSnapshot(false),
       dispatcherContext(dispatcherContexts.value(parent->dbusConnection().name()))
 {
     // FIXME: QRegExp probably isn't the most efficient possible way to parse
@@ -4071,6 +4098,51 @@ Client::ChannelDispatcherInterface *Account::dispatcherInterface() const
     return mPriv->dispatcherContext->iface;
 }
 
+QVariantMap Account::snapshotProperties() const
+{
+    // Only what stays meaningful across runs is saved. The parameters are left out as they may
+    // hold passwords, and the connection and current presence are left to the revalidation.
+    QVariantMap props;
+    props.insert(QLatin1String("Interfaces"), interfaces());
+    props.insert(QLatin1String("Service"), mPriv->serviceName);
+    props.insert(QLatin1String("DisplayName"), mPriv->displayName);
+    props.insert(QLatin1String("Icon"), mPriv->iconName);
+    props.insert(QLatin1String("Nickname"), mPriv->nickname);
+    props.insert(QLatin1String("NormalizedName"), mPriv->normalizedName);
+    props.insert(QLatin1String("Valid"), mPriv->valid);
+    props.insert(QLatin1String("Enabled"), mPriv->enabled);
+    props.insert(QLatin1String("ConnectAutomatically"), mPriv->connectsAutomatically);
+    props.insert(QLatin1String("HasBeenOnline"), mPriv->hasBeenOnline);
+    props.insert(QLatin1String("AutomaticPresence"),
+            presenceToSnapshot(mPriv->automaticPresence));
+    props.insert(QLatin1String("RequestedPresence"),
+            presenceToSnapshot(mPriv->requestedPresence));
+    return props;
+}
+
+void Account::setSnapshotProperties(const QVariantMap &properties)
+{
+    if (mPriv->coreFinished || mPriv->mayFinishCore) {
+        // Too late, the core is already introspected from D-Bus
+        return;
+    }
+
+    mPriv->snapshotProperties = properties;
+
+    QStringList presenceKeys;
+    presenceKeys << QLatin1String("AutomaticPresence") << QLatin1String("RequestedPresence");
+    foreach (const QString &key, presenceKeys) {
+        if (mPriv->snapshotProperties.contains(key)) {
+            QVariant presence = presenceFromSnapshot(mPriv->snapshotProperties.value(key));
+            if (presence.isValid()) {
+                mPriv->snapshotProperties.insert(key, presence);
+            } else {
+                mPriv->snapshotProperties.remove(key);
+            }
+        }
+    }
+}
+
 /**** Private ****/
 void Account::Private::init()
 {
@@ -4491,6 +4563,23 @@ void Account::onDispatcherIntrospected(Tp::PendingOperation *op)
         }
     }
 
+    if (!mPriv->snapshotProperties.isEmpty()) {
+        // The properties saved by the AccountManager are enough for the core to be usable, so
+        // make it ready with them now, and only revalidate them with the GetAll below
+        debug() << "Account" << objectPath() << "basic functionality is ready (from snapshot)";
+        mPriv->updateProperties(mPriv->snapshotProperties);
+        mPriv->snapshotProperties.clear();
+
+        mPriv->readinessHelper->setInterfaces(interfaces());
+        mPriv->mayFinishCore = true;
+        mPriv->revalidatingSnapshot = true;
+
+        if (mPriv->connObjPathQueue.isEmpty()) {
+            mPriv->coreFinished = true;
+            mPriv->readinessHelper->setIntrospectCompleted(FeatureCore, true);
+        }
+    }
+
     debug() << "Calling Properties::GetAll(Account) on " << objectPath();
     QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(
             mPriv->properties->GetAll(
@@ -4504,7 +4593,22 @@ void Account::gotMainProperties(QDBusPendingCallWatcher *watcher)
 {
     QDBusPendingReply<QVariantMap> reply = *watcher;
 
-    if (!reply.isError()) {
+    if (mPriv->revalidatingSnapshot) {
+        // FeatureCore is already ready from the snapshot, anything which differs is signalled by
+        // updateProperties() as a normal change
+        mPriv->revalidatingSnapshot = false;
+
+        if (!reply.isError()) {
+            debug() << "Got reply to Properties.GetAll(Account) for" << objectPath() <<
+                "- revalidating snapshot";
+            mPriv->updateProperties(reply.value());
+            mPriv->readinessHelper->setInterfaces(interfaces());
+        } else {
+            warning().nospace() <<
+                "GetAll(Account) failed, keeping snapshot properties: " <<
+                reply.error().name() << ": " << reply.error().message();
+        }
+    } else if (!reply.isError()) {
         debug() << "Got reply to Properties.GetAll(Account) for" << objectPath();
         mPriv->updateProperties(reply.value());
 
@@ -72,8 +72,8 @@ class TP_QT_EXPORT Account : public StatelessDBusProxy,
     Q_DISABLE_COPY(Account)
     Q_PROPERTY(bool valid READ isValidAccount NOTIFY validityChanged)
     Q_PROPERTY(bool enabled READ isEnabled NOTIFY stateChanged)
-    Q_PROPERTY(QString cmName READ cmName)
-    Q_PROPERTY(QString protocolName READ protocolName)
+    Q_PROPERTY(QString cmName READ cmName CONSTANT)
+    Q_PROPERTY(QString protocolName READ protocolName CONSTANT)
     Q_PROPERTY(QString serviceName READ serviceName NOTIFY serviceNameChanged)
     Q_PROPERTY(ProfilePtr profile READ profile NOTIFY profileChanged)
     Q_PROPERTY(QString displayName READ displayName NOTIFY displayNameChanged)
@@ -96,7 +96,7 @@ class TP_QT_EXPORT Account : public StatelessDBusProxy,
     Q_PROPERTY(Presence currentPresence READ currentPresence NOTIFY currentPresenceChanged)
     Q_PROPERTY(Presence requestedPresence READ requestedPresence NOTIFY requestedPresenceChanged)
     Q_PROPERTY(bool online READ isOnline NOTIFY onlinenessChanged)
-    Q_PROPERTY(QString uniqueIdentifier READ uniqueIdentifier)
+    Q_PROPERTY(QString uniqueIdentifier READ uniqueIdentifier CONSTANT)
     Q_PROPERTY(QString normalizedName READ normalizedName NOTIFY normalizedNameChanged)
 
 public:
@@ -569,6 +569,11 @@ private Q_SLOTS:
     TP_QT_NO_EXPORT void onConnectionBuilt(Tp::PendingOperation *);
 
 private:
+    friend class AccountManager; // to use snapshotProperties() and setSnapshotProperties()
+
+    TP_QT_NO_EXPORT QVariantMap snapshotProperties() const;
+    TP_QT_NO_EXPORT void setSnapshotProperties(const QVariantMap &properties);
+
     struct Private;
     friend struct Private;
 
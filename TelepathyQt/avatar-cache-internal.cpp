@@ -0,0 +1,545 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "TelepathyQt/avatar-cache-internal.h"
+
+#include "TelepathyQt/_gen/avatar-cache-internal.moc.hpp"
+
+#include "TelepathyQt/debug-internal.h"
+
+#include <TelepathyQt/Utils>
+
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMap>
+#include <QMetaObject>
+#include <QRunnable>
+#include <QTemporaryFile>
+
+namespace Tp
+{
+
+namespace
+{
+
+const quint32 indexMagic = 0x54504156; // "TPAV"
+const quint32 indexVersion = 1;
+
+QString indexFileName(const QString &path)
+{
+    // Escaped tokens never start with a dot, so this cannot clash with an avatar
+    return path + QLatin1String("/.index");
+}
+
+QString avatarFileName(const QString &path, const QString &key)
+{
+    return path + QLatin1Char('/') + key;
+}
+
+QString mimeTypeFileName(const QString &avatarFileName)
+{
+    return avatarFileName + QLatin1String(".mime");
+}
+
+bool writeFileAtomically(const QString &fileName, const QByteArray &data)
+{
+    QTemporaryFile file(fileName);
+    if (!file.open()) {
+        return false;
+    }
+
+    if (file.write(data) != data.size()) {
+        return false;
+    }
+
+    file.setAutoRemove(false);
+    if (!file.rename(fileName)) {
+        file.remove();
+        return false;
+    }
+    return true;
+}
+
+bool readIndex(const QString &path, AvatarCache::EntryMap *entries)
+{
+    QFile file(indexFileName(path));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_4_6);
+
+    quint32 magic, version, count;
+    stream >> magic >> version >> count;
+    if (stream.status() != QDataStream::Ok || magic != indexMagic || version != indexVersion) {
+        warning() << "Ignoring invalid avatar cache index" << file.fileName();
+        return false;
+    }
+
+    AvatarCache::EntryMap read;
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        QString key;
+        AvatarCache::Entry entry;
+        stream >> key >> entry.mimeType >> entry.size >> entry.lastUsed;
+        read.insert(key, entry);
+    }
+
+    if (stream.status() != QDataStream::Ok) {
+        warning() << "Avatar cache index" << file.fileName() << "is truncated";
+        return false;
+    }
+
+    *entries = read;
+    return true;
+}
+
+// Lookups trust the in-memory index, so this is where avatars removed from under us, e.g. by
+// another process evicting them, are noticed
+void dropMissing(const QString &path, AvatarCache::EntryMap *entries, QStringList *missing)
+{
+    AvatarCache::EntryMap::iterator i = entries->begin();
+    while (i != entries->end()) {
+        if (QFile::exists(avatarFileName(path, i.key()))) {
+            ++i;
+            continue;
+        }
+
+        missing->append(i.key());
+        i = entries->erase(i);
+    }
+}
+
+// Runs a job on the cache's worker thread. The pool deletes the runner once run() returns, so
+// the results are posted back to the cache by value rather than read from the runner.
+class JobRunner : public QRunnable
+{
+public:
+    JobRunner(AvatarCache *cache, const AvatarCache::Job &job)
+        : mCache(cache), mJob(job)
+    {
+        setAutoDelete(true);
+    }
+
+    void run();
+
+private:
+    void loadIndex();
+    void importDirectory();
+    void storeAvatar();
+    void writeIndex();
+
+    AvatarCache *mCache;
+    AvatarCache::Job mJob;
+};
+
+void JobRunner::run()
+{
+    switch (mJob.type) {
+        case AvatarCache::Job::LoadIndex:
+            loadIndex();
+            break;
+        case AvatarCache::Job::StoreAvatar:
+            storeAvatar();
+            break;
+        case AvatarCache::Job::WriteIndex:
+            writeIndex();
+            break;
+    }
+
+    // The cache waits for its pool to be done before going away, so it is still alive here
+    QMetaObject::invokeMethod(mCache, "onJobFinished", Qt::QueuedConnection,
+            Q_ARG(Tp::AvatarCache::Job, mJob));
+}
+
+void JobRunner::loadIndex()
+{
+    if (!readIndex(mJob.path, &mJob.entries)) {
+        // Either a new cache, one written before the index was introduced or a broken index
+        importDirectory();
+        return;
+    }
+
+    dropMissing(mJob.path, &mJob.entries, &mJob.missing);
+    mJob.needsWrite = !mJob.missing.isEmpty();
+    mJob.success = true;
+}
+
+void JobRunner::importDirectory()
+{
+    // Every avatar comes with a .mime file next to it, which is all the index needs
+    QDir dir(mJob.path);
+    QFileInfoList mimeFiles = dir.entryInfoList(QStringList() << QLatin1String("*.mime"),
+            QDir::Files);
+    uint now = QDateTime::currentDateTime().toTime_t();
+    foreach (const QFileInfo &mimeInfo, mimeFiles) {
+        QFileInfo avatarInfo(mimeInfo.absolutePath() + QLatin1Char('/') +
+                mimeInfo.completeBaseName());
+        if (!avatarInfo.exists()) {
+            continue;
+        }
+
+        QFile mimeFile(mimeInfo.filePath());
+        if (!mimeFile.open(QIODevice::ReadOnly)) {
+            continue;
+        }
+
+        AvatarCache::Entry entry;
+        entry.mimeType = QString(QLatin1String(mimeFile.readAll()));
+        entry.size = avatarInfo.size();
+        entry.lastUsed = now;
+        mJob.entries.insert(avatarInfo.fileName(), entry);
+    }
+
+    debug() << "Imported" << mJob.entries.size() << "avatars into the cache index for" <<
+        mJob.path;
+    mJob.needsWrite = !mJob.entries.isEmpty();
+    mJob.success = true;
+}
+
+void JobRunner::storeAvatar()
+{
+    if (!QDir().mkpath(mJob.path)) {
+        warning() << "Unable to create avatar cache directory" << mJob.path;
+        return;
+    }
+
+    QString fileName = avatarFileName(mJob.path, mJob.key);
+
+    // The .mime file is still written so older versions sharing the cache can use the avatar
+    QString mimeFileName = mimeTypeFileName(fileName);
+    if (!QFile::exists(mimeFileName)) {
+        writeFileAtomically(mimeFileName, mJob.mimeType.toLatin1());
+    }
+
+    if (!QFile::exists(fileName) && !writeFileAtomically(fileName, mJob.data)) {
+        warning() << "Unable to write avatar" << fileName;
+        return;
+    }
+
+    mJob.success = true;
+}
+
+void JobRunner::writeIndex()
+{
+    if (!QDir(mJob.path).exists()) {
+        // The cache directory was removed from under us, don't bring it back just for the index
+        return;
+    }
+
+    dropMissing(mJob.path, &mJob.entries, &mJob.missing);
+
+    // Other processes share the directory and write their own view of it to the index, so merge
+    // with what is there now instead of dropping their entries
+    AvatarCache::EntryMap onDisk;
+    readIndex(mJob.path, &onDisk);
+    for (AvatarCache::EntryMap::const_iterator i = onDisk.constBegin();
+            i != onDisk.constEnd(); ++i) {
+        AvatarCache::EntryMap::iterator entry = mJob.entries.find(i.key());
+        if (entry != mJob.entries.end()) {
+            entry.value().lastUsed = qMax(entry.value().lastUsed, i.value().lastUsed);
+            continue;
+        }
+
+        AvatarCache::EntryMap::iterator removal = mJob.removals.find(i.key());
+        if (removal != mJob.removals.end()) {
+            if (i.value().lastUsed <= removal.value().lastUsed) {
+                continue;
+            }
+
+            // Someone else used the avatar after we evicted it, so it stays
+            mJob.removals.erase(removal);
+        }
+
+        if (QFile::exists(avatarFileName(mJob.path, i.key()))) {
+            mJob.entries.insert(i.key(), i.value());
+        }
+    }
+
+    for (AvatarCache::EntryMap::const_iterator i = mJob.removals.constBegin();
+            i != mJob.removals.constEnd(); ++i) {
+        QString fileName = avatarFileName(mJob.path, i.key());
+        QFile::remove(fileName);
+        QFile::remove(mimeTypeFileName(fileName));
+    }
+
+    QByteArray index;
+    QDataStream stream(&index, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_4_6);
+    stream << indexMagic << indexVersion << (quint32) mJob.entries.size();
+    for (AvatarCache::EntryMap::const_iterator i = mJob.entries.constBegin();
+            i != mJob.entries.constEnd(); ++i) {
+        stream << i.key() << i.value().mimeType << i.value().size << i.value().lastUsed;
+    }
+
+    mJob.success = writeFileAtomically(indexFileName(mJob.path), index);
+}
+
+// Caches are shared by all ContactManagers using the same directory, so there is a single
+// index per directory in this process
+QHash<QString, AvatarCache *> caches;
+
+}
+
+AvatarCachePtr AvatarCache::forDirectory(const QString &path)
+{
+    AvatarCache *cache = caches.value(path);
+    if (!cache) {
+        cache = new AvatarCache(path);
+    }
+    return AvatarCachePtr(cache);
+}
+
+AvatarCache::AvatarCache(const QString &path)
+    : QObject(),
+      mPath(path),
+      mLoaded(false),
+      mSize(0),
+      mSizeLimit(0)
+{
+    qRegisterMetaType<Tp::AvatarCache::Job>("Tp::AvatarCache::Job");
+
+    caches.insert(path, this);
+
+    // A single worker keeps the jobs in submission order, so the index is always written after
+    // the avatars it refers to
+    mPool.setMaxThreadCount(1);
+
+    mFlushTimer.setSingleShot(true);
+    mFlushTimer.setInterval(1000);
+    connect(&mFlushTimer, SIGNAL(timeout()), SLOT(flushIndex()));
+
+    Job job;
+    job.type = Job::LoadIndex;
+    submit(job);
+}
+
+AvatarCache::~AvatarCache()
+{
+    caches.remove(mPath);
+
+    if (mFlushTimer.isActive()) {
+        flushIndex();
+    }
+
+    // Results still queued for us are dropped along with this object
+    mPool.waitForDone();
+}
+
+bool AvatarCache::lookup(const QString &token, AvatarData *avatar)
+{
+    QString key = escapeAsIdentifier(token);
+    EntryMap::iterator i = mEntries.find(key);
+    if (i == mEntries.end()) {
+        return false;
+    }
+
+    i.value().lastUsed = QDateTime::currentDateTime().toTime_t();
+    scheduleFlush();
+
+    *avatar = AvatarData(fileNameForKey(key), i.value().mimeType);
+    return true;
+}
+
+void AvatarCache::store(const QString &token, const QByteArray &data, const QString &mimeType)
+{
+    AvatarData avatar;
+    if (lookup(token, &avatar)) {
+        emit avatarStored(token, avatar);
+        return;
+    }
+
+    if (mStoring.contains(token)) {
+        // Already being written, avatarStored() will be emitted when done
+        return;
+    }
+
+    mStoring.insert(token, mimeType);
+
+    Job job;
+    job.type = Job::StoreAvatar;
+    job.token = token;
+    job.key = escapeAsIdentifier(token);
+    job.data = data;
+    job.mimeType = mimeType;
+    submit(job);
+}
+
+void AvatarCache::setSizeLimit(qint64 maxBytes)
+{
+    mSizeLimit = maxBytes;
+    if (mLoaded) {
+        evict();
+    }
+}
+
+void AvatarCache::onJobFinished(const Tp::AvatarCache::Job &job)
+{
+    switch (job.type) {
+        case Job::LoadIndex:
+            // Anything stored before the index was loaded is more recent than what's on disk
+            for (EntryMap::const_iterator i = job.entries.constBegin();
+                    i != job.entries.constEnd(); ++i) {
+                if (!mEntries.contains(i.key())) {
+                    mEntries.insert(i.key(), i.value());
+                    mSize += i.value().size;
+                }
+            }
+
+            debug() << "Avatar cache" << mPath << "loaded with" << mEntries.size() << "entries";
+            mLoaded = true;
+            if (job.needsWrite) {
+                scheduleFlush();
+            }
+            evict();
+            emit loaded();
+            break;
+
+        case Job::StoreAvatar: {
+            mStoring.remove(job.token);
+
+            AvatarData avatar;
+            if (job.success) {
+                Entry entry;
+                entry.mimeType = job.mimeType;
+                entry.size = job.data.size();
+                entry.lastUsed = QDateTime::currentDateTime().toTime_t();
+                if (mEntries.contains(job.key)) {
+                    mSize -= mEntries.value(job.key).size;
+                }
+                mEntries.insert(job.key, entry);
+                mSize += entry.size;
+
+                avatar = AvatarData(fileNameForKey(job.key), job.mimeType);
+                scheduleFlush();
+                evict(job.key);
+            } else {
+                avatar = AvatarData(QString(), job.mimeType);
+            }
+
+            emit avatarStored(job.token, avatar);
+            break;
+        }
+
+        case Job::WriteIndex: {
+            foreach (const QString &key, job.missing) {
+                // Nothing can have stored it again since, as store() finds it in the index
+                EntryMap::iterator entry = mEntries.find(key);
+                if (entry != mEntries.end()) {
+                    debug() << "Cached avatar" << fileNameForKey(key) << "is gone, dropping it";
+                    mSize -= entry.value().size;
+                    mEntries.erase(entry);
+                }
+            }
+
+            if (!job.success) {
+                debug() << "Avatar cache index for" << mPath << "not written";
+                break;
+            }
+
+            // Pick up what other processes added to the index meanwhile, leaving out what we
+            // evicted since the index was written
+            bool grown = false;
+            for (EntryMap::const_iterator i = job.entries.constBegin();
+                    i != job.entries.constEnd(); ++i) {
+                EntryMap::iterator entry = mEntries.find(i.key());
+                if (entry != mEntries.end()) {
+                    entry.value().lastUsed = qMax(entry.value().lastUsed, i.value().lastUsed);
+                } else if (!mPendingRemovals.contains(i.key()) &&
+                        !job.removals.contains(i.key())) {
+                    mEntries.insert(i.key(), i.value());
+                    mSize += i.value().size;
+                    grown = true;
+                }
+            }
+
+            if (grown && mLoaded) {
+                evict();
+            }
+            break;
+        }
+    }
+}
+
+void AvatarCache::flushIndex()
+{
+    mFlushTimer.stop();
+
+    Job job;
+    job.type = Job::WriteIndex;
+    job.entries = mEntries;
+    job.removals = mPendingRemovals;
+    mPendingRemovals.clear();
+    submit(job);
+}
+
+QString AvatarCache::fileNameForKey(const QString &key) const
+{
+    return avatarFileName(mPath, key);
+}
+
+void AvatarCache::submit(const Job &job)
+{
+    Job pathed(job);
+    pathed.path = mPath;
+    mPool.start(new JobRunner(this, pathed));
+}
+
+void AvatarCache::evict(const QString &keep)
+{
+    if (mSizeLimit <= 0 || mSize <= mSizeLimit) {
+        return;
+    }
+
+    QMultiMap<uint, QString> byAge;
+    for (EntryMap::const_iterator i = mEntries.constBegin(); i != mEntries.constEnd(); ++i) {
+        byAge.insert(i.value().lastUsed, i.key());
+    }
+
+    int evicted = 0;
+    for (QMultiMap<uint, QString>::const_iterator i = byAge.constBegin();
+            i != byAge.constEnd() && mSize > mSizeLimit; ++i) {
+        if (i.value() == keep) {
+            continue;
+        }
+
+        Entry entry = mEntries.take(i.value());
+        mSize -= entry.size;
+        mPendingRemovals.insert(i.value(), entry);
+        ++evicted;
+    }
+
+    debug() << "Evicted" << evicted << "avatars from" << mPath;
+    scheduleFlush();
+}
+
+void AvatarCache::scheduleFlush()
+{
+    // Batch index updates, as every lookup refreshes the LRU information
+    if (!mFlushTimer.isActive()) {
+        mFlushTimer.start();
+    }
+}
+
+} // Tp
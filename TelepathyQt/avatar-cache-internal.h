@@ -0,0 +1,140 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _TelepathyQt_avatar_cache_internal_h_HEADER_GUARD_
+#define _TelepathyQt_avatar_cache_internal_h_HEADER_GUARD_
+
+#include <TelepathyQt/AvatarData>
+#include <TelepathyQt/RefCounted>
+#include <TelepathyQt/SharedPtr>
+
+#include <QByteArray>
+#include <QHash>
+#include <QMetaType>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QTimer>
+
+namespace Tp
+{
+
+class AvatarCache;
+typedef SharedPtr<AvatarCache> AvatarCachePtr;
+
+class TP_QT_NO_EXPORT AvatarCache : public QObject, public RefCounted
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(AvatarCache)
+
+public:
+    struct Entry
+    {
+        Entry() : size(0), lastUsed(0) {}
+
+        QString mimeType;
+        qint64 size;
+        uint lastUsed;
+    };
+    typedef QHash<QString, Entry> EntryMap;
+
+    // What a job running on the worker thread needs, and what it found out. Jobs are owned by the
+    // thread pool, so this is posted back by value.
+    struct Job
+    {
+        enum Type
+        {
+            LoadIndex,
+            StoreAvatar,
+            WriteIndex
+        };
+
+        Job() : type(LoadIndex), success(false), needsWrite(false) {}
+
+        Type type;
+        QString path;
+
+        // StoreAvatar
+        QString token;
+        QString key;
+        QByteArray data;
+        QString mimeType;
+
+        // LoadIndex and WriteIndex; for WriteIndex, removals are the evicted entries as they were
+        // when evicted, and entries is the index as written, merged with the one on disk
+        EntryMap entries;
+        EntryMap removals;
+
+        // Results; missing are the keys in entries whose avatar was found to be gone
+        QStringList missing;
+        bool success;
+        bool needsWrite;
+    };
+
+    static AvatarCachePtr forDirectory(const QString &path);
+
+    ~AvatarCache();
+
+    QString path() const { return mPath; }
+    bool isLoaded() const { return mLoaded; }
+
+    bool lookup(const QString &token, AvatarData *avatar);
+    void store(const QString &token, const QByteArray &data, const QString &mimeType);
+    bool isStoring(const QString &token) const { return mStoring.contains(token); }
+
+    qint64 size() const { return mSize; }
+    qint64 sizeLimit() const { return mSizeLimit; }
+    void setSizeLimit(qint64 maxBytes);
+
+Q_SIGNALS:
+    void loaded();
+    void avatarStored(const QString &token, const Tp::AvatarData &avatar);
+
+private Q_SLOTS:
+    void onJobFinished(const Tp::AvatarCache::Job &job);
+    void flushIndex();
+
+private:
+    AvatarCache(const QString &path);
+
+    QString fileNameForKey(const QString &key) const;
+    void submit(const Job &job);
+    void evict(const QString &keep = QString());
+    void scheduleFlush();
+
+    QString mPath;
+    bool mLoaded;
+    EntryMap mEntries;
+    qint64 mSize;
+    qint64 mSizeLimit;
+    QHash<QString, QString> mStoring;
+    EntryMap mPendingRemovals;
+
+    QThreadPool mPool;
+    QTimer mFlushTimer;
+};
+
+} // Tp
+
+Q_DECLARE_METATYPE(Tp::AvatarCache::Job)
+
+#endif
@@ -377,8 +377,27 @@ struct TP_QT_NO_EXPORT BaseChannelTextType::Private {
     uint pendingMessagesId;
     MessageAcknowledgedCallback messageAcknowledgedCB;
     BaseChannelTextType::Adaptee *adaptee;
+
+    static const QString keyPendingMessageId;
+    static const QString keyMessageReceived;
+    static const QString keyMessageSender;
+    static const QString keyMessageType;
+    static const QString keyMessageToken;
+    static const QString keyContentType;
+    static const QString keyContent;
+    static const QString textPlain;
 };
 
+const QString BaseChannelTextType::Private::keyPendingMessageId(
+        QLatin1String("pending-message-id"));
+const QString BaseChannelTextType::Private::keyMessageReceived(QLatin1String("message-received"));
+const QString BaseChannelTextType::Private::keyMessageSender(QLatin1String("message-sender"));
+const QString BaseChannelTextType::Private::keyMessageType(QLatin1String("message-type"));
+const QString BaseChannelTextType::Private::keyMessageToken(QLatin1String("message-token"));
+const QString BaseChannelTextType::Private::keyContentType(QLatin1String("content-type"));
+const QString BaseChannelTextType::Private::keyContent(QLatin1String("content"));
+const QString BaseChannelTextType::Private::textPlain(QLatin1String("text/plain"));
+
 /**
  * \class BaseChannelTextType
  * \ingroup servicecm
@@ -426,44 +445,46 @@ void BaseChannelTextType::createAdaptor()
 
 void BaseChannelTextType::addReceivedMessage(const Tp::MessagePartList &msg)
 {
-    MessagePartList message = msg;
     if (msg.empty()) {
         warning() << "empty message: not sent";
         return;
     }
-    MessagePart &header = message.front();
 
-    if (header.count(QLatin1String("pending-message-id")))
+    // Only the header needs to be copied to add the pending-message-id: the other parts stay shared
+    // with msg, and the resulting list is shared by the pending messages and both signals
+    MessagePartList message = msg;
+    MessagePart &header = message.first();
+
+    if (header.contains(Private::keyPendingMessageId))
         warning() << "pending-message-id will be overwritten";
 
     /* Add pending-message-id to header */
     uint pendingMessageId = mPriv->pendingMessagesId++;
-    header[QLatin1String("pending-message-id")] = QDBusVariant(pendingMessageId);
-    mPriv->pendingMessages[pendingMessageId] = message;
-
-    uint timestamp = 0;
-    if (header.count(QLatin1String("message-received")))
-        timestamp = header[QLatin1String("message-received")].variant().toUInt();
+    header.insert(Private::keyPendingMessageId, QDBusVariant(pendingMessageId));
+    mPriv->pendingMessages.insert(pendingMessageId, message);
 
-    uint handle = 0;
-    if (header.count(QLatin1String("message-sender")))
-        handle = header[QLatin1String("message-sender")].variant().toUInt();
+    const MessagePart &constHeader = header;
+    uint timestamp = constHeader.value(Private::keyMessageReceived).variant().toUInt();
+    uint handle = constHeader.value(Private::keyMessageSender).variant().toUInt();
 
     uint type = ChannelTextMessageTypeNormal;
-    if (header.count(QLatin1String("message-type")))
-        type = header[QLatin1String("message-type")].variant().toUInt();
+    MessagePart::const_iterator typeIt = constHeader.constFind(Private::keyMessageType);
+    if (typeIt != constHeader.constEnd())
+        type = typeIt.value().variant().toUInt();
 
     //FIXME: flags are not parsed
     uint flags = 0;
 
     QString content;
-    for (MessagePartList::Iterator i = message.begin() + 1; i != message.end(); ++i)
-        if (i->count(QLatin1String("content-type"))
-                && i->value(QLatin1String("content-type")).variant().toString() == QLatin1String("text/plain")
-                && i->count(QLatin1String("content"))) {
-            content = i->value(QLatin1String("content")).variant().toString();
+    for (MessagePartList::const_iterator i = message.constBegin() + 1;
+            i != message.constEnd(); ++i) {
+        MessagePart::const_iterator contentIt = i->constFind(Private::keyContent);
+        if (contentIt != i->constEnd()
+                && i->value(Private::keyContentType).variant().toString() == Private::textPlain) {
+            content = contentIt.value().variant().toString();
             break;
         }
+    }
     if (content.length() > 0)
         QMetaObject::invokeMethod(mPriv->adaptee, "received",
                                   Qt::QueuedConnection,
@@ -506,9 +527,11 @@ void BaseChannelTextType::acknowledgePendingMessages(const Tp::UIntList &IDs, DB
             return;
         }
 
-        MessagePart &header = i->front();
-        if (header.count(QLatin1String("message-token")) && mPriv->messageAcknowledgedCB.isValid())
-            mPriv->messageAcknowledgedCB(header[QLatin1String("message-token")].variant().toString());
+        // Only look at the header, so the message isn't detached just before being dropped
+        const MessagePart &header = i->at(0);
+        MessagePart::const_iterator tokenIt = header.constFind(Private::keyMessageToken);
+        if (tokenIt != header.constEnd() && mPriv->messageAcknowledgedCB.isValid())
+            mPriv->messageAcknowledgedCB(tokenIt.value().variant().toString());
 
         mPriv->pendingMessages.erase(i);
     }
@@ -33,6 +33,8 @@
 #include <TelepathyQt/DBusObject>
 #include <TelepathyQt/Utils>
 #include <TelepathyQt/AbstractProtocolInterface>
+#include <QCache>
+#include <QPair>
 #include <QString>
 #include <QVariantMap>
 
@@ -49,9 +51,32 @@ struct TP_QT_NO_EXPORT BaseConnection::Private {
           parameters(parameters),
           status(Tp::ConnectionStatusDisconnected),
           selfHandle(0),
-          adaptee(new BaseConnection::Adaptee(dbusConnection, parent)) {
+          adaptee(new BaseConnection::Adaptee(dbusConnection, parent)),
+          handleIds(maxCachedHandleIds),
+          channelLookups(0),
+          channelLookupHits(0),
+          handleIdLookups(0),
+          handleIdLookupHits(0) {
     }
 
+    // (channel type, (target handle type, target handle))
+    typedef QPair<QString, QPair<uint, uint> > ChannelKey;
+    // (handle type, handle)
+    typedef QPair<uint, uint> HandleKey;
+
+    static ChannelKey channelKey(const QString &channelType, uint targetHandleType,
+            uint targetHandle)
+    {
+        return ChannelKey(channelType, qMakePair(targetHandleType, targetHandle));
+    }
+
+    void addChannel(const BaseChannelPtr &channel);
+    void removeChannel(const BaseChannelPtr &channel);
+
+    QString handleId(uint handleType, uint handle, DBusError *error);
+
+    static const int maxCachedHandleIds = 256;
+
     BaseConnection *parent;
     QString cmName;
     QString protocolName;
@@ -65,8 +90,55 @@ struct TP_QT_NO_EXPORT BaseConnection::Private {
     InspectHandlesCallback inspectHandlesCB;
     uint selfHandle;
     BaseConnection::Adaptee *adaptee;
+
+    // Lets ensureChannel() find an existing channel without going through all of them
+    QMultiHash<ChannelKey, BaseChannelPtr> channelsByKey;
+    // Identifiers of recently used handles, which stay the same for the lifetime of the connection
+    QCache<HandleKey, QString> handleIds;
+
+    quint64 channelLookups;
+    quint64 channelLookupHits;
+    quint64 handleIdLookups;
+    quint64 handleIdLookupHits;
 };
 
+void BaseConnection::Private::addChannel(const BaseChannelPtr &channel)
+{
+    channels.insert(channel);
+    channelsByKey.insert(channelKey(channel->channelType(), channel->targetHandleType(),
+                channel->targetHandle()), channel);
+}
+
+void BaseConnection::Private::removeChannel(const BaseChannelPtr &channel)
+{
+    channels.remove(channel);
+    channelsByKey.remove(channelKey(channel->channelType(), channel->targetHandleType(),
+                channel->targetHandle()), channel);
+}
+
+QString BaseConnection::Private::handleId(uint handleType, uint handle, DBusError *error)
+{
+    ++handleIdLookups;
+
+    HandleKey key(handleType, handle);
+    if (QString *id = handleIds.object(key)) {
+        ++handleIdLookupHits;
+        return *id;
+    }
+
+    QStringList list = inspectHandlesCB(handleType, UIntList() << handle, error);
+    if (error->isValid()) {
+        return QString();
+    }
+    if (list.isEmpty()) {
+        error->set(TP_QT_ERROR_INVALID_HANDLE, QLatin1String("Could not inspect handle"));
+        return QString();
+    }
+
+    handleIds.insert(key, new QString(list.first()));
+    return list.first();
+}
+
 BaseConnection::Adaptee::Adaptee(const QDBusConnection &dbusConnection,
                                  BaseConnection *connection)
     : QObject(connection),
@@ -272,6 +344,10 @@ void BaseConnection::setStatus(uint newStatus, uint reason)
     debug() << "BaseConnection::setStatus " << newStatus << " " << reason << " " << this;
     bool changed = (newStatus != mPriv->status);
     mPriv->status = newStatus;
+    if (newStatus == Tp::ConnectionStatusDisconnected) {
+        // handles don't outlive the connection they were issued on
+        mPriv->handleIds.clear();
+    }
     if (changed)
         emit mPriv->adaptee->statusChanged(newStatus, reason);
 }
@@ -303,24 +379,22 @@ Tp::BaseChannelPtr BaseConnection::createChannel(const QString &channelType,
 
     QString targetID;
     if (targetHandle != 0) {
-        QStringList list = mPriv->inspectHandlesCB(targetHandleType,  UIntList() << targetHandle, error);
+        targetID = mPriv->handleId(targetHandleType, targetHandle, error);
         if (error->isValid()) {
             debug() << "BaseConnection::createChannel: could not resolve handle " << targetHandle;
             return BaseChannelPtr();
         } else {
-            debug() << "BaseConnection::createChannel: found targetID " << *list.begin();
-            targetID = *list.begin();
+            debug() << "BaseConnection::createChannel: found targetID " << targetID;
         }
     }
     QString initiatorID;
     if (initiatorHandle != 0) {
-        QStringList list = mPriv->inspectHandlesCB(HandleTypeContact, UIntList() << initiatorHandle, error);
+        initiatorID = mPriv->handleId(HandleTypeContact, initiatorHandle, error);
         if (error->isValid()) {
             debug() << "BaseConnection::createChannel: could not resolve handle " << initiatorHandle;
             return BaseChannelPtr();
         } else {
-            debug() << "BaseConnection::createChannel: found initiatorID " << *list.begin();
-            initiatorID = *list.begin();
+            debug() << "BaseConnection::createChannel: found initiatorID " << initiatorID;
         }
     }
     channel->setInitiatorHandle(initiatorHandle);
@@ -332,7 +406,7 @@ Tp::BaseChannelPtr BaseConnection::createChannel(const QString &channelType,
     if (error->isValid())
         return BaseChannelPtr();
 
-    mPriv->channels.insert(channel);
+    mPriv->addChannel(channel);
 
     BaseConnectionRequestsInterfacePtr reqIface =
         BaseConnectionRequestsInterfacePtr::dynamicCast(interface(TP_QT_IFACE_CONNECTION_INTERFACE_REQUESTS));
@@ -371,6 +445,9 @@ UIntList BaseConnection::requestHandles(uint handleType, const QStringList &iden
         error->set(TP_QT_ERROR_NOT_IMPLEMENTED, QLatin1String("Not implemented"));
         return UIntList();
     }
+
+    // The identifiers are as given by the client and may not be normalized, so they're not put in
+    // the handle ID cache: that is only filled with what inspectHandlesCB() returns
     return mPriv->requestHandlesCB(handleType, identifiers, error);
 }
 
@@ -403,13 +480,14 @@ BaseChannelPtr BaseConnection::ensureChannel(const QString &channelType, uint ta
         bool suppressHandler,
         DBusError* error)
 {
-    foreach(BaseChannelPtr channel, mPriv->channels) {
-        if (channel->channelType() == channelType
-                && channel->targetHandleType() == targetHandleType
-                && channel->targetHandle() == targetHandle) {
-            yours = false;
-            return channel;
-        }
+    ++mPriv->channelLookups;
+
+    BaseChannelPtr channel = mPriv->channelsByKey.value(
+            Private::channelKey(channelType, targetHandleType, targetHandle));
+    if (channel) {
+        ++mPriv->channelLookupHits;
+        yours = false;
+        return channel;
     }
     yours = true;
     return createChannel(channelType, targetHandleType, targetHandle, initiatorHandle, suppressHandler, error);
@@ -421,7 +499,56 @@ void BaseConnection::removeChannel()
                                  qobject_cast<BaseChannel*>(sender()));
     Q_ASSERT(channel);
     Q_ASSERT(mPriv->channels.contains(channel));
-    mPriv->channels.remove(channel);
+    mPriv->removeChannel(channel);
+}
+
+/**
+ * Return the number of times ensureChannel() looked for an existing channel.
+ *
+ * \return The number of channel lookups.
+ * \sa channelLookupHits()
+ */
+quint64 BaseConnection::channelLookups() const
+{
+    return mPriv->channelLookups;
+}
+
+/**
+ * Return the number of times ensureChannel() found an existing channel, rather than having to
+ * create one.
+ *
+ * \return The number of successful channel lookups.
+ * \sa channelLookups()
+ */
+quint64 BaseConnection::channelLookupHits() const
+{
+    return mPriv->channelLookupHits;
+}
+
+/**
+ * Return the number of times createChannel() needed the identifier of a handle.
+ *
+ * \return The number of handle identifier lookups.
+ * \sa handleIdLookupHits(), setInspectHandlesCallback()
+ */
+quint64 BaseConnection::handleIdLookups() const
+{
+    return mPriv->handleIdLookups;
+}
+
+/**
+ * Return the number of times createChannel() found the identifier of a handle in the cache kept by
+ * this connection, rather than having to call the callback set with setInspectHandlesCallback().
+ *
+ * Only the identifiers returned by the callback set with setInspectHandlesCallback() are cached,
+ * for a limited number of recently used handles.
+ *
+ * \return The number of handle identifier lookups served from the cache.
+ * \sa handleIdLookups()
+ */
+quint64 BaseConnection::handleIdLookupHits() const
+{
+    return mPriv->handleIdLookupHits;
 }
 
 /**
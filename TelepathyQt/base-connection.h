@@ -107,6 +107,11 @@ public:
                                  uint targetHandle, bool &yours, uint initiatorHandle, bool suppressHandler, DBusError *error);
     void addChannel(BaseChannelPtr channel);
 
+    quint64 channelLookups() const;
+    quint64 channelLookupHits() const;
+    quint64 handleIdLookups() const;
+    quint64 handleIdLookupHits() const;
+
     QList<AbstractConnectionInterfacePtr> interfaces() const;
     AbstractConnectionInterfacePtr interface(const QString  &interfaceName) const;
     bool plugInterface(const AbstractConnectionInterfacePtr &interface);
@@ -30,23 +30,108 @@ namespace Tp
 
 struct TP_QT_NO_EXPORT CapabilitiesBase::Private : public QSharedData
 {
+    // What the higher-level query methods return, worked out once for each spec list
+    enum Capability
+    {
+        TextChats = 1 << 0,
+        AudioCalls = 1 << 1,
+        VideoCalls = 1 << 2,
+        VideoCallsWithAudio = 1 << 3,
+        UpgradingCalls = 1 << 4,
+        StreamedMediaCalls = 1 << 5,
+        StreamedMediaAudioCalls = 1 << 6,
+        StreamedMediaVideoCalls = 1 << 7,
+        StreamedMediaVideoCallsWithAudio = 1 << 8,
+        UpgradingStreamedMediaCalls = 1 << 9,
+        FileTransfers = 1 << 10
+    };
+
     Private(bool specificToContact);
     Private(const RequestableChannelClassSpecList &rccSpecs, bool specificToContact);
 
+    void updateCapabilities();
+
     RequestableChannelClassSpecList rccSpecs;
     bool specificToContact;
+    uint capabilities;
 };
 
 CapabilitiesBase::Private::Private(bool specificToContact)
-    : specificToContact(specificToContact)
+    : specificToContact(specificToContact),
+      capabilities(0)
 {
 }
 
 CapabilitiesBase::Private::Private(const RequestableChannelClassSpecList &rccSpecs,
         bool specificToContact)
     : rccSpecs(rccSpecs),
-      specificToContact(specificToContact)
+      specificToContact(specificToContact),
+      capabilities(0)
 {
+    updateCapabilities();
+}
+
+void CapabilitiesBase::Private::updateCapabilities()
+{
+    static const RequestableChannelClassSpec textChat = RequestableChannelClassSpec::textChat();
+    static const RequestableChannelClassSpec audioCall = RequestableChannelClassSpec::audioCall();
+    static const RequestableChannelClassSpec videoCall = RequestableChannelClassSpec::videoCall();
+    static const RequestableChannelClassSpec videoCallWithAudioAllowed =
+        RequestableChannelClassSpec::videoCallWithAudioAllowed();
+    static const RequestableChannelClassSpec audioCallWithVideoAllowed =
+        RequestableChannelClassSpec::audioCallWithVideoAllowed();
+    static const RequestableChannelClassSpec streamedMediaCall =
+        RequestableChannelClassSpec::streamedMediaCall();
+    static const RequestableChannelClassSpec streamedMediaAudioCall =
+        RequestableChannelClassSpec::streamedMediaAudioCall();
+    static const RequestableChannelClassSpec streamedMediaVideoCall =
+        RequestableChannelClassSpec::streamedMediaVideoCall();
+    static const RequestableChannelClassSpec streamedMediaVideoCallWithAudio =
+        RequestableChannelClassSpec::streamedMediaVideoCallWithAudio();
+    static const RequestableChannelClassSpec fileTransfer =
+        RequestableChannelClassSpec::fileTransfer();
+
+    capabilities = 0;
+    foreach (const RequestableChannelClassSpec &rccSpec, rccSpecs) {
+        if (rccSpec.supports(textChat)) {
+            capabilities |= TextChats;
+        }
+        if (rccSpec.supports(audioCall)) {
+            capabilities |= AudioCalls;
+        }
+        if (rccSpec.supports(videoCall)) {
+            capabilities |= VideoCalls;
+        }
+        if (rccSpec.supports(videoCallWithAudioAllowed) ||
+            rccSpec.supports(audioCallWithVideoAllowed)) {
+            capabilities |= VideoCallsWithAudio;
+        }
+        if (rccSpec.channelType() == TP_QT_IFACE_CHANNEL_TYPE_CALL &&
+            rccSpec.allowsProperty(TP_QT_IFACE_CHANNEL_TYPE_CALL + QLatin1String(".MutableContents"))) {
+            capabilities |= UpgradingCalls;
+        }
+        if (rccSpec.supports(streamedMediaCall)) {
+            capabilities |= StreamedMediaCalls;
+        }
+        if (rccSpec.supports(streamedMediaAudioCall)) {
+            capabilities |= StreamedMediaAudioCalls;
+        }
+        if (rccSpec.supports(streamedMediaVideoCall)) {
+            capabilities |= StreamedMediaVideoCalls;
+        }
+        if (rccSpec.supports(streamedMediaVideoCallWithAudio)) {
+            capabilities |= StreamedMediaVideoCallsWithAudio;
+        }
+        if (rccSpec.channelType() == TP_QT_IFACE_CHANNEL_TYPE_STREAMED_MEDIA &&
+            !rccSpec.allowsProperty(TP_QT_IFACE_CHANNEL_TYPE_STREAMED_MEDIA + QLatin1String(".ImmutableStreams"))) {
+            // TODO should we test all classes that have channelType
+            //      StreamedMedia or just one is fine?
+            capabilities |= UpgradingStreamedMediaCalls;
+        }
+        if (rccSpec.supports(fileTransfer)) {
+            capabilities |= FileTransfers;
+        }
+    }
 }
 
 /**
@@ -147,6 +232,7 @@ void CapabilitiesBase::updateRequestableChannelClasses(
         const RequestableChannelClassList &rccs)
 {
     mPriv->rccSpecs = RequestableChannelClassSpecList(rccs);
+    mPriv->updateCapabilities();
 }
 
 /**
@@ -189,54 +275,27 @@ bool CapabilitiesBase::isSpecificToContact() const
  */
 bool CapabilitiesBase::textChats() const
 {
-    foreach (const RequestableChannelClassSpec &rccSpec, mPriv->rccSpecs) {
-        if (rccSpec.supports(RequestableChannelClassSpec::textChat())) {
-            return true;
-        }
-    }
-    return false;
+    return mPriv->capabilities & Private::TextChats;
 }
 
 bool CapabilitiesBase::audioCalls() const
 {
-    foreach (const RequestableChannelClassSpec &rccSpec, mPriv->rccSpecs) {
-        if (rccSpec.supports(RequestableChannelClassSpec::audioCall())) {
-            return true;
-        }
-    }
-    return false;
+    return mPriv->capabilities & Private::AudioCalls;
 }
 
 bool CapabilitiesBase::videoCalls() const
 {
-    foreach (const RequestableChannelClassSpec &rccSpec, mPriv->rccSpecs) {
-        if (rccSpec.supports(RequestableChannelClassSpec::videoCall())) {
-            return true;
-        }
-    }
-    return false;
+    return mPriv->capabilities & Private::VideoCalls;
 }
 
 bool CapabilitiesBase::videoCallsWithAudio() const
 {
-    foreach (const RequestableChannelClassSpec &rccSpec, mPriv->rccSpecs) {
-        if (rccSpec.supports(RequestableChannelClassSpec::videoCallWithAudioAllowed()) ||
-            rccSpec.supports(RequestableChannelClassSpec::audioCallWithVideoAllowed())) {
-            return true;
-        }
-    }
-    return false;
+    return mPriv->capabilities & Private::VideoCallsWithAudio;
 }
 
 bool CapabilitiesBase::upgradingCalls() const
 {
-    foreach (const RequestableChannelClassSpec &rccSpec, mPriv->rccSpecs) {
-        if (rccSpec.channelType() == TP_QT_IFACE_CHANNEL_TYPE_CALL &&
-            rccSpec.allowsProperty(TP_QT_IFACE_CHANNEL_TYPE_CALL + QLatin1String(".MutableContents"))) {
-            return true;
-        }
-    }
-    return false;
+    return mPriv->capabilities & Private::UpgradingCalls;
 }
 
 /**
@@ -254,12 +313,7 @@ bool CapabilitiesBase::upgradingCalls() const
  */
 bool CapabilitiesBase::streamedMediaCalls() const
 {
-    foreach (const RequestableChannelClassSpec &rccSpec, mPriv->rccSpecs) {
-        if (rccSpec.supports(RequestableChannelClassSpec::streamedMediaCall())) {
-            return true;
-        }
-    }
-    return false;
+    return mPriv->capabilities & Private::StreamedMediaCalls;
 }
 
 /**
@@ -285,12 +339,7 @@ bool CapabilitiesBase::streamedMediaCalls() const
  */
 bool CapabilitiesBase::streamedMediaAudioCalls() const
 {
-    foreach (const RequestableChannelClassSpec &rccSpec, mPriv->rccSpecs) {
-        if (rccSpec.supports(RequestableChannelClassSpec::streamedMediaAudioCall())) {
-            return true;
-        }
-    }
-    return false;
+    return mPriv->capabilities & Private::StreamedMediaAudioCalls;
 }
 
 /**
@@ -305,12 +354,7 @@ bool CapabilitiesBase::streamedMediaAudioCalls() const
  */
 bool CapabilitiesBase::streamedMediaVideoCalls() const
 {
-    foreach (const RequestableChannelClassSpec &rccSpec, mPriv->rccSpecs) {
-        if (rccSpec.supports(RequestableChannelClassSpec::streamedMediaVideoCall())) {
-            return true;
-        }
-    }
-    return false;
+    return mPriv->capabilities & Private::StreamedMediaVideoCalls;
 }
 
 /**
@@ -325,12 +369,7 @@ bool CapabilitiesBase::streamedMediaVideoCalls() const
  */
 bool CapabilitiesBase::streamedMediaVideoCallsWithAudio() const
 {
-    foreach (const RequestableChannelClassSpec &rccSpec, mPriv->rccSpecs) {
-        if (rccSpec.supports(RequestableChannelClassSpec::streamedMediaVideoCallWithAudio())) {
-            return true;
-        }
-    }
-    return false;
+    return mPriv->capabilities & Private::StreamedMediaVideoCallsWithAudio;
 }
 
 /**
@@ -360,15 +399,7 @@ bool CapabilitiesBase::streamedMediaVideoCallsWithAudio() const
  */
 bool CapabilitiesBase::upgradingStreamedMediaCalls() const
 {
-    foreach (const RequestableChannelClassSpec &rccSpec, mPriv->rccSpecs) {
-        if (rccSpec.channelType() == TP_QT_IFACE_CHANNEL_TYPE_STREAMED_MEDIA &&
-            !rccSpec.allowsProperty(TP_QT_IFACE_CHANNEL_TYPE_STREAMED_MEDIA + QLatin1String(".ImmutableStreams"))) {
-            // TODO should we test all classes that have channelType
-            //      StreamedMedia or just one is fine?
-            return true;
-        }
-    }
-    return false;
+    return mPriv->capabilities & Private::UpgradingStreamedMediaCalls;
 }
 
 /**
@@ -379,12 +410,7 @@ bool CapabilitiesBase::upgradingStreamedMediaCalls() const
  */
 bool CapabilitiesBase::fileTransfers() const
 {
-    foreach (const RequestableChannelClassSpec &rccSpec, mPriv->rccSpecs) {
-        if (rccSpec.supports(RequestableChannelClassSpec::fileTransfer())) {
-            return true;
-        }
-    }
-    return false;
+    return mPriv->capabilities & Private::FileTransfers;
 }
 
 } // Tp
@@ -0,0 +1,77 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+
+#ifndef _TelepathyQt_channel_class_spec_internal_h_HEADER_GUARD_
+#define _TelepathyQt_channel_class_spec_internal_h_HEADER_GUARD_
+
+#ifndef BUILDING_TP_QT
+#error "This file is a TpQt internal header not to be included by applications"
+#endif
+
+#include <TelepathyQt/ChannelClassSpec>
+
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QVariant>
+
+namespace Tp
+{
+
+// Finds which of a list of channel classes a channel matches, i.e. which of them are a subset of
+// the channel class given by its immutable properties. Nearly every class has a ChannelType and a
+// TargetHandleType, so the classes are indexed by those, and only the other properties of the few
+// classes having the same ones as the channel are compared one by one.
+class TP_QT_NO_EXPORT ChannelClassIndex
+{
+public:
+    ChannelClassIndex() { }
+
+    void rebuild(const QList<ChannelClassSpec> &classes);
+
+    // Positions in the list given to rebuild() of the matching classes, in increasing order
+    QList<int> matches(const ChannelClassSpec &channelClass) const;
+    // Position of the first matching class, or -1 if there is none
+    int firstMatch(const ChannelClassSpec &channelClass) const;
+
+private:
+    struct Entry
+    {
+        int position;
+        QList<QPair<QString, QVariant> > properties;
+    };
+    typedef QPair<QString, uint> Key;
+
+    static bool keyFor(const QVariantMap &properties, Key *key);
+    static bool entryMatches(const Entry &entry, const QVariantMap &properties);
+    void lookup(const ChannelClassSpec &channelClass, QList<int> *positions, bool firstOnly) const;
+    void lookupAll(const QVariantMap &properties, QList<int> *positions, bool firstOnly) const;
+
+    QHash<Key, QList<Entry> > mByType;
+    // Classes which don't have both a ChannelType and a TargetHandleType
+    QList<Entry> mOthers;
+};
+
+} // Tp
+
+#endif
@@ -21,6 +21,7 @@
  */
 
 #include <TelepathyQt/ChannelClassSpec>
+#include "TelepathyQt/channel-class-spec-internal.h"
 
 #include "TelepathyQt/_gen/future-constants.h"
 
@@ -722,4 +723,162 @@ ChannelClassSpec ChannelClassSpec::contactSearch(const QVariantMap &additionalPr
  * \brief The ChannelClassSpecList class represents a list of ChannelClassSpec.
  */
 
+void ChannelClassIndex::rebuild(const QList<ChannelClassSpec> &classes)
+{
+    mByType.clear();
+    mOthers.clear();
+
+    static const QString channelType = TP_QT_IFACE_CHANNEL + QLatin1String(".ChannelType");
+    static const QString targetHandleType =
+        TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandleType");
+
+    for (int i = 0; i < classes.size(); ++i) {
+        QVariantMap properties = classes.at(i).allProperties();
+
+        Key key;
+        bool indexed = keyFor(properties, &key);
+        if (indexed) {
+            properties.remove(channelType);
+            properties.remove(targetHandleType);
+        }
+
+        Entry entry;
+        entry.position = i;
+        for (QVariantMap::const_iterator j = properties.constBegin();
+                j != properties.constEnd(); ++j) {
+            entry.properties.append(qMakePair(j.key(), j.value()));
+        }
+
+        if (indexed) {
+            mByType[key].append(entry);
+        } else {
+            mOthers.append(entry);
+        }
+    }
+}
+
+QList<int> ChannelClassIndex::matches(const ChannelClassSpec &channelClass) const
+{
+    QList<int> positions;
+    lookup(channelClass, &positions, false);
+    return positions;
+}
+
+int ChannelClassIndex::firstMatch(const ChannelClassSpec &channelClass) const
+{
+    QList<int> positions;
+    lookup(channelClass, &positions, true);
+    return positions.isEmpty() ? -1 : positions.first();
+}
+
+bool ChannelClassIndex::keyFor(const QVariantMap &properties, Key *key)
+{
+    static const QString channelType = TP_QT_IFACE_CHANNEL + QLatin1String(".ChannelType");
+    static const QString targetHandleType =
+        TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandleType");
+
+    // Only the types setChannelType() and setTargetHandleType() use can be indexed, as other
+    // types might still compare equal as QVariants
+    QVariantMap::const_iterator type = properties.constFind(channelType);
+    QVariantMap::const_iterator handleType = properties.constFind(targetHandleType);
+    if (type == properties.constEnd() || type.value().type() != QVariant::String ||
+            handleType == properties.constEnd() || handleType.value().type() != QVariant::UInt) {
+        return false;
+    }
+
+    *key = Key(type.value().toString(), handleType.value().toUInt());
+    return true;
+}
+
+bool ChannelClassIndex::entryMatches(const Entry &entry, const QVariantMap &properties)
+{
+    for (QList<QPair<QString, QVariant> >::const_iterator i = entry.properties.constBegin();
+            i != entry.properties.constEnd(); ++i) {
+        QVariantMap::const_iterator property = properties.constFind(i->first);
+        if (property == properties.constEnd() || property.value() != i->second) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void ChannelClassIndex::lookup(const ChannelClassSpec &channelClass, QList<int> *positions,
+        bool firstOnly) const
+{
+    static const QString channelType = TP_QT_IFACE_CHANNEL + QLatin1String(".ChannelType");
+    static const QString targetHandleType =
+        TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandleType");
+
+    QVariantMap properties = channelClass.allProperties();
+
+    QList<Entry> byType;
+    Key key;
+    if (keyFor(properties, &key)) {
+        byType = mByType.value(key);
+    } else if (properties.contains(channelType) && properties.contains(targetHandleType)) {
+        // The channel has both, but not with the types the index uses. They may still compare
+        // equal to those of the indexed classes, so check them all.
+        lookupAll(properties, positions, firstOnly);
+        return;
+    }
+
+    // Both lists are sorted by position, so merge them to keep the matches in order
+    int i = 0;
+    int j = 0;
+    while (i < byType.size() || j < mOthers.size()) {
+        const Entry *entry;
+        if (j == mOthers.size() ||
+                (i < byType.size() && byType.at(i).position < mOthers.at(j).position)) {
+            entry = &byType.at(i++);
+        } else {
+            entry = &mOthers.at(j++);
+        }
+
+        if (entryMatches(*entry, properties)) {
+            positions->append(entry->position);
+            if (firstOnly) {
+                return;
+            }
+        }
+    }
+}
+
+void ChannelClassIndex::lookupAll(const QVariantMap &properties, QList<int> *positions,
+        bool firstOnly) const
+{
+    static const QString channelType = TP_QT_IFACE_CHANNEL + QLatin1String(".ChannelType");
+    static const QString targetHandleType =
+        TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandleType");
+
+    QVariant type = properties.value(channelType);
+    QVariant handleType = properties.value(targetHandleType);
+
+    QList<int> found;
+    for (QHash<Key, QList<Entry> >::const_iterator i = mByType.constBegin();
+            i != mByType.constEnd(); ++i) {
+        if (type != QVariant(i.key().first) || handleType != QVariant(i.key().second)) {
+            continue;
+        }
+
+        foreach (const Entry &entry, i.value()) {
+            if (entryMatches(entry, properties)) {
+                found.append(entry.position);
+            }
+        }
+    }
+
+    foreach (const Entry &entry, mOthers) {
+        if (entryMatches(entry, properties)) {
+            found.append(entry.position);
+        }
+    }
+
+    qSort(found);
+    if (firstOnly && !found.isEmpty()) {
+        positions->append(found.first());
+    } else {
+        positions->append(found);
+    }
+}
+
 } // Tp
@@ -26,6 +26,7 @@
 
 #include "TelepathyQt/_gen/future-constants.h"
 
+#include "TelepathyQt/channel-class-spec-internal.h"
 #include "TelepathyQt/debug-internal.h"
 
 #include <TelepathyQt/CallChannel>
@@ -55,16 +56,41 @@ struct TP_QT_NO_EXPORT ChannelFactory::Private
 {
     Private();
 
+    void rebuildFeaturesIndex();
+    void rebuildCtorsIndex();
+
     QList<ChannelClassFeatures> features;
 
     typedef QPair<ChannelClassSpec, ConstructorConstPtr> CtorPair;
     QList<CtorPair> ctors;
+
+    // Looked up for every channel the factory constructs, rebuilt whenever the lists change
+    ChannelClassIndex featuresIndex;
+    ChannelClassIndex ctorsIndex;
 };
 
 ChannelFactory::Private::Private()
 {
 }
 
+void ChannelFactory::Private::rebuildFeaturesIndex()
+{
+    QList<ChannelClassSpec> classes;
+    foreach (const ChannelClassFeatures &pair, features) {
+        classes.append(pair.first);
+    }
+    featuresIndex.rebuild(classes);
+}
+
+void ChannelFactory::Private::rebuildCtorsIndex()
+{
+    QList<ChannelClassSpec> classes;
+    foreach (const CtorPair &pair, ctors) {
+        classes.append(pair.first);
+    }
+    ctorsIndex.rebuild(classes);
+}
+
 /**
  * \class ChannelFactory
  * \ingroup utils
@@ -548,10 +574,8 @@ Features ChannelFactory::featuresFor(const ChannelClassSpec &channelClass) const
 {
     Features features;
 
-    foreach (const ChannelClassFeatures &pair, mPriv->features) {
-        if (pair.first.isSubsetOf(channelClass)) {
-            features.unite(pair.second);
-        }
+    foreach (int i, mPriv->featuresIndex.matches(channelClass)) {
+        features.unite(mPriv->features.at(i).second);
     }
 
     return features;
@@ -574,15 +598,14 @@ void ChannelFactory::addFeaturesFor(const ChannelClassSpec &channelClass, const
     // We ran out of feature specifications (for the given size/specificity of a channel class)
     // before finding a matching one, so let's create a new entry
     mPriv->features.insert(i, qMakePair(channelClass, features));
+    mPriv->rebuildFeaturesIndex();
 }
 
 ChannelFactory::ConstructorConstPtr ChannelFactory::constructorFor(const ChannelClassSpec &cc) const
 {
-    QList<Private::CtorPair>::iterator i;
-    for (i = mPriv->ctors.begin(); i != mPriv->ctors.end(); ++i) {
-        if (i->first.isSubsetOf(cc)) {
-            return i->second;
-        }
+    int i = mPriv->ctorsIndex.firstMatch(cc);
+    if (i >= 0) {
+        return mPriv->ctors.at(i).second;
     }
 
     // If this is reached, we didn't have a proper fallback constructor
@@ -615,6 +638,7 @@ void ChannelFactory::setConstructorFor(const ChannelClassSpec &channelClass,
     // We ran out of constructors (for the given size/specificity of a channel class)
     // before finding a matching one, so let's create a new entry
     mPriv->ctors.insert(i, qMakePair(channelClass, ctor));
+    mPriv->rebuildCtorsIndex();
 }
 
 /**
@@ -91,8 +91,12 @@ struct TP_QT_NO_EXPORT Channel::Private
     void doMembersChangedDetailed(const UIntList &, const UIntList &, const UIntList &,
             const UIntList &, const QVariantMap &);
     void processMembersChanged();
+    void coalesceMembersChanged();
     void updateContacts(const QList<ContactPtr> &contacts =
             QList<ContactPtr>());
+    void applyMembersChanged(const GroupMembersChangedInfo *info,
+            QHash<uint, ContactPtr> &batchContacts);
+    ContactPtr knownContact(uint handle, const QHash<uint, ContactPtr> &batchContacts) const;
     bool fakeGroupInterfaceIfNeeded();
     void setReady();
 
@@ -162,25 +166,52 @@ struct TP_QT_NO_EXPORT Channel::Private
 
     // Queue of received MCD signals to process
     QQueue<GroupMembersChangedInfo *> groupMembersChangedQueue;
-    GroupMembersChangedInfo *currentGroupMembersChangedInfo;
-
-    // Pending from the MCD signal currently processed, but contacts not yet built
-    QSet<uint> pendingGroupMembers;
-    QSet<uint> pendingGroupLocalPendingMembers;
-    QSet<uint> pendingGroupRemotePendingMembers;
-    UIntList groupMembersToRemove;
-    UIntList groupLocalPendingMembersToRemove;
-    UIntList groupRemotePendingMembersToRemove;
+    // The MCD signals currently processed, in order, whose contacts are being built together
+    QList<GroupMembersChangedInfo *> currentGroupMembersChangedInfos;
 
     // Initial members
     UIntList groupInitialMembers;
     LocalPendingInfoList groupInitialLP;
     UIntList groupInitialRP;
 
+    // Members by handle, along with the set of their contacts, which is kept up to date as they
+    // change so that the public accessors can return it as is instead of building it each time
+    struct GroupMembers
+    {
+        bool isEmpty() const { return byHandle.isEmpty(); }
+        int size() const { return byHandle.size(); }
+        bool contains(uint handle) const { return byHandle.contains(handle); }
+        ContactPtr value(uint handle) const { return byHandle.value(handle); }
+
+        void insert(uint handle, const ContactPtr &contact)
+        {
+            ContactPtr old = byHandle.value(handle);
+            if (old) {
+                contacts.remove(old);
+            }
+            byHandle.insert(handle, contact);
+            contacts.insert(contact);
+        }
+
+        ContactPtr take(uint handle)
+        {
+            ContactPtr contact = byHandle.take(handle);
+            if (contact) {
+                contacts.remove(contact);
+            }
+            return contact;
+        }
+
+        void remove(uint handle) { take(handle); }
+
+        QHash<uint, ContactPtr> byHandle;
+        Contacts contacts;
+    };
+
     // Current members
-    QHash<uint, ContactPtr> groupContacts;
-    QHash<uint, ContactPtr> groupLocalPendingContacts;
-    QHash<uint, ContactPtr> groupRemotePendingContacts;
+    GroupMembers groupContacts;
+    GroupMembers groupLocalPendingContacts;
+    GroupMembers groupRemotePendingContacts;
 
     // Stored change info
     QHash<uint, GroupMemberChangeDetails> groupLocalPendingContactsChangeInfo;
@@ -227,6 +258,14 @@ struct TP_QT_NO_EXPORT Channel::Private::GroupMembersChangedInfo
     {
     }
 
+    QSet<uint> handles() const
+    {
+        return (added.toSet() + removed.toSet()) + (localPending.toSet() + remotePending.toSet());
+    }
+
+    bool canMerge(const GroupMembersChangedInfo *other) const;
+    void merge(const GroupMembersChangedInfo *other);
+
     UIntList added;
     UIntList removed;
     UIntList localPending;
@@ -259,6 +298,51 @@ const QString Channel::Private::GroupMembersChangedInfo::keyChangeReason(
 const QString Channel::Private::GroupMembersChangedInfo::keyMessage(QLatin1String("message"));
 const QString Channel::Private::GroupMembersChangedInfo::keyContactIds(QLatin1String("contact-ids"));
 
+bool Channel::Private::GroupMembersChangedInfo::canMerge(
+        const GroupMembersChangedInfo *other) const
+{
+    if (actor != other->actor || reason != other->reason || message != other->message) {
+        return false;
+    }
+
+    // Anything else in the details, such as an error, is specific to the change it came with
+    QVariantMap::const_iterator i;
+    for (i = details.constBegin(); i != details.constEnd(); ++i) {
+        if (i.key() != keyActor && i.key() != keyChangeReason && i.key() != keyMessage &&
+                i.key() != keyContactIds) {
+            return false;
+        }
+    }
+    for (i = other->details.constBegin(); i != other->details.constEnd(); ++i) {
+        if (i.key() != keyActor && i.key() != keyChangeReason && i.key() != keyMessage &&
+                i.key() != keyContactIds) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void Channel::Private::GroupMembersChangedInfo::merge(const GroupMembersChangedInfo *other)
+{
+    added << other->added;
+    removed << other->removed;
+    localPending << other->localPending;
+    remotePending << other->remotePending;
+
+    if (other->details.contains(keyContactIds)) {
+        HandleIdentifierMap contactIds = qdbus_cast<HandleIdentifierMap>(
+                details.value(keyContactIds));
+        HandleIdentifierMap otherContactIds = qdbus_cast<HandleIdentifierMap>(
+                other->details.value(keyContactIds));
+        HandleIdentifierMap::const_iterator i;
+        for (i = otherContactIds.constBegin(); i != otherContactIds.constEnd(); ++i) {
+            contactIds.insert(i.key(), i.value());
+        }
+        details.insert(keyContactIds, QVariant::fromValue(contactIds));
+    }
+}
+
 Channel::Private::Private(Channel *parent, const ConnectionPtr &connection,
         const QVariantMap &immutableProperties)
     : parent(parent),
@@ -277,7 +361,6 @@ Channel::Private::Private(Channel *parent, const ConnectionPtr &connection,
       usingMembersChangedDetailed(false),
       groupHaveMembers(false),
       buildingContacts(false),
-      currentGroupMembersChangedInfo(0),
       groupAreHandleOwnersAvailable(false),
       pendingRetrieveGroupSelfContact(false),
       groupIsSelfHandleTracked(false),
@@ -331,7 +414,9 @@ Channel::Private::Private(Channel *parent, const ConnectionPtr &connection,
 
 Channel::Private::~Private()
 {
-    delete currentGroupMembersChangedInfo;
+    foreach (GroupMembersChangedInfo *info, currentGroupMembersChangedInfos) {
+        delete info;
+    }
     foreach (GroupMembersChangedInfo *info, groupMembersChangedQueue) {
         delete info;
     }
@@ -741,9 +826,7 @@ void Channel::Private::nowHaveInitialMembers()
     Q_ASSERT(!parent->isReady(Channel::FeatureCore));
     Q_ASSERT(!buildingContacts);
 
-    Q_ASSERT(pendingGroupMembers.isEmpty());
-    Q_ASSERT(pendingGroupLocalPendingMembers.isEmpty());
-    Q_ASSERT(pendingGroupRemotePendingMembers.isEmpty());
+    Q_ASSERT(currentGroupMembersChangedInfos.isEmpty());
 
     Q_ASSERT(groupContacts.isEmpty());
     Q_ASSERT(groupLocalPendingContacts.isEmpty());
@@ -833,14 +916,24 @@ void Channel::Private::buildContacts()
     buildingContacts = true;
 
     ContactManagerPtr manager = connection->contactManager();
-    UIntList toBuild = QSet<uint>(pendingGroupMembers +
-            pendingGroupLocalPendingMembers +
-            pendingGroupRemotePendingMembers).toList();
 
-    if (currentGroupMembersChangedInfo &&
-            currentGroupMembersChangedInfo->actor != 0) {
-        toBuild.append(currentGroupMembersChangedInfo->actor);
+    // Members we already have contacts for, e.g. going from local pending to current, can reuse
+    // them, so only build the ones we don't know yet
+    QSet<uint> toBuildSet;
+    foreach (const GroupMembersChangedInfo *info, currentGroupMembersChangedInfos) {
+        foreach (uint handle, info->added + info->localPending + info->remotePending) {
+            if (!groupContacts.contains(handle) &&
+                    !groupLocalPendingContacts.contains(handle) &&
+                    !groupRemotePendingContacts.contains(handle)) {
+                toBuildSet.insert(handle);
+            }
+        }
+
+        if (info->actor != 0) {
+            toBuildSet.insert(info->actor);
+        }
     }
+    UIntList toBuild = toBuildSet.toList();
 
     if (!initiatorContact && initiatorHandle) {
         // No initiator contact, but Yes initiator handle - might do something about it with just
@@ -919,76 +1012,70 @@ void Channel::Private::processMembersChanged()
         return;
     }
 
-    Q_ASSERT(pendingGroupMembers.isEmpty());
-    Q_ASSERT(pendingGroupLocalPendingMembers.isEmpty());
-    Q_ASSERT(pendingGroupRemotePendingMembers.isEmpty());
+    Q_ASSERT(currentGroupMembersChangedInfos.isEmpty());
 
     // always set this to false here, as buildContacts will always try to
     // retrieve the selfContact and updateContacts will check if the built
     // contact is the same as the current contact.
     pendingRetrieveGroupSelfContact = false;
 
-    currentGroupMembersChangedInfo = groupMembersChangedQueue.dequeue();
-
-    foreach (uint handle, currentGroupMembersChangedInfo->added) {
-        if (!groupContacts.contains(handle)) {
-            pendingGroupMembers.insert(handle);
-        }
-
-        // the member was added to current members, check if it was in the
-        // local/pending lists and if true, schedule for removal from that list
-        if (groupLocalPendingContacts.contains(handle)) {
-            groupLocalPendingMembersToRemove.append(handle);
-        } else if(groupRemotePendingContacts.contains(handle)) {
-            groupRemotePendingMembersToRemove.append(handle);
-        }
+    // Take everything which has been queued, e.g. during a MUC join storm, so that the contacts
+    // for all of it are built with a single request rather than one after the other
+    coalesceMembersChanged();
+    while (!groupMembersChangedQueue.isEmpty()) {
+        currentGroupMembersChangedInfos.append(groupMembersChangedQueue.dequeue());
     }
 
-    foreach (uint handle, currentGroupMembersChangedInfo->localPending) {
-        if (!groupLocalPendingContacts.contains(handle)) {
-            pendingGroupLocalPendingMembers.insert(handle);
-        }
-    }
+    // Always go through buildContacts - we might have a self/initiator/whatever handle to build
+    buildContacts();
+}
+
+void Channel::Private::coalesceMembersChanged()
+{
+    // Merge consecutive changes into one when that doesn't change the outcome: they need to have
+    // the same actor, reason and message, and to be about different handles, so that applying
+    // the merged change is the same as applying them one after the other. Changes which can't be
+    // merged are kept in order, and are still signalled separately.
+    QQueue<GroupMembersChangedInfo *> coalesced;
+    QSet<uint> mergedHandles;
+    while (!groupMembersChangedQueue.isEmpty()) {
+        GroupMembersChangedInfo *info = groupMembersChangedQueue.dequeue();
+        if (!coalesced.isEmpty()) {
+            GroupMembersChangedInfo *last = coalesced.last();
+            QSet<uint> handles = info->handles();
+            bool overlaps = false;
+            foreach (uint handle, handles) {
+                if (mergedHandles.contains(handle)) {
+                    overlaps = true;
+                    break;
+                }
+            }
 
-    foreach (uint handle, currentGroupMembersChangedInfo->remotePending) {
-        if (!groupRemotePendingContacts.contains(handle)) {
-            pendingGroupRemotePendingMembers.insert(handle);
+            if (!overlaps && last->canMerge(info)) {
+                last->merge(info);
+                mergedHandles.unite(handles);
+                delete info;
+                continue;
+            }
         }
-    }
 
-    foreach (uint handle, currentGroupMembersChangedInfo->removed) {
-        groupMembersToRemove.append(handle);
+        coalesced.enqueue(info);
+        mergedHandles = info->handles();
     }
 
-    // Always go through buildContacts - we might have a self/initiator/whatever handle to build
-    buildContacts();
+    groupMembersChangedQueue = coalesced;
 }
 
 void Channel::Private::updateContacts(const QList<ContactPtr> &contacts)
 {
-    Contacts groupContactsAdded;
-    Contacts groupLocalPendingContactsAdded;
-    Contacts groupRemotePendingContactsAdded;
-    ContactPtr actorContact;
     bool selfContactUpdated = false;
 
     debug() << "Entering Chan::Priv::updateContacts() with" << contacts.size() << "contacts";
 
-    // FIXME: simplify. Some duplication of logic present.
-    foreach (ContactPtr contact, contacts) {
+    QHash<uint, ContactPtr> builtContacts;
+    foreach (const ContactPtr &contact, contacts) {
         uint handle = contact->handle()[0];
-        if (pendingGroupMembers.contains(handle)) {
-            groupContactsAdded.insert(contact);
-            groupContacts[handle] = contact;
-        } else if (pendingGroupLocalPendingMembers.contains(handle)) {
-            groupLocalPendingContactsAdded.insert(contact);
-            groupLocalPendingContacts[handle] = contact;
-            // FIXME: should set the details and actor here too
-            groupLocalPendingContactsChangeInfo[handle] = GroupMemberChangeDetails();
-        } else if (pendingGroupRemotePendingMembers.contains(handle)) {
-            groupRemotePendingContactsAdded.insert(contact);
-            groupRemotePendingContacts[handle] = contact;
-        }
+        builtContacts.insert(handle, contact);
 
         if (groupSelfHandle == handle && groupSelfContact != contact) {
             groupSelfContact = contact;
@@ -1010,11 +1097,6 @@ void Channel::Private::updateContacts(const QList<ContactPtr> &contacts)
                 targetId = targetContact->id();
             }
         }
-
-        if (currentGroupMembersChangedInfo &&
-            currentGroupMembersChangedInfo->actor == contact->handle()[0]) {
-            actorContact = contact;
-        }
     }
 
     if (!groupSelfHandle && groupSelfContact) {
@@ -1022,91 +1104,139 @@ void Channel::Private::updateContacts(const QList<ContactPtr> &contacts)
         selfContactUpdated = true;
     }
 
-    pendingGroupMembers.clear();
-    pendingGroupLocalPendingMembers.clear();
-    pendingGroupRemotePendingMembers.clear();
+    // Apply the changes in the order they were signalled, so each groupMembersChanged() is
+    // relative to the membership left by the previous one. Contacts removed by a change are kept
+    // around in the batch, as buildContacts() didn't build them if a later change adds them back.
+    QList<GroupMembersChangedInfo *> infos = currentGroupMembersChangedInfos;
+    currentGroupMembersChangedInfos.clear();
+    QHash<uint, ContactPtr> batchContacts = builtContacts;
+    foreach (GroupMembersChangedInfo *info, infos) {
+        applyMembersChanged(info, batchContacts);
+        delete info;
+    }
 
-    // FIXME: This shouldn't be needed. Clearer would be to first scan for the actor being present
-    // in the contacts supplied.
-    foreach (ContactPtr contact, contacts) {
-        uint handle = contact->handle()[0];
-        if (groupLocalPendingContactsChangeInfo.contains(handle)) {
-            groupLocalPendingContactsChangeInfo[handle] =
-                GroupMemberChangeDetails(actorContact,
-                        currentGroupMembersChangedInfo ? currentGroupMembersChangedInfo->details : QVariantMap());
-        }
+    if (selfContactUpdated && parent->isReady(Channel::FeatureCore)) {
+        emit parent->groupSelfContactChanged();
+    }
+
+    processMembersChanged();
+}
+
+ContactPtr Channel::Private::knownContact(uint handle,
+        const QHash<uint, ContactPtr> &batchContacts) const
+{
+    ContactPtr contact = batchContacts.value(handle);
+    if (!contact) {
+        contact = groupContacts.value(handle);
+    }
+    if (!contact) {
+        contact = groupLocalPendingContacts.value(handle);
     }
+    if (!contact) {
+        contact = groupRemotePendingContacts.value(handle);
+    }
+    return contact;
+}
 
+void Channel::Private::applyMembersChanged(const GroupMembersChangedInfo *info,
+        QHash<uint, ContactPtr> &batchContacts)
+{
+    Contacts groupContactsAdded;
+    Contacts groupLocalPendingContactsAdded;
+    Contacts groupRemotePendingContactsAdded;
     Contacts groupContactsRemoved;
-    ContactPtr contactToRemove;
-    foreach (uint handle, groupMembersToRemove) {
-        if (groupContacts.contains(handle)) {
-            contactToRemove = groupContacts[handle];
-            groupContacts.remove(handle);
-        } else if (groupLocalPendingContacts.contains(handle)) {
-            contactToRemove = groupLocalPendingContacts[handle];
-            groupLocalPendingContacts.remove(handle);
-        } else if (groupRemotePendingContacts.contains(handle)) {
-            contactToRemove = groupRemotePendingContacts[handle];
-            groupRemotePendingContacts.remove(handle);
-        }
+    ContactPtr actorContact;
 
-        if (groupLocalPendingContactsChangeInfo.contains(handle)) {
-            groupLocalPendingContactsChangeInfo.remove(handle);
-        }
+    if (info->actor != 0) {
+        actorContact = knownContact(info->actor, batchContacts);
+    }
+    GroupMemberChangeDetails details(actorContact, info->details);
 
-        if (contactToRemove) {
-            groupContactsRemoved.insert(contactToRemove);
+    QSet<uint> added = info->added.toSet();
+    QSet<uint> localPending = info->localPending.toSet();
+
+    foreach (uint handle, info->added) {
+        if (!groupContacts.contains(handle)) {
+            ContactPtr contact = knownContact(handle, batchContacts);
+            if (contact) {
+                groupContactsAdded.insert(contact);
+                groupContacts.insert(handle, contact);
+            }
         }
-    }
-    groupMembersToRemove.clear();
 
-    // FIXME: drop the LPToRemove and RPToRemove sets - they're redundant
-    foreach (uint handle, groupLocalPendingMembersToRemove) {
+        // the member was added to current members, so it's not local or remote pending anymore
         groupLocalPendingContacts.remove(handle);
+        groupRemotePendingContacts.remove(handle);
     }
-    groupLocalPendingMembersToRemove.clear();
 
-    foreach (uint handle, groupRemotePendingMembersToRemove) {
-        groupRemotePendingContacts.remove(handle);
+    foreach (uint handle, info->localPending) {
+        if (added.contains(handle) || groupLocalPendingContacts.contains(handle)) {
+            continue;
+        }
+
+        ContactPtr contact = knownContact(handle, batchContacts);
+        if (contact) {
+            groupLocalPendingContactsAdded.insert(contact);
+            groupLocalPendingContacts.insert(handle, contact);
+            groupLocalPendingContactsChangeInfo.insert(handle, details);
+        }
     }
-    groupRemotePendingMembersToRemove.clear();
 
-    if (!groupContactsAdded.isEmpty() ||
-        !groupLocalPendingContactsAdded.isEmpty() ||
-        !groupRemotePendingContactsAdded.isEmpty() ||
-        !groupContactsRemoved.isEmpty()) {
-        GroupMemberChangeDetails details(
-                actorContact,
-                currentGroupMembersChangedInfo ? currentGroupMembersChangedInfo->details : QVariantMap());
+    foreach (uint handle, info->remotePending) {
+        if (added.contains(handle) || localPending.contains(handle) ||
+                groupRemotePendingContacts.contains(handle)) {
+            continue;
+        }
 
-        if (currentGroupMembersChangedInfo
-                && currentGroupMembersChangedInfo->removed.contains(groupSelfHandle)) {
-            // Update groupSelfContactRemoveInfo with the proper actor in case
-            // the actor was not available by the time onMembersChangedDetailed
-            // was called.
-            groupSelfContactRemoveInfo = details;
+        ContactPtr contact = knownContact(handle, batchContacts);
+        if (contact) {
+            groupRemotePendingContactsAdded.insert(contact);
+            groupRemotePendingContacts.insert(handle, contact);
         }
+    }
 
-        if (parent->isReady(Channel::FeatureCore)) {
-            // Channel is ready, we can signal membership changes to the outside world without
-            // confusing anyone's fragile logic.
-            emit parent->groupMembersChanged(
-                    groupContactsAdded,
-                    groupLocalPendingContactsAdded,
-                    groupRemotePendingContactsAdded,
-                    groupContactsRemoved,
-                    details);
+    foreach (uint handle, info->removed) {
+        ContactPtr contactToRemove;
+        if (groupContacts.contains(handle)) {
+            contactToRemove = groupContacts.take(handle);
+        } else if (groupLocalPendingContacts.contains(handle)) {
+            contactToRemove = groupLocalPendingContacts.take(handle);
+        } else if (groupRemotePendingContacts.contains(handle)) {
+            contactToRemove = groupRemotePendingContacts.take(handle);
+        }
+
+        groupLocalPendingContactsChangeInfo.remove(handle);
+
+        if (contactToRemove) {
+            groupContactsRemoved.insert(contactToRemove);
+            batchContacts.insert(handle, contactToRemove);
         }
     }
-    delete currentGroupMembersChangedInfo;
-    currentGroupMembersChangedInfo = 0;
 
-    if (selfContactUpdated && parent->isReady(Channel::FeatureCore)) {
-        emit parent->groupSelfContactChanged();
+    if (groupContactsAdded.isEmpty() &&
+        groupLocalPendingContactsAdded.isEmpty() &&
+        groupRemotePendingContactsAdded.isEmpty() &&
+        groupContactsRemoved.isEmpty()) {
+        return;
     }
 
-    processMembersChanged();
+    if (info->removed.contains(groupSelfHandle)) {
+        // Update groupSelfContactRemoveInfo with the proper actor in case
+        // the actor was not available by the time onMembersChangedDetailed
+        // was called.
+        groupSelfContactRemoveInfo = details;
+    }
+
+    if (parent->isReady(Channel::FeatureCore)) {
+        // Channel is ready, we can signal membership changes to the outside world without
+        // confusing anyone's fragile logic.
+        emit parent->groupMembersChanged(
+                groupContactsAdded,
+                groupLocalPendingContactsAdded,
+                groupRemotePendingContactsAdded,
+                groupContactsRemoved,
+                details);
+    }
 }
 
 bool Channel::Private::fakeGroupInterfaceIfNeeded()
@@ -2375,9 +2505,13 @@ Contacts Channel::groupContacts(bool includeSelfContact) const
         warning() << "Channel::groupMembers() used channel not ready";
     }
 
-    Contacts ret = mPriv->groupContacts.values().toSet();
+    // Only detach from the set we keep when the self contact actually has to be left out
+    Contacts ret = mPriv->groupContacts.contacts;
     if (!includeSelfContact) {
-        ret.remove(groupSelfContact());
+        ContactPtr self = groupSelfContact();
+        if (self && ret.contains(self)) {
+            ret.remove(self);
+        }
     }
     return ret;
 }
@@ -2406,9 +2540,12 @@ Contacts Channel::groupLocalPendingContacts(bool includeSelfContact) const
         warning() << "Channel::groupLocalPendingContacts() used with no group interface";
     }
 
-    Contacts ret = mPriv->groupLocalPendingContacts.values().toSet();
+    Contacts ret = mPriv->groupLocalPendingContacts.contacts;
     if (!includeSelfContact) {
-        ret.remove(groupSelfContact());
+        ContactPtr self = groupSelfContact();
+        if (self && ret.contains(self)) {
+            ret.remove(self);
+        }
     }
     return ret;
 }
@@ -2438,9 +2575,12 @@ Contacts Channel::groupRemotePendingContacts(bool includeSelfContact) const
             "group interface";
     }
 
-    Contacts ret = mPriv->groupRemotePendingContacts.values().toSet();
+    Contacts ret = mPriv->groupRemotePendingContacts.contacts;
     if (!includeSelfContact) {
-        ret.remove(groupSelfContact());
+        ContactPtr self = groupSelfContact();
+        if (self && ret.contains(self)) {
+            ret.remove(self);
+        }
     }
     return ret;
 }
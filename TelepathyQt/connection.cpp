@@ -31,6 +31,7 @@
 #include "TelepathyQt/_gen/connection-lowlevel.moc.hpp"
 
 #include "TelepathyQt/debug-internal.h"
+#include "TelepathyQt/handle-table-internal.h"
 
 #include <TelepathyQt/ChannelFactory>
 #include <TelepathyQt/ConnectionCapabilities>
@@ -170,7 +171,8 @@ struct TP_QT_NO_EXPORT Connection::Private::HandleContext
 {
     struct Type
     {
-        QHash<uint, uint> refcounts;
+        // Can be used without holding the lock, see HandleTable
+        HandleTable refcounts;
         QSet<uint> toRelease;
         uint requestsInFlight;
         bool releaseScheduled;
@@ -187,9 +189,16 @@ struct TP_QT_NO_EXPORT Connection::Private::HandleContext
     {
     }
 
+    // A fixed array rather than a hash, so that it can be looked up without the lock. Handles of
+    // unknown types, which the CM should reject anyway, are tracked with those of type None.
+    Type &type(uint handleType)
+    {
+        return types[handleType < (uint) NUM_HANDLE_TYPES ? handleType : (uint) HandleTypeNone];
+    }
+
     int refcount;
     QMutex lock;
-    QHash<uint, Type> types;
+    Type types[NUM_HANDLE_TYPES];
 };
 
 Connection::Private::Private(Connection *parent,
@@ -341,13 +350,14 @@ Connection::Private::~Private()
         if (!immortalHandles) {
             debug() << "Destroying HandleContext";
 
-            foreach (uint handleType, handleContext->types.keys()) {
-                HandleContext::Type type = handleContext->types[handleType];
+            for (uint handleType = 0; handleType < (uint) NUM_HANDLE_TYPES; ++handleType) {
+                HandleContext::Type &type = handleContext->types[handleType];
 
-                if (!type.refcounts.empty()) {
+                UIntList referenced = type.refcounts.referencedHandles();
+                if (!referenced.empty()) {
                     debug() << " Still had references to" <<
-                        type.refcounts.size() << "handles, releasing now";
-                    baseInterface->ReleaseHandles(handleType, type.refcounts.keys());
+                        referenced.size() << "handles, releasing now";
+                    baseInterface->ReleaseHandles(handleType, referenced);
                 }
 
                 if (!type.toRelease.empty()) {
@@ -1991,7 +2001,7 @@ PendingHandles *ConnectionLowlevel::requestHandles(HandleType handleType, const
     if (!hasImmortalHandles()) {
         Connection::Private::HandleContext *handleContext = conn->mPriv->handleContext;
         QMutexLocker locker(&handleContext->lock);
-        handleContext->types[handleType].requestsInFlight++;
+        handleContext->type(handleType).requestsInFlight++;
     }
 
     PendingHandles *pending =
@@ -2046,9 +2056,9 @@ PendingHandles *ConnectionLowlevel::referenceHandles(HandleType handleType, cons
         Connection::Private::HandleContext *handleContext = conn->mPriv->handleContext;
         QMutexLocker locker(&handleContext->lock);
 
+        Connection::Private::HandleContext::Type &type = handleContext->type(handleType);
         foreach (uint handle, handles) {
-            if (handleContext->types[handleType].refcounts.contains(handle) ||
-                handleContext->types[handleType].toRelease.contains(handle)) {
+            if (type.refcounts.isReferenced(handle) || type.toRelease.contains(handle)) {
                 alreadyHeld.push_back(handle);
             }
             else {
@@ -2195,7 +2205,7 @@ PendingContactAttributes *ConnectionLowlevel::contactAttributes(const UIntList &
     if (!hasImmortalHandles()) {
         Connection::Private::HandleContext *handleContext = conn->mPriv->handleContext;
         QMutexLocker locker(&handleContext->lock);
-        handleContext->types[HandleTypeContact].requestsInFlight++;
+        handleContext->type(HandleTypeContact).requestsInFlight++;
     }
 
     Client::ConnectionInterfaceContactsInterface *contactsInterface =
@@ -2308,13 +2318,18 @@ void Connection::refHandle(HandleType handleType, uint handle)
     }
 
     Private::HandleContext *handleContext = mPriv->handleContext;
-    QMutexLocker locker(&handleContext->lock);
+    Private::HandleContext::Type &type = handleContext->type(handleType);
 
-    if (handleContext->types[handleType].toRelease.contains(handle)) {
-        handleContext->types[handleType].toRelease.remove(handle);
+    // Copying ReferencedHandles mostly references handles we already hold, which doesn't need the
+    // lock
+    if (type.refcounts.tryRef(handle)) {
+        return;
     }
 
-    handleContext->types[handleType].refcounts[handle]++;
+    QMutexLocker locker(&handleContext->lock);
+
+    type.toRelease.remove(handle);
+    type.refcounts.ref(handle);
 }
 
 void Connection::unrefHandle(HandleType handleType, uint handle)
@@ -2324,23 +2339,26 @@ void Connection::unrefHandle(HandleType handleType, uint handle)
     }
 
     Private::HandleContext *handleContext = mPriv->handleContext;
-    QMutexLocker locker(&handleContext->lock);
+    Private::HandleContext::Type &type = handleContext->type(handleType);
+
+    // Likewise, only dropping the last reference needs the lock
+    if (type.refcounts.tryUnref(handle)) {
+        return;
+    }
 
-    Q_ASSERT(handleContext->types.contains(handleType));
-    Q_ASSERT(handleContext->types[handleType].refcounts.contains(handle));
+    QMutexLocker locker(&handleContext->lock);
 
-    if (!--handleContext->types[handleType].refcounts[handle]) {
-        handleContext->types[handleType].refcounts.remove(handle);
-        handleContext->types[handleType].toRelease.insert(handle);
+    if (type.refcounts.unref(handle)) {
+        type.toRelease.insert(handle);
 
-        if (!handleContext->types[handleType].releaseScheduled) {
-            if (!handleContext->types[handleType].requestsInFlight) {
+        if (!type.releaseScheduled) {
+            if (!type.requestsInFlight) {
                 debug() << "Lost last reference to at least one handle of type" <<
                     handleType <<
                     "and no requests in flight for that type - scheduling a release sweep";
                 QMetaObject::invokeMethod(this, "doReleaseSweep",
                         Qt::QueuedConnection, Q_ARG(uint, handleType));
-                handleContext->types[handleType].releaseScheduled = true;
+                type.releaseScheduled = true;
             }
         }
     }
@@ -2355,26 +2373,30 @@ void Connection::doReleaseSweep(uint handleType)
     Private::HandleContext *handleContext = mPriv->handleContext;
     QMutexLocker locker(&handleContext->lock);
 
-    Q_ASSERT(handleContext->types.contains(handleType));
-    Q_ASSERT(handleContext->types[handleType].releaseScheduled);
+    Private::HandleContext::Type &type = handleContext->type(handleType);
+    Q_ASSERT(type.releaseScheduled);
 
     debug() << "Entering handle release sweep for type" << handleType;
-    handleContext->types[handleType].releaseScheduled = false;
+    type.releaseScheduled = false;
 
-    if (handleContext->types[handleType].requestsInFlight > 0) {
+    if (type.requestsInFlight > 0) {
         debug() << " There are requests in flight, deferring sweep to when they have been completed";
         return;
     }
 
-    if (handleContext->types[handleType].toRelease.isEmpty()) {
+    if (type.toRelease.isEmpty()) {
         debug() << " No handles to release - every one has been resurrected";
         return;
     }
 
-    debug() << " Releasing" << handleContext->types[handleType].toRelease.size() << "handles";
+    // Every handle which lost its last reference since the previous sweep goes in a single call
+    debug() << " Releasing" << type.toRelease.size() << "handles";
+
+    mPriv->baseInterface->ReleaseHandles(handleType, type.toRelease.toList());
+    type.toRelease.clear();
 
-    mPriv->baseInterface->ReleaseHandles(handleType, handleContext->types[handleType].toRelease.toList());
-    handleContext->types[handleType].toRelease.clear();
+    // Those handles don't need to be tracked anymore
+    type.refcounts.reclaim();
 }
 
 void Connection::handleRequestLanded(HandleType handleType)
@@ -2386,16 +2408,16 @@ void Connection::handleRequestLanded(HandleType handleType)
     Private::HandleContext *handleContext = mPriv->handleContext;
     QMutexLocker locker(&handleContext->lock);
 
-    Q_ASSERT(handleContext->types.contains(handleType));
-    Q_ASSERT(handleContext->types[handleType].requestsInFlight > 0);
+    Private::HandleContext::Type &type = handleContext->type(handleType);
+    Q_ASSERT(type.requestsInFlight > 0);
 
-    if (!--handleContext->types[handleType].requestsInFlight &&
-        !handleContext->types[handleType].toRelease.isEmpty() &&
-        !handleContext->types[handleType].releaseScheduled) {
+    if (!--type.requestsInFlight &&
+        !type.toRelease.isEmpty() &&
+        !type.releaseScheduled) {
         debug() << "All handle requests for type" << handleType <<
             "landed and there are handles of that type to release - scheduling a release sweep";
         QMetaObject::invokeMethod(this, "doReleaseSweep", Qt::QueuedConnection, Q_ARG(uint, handleType));
-        handleContext->types[handleType].releaseScheduled = true;
+        type.releaseScheduled = true;
     }
 }
 
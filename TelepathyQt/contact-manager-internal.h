@@ -26,6 +26,7 @@
 #include <TelepathyQt/ContactManager>
 #include <TelepathyQt/Global>
 #include <TelepathyQt/PendingOperation>
+#include <TelepathyQt/ReferencedHandles>
 #include <TelepathyQt/Types>
 
 #include <QList>
@@ -383,6 +384,35 @@ private:
     QSet<uint> mToRequest;
 };
 
+class TP_QT_NO_EXPORT ContactManager::PendingCoalescedAttributes : public PendingOperation
+{
+    Q_OBJECT
+
+public:
+    PendingCoalescedAttributes(const ConnectionPtr &conn);
+    ~PendingCoalescedAttributes();
+
+    void addRequest(const UIntList &handles, const QStringList &interfaces);
+
+    void requestAttributes();
+
+    ReferencedHandles validHandles() const { return mValidHandles; }
+    ContactAttributesMap attributes() const { return mAttributes; }
+
+private Q_SLOTS:
+    void onAttributesFinished(Tp::PendingOperation *op);
+
+private:
+    ConnectionPtr mConn;
+    UIntList mHandles;
+    QSet<uint> mHandleSet;
+    QSet<QString> mInterfaces;
+    uint mRequests;
+
+    ReferencedHandles mValidHandles;
+    ContactAttributesMap mAttributes;
+};
+
 } // Tp
 
 #endif
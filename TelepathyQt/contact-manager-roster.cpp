@@ -2010,35 +2010,60 @@ void ContactManager::Roster::computeKnownContactsChanges(const Tp::Contacts& add
         const Tp::Contacts& pendingAdded, const Tp::Contacts& remotePendingAdded,
         const Tp::Contacts& removed, const Channel::GroupMemberChangeDetails &details)
 {
-    // First of all, compute the real additions/removals based upon our cache
+    // First of all, compute the real additions/removals based upon our cache. Only the changed
+    // contacts are looked up in it, so the cost depends on the size of the change rather than on
+    // the size of the lists.
     Tp::Contacts realAdded;
-    realAdded.unite(added);
-    realAdded.unite(pendingAdded);
-    realAdded.unite(remotePendingAdded);
-    realAdded.subtract(cachedAllKnownContacts);
-    Tp::Contacts realRemoved = removed;
-    realRemoved.intersect(cachedAllKnownContacts);
+    foreach (const Tp::Contacts &contacts,
+            QList<Tp::Contacts>() << added << pendingAdded << remotePendingAdded) {
+        foreach (const ContactPtr &contact, contacts) {
+            if (!cachedAllKnownContacts.contains(contact)) {
+                realAdded.insert(contact);
+            }
+        }
+    }
 
-    // Check if realRemoved have been _really_ removed from all lists
-    foreach (const ChannelInfo &contactListChannel, contactListChannels) {
-        ChannelPtr channel = contactListChannel.channel;
-        if (!channel) {
-            continue;
+    Tp::Contacts realRemoved;
+    foreach (const ContactPtr &contact, removed) {
+        if (cachedAllKnownContacts.contains(contact) &&
+                !contactListContacts.contains(contact) &&
+                !blockedContacts.contains(contact)) {
+            realRemoved.insert(contact);
         }
-        realRemoved.subtract(channel->groupContacts());
-        realRemoved.subtract(channel->groupLocalPendingContacts());
-        realRemoved.subtract(channel->groupRemotePendingContacts());
     }
 
-    // ...and from the Conn.I.ContactList / Conn.I.ContactBlocking contacts
-    realRemoved.subtract(contactListContacts);
-    realRemoved.subtract(blockedContacts);
+    // Check if realRemoved have been _really_ removed from all lists
+    if (!realRemoved.isEmpty()) {
+        foreach (const ChannelInfo &contactListChannel, contactListChannels) {
+            ChannelPtr channel = contactListChannel.channel;
+            if (!channel) {
+                continue;
+            }
+
+            Contacts members = channel->groupContacts();
+            Contacts localPending = channel->groupLocalPendingContacts();
+            Contacts remotePending = channel->groupRemotePendingContacts();
+            Contacts::iterator i = realRemoved.begin();
+            while (i != realRemoved.end()) {
+                if (members.contains(*i) || localPending.contains(*i) ||
+                        remotePending.contains(*i)) {
+                    i = realRemoved.erase(i);
+                } else {
+                    ++i;
+                }
+            }
+        }
+    }
 
     // Are there any real changes?
     if (!realAdded.isEmpty() || !realRemoved.isEmpty()) {
         // Yes, update our "cache" and emit the signal
-        cachedAllKnownContacts.unite(realAdded);
-        cachedAllKnownContacts.subtract(realRemoved);
+        foreach (const ContactPtr &contact, realAdded) {
+            cachedAllKnownContacts.insert(contact);
+        }
+        foreach (const ContactPtr &contact, realRemoved) {
+            cachedAllKnownContacts.remove(contact);
+        }
         emit contactManager->allKnownContactsChanged(realAdded, realRemoved, details);
     }
 }
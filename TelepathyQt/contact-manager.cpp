@@ -25,12 +25,15 @@
 
 #include "TelepathyQt/_gen/contact-manager.moc.hpp"
 
+#include "TelepathyQt/avatar-cache-internal.h"
 #include "TelepathyQt/debug-internal.h"
+#include "TelepathyQt/feature-internal.h"
 #include "TelepathyQt/future-internal.h"
 
 #include <TelepathyQt/AvatarData>
 #include <TelepathyQt/Connection>
 #include <TelepathyQt/ConnectionLowlevel>
+#include <TelepathyQt/ContactCapabilities>
 #include <TelepathyQt/ContactFactory>
 #include <TelepathyQt/PendingChannel>
 #include <TelepathyQt/PendingContactAttributes>
@@ -52,8 +55,8 @@ struct TP_QT_NO_EXPORT ContactManager::Private
     ~Private();
 
     // avatar specific methods
-    bool buildAvatarFileName(QString token, bool createDir,
-        QString &avatarFileName, QString &mimeTypeFileName);
+    QString avatarCachePath();
+    AvatarCache *ensureAvatarCache();
     Features realFeatures(const Features &features);
     QSet<QString> interfacesForFeatures(const Features &features);
 
@@ -69,9 +72,33 @@ struct TP_QT_NO_EXPORT ContactManager::Private
     // avatar
     QSet<ContactPtr> requestAvatarsQueue;
     bool requestAvatarsIdle;
+    AvatarCachePtr avatarCache;
+    qint64 avatarCacheSizeLimit;
+    QHash<QString, QSet<uint> > avatarsBeingStored;
 
     // contact info
     PendingRefreshContactInfo *refreshInfoOp;
+
+    // attribute requests issued in the current main loop iteration
+    PendingCoalescedAttributes *coalescedAttributesOp;
+
+    // chunked attribute fetching
+    uint attributesChunkSize;
+    uint maxAttributesChunksInFlight;
+
+    // capabilities, shared by all the contacts which have the same ones; interned lists are
+    // looked up by capabilitiesHash() of their bare classes, and dropped when no contact uses them
+    // anymore
+    struct InternedCapabilities
+    {
+        RequestableChannelClassList rccs;
+        ContactCapabilities caps;
+        uint users;
+    };
+    QHash<uint, QList<InternedCapabilities> > internedCapabilities;
+    ContactCapabilities unknownCapabilities;
+    RequestableChannelClassSpecList connectionCapabilitiesSpecs;
+    ContactCapabilities connectionCapabilities;
 };
 
 ContactManager::Private::Private(ContactManager *parent, Connection *connection)
@@ -79,18 +106,42 @@ ContactManager::Private::Private(ContactManager *parent, Connection *connection)
       connection(connection),
       roster(new ContactManager::Roster(parent)),
       requestAvatarsIdle(false),
-      refreshInfoOp(0)
+      avatarCacheSizeLimit(0),
+      refreshInfoOp(0),
+      coalescedAttributesOp(0),
+      attributesChunkSize(0),
+      maxAttributesChunksInFlight(2)
 {
 }
 
 ContactManager::Private::~Private()
 {
     delete refreshInfoOp;
+    delete coalescedAttributesOp;
     delete roster;
 }
 
-bool ContactManager::Private::buildAvatarFileName(QString token, bool createDir,
-        QString &avatarFileName, QString &mimeTypeFileName)
+namespace
+{
+
+uint capabilitiesHash(const RequestableChannelClassList &rccs)
+{
+    // Only meant to tell lists apart cheaply, so the fixed property values aren't hashed
+    uint ret = rccs.size();
+    foreach (const RequestableChannelClass &rcc, rccs) {
+        ret = ret * 31 + qHash(rcc.fixedProperties.value(
+                    TP_QT_IFACE_CHANNEL + QLatin1String(".ChannelType")).toString());
+        ret = ret * 31 + rcc.fixedProperties.size();
+        foreach (const QString &property, rcc.allowedProperties) {
+            ret = ret * 31 + qHash(property);
+        }
+    }
+    return ret;
+}
+
+}
+
+QString ContactManager::Private::avatarCachePath()
 {
     QString cacheDir = QString(QLatin1String(qgetenv("XDG_CACHE_HOME")));
     if (cacheDir.isEmpty()) {
@@ -98,17 +149,27 @@ bool ContactManager::Private::buildAvatarFileName(QString token, bool createDir,
     }
 
     ConnectionPtr conn(parent->connection());
-    QString path = QString(QLatin1String("%1/telepathy/avatars/%2/%3")).
+    return QString(QLatin1String("%1/telepathy/avatars/%2/%3")).
         arg(cacheDir).arg(conn->cmName()).arg(conn->protocolName());
+}
 
-    if (createDir && !QDir().mkpath(path)) {
-        return false;
-    }
-
-    avatarFileName = QString(QLatin1String("%1/%2")).arg(path).arg(escapeAsIdentifier(token));
-    mimeTypeFileName = QString(QLatin1String("%1.mime")).arg(avatarFileName);
+AvatarCache *ContactManager::Private::ensureAvatarCache()
+{
+    QString path = avatarCachePath();
+    if (!avatarCache || avatarCache->path() != path) {
+        if (avatarCache) {
+            avatarCache->disconnect(parent);
+        }
 
-    return true;
+        avatarCache = AvatarCache::forDirectory(path);
+        if (avatarCacheSizeLimit > 0) {
+            avatarCache->setSizeLimit(avatarCacheSizeLimit);
+        }
+        parent->connect(avatarCache.data(),
+                SIGNAL(avatarStored(QString,Tp::AvatarData)),
+                SLOT(onAvatarStored(QString,Tp::AvatarData)));
+    }
+    return avatarCache.data();
 }
 
 Features ContactManager::Private::realFeatures(const Features &features)
@@ -193,6 +254,56 @@ void ContactManager::PendingRefreshContactInfo::onRefreshInfoFinished(PendingOpe
     }
 }
 
+ContactManager::PendingCoalescedAttributes::PendingCoalescedAttributes(const ConnectionPtr &conn)
+    : PendingOperation(conn),
+      mConn(conn),
+      mRequests(0)
+{
+}
+
+ContactManager::PendingCoalescedAttributes::~PendingCoalescedAttributes()
+{
+}
+
+void ContactManager::PendingCoalescedAttributes::addRequest(const UIntList &handles,
+        const QStringList &interfaces)
+{
+    foreach (uint handle, handles) {
+        if (!mHandleSet.contains(handle)) {
+            mHandleSet.insert(handle);
+            mHandles.append(handle);
+        }
+    }
+    mInterfaces.unite(interfaces.toSet());
+    ++mRequests;
+}
+
+void ContactManager::PendingCoalescedAttributes::requestAttributes()
+{
+    Q_ASSERT(!mHandles.isEmpty());
+
+    debug() << "Requesting attributes for" << mHandles.size() << "contacts on behalf of" <<
+        mRequests << "requests";
+    PendingContactAttributes *nested = mConn->lowlevel()->contactAttributes(mHandles,
+            mInterfaces.toList(), true);
+    connect(nested,
+            SIGNAL(finished(Tp::PendingOperation*)),
+            SLOT(onAttributesFinished(Tp::PendingOperation*)));
+}
+
+void ContactManager::PendingCoalescedAttributes::onAttributesFinished(PendingOperation *op)
+{
+    if (op->isError()) {
+        setFinishedWithError(op->errorName(), op->errorMessage());
+        return;
+    }
+
+    PendingContactAttributes *pendingAttributes = qobject_cast<PendingContactAttributes *>(op);
+    mValidHandles = pendingAttributes->validHandles();
+    mAttributes = pendingAttributes->attributes();
+    setFinished();
+}
+
 /**
  * \class ContactManager
  * \ingroup clientconn
@@ -212,6 +323,7 @@ ContactManager::ContactManager(Connection *connection)
     : Object(),
       mPriv(new Private(this, connection))
 {
+    mPriv->unknownCapabilities = ContactCapabilities(true);
 }
 
 /**
@@ -993,7 +1105,6 @@ PendingContacts *ContactManager::contactsForHandles(const UIntList &handles,
 {
     QMap<uint, ContactPtr> satisfyingContacts;
     QSet<uint> otherContacts;
-    Features missingFeatures;
 
     if (!connection()->isValid()) {
         return new PendingContacts(ContactManagerPtr(this), handles, features, Features(),
@@ -1022,23 +1133,28 @@ PendingContacts *ContactManager::contactsForHandles(const UIntList &handles,
         }
     }
 
+    // This is done for every handle, so compare the features as bitmaps rather than as sets
+    FeatureBits realFeatureBits(realFeatures);
+    FeatureBits missingFeatureBits;
     foreach (uint handle, handles) {
         ContactPtr contact = lookupContactByHandle(handle);
         if (contact) {
-            if ((realFeatures - contact->requestedFeatures()).isEmpty()) {
+            const FeatureBits &contactFeatureBits = contact->requestedFeatureBits();
+            if (contactFeatureBits.contains(realFeatureBits)) {
                 // Contact exists and has all the requested features
                 satisfyingContacts.insert(handle, contact);
             } else {
                 // Contact exists but is missing features
                 otherContacts.insert(handle);
-                missingFeatures.unite(realFeatures - contact->requestedFeatures());
+                missingFeatureBits |= realFeatureBits - contactFeatureBits;
             }
         } else {
             // Contact doesn't exist - we need to get all of the features (same as unite(features))
-            missingFeatures = realFeatures;
+            missingFeatureBits = realFeatureBits;
             otherContacts.insert(handle);
         }
     }
+    Features missingFeatures = missingFeatureBits.toFeatures();
 
     QSet<QString> interfaces = mPriv->interfacesForFeatures(missingFeatures);
 
@@ -1174,6 +1290,146 @@ PendingContacts *ContactManager::upgradeContacts(const QList<ContactPtr> &contac
     return new PendingContacts(ContactManagerPtr(this), contacts, features);
 }
 
+/**
+ * Return the maximum number of handles requested per Contacts.GetContactAttributes call made by
+ * contactsForHandles(), or 0 if chunking is disabled.
+ *
+ * \return The chunk size, or 0 if all attributes are requested in a single call.
+ * \sa setContactAttributesChunking()
+ */
+uint ContactManager::contactAttributesChunkSize() const
+{
+    return mPriv->attributesChunkSize;
+}
+
+/**
+ * Return the maximum number of Contacts.GetContactAttributes calls a single PendingContacts keeps
+ * in flight when chunking is enabled.
+ *
+ * \return The maximum number of chunks in flight.
+ * \sa setContactAttributesChunking()
+ */
+uint ContactManager::maxContactAttributesChunksInFlight() const
+{
+    return mPriv->maxAttributesChunksInFlight;
+}
+
+/**
+ * Set whether contactsForHandles() should split its Contacts.GetContactAttributes request into
+ * several smaller calls.
+ *
+ * When \a chunkSize is non-zero, requests for more than \a chunkSize contacts are split into
+ * chunks of at most \a chunkSize handles, with at most \a maxChunksInFlight of them pending at
+ * any time. PendingContacts::contactsRetrieved() is emitted as each chunk is processed, so the
+ * first contacts of a large roster become usable before the whole request finishes.
+ *
+ * Chunking is disabled by default. The setting only affects requests made after it is changed.
+ *
+ * \param chunkSize The maximum number of handles per call, or 0 to disable chunking.
+ * \param maxChunksInFlight The maximum number of concurrent calls per request.
+ * \sa contactAttributesChunkSize(), maxContactAttributesChunksInFlight()
+ */
+void ContactManager::setContactAttributesChunking(uint chunkSize, uint maxChunksInFlight)
+{
+    mPriv->attributesChunkSize = chunkSize;
+    mPriv->maxAttributesChunksInFlight = qMax(maxChunksInFlight, 1u);
+}
+
+/**
+ * Return the maximum size in bytes of the on-disk avatar cache used by this contact manager, or 0
+ * if the cache size is not limited.
+ *
+ * \return The avatar cache size limit in bytes.
+ * \sa setAvatarCacheSizeLimit()
+ */
+qint64 ContactManager::avatarCacheSizeLimit() const
+{
+    return mPriv->avatarCacheSizeLimit;
+}
+
+/**
+ * Set the maximum size in bytes of the on-disk avatar cache used by this contact manager.
+ *
+ * When the avatars stored for this connection manager and protocol exceed \a maxBytes, the least
+ * recently used ones are removed from the cache. The limit applies to the whole cache directory,
+ * which is shared by all contact managers for the same connection manager and protocol.
+ *
+ * The cache size is not limited by default.
+ *
+ * \param maxBytes The avatar cache size limit in bytes, or 0 to not limit the cache size.
+ * \sa avatarCacheSizeLimit(), Contact::avatarData()
+ */
+void ContactManager::setAvatarCacheSizeLimit(qint64 maxBytes)
+{
+    mPriv->avatarCacheSizeLimit = maxBytes;
+    if (mPriv->avatarCache) {
+        mPriv->avatarCache->setSizeLimit(maxBytes);
+    }
+}
+
+ContactCapabilities ContactManager::defaultCapabilities()
+{
+    if (supportedFeatures().contains(Contact::FeatureCapabilities)) {
+        return mPriv->unknownCapabilities;
+    }
+
+    // The connection capabilities are normally set once, but check whether they were replaced since
+    // the shared object was made. This is cheap as long as it's still the same list.
+    RequestableChannelClassSpecList specs = connection()->capabilities().allClassSpecs();
+    if (specs != mPriv->connectionCapabilitiesSpecs) {
+        mPriv->connectionCapabilitiesSpecs = specs;
+        mPriv->connectionCapabilities = ContactCapabilities(specs, false);
+    }
+    return mPriv->connectionCapabilities;
+}
+
+ContactCapabilities ContactManager::internCapabilities(const RequestableChannelClassList &rccs,
+        RequestableChannelClassList *internedRccs)
+{
+    QList<Private::InternedCapabilities> &candidates =
+        mPriv->internedCapabilities[capabilitiesHash(rccs)];
+    for (int i = 0; i < candidates.size(); ++i) {
+        Private::InternedCapabilities &candidate = candidates[i];
+        if (candidate.rccs == rccs) {
+            ++candidate.users;
+            *internedRccs = candidate.rccs;
+            return candidate.caps;
+        }
+    }
+
+    Private::InternedCapabilities interned;
+    interned.rccs = rccs;
+    interned.caps = ContactCapabilities(rccs, true);
+    interned.users = 1;
+    candidates.append(interned);
+    *internedRccs = interned.rccs;
+    return interned.caps;
+}
+
+void ContactManager::releaseCapabilities(const RequestableChannelClassList &internedRccs)
+{
+    uint hash = capabilitiesHash(internedRccs);
+    QHash<uint, QList<Private::InternedCapabilities> >::iterator it =
+        mPriv->internedCapabilities.find(hash);
+    if (it == mPriv->internedCapabilities.end()) {
+        return;
+    }
+
+    // The list is the interned one, so this is normally just comparing pointers
+    QList<Private::InternedCapabilities> &candidates = it.value();
+    for (int i = 0; i < candidates.size(); ++i) {
+        if (candidates[i].rccs == internedRccs) {
+            if (--candidates[i].users == 0) {
+                candidates.removeAt(i);
+                if (candidates.isEmpty()) {
+                    mPriv->internedCapabilities.erase(it);
+                }
+            }
+            return;
+        }
+    }
+}
+
 ContactPtr ContactManager::lookupContactByHandle(uint handle)
 {
     ContactPtr contact;
@@ -1260,6 +1516,15 @@ void ContactManager::onAliasesChanged(const AliasPairList &aliases)
 void ContactManager::doRequestAvatars()
 {
     Q_ASSERT(mPriv->requestAvatarsIdle);
+
+    AvatarCache *cache = mPriv->ensureAvatarCache();
+    if (!cache->isLoaded()) {
+        // The cache index is read in the background, check it once it is available
+        connect(cache, SIGNAL(loaded()), SLOT(doRequestAvatars()), Qt::UniqueConnection);
+        return;
+    }
+    disconnect(cache, SIGNAL(loaded()), this, SLOT(doRequestAvatars()));
+
     QSet<ContactPtr> contacts = mPriv->requestAvatarsQueue;
     Q_ASSERT(contacts.size() > 0);
 
@@ -1267,30 +1532,29 @@ void ContactManager::doRequestAvatars()
     mPriv->requestAvatarsIdle = false;
 
     int found = 0;
+    int storing = 0;
     UIntList notFound;
     foreach (const ContactPtr &contact, contacts) {
         if (!contact) {
             continue;
         }
 
-        QString avatarFileName;
-        QString mimeTypeFileName;
-        bool success = (contact->isAvatarTokenKnown() &&
-            mPriv->buildAvatarFileName(contact->avatarToken(), false,
-                avatarFileName, mimeTypeFileName));
-
         /* Check if the avatar is already in the cache */
-        if (success && QFile::exists(avatarFileName)) {
-            QFile mimeTypeFile(mimeTypeFileName);
-            mimeTypeFile.open(QIODevice::ReadOnly);
-            QString mimeType = QString(QLatin1String(mimeTypeFile.readAll()));
-            mimeTypeFile.close();
-
-            found++;
-
-            contact->receiveAvatarData(AvatarData(avatarFileName, mimeType));
+        if (contact->isAvatarTokenKnown()) {
+            QString token = contact->avatarToken();
+            AvatarData avatar;
+            if (cache->lookup(token, &avatar)) {
+                found++;
+                contact->receiveAvatarData(avatar);
+                continue;
+            }
 
-            continue;
+            /* Or about to be, in which case it will be handed out by onAvatarStored() */
+            if (cache->isStoring(token)) {
+                storing++;
+                mPriv->avatarsBeingStored[token].insert(contact->handle()[0]);
+                continue;
+            }
         }
 
         notFound << contact->handle()[0];
@@ -1300,11 +1564,15 @@ void ContactManager::doRequestAvatars()
         debug() << "Avatar(s) found in cache for" << found << "contact(s)";
     }
 
-    if (found == contacts.size()) {
+    if (storing > 0) {
+        debug() << "Avatar(s) being written to cache for" << storing << "contact(s)";
+    }
+
+    if (notFound.isEmpty()) {
         return;
     }
 
-    debug() << "Requesting avatar(s) for" << contacts.size() - found << "contact(s)";
+    debug() << "Requesting avatar(s) for" << notFound.size() << "contact(s)";
 
     Client::ConnectionInterfaceAvatarsInterface *avatarsInterface =
         connection()->interface<Client::ConnectionInterfaceAvatarsInterface>();
@@ -1328,46 +1596,27 @@ void ContactManager::onAvatarUpdated(uint handle, const QString &token)
 void ContactManager::onAvatarRetrieved(uint handle, const QString &token,
     const QByteArray &data, const QString &mimeType)
 {
-    QString avatarFileName;
-    QString mimeTypeFileName;
-
     debug() << "Got AvatarRetrieved for contact with handle" << handle;
 
-    bool success = mPriv->buildAvatarFileName(token, true, avatarFileName,
-        mimeTypeFileName);
-
-    if (success) {
-        debug() << "Write avatar in cache for handle" << handle;
-        debug() << "Filename:" << avatarFileName;
-        debug() << "MimeType:" << mimeType;
-
-        if (!QFile::exists(mimeTypeFileName)) {
-            QTemporaryFile mimeTypeFile(mimeTypeFileName);
-            if (mimeTypeFile.open()) {
-                mimeTypeFile.write(mimeType.toLatin1());
-                mimeTypeFile.setAutoRemove(false);
-                if (!mimeTypeFile.rename(mimeTypeFileName)) {
-                    mimeTypeFile.remove();
-                }
-            }
-        }
-
-        if (!QFile::exists(avatarFileName)) {
-            QTemporaryFile avatarFile(avatarFileName);
-            if (avatarFile.open()) {
-                avatarFile.write(data);
-                avatarFile.setAutoRemove(false);
-                if (!avatarFile.rename(avatarFileName)) {
-                    avatarFile.remove();
-                }
-            }
-        }
-    }
-
     ContactPtr contact = lookupContactByHandle(handle);
     if (contact) {
         contact->setAvatarToken(token);
-        contact->receiveAvatarData(AvatarData(avatarFileName, mimeType));
+    }
+
+    // The avatar is written to the cache in the background, and only handed to the contact once
+    // the file is there
+    mPriv->avatarsBeingStored[token].insert(handle);
+    mPriv->ensureAvatarCache()->store(token, data, mimeType);
+}
+
+void ContactManager::onAvatarStored(const QString &token, const AvatarData &avatar)
+{
+    QSet<uint> handles = mPriv->avatarsBeingStored.take(token);
+    foreach (uint handle, handles) {
+        ContactPtr contact = lookupContactByHandle(handle);
+        if (contact && contact->avatarToken() == token) {
+            contact->receiveAvatarData(avatar);
+        }
     }
 }
 
@@ -1438,6 +1687,14 @@ void ContactManager::doRefreshInfo()
     op->refreshInfo();
 }
 
+void ContactManager::doRequestAttributes()
+{
+    PendingCoalescedAttributes *op = mPriv->coalescedAttributesOp;
+    Q_ASSERT(op);
+    mPriv->coalescedAttributesOp = 0;
+    op->requestAttributes();
+}
+
 ContactPtr ContactManager::ensureContact(const ReferencedHandles &handle,
         const Features &features, const QVariantMap &attributes)
 {
@@ -1474,6 +1731,20 @@ ContactPtr ContactManager::ensureContact(uint bareHandle, const QString &id,
     return contact;
 }
 
+ContactManager::PendingCoalescedAttributes *ContactManager::requestContactAttributes(
+        const UIntList &handles, const QStringList &interfaces)
+{
+    // Requests made in the same main loop iteration (e.g. by several channels looking at the same
+    // members) are merged into a single GetContactAttributes call
+    if (!mPriv->coalescedAttributesOp) {
+        mPriv->coalescedAttributesOp = new PendingCoalescedAttributes(connection());
+        QTimer::singleShot(0, this, SLOT(doRequestAttributes()));
+    }
+
+    mPriv->coalescedAttributesOp->addRequest(handles, interfaces);
+    return mPriv->coalescedAttributesOp;
+}
+
 QString ContactManager::featureToInterface(const Feature &feature)
 {
     if (feature == Contact::FeatureAlias) {
@@ -125,6 +125,13 @@ public:
     PendingContacts *upgradeContacts(const QList<ContactPtr> &contacts,
             const Features &features);
 
+    uint contactAttributesChunkSize() const;
+    uint maxContactAttributesChunksInFlight() const;
+    void setContactAttributesChunking(uint chunkSize, uint maxChunksInFlight = 2);
+
+    qint64 avatarCacheSizeLimit() const;
+    void setAvatarCacheSizeLimit(qint64 maxBytes);
+
     void requestContactAvatars(const QList<ContactPtr> &contacts);
 
     PendingOperation *refreshContactInfo(const QList<ContactPtr> &contact);
@@ -152,18 +159,23 @@ private Q_SLOTS:
     TP_QT_NO_EXPORT void doRequestAvatars();
     TP_QT_NO_EXPORT void onAvatarUpdated(uint, const QString &);
     TP_QT_NO_EXPORT void onAvatarRetrieved(uint, const QString &, const QByteArray &, const QString &);
+    TP_QT_NO_EXPORT void onAvatarStored(const QString &, const Tp::AvatarData &);
     TP_QT_NO_EXPORT void onPresencesChanged(const Tp::SimpleContactPresences &);
     TP_QT_NO_EXPORT void onCapabilitiesChanged(const Tp::ContactCapabilitiesMap &);
     TP_QT_NO_EXPORT void onLocationUpdated(uint, const QVariantMap &);
     TP_QT_NO_EXPORT void onContactInfoChanged(uint, const Tp::ContactInfoFieldList &);
     TP_QT_NO_EXPORT void onClientTypesUpdated(uint, const QStringList &);
     TP_QT_NO_EXPORT void doRefreshInfo();
+    TP_QT_NO_EXPORT void doRequestAttributes();
 
 private:
+    class PendingCoalescedAttributes;
     class PendingRefreshContactInfo;
     class Roster;
     friend class Channel;
     friend class Connection;
+    friend class Contact;
+    friend class PendingCoalescedAttributes;
     friend class PendingContacts;
     friend class PendingRefreshContactInfo;
     friend class Roster;
@@ -187,6 +199,14 @@ private:
 
     TP_QT_NO_EXPORT PendingOperation *refreshContactInfo(Contact *contact);
 
+    TP_QT_NO_EXPORT ContactCapabilities defaultCapabilities();
+    TP_QT_NO_EXPORT ContactCapabilities internCapabilities(const RequestableChannelClassList &rccs,
+            RequestableChannelClassList *internedRccs);
+    TP_QT_NO_EXPORT void releaseCapabilities(const RequestableChannelClassList &internedRccs);
+
+    TP_QT_NO_EXPORT PendingCoalescedAttributes *requestContactAttributes(const UIntList &handles,
+            const QStringList &interfaces);
+
     struct Private;
     friend struct Private;
     Private *mPriv;
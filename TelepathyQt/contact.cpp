@@ -25,6 +25,7 @@
 #include "TelepathyQt/_gen/contact.moc.hpp"
 
 #include "TelepathyQt/debug-internal.h"
+#include "TelepathyQt/feature-internal.h"
 #include "TelepathyQt/future-internal.h"
 
 #include <TelepathyQt/AvatarData>
@@ -43,6 +44,103 @@
 namespace Tp
 {
 
+namespace
+{
+
+// Contact attributes understood by Contact::augment(), in the same order as attributeKeys()
+enum AttributeKey
+{
+    AttributeContactId,
+    AttributeSubscribe,
+    AttributePublish,
+    AttributePublishRequest,
+    AttributeAlias,
+    AttributeAvatarToken,
+    AttributeCapabilities,
+    AttributeInfo,
+    AttributeLocation,
+    AttributePresence,
+    AttributeGroups,
+    AttributeAddresses,
+    AttributeUris,
+    AttributeClientTypes,
+    NumAttributeKeys
+};
+
+const QString *attributeKeys()
+{
+    const static QString keys[NumAttributeKeys] = {
+        TP_QT_IFACE_CONNECTION + QLatin1String("/contact-id"),
+        TP_QT_IFACE_CONNECTION_INTERFACE_CONTACT_LIST + QLatin1String("/subscribe"),
+        TP_QT_IFACE_CONNECTION_INTERFACE_CONTACT_LIST + QLatin1String("/publish"),
+        TP_QT_IFACE_CONNECTION_INTERFACE_CONTACT_LIST + QLatin1String("/publish-request"),
+        TP_QT_IFACE_CONNECTION_INTERFACE_ALIASING + QLatin1String("/alias"),
+        TP_QT_IFACE_CONNECTION_INTERFACE_AVATARS + QLatin1String("/token"),
+        TP_QT_IFACE_CONNECTION_INTERFACE_CONTACT_CAPABILITIES + QLatin1String("/capabilities"),
+        TP_QT_IFACE_CONNECTION_INTERFACE_CONTACT_INFO + QLatin1String("/info"),
+        TP_QT_IFACE_CONNECTION_INTERFACE_LOCATION + QLatin1String("/location"),
+        TP_QT_IFACE_CONNECTION_INTERFACE_SIMPLE_PRESENCE + QLatin1String("/presence"),
+        TP_QT_IFACE_CONNECTION_INTERFACE_CONTACT_GROUPS + QLatin1String("/groups"),
+        TP_QT_IFACE_CONNECTION_INTERFACE_ADDRESSING + QLatin1String("/addresses"),
+        TP_QT_IFACE_CONNECTION_INTERFACE_ADDRESSING + QLatin1String("/uris"),
+        TP_QT_IFACE_CONNECTION_INTERFACE_CLIENT_TYPES + QLatin1String("/client-types")
+    };
+    return keys;
+}
+
+QHash<QString, int> buildAttributeKeyIndex()
+{
+    QHash<QString, int> ret;
+    const QString *keys = attributeKeys();
+    for (int i = 0; i < NumAttributeKeys; ++i) {
+        ret.insert(keys[i], i);
+    }
+    return ret;
+}
+
+int attributeKeyIndex(const QString &key)
+{
+    const static QHash<QString, int> index = buildAttributeKeyIndex();
+    return index.value(key, -1);
+}
+
+// Holds pointers into an attribute map, so each attribute can be looked up by AttributeKey
+// without building its qualified name again
+class AttributeValues
+{
+public:
+    AttributeValues(const QVariantMap &attributes)
+    {
+        for (int i = 0; i < NumAttributeKeys; ++i) {
+            mValues[i] = 0;
+        }
+
+        for (QVariantMap::const_iterator i = attributes.constBegin();
+                i != attributes.constEnd(); ++i) {
+            int key = attributeKeyIndex(i.key());
+            if (key >= 0) {
+                mValues[key] = &i.value();
+            }
+        }
+    }
+
+    bool contains(AttributeKey key) const
+    {
+        return mValues[key] != 0;
+    }
+
+    template<typename T>
+    T value(AttributeKey key) const
+    {
+        return mValues[key] ? qdbus_cast<T>(*mValues[key]) : T();
+    }
+
+private:
+    const QVariant *mValues[NumAttributeKeys];
+};
+
+}
+
 struct TP_QT_NO_EXPORT Contact::Private
 {
     Private(Contact *parent, ContactManager *manager,
@@ -50,51 +148,98 @@ struct TP_QT_NO_EXPORT Contact::Private
         : parent(parent),
           manager(ContactManagerPtr(manager)),
           handle(handle),
-          caps(manager->supportedFeatures().contains(Contact::FeatureCapabilities) ?
-                   ContactCapabilities(true) :  ContactCapabilities(
-                           manager->connection()->capabilities().allClassSpecs(), false)),
-          isContactInfoKnown(false), isAvatarTokenKnown(false),
+          caps(manager->defaultCapabilities()),
+          isAvatarTokenKnown(false),
           subscriptionState(SubscriptionStateUnknown),
           publishState(SubscriptionStateUnknown),
-          blocked(false)
+          blocked(false),
+          capsInterned(false),
+          extra(0)
+    {
+    }
+
+    ~Private()
     {
+        delete extra;
     }
 
+    struct ExtraData;
+
     void updateAvatarData();
 
+    const ExtraData &extraData() const;
+    ExtraData &ensureExtraData();
+
     Contact *parent;
 
     WeakPtr<ContactManager> manager;
     ReferencedHandles handle;
     QString id;
 
-    Features requestedFeatures;
-    Features actualFeatures;
+    FeatureBits requestedFeatures;
+    FeatureBits actualFeatures;
 
     QString alias;
-    QMap<QString, QString> vcardAddresses;
-    QStringList uris;
     Presence presence;
     ContactCapabilities caps;
+
+    bool isAvatarTokenKnown;
+    QString avatarToken;
+
+    SubscriptionState subscriptionState;
+    SubscriptionState publishState;
+    bool blocked;
+
+    // The bare classes caps was interned for, to release it from the manager when done
+    RequestableChannelClassList capsRccs;
+    bool capsInterned;
+
+    // Most contacts in a large roster never have any of the rarely used fields set, so they are
+    // only allocated when first written to
+    ExtraData *extra;
+};
+
+struct TP_QT_NO_EXPORT Contact::Private::ExtraData
+{
+    ExtraData()
+        : isContactInfoKnown(false)
+    {
+    }
+
+    QMap<QString, QString> vcardAddresses;
+    QStringList uris;
     LocationInfo location;
 
     bool isContactInfoKnown;
     InfoFields info;
 
-    bool isAvatarTokenKnown;
-    QString avatarToken;
     AvatarData avatarData;
 
-    SubscriptionState subscriptionState;
-    SubscriptionState publishState;
     QString publishStateMessage;
-    bool blocked;
 
     QSet<QString> groups;
 
     QStringList clientTypes;
 };
 
+const Contact::Private::ExtraData &Contact::Private::extraData() const
+{
+    if (extra) {
+        return *extra;
+    }
+
+    const static ExtraData empty;
+    return empty;
+}
+
+Contact::Private::ExtraData &Contact::Private::ensureExtraData()
+{
+    if (!extra) {
+        extra = new ExtraData;
+    }
+    return *extra;
+}
+
 void Contact::Private::updateAvatarData()
 {
     /* If token is NULL, it means that CM doesn't know the token. In that case we
@@ -108,8 +253,10 @@ void Contact::Private::updateAvatarData()
     /* If token is empty (""), it means the contact has no avatar. */
     if (avatarToken.isEmpty()) {
         debug() << "Contact" << parent->id() << "has no avatar";
-        avatarData = AvatarData();
-        emit parent->avatarDataChanged(avatarData);
+        if (extra) {
+            extra->avatarData = AvatarData();
+        }
+        emit parent->avatarDataChanged(AvatarData());
         return;
     }
 
@@ -321,9 +468,8 @@ Contact::Contact(ContactManager *manager, const ReferencedHandles &handle,
     : Object(),
       mPriv(new Private(this, manager, handle))
 {
-    mPriv->requestedFeatures.unite(requestedFeatures);
-    mPriv->id = qdbus_cast<QString>(attributes[
-            TP_QT_IFACE_CONNECTION + QLatin1String("/contact-id")]);
+    mPriv->requestedFeatures |= FeatureBits(requestedFeatures);
+    mPriv->id = qdbus_cast<QString>(attributes.value(attributeKeys()[AttributeContactId]));
 }
 
 /**
@@ -332,6 +478,14 @@ Contact::Contact(ContactManager *manager, const ReferencedHandles &handle,
 Contact::~Contact()
 {
     debug() << "Contact" << id() << "destroyed";
+
+    if (mPriv->capsInterned) {
+        ContactManagerPtr contactManager(mPriv->manager);
+        if (contactManager) {
+            contactManager->releaseCapabilities(mPriv->capsRccs);
+        }
+    }
+
     delete mPriv;
 }
 
@@ -371,6 +525,11 @@ QString Contact::id() const
  * \return The requested features as a set of Feature objects.
  */
 Features Contact::requestedFeatures() const
+{
+    return mPriv->requestedFeatures.toFeatures();
+}
+
+const FeatureBits &Contact::requestedFeatureBits() const
 {
     return mPriv->requestedFeatures;
 }
@@ -382,7 +541,7 @@ Features Contact::requestedFeatures() const
  */
 Features Contact::actualFeatures() const
 {
-    return mPriv->actualFeatures;
+    return mPriv->actualFeatures.toFeatures();
 }
 
 /**
@@ -415,7 +574,7 @@ QString Contact::alias() const
  */
 QMap<QString, QString> Contact::vcardAddresses() const
 {
-    return mPriv->vcardAddresses;
+    return mPriv->extraData().vcardAddresses;
 }
 
 /**
@@ -428,7 +587,7 @@ QMap<QString, QString> Contact::vcardAddresses() const
  */
 QStringList Contact::uris() const
 {
-    return mPriv->uris;
+    return mPriv->extraData().uris;
 }
 
 /**
@@ -493,7 +652,7 @@ AvatarData Contact::avatarData() const
         return AvatarData();
     }
 
-    return mPriv->avatarData;
+    return mPriv->extraData().avatarData;
 }
 
 /**
@@ -588,7 +747,7 @@ LocationInfo Contact::location() const
         return LocationInfo();
     }
 
-    return mPriv->location;
+    return mPriv->extraData().location;
 }
 
 /**
@@ -611,7 +770,7 @@ bool Contact::isContactInfoKnown() const
         return false;
     }
 
-    return mPriv->isContactInfoKnown;
+    return mPriv->extraData().isContactInfoKnown;
 }
 
 /**
@@ -635,7 +794,7 @@ Contact::InfoFields Contact::infoFields() const
         return InfoFields();
     }
 
-    return mPriv->info;
+    return mPriv->extraData().info;
 }
 
 /**
@@ -757,7 +916,7 @@ Contact::PresenceState Contact::publishState() const
  */
 QString Contact::publishStateMessage() const
 {
-    return mPriv->publishStateMessage;
+    return mPriv->extraData().publishStateMessage;
 }
 
 /**
@@ -891,7 +1050,7 @@ PendingOperation *Contact::unblock()
  */
 QStringList Contact::groups() const
 {
-    return mPriv->groups.toList();
+    return mPriv->extraData().groups.toList();
 }
 
 /**
@@ -953,7 +1112,7 @@ QStringList Contact::clientTypes() const
         return QStringList();
     }
 
-    return mPriv->clientTypes;
+    return mPriv->extraData().clientTypes;
 }
 
 /**
@@ -987,24 +1146,21 @@ PendingStringList *Contact::requestClientTypes()
 
 void Contact::augment(const Features &requestedFeatures, const QVariantMap &attributes)
 {
-    mPriv->requestedFeatures.unite(requestedFeatures);
+    mPriv->requestedFeatures |= FeatureBits(requestedFeatures);
+
+    // Walk the attributes once instead of looking up each qualified name per feature
+    AttributeValues values(attributes);
 
-    mPriv->id = qdbus_cast<QString>(attributes[
-            TP_QT_IFACE_CONNECTION + QLatin1String("/contact-id")]);
+    mPriv->id = values.value<QString>(AttributeContactId);
 
-    if (attributes.contains(TP_QT_IFACE_CONNECTION_INTERFACE_CONTACT_LIST +
-                QLatin1String("/subscribe"))) {
-        uint subscriptionState = qdbus_cast<uint>(attributes.value(
-                     TP_QT_IFACE_CONNECTION_INTERFACE_CONTACT_LIST + QLatin1String("/subscribe")));
+    if (values.contains(AttributeSubscribe)) {
+        uint subscriptionState = values.value<uint>(AttributeSubscribe);
         setSubscriptionState((SubscriptionState) subscriptionState);
     }
 
-    if (attributes.contains(TP_QT_IFACE_CONNECTION_INTERFACE_CONTACT_LIST +
-                QLatin1String("/publish"))) {
-        uint publishState = qdbus_cast<uint>(attributes.value(
-                    TP_QT_IFACE_CONNECTION_INTERFACE_CONTACT_LIST + QLatin1String("/publish")));
-        QString publishRequest = qdbus_cast<QString>(attributes.value(
-                    TP_QT_IFACE_CONNECTION_INTERFACE_CONTACT_LIST + QLatin1String("/publish-request")));
+    if (values.contains(AttributePublish)) {
+        uint publishState = values.value<uint>(AttributePublish);
+        QString publishRequest = values.value<QString>(AttributePublishRequest);
         setPublishState((SubscriptionState) publishState, publishRequest);
     }
 
@@ -1016,8 +1172,7 @@ void Contact::augment(const Features &requestedFeatures, const QVariantMap &attr
         ContactInfoFieldList maybeInfo;
 
         if (feature == FeatureAlias) {
-            maybeAlias = qdbus_cast<QString>(attributes.value(
-                        TP_QT_IFACE_CONNECTION_INTERFACE_ALIASING + QLatin1String("/alias")));
+            maybeAlias = values.value<QString>(AttributeAlias);
 
             if (!maybeAlias.isEmpty()) {
                 receiveAlias(maybeAlias);
@@ -1030,10 +1185,8 @@ void Contact::augment(const Features &requestedFeatures, const QVariantMap &attr
                 mPriv->updateAvatarData();
             }
         } else if (feature == FeatureAvatarToken) {
-            if (attributes.contains(
-                        TP_QT_IFACE_CONNECTION_INTERFACE_AVATARS + QLatin1String("/token"))) {
-                receiveAvatarToken(qdbus_cast<QString>(attributes.value(
-                                TP_QT_IFACE_CONNECTION_INTERFACE_AVATARS + QLatin1String("/token"))));
+            if (values.contains(AttributeAvatarToken)) {
+                receiveAvatarToken(values.value<QString>(AttributeAvatarToken));
             } else {
                 if (manager()->supportedFeatures().contains(FeatureAvatarToken)) {
                     // AvatarToken being supported but not included in the mapping indicates
@@ -1045,8 +1198,7 @@ void Contact::augment(const Features &requestedFeatures, const QVariantMap &attr
                 mPriv->avatarToken = QLatin1String("");
             }
         } else if (feature == FeatureCapabilities) {
-            maybeCaps = qdbus_cast<RequestableChannelClassList>(attributes.value(
-                        TP_QT_IFACE_CONNECTION_INTERFACE_CONTACT_CAPABILITIES + QLatin1String("/capabilities")));
+            maybeCaps = values.value<RequestableChannelClassList>(AttributeCapabilities);
 
             if (!maybeCaps.isEmpty()) {
                 receiveCapabilities(maybeCaps);
@@ -1060,8 +1212,7 @@ void Contact::augment(const Features &requestedFeatures, const QVariantMap &attr
                 }
             }
         } else if (feature == FeatureInfo) {
-            maybeInfo = qdbus_cast<ContactInfoFieldList>(attributes.value(
-                        TP_QT_IFACE_CONNECTION_INTERFACE_CONTACT_INFO + QLatin1String("/info")));
+            maybeInfo = values.value<ContactInfoFieldList>(AttributeInfo);
 
             if (!maybeInfo.isEmpty()) {
                 receiveInfo(maybeInfo);
@@ -1075,8 +1226,7 @@ void Contact::augment(const Features &requestedFeatures, const QVariantMap &attr
                 }
             }
         } else if (feature == FeatureLocation) {
-            maybeLocation = qdbus_cast<QVariantMap>(attributes.value(
-                        TP_QT_IFACE_CONNECTION_INTERFACE_LOCATION + QLatin1String("/location")));
+            maybeLocation = values.value<QVariantMap>(AttributeLocation);
 
             if (!maybeLocation.isEmpty()) {
                 receiveLocation(maybeLocation);
@@ -1090,8 +1240,7 @@ void Contact::augment(const Features &requestedFeatures, const QVariantMap &attr
                 }
             }
         } else if (feature == FeatureSimplePresence) {
-            maybePresence = qdbus_cast<SimplePresence>(attributes.value(
-                        TP_QT_IFACE_CONNECTION_INTERFACE_SIMPLE_PRESENCE + QLatin1String("/presence")));
+            maybePresence = values.value<SimplePresence>(AttributePresence);
 
             if (!maybePresence.status.isEmpty()) {
                 receiveSimplePresence(maybePresence);
@@ -1100,18 +1249,16 @@ void Contact::augment(const Features &requestedFeatures, const QVariantMap &attr
                         QLatin1String("unknown"), QLatin1String(""));
             }
         } else if (feature == FeatureRosterGroups) {
-            QStringList groups = qdbus_cast<QStringList>(attributes.value(
-                        TP_QT_IFACE_CONNECTION_INTERFACE_CONTACT_GROUPS + QLatin1String("/groups")));
-            mPriv->groups = groups.toSet();
+            QStringList groups = values.value<QStringList>(AttributeGroups);
+            if (!groups.isEmpty() || mPriv->extra) {
+                mPriv->ensureExtraData().groups = groups.toSet();
+            }
         } else if (feature == FeatureAddresses) {
-            VCardFieldAddressMap addresses = qdbus_cast<VCardFieldAddressMap>(attributes.value(
-                        TP_QT_IFACE_CONNECTION_INTERFACE_ADDRESSING + QLatin1String("/addresses")));
-            QStringList uris = qdbus_cast<QStringList>(attributes.value(
-                        TP_QT_IFACE_CONNECTION_INTERFACE_ADDRESSING + QLatin1String("/uris")));
+            VCardFieldAddressMap addresses = values.value<VCardFieldAddressMap>(AttributeAddresses);
+            QStringList uris = values.value<QStringList>(AttributeUris);
             receiveAddresses(addresses, uris);
         } else if (feature == FeatureClientTypes) {
-            QStringList maybeClientTypes = qdbus_cast<QStringList>(attributes.value(
-                        TP_QT_IFACE_CONNECTION_INTERFACE_CLIENT_TYPES + QLatin1String("/client-types")));
+            QStringList maybeClientTypes = values.value<QStringList>(AttributeClientTypes);
 
             if (!maybeClientTypes.isEmpty()) {
                 receiveClientTypes(maybeClientTypes);
@@ -1170,9 +1317,9 @@ void Contact::setAvatarToken(const QString &token)
 
 void Contact::receiveAvatarData(const AvatarData &avatar)
 {
-    if (mPriv->avatarData.fileName != avatar.fileName) {
-        mPriv->avatarData = avatar;
-        emit avatarDataChanged(mPriv->avatarData);
+    if (mPriv->extraData().avatarData.fileName != avatar.fileName) {
+        mPriv->ensureExtraData().avatarData = avatar;
+        emit avatarDataChanged(avatar);
     }
 }
 
@@ -1199,8 +1346,20 @@ void Contact::receiveCapabilities(const RequestableChannelClassList &caps)
 
     mPriv->actualFeatures.insert(FeatureCapabilities);
 
-    if (mPriv->caps.allClassSpecs().bareClasses() != caps) {
-        mPriv->caps.updateRequestableChannelClasses(caps);
+    // Contacts with the same capabilities share a single object, so comparing the spec lists is
+    // usually just comparing pointers
+    ContactManagerPtr contactManager = manager();
+    RequestableChannelClassList newCapsRccs;
+    ContactCapabilities newCaps = contactManager->internCapabilities(caps, &newCapsRccs);
+    if (mPriv->capsInterned) {
+        contactManager->releaseCapabilities(mPriv->capsRccs);
+    }
+    mPriv->capsRccs = newCapsRccs;
+    mPriv->capsInterned = true;
+
+    bool changed = mPriv->caps.allClassSpecs() != newCaps.allClassSpecs();
+    mPriv->caps = newCaps;
+    if (changed) {
         emit capabilitiesChanged(mPriv->caps);
     }
 }
@@ -1213,9 +1372,10 @@ void Contact::receiveLocation(const QVariantMap &location)
 
     mPriv->actualFeatures.insert(FeatureLocation);
 
-    if (mPriv->location.allDetails() != location) {
-        mPriv->location.updateData(location);
-        emit locationUpdated(mPriv->location);
+    if (mPriv->extraData().location.allDetails() != location) {
+        Private::ExtraData &extra = mPriv->ensureExtraData();
+        extra.location.updateData(location);
+        emit locationUpdated(extra.location);
     }
 }
 
@@ -1226,11 +1386,12 @@ void Contact::receiveInfo(const ContactInfoFieldList &info)
     }
 
     mPriv->actualFeatures.insert(FeatureInfo);
-    mPriv->isContactInfoKnown = true;
+    Private::ExtraData &extra = mPriv->ensureExtraData();
+    extra.isContactInfoKnown = true;
 
-    if (mPriv->info.allFields() != info) {
-        mPriv->info = InfoFields(info);
-        emit infoFieldsChanged(mPriv->info);
+    if (extra.info.allFields() != info) {
+        extra.info = InfoFields(info);
+        emit infoFieldsChanged(extra.info);
     }
 }
 
@@ -1242,8 +1403,11 @@ void Contact::receiveAddresses(const QMap<QString, QString> &addresses,
     }
 
     mPriv->actualFeatures.insert(FeatureAddresses);
-    mPriv->vcardAddresses = addresses;
-    mPriv->uris = uris;
+    if (!addresses.isEmpty() || !uris.isEmpty() || mPriv->extra) {
+        Private::ExtraData &extra = mPriv->ensureExtraData();
+        extra.vcardAddresses = addresses;
+        extra.uris = uris;
+    }
 }
 
 void Contact::receiveClientTypes(const QStringList &clientTypes)
@@ -1254,9 +1418,9 @@ void Contact::receiveClientTypes(const QStringList &clientTypes)
 
     mPriv->actualFeatures.insert(FeatureClientTypes);
 
-    if (mPriv->clientTypes != clientTypes) {
-        mPriv->clientTypes = clientTypes;
-        emit clientTypesChanged(mPriv->clientTypes);
+    if (mPriv->extraData().clientTypes != clientTypes) {
+        mPriv->ensureExtraData().clientTypes = clientTypes;
+        emit clientTypesChanged(clientTypes);
     }
 }
 
@@ -1285,12 +1449,14 @@ void Contact::setSubscriptionState(SubscriptionState state)
 
 void Contact::setPublishState(SubscriptionState state, const QString &message)
 {
-    if (mPriv->publishState == state && mPriv->publishStateMessage == message) {
+    if (mPriv->publishState == state && mPriv->extraData().publishStateMessage == message) {
         return;
     }
 
     mPriv->publishState = state;
-    mPriv->publishStateMessage = message;
+    if (!message.isEmpty() || mPriv->extra) {
+        mPriv->ensureExtraData().publishStateMessage = message;
+    }
 
     emit publishStateChanged(subscriptionStateToPresenceState(state), message);
 }
@@ -1308,15 +1474,15 @@ void Contact::setBlocked(bool value)
 
 void Contact::setAddedToGroup(const QString &group)
 {
-    if (!mPriv->groups.contains(group)) {
-        mPriv->groups.insert(group);
+    if (!mPriv->extraData().groups.contains(group)) {
+        mPriv->ensureExtraData().groups.insert(group);
         emit addedToGroup(group);
     }
 }
 
 void Contact::setRemovedFromGroup(const QString &group)
 {
-    if (mPriv->groups.remove(group)) {
+    if (mPriv->extra && mPriv->extra->groups.remove(group)) {
         emit removedFromGroup(group);
     }
 }
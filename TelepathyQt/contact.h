@@ -233,6 +233,8 @@ private:
     TP_QT_NO_EXPORT void setAddedToGroup(const QString &group);
     TP_QT_NO_EXPORT void setRemovedFromGroup(const QString &group);
 
+    TP_QT_NO_EXPORT const FeatureBits &requestedFeatureBits() const;
+
     struct Private;
     friend class Connection;
     friend class ContactFactory;
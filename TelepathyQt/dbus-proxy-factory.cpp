@@ -110,7 +110,14 @@ DBusProxyPtr DBusProxyFactory::cachedProxy(const QString &busName,
         const QString &objectPath) const
 {
     QString finalName = finalBusNameFrom(busName);
-    return mPriv->cache->get(Cache::Key(finalName, objectPath));
+    DBusProxyPtr proxy = mPriv->cache->get(Cache::Key(finalName, objectPath));
+    if (proxy.isNull() && finalName != busName) {
+        // With StatefulDBusProxy::asyncUniqueNameResolution(), proxies constructed before the
+        // owner of their well-known name was known keep that name, and are cached by it. They are
+        // invalidated if the owner changes, so one still valid is for the current owner.
+        proxy = mPriv->cache->get(Cache::Key(busName, objectPath));
+    }
+    return proxy;
 }
 
 /**
@@ -0,0 +1,82 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _TelepathyQt_dbus_proxy_internal_h_HEADER_GUARD_
+#define _TelepathyQt_dbus_proxy_internal_h_HEADER_GUARD_
+
+#ifndef BUILDING_TP_QT
+#error "This file is a TpQt internal header not to be included by applications"
+#endif
+
+#include <QDBusConnection>
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QString>
+
+class QDBusPendingCallWatcher;
+class QDBusServiceWatcher;
+
+namespace Tp
+{
+
+// Maps well-known names to their current unique name owner, for a single bus. Names are watched
+// before their owner is asked for, so entries are kept up to date from NameOwnerChanged and can be
+// used in place of GetNameOwner round trips.
+class TP_QT_NO_EXPORT DBusNameOwnerCache : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(DBusNameOwnerCache)
+
+public:
+    static DBusNameOwnerCache *forBus(const QDBusConnection &bus);
+
+    ~DBusNameOwnerCache();
+
+    QString owner(const QString &name) const { return mOwners.value(name); }
+
+    bool isResolving(const QString &name) const { return mResolving.contains(name); }
+    void resolve(const QString &name);
+
+Q_SIGNALS:
+    void resolved(const QString &name, const QString &owner,
+            const QString &errorName, const QString &errorMessage);
+
+private Q_SLOTS:
+    void onServiceOwnerChanged(const QString &name, const QString &oldOwner,
+            const QString &newOwner);
+    void onGetNameOwnerFinished(QDBusPendingCallWatcher *watcher);
+
+private:
+    DBusNameOwnerCache(const QDBusConnection &bus);
+
+    void watch(const QString &name);
+    void abortResolving();
+
+    QDBusConnection mBus;
+    QDBusServiceWatcher *mWatcher;
+    QHash<QString, QString> mOwners;
+    QSet<QString> mResolving;
+};
+
+} // Tp
+
+#endif
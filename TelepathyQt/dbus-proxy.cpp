@@ -23,22 +23,442 @@
 #include "config.h"
 
 #include <TelepathyQt/DBusProxy>
+#include "TelepathyQt/dbus-proxy-internal.h"
 
 #include "TelepathyQt/_gen/dbus-proxy.moc.hpp"
+#include "TelepathyQt/_gen/dbus-proxy-internal.moc.hpp"
 
 #include "TelepathyQt/debug-internal.h"
 
 #include <TelepathyQt/Constants>
+#include <TelepathyQt/Types>
 
+#include <QDateTime>
 #include <QDBusConnection>
 #include <QDBusConnectionInterface>
 #include <QDBusError>
+#include <QDBusMessage>
+#include <QDBusObjectPath>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
 #include <QDBusServiceWatcher>
+#include <QDBusVariant>
+#include <QHash>
+#include <QTime>
 #include <QTimer>
 
 namespace Tp
 {
 
+namespace
+{
+
+QHash<QString, DBusNameOwnerCache *> nameOwnerCaches;
+
+bool resolveUniqueNamesAsync = false;
+
+bool profileByDefault = false;
+
+// There is no way to get at the marshalled size of a message, so add up what the arguments we know
+// about will take on the wire; anything else is counted as empty
+int estimatedSize(const QVariant &value)
+{
+    switch (value.type()) {
+        case QVariant::Bool:
+        case QVariant::Int:
+        case QVariant::UInt:
+            return 4;
+        case QVariant::LongLong:
+        case QVariant::ULongLong:
+        case QVariant::Double:
+            return 8;
+        case QVariant::String:
+            return value.toString().toUtf8().size() + 5;
+        case QVariant::ByteArray:
+            return value.toByteArray().size() + 4;
+        case QVariant::StringList: {
+            int ret = 4;
+            foreach (const QString &s, value.toStringList()) {
+                ret += s.toUtf8().size() + 5;
+            }
+            return ret;
+        }
+        case QVariant::List: {
+            int ret = 4;
+            foreach (const QVariant &v, value.toList()) {
+                ret += estimatedSize(v);
+            }
+            return ret;
+        }
+        case QVariant::Map: {
+            int ret = 4;
+            QVariantMap map = value.toMap();
+            for (QVariantMap::const_iterator i = map.constBegin(); i != map.constEnd(); ++i) {
+                ret += i.key().toUtf8().size() + 5 + estimatedSize(i.value());
+            }
+            return ret;
+        }
+        default:
+            break;
+    }
+
+    int type = value.userType();
+    if (type == qMetaTypeId<QDBusVariant>()) {
+        return estimatedSize(qvariant_cast<QDBusVariant>(value).variant()) + 3;
+    } else if (type == qMetaTypeId<QDBusObjectPath>()) {
+        return qvariant_cast<QDBusObjectPath>(value).path().size() + 5;
+    } else if (type == qMetaTypeId<UIntList>()) {
+        return 4 + 4 * qvariant_cast<UIntList>(value).size();
+    }
+    return 0;
+}
+
+QString jsonString(const QString &value)
+{
+    QString ret;
+    ret.reserve(value.size() + 2);
+    ret += QLatin1Char('"');
+    for (int i = 0; i < value.size(); ++i) {
+        QChar c = value.at(i);
+        if (c == QLatin1Char('"') || c == QLatin1Char('\\')) {
+            ret += QLatin1Char('\\');
+            ret += c;
+        } else if (c.unicode() < 0x20) {
+            ret += QString(QLatin1String("\\u%1")).arg(c.unicode(), 4, 16, QLatin1Char('0'));
+        } else {
+            ret += c;
+        }
+    }
+    ret += QLatin1Char('"');
+    return ret;
+}
+
+}
+
+// ==== DBusProxyTimeline ==============================================
+
+struct TP_QT_NO_EXPORT DBusProxyTimeline::Private : public QSharedData
+{
+    Private(const QString &busName, const QString &objectPath)
+        : busName(busName),
+          objectPath(objectPath),
+          startTime(QDateTime::currentDateTime())
+    {
+        clock.start();
+    }
+
+    QString className;
+    QString busName;
+    QString objectPath;
+    QDateTime startTime;
+    QTime clock;
+
+    QList<Call> calls;
+    QList<Introspection> introspections;
+    // Index in introspections of those which haven't finished yet
+    QHash<Feature, int> runningIntrospections;
+};
+
+/**
+ * \class DBusProxyTimeline
+ * \ingroup clientproxies
+ * \headerfile TelepathyQt/dbus-proxy.h <TelepathyQt/DBusProxyTimeline>
+ *
+ * \brief The DBusProxyTimeline class records the D-Bus calls made by a DBusProxy and the
+ * introspection of its features.
+ *
+ * It is meant to find out what the time it takes for proxies to become ready is spent on. Recording
+ * is enabled with DBusProxy::setProfilingEnabled() or DBusProxy::setProfilingEnabledByDefault(),
+ * and what was recorded so far is then returned by DBusProxy::timeline().
+ *
+ * All times are in milliseconds since startTime().
+ */
+
+/**
+ * \struct DBusProxyTimeline::Call
+ * \ingroup clientproxies
+ * \headerfile TelepathyQt/dbus-proxy.h <TelepathyQt/DBusProxyTimeline>
+ *
+ * \brief The DBusProxyTimeline::Call struct represents a D-Bus method call made through one of
+ * the interfaces of a proxy.
+ *
+ * \c requestSize is an estimate of the size of the arguments, in bytes. \c latency is the time
+ * until the reply or error was received, or -1 if neither has been yet. \c errorName is empty
+ * unless the call failed.
+ */
+
+/**
+ * \struct DBusProxyTimeline::Introspection
+ * \ingroup clientproxies
+ * \headerfile TelepathyQt/dbus-proxy.h <TelepathyQt/DBusProxyTimeline>
+ *
+ * \brief The DBusProxyTimeline::Introspection struct represents the introspection of a feature of a
+ * proxy.
+ *
+ * \c finishTime is -1 while the introspection is still running.
+ */
+
+/**
+ * Construct a new invalid DBusProxyTimeline object.
+ */
+DBusProxyTimeline::DBusProxyTimeline()
+{
+}
+
+DBusProxyTimeline::DBusProxyTimeline(const DBusProxyTimeline &other)
+    : mPriv(other.mPriv)
+{
+}
+
+/**
+ * Class destructor.
+ */
+DBusProxyTimeline::~DBusProxyTimeline()
+{
+}
+
+DBusProxyTimeline &DBusProxyTimeline::operator=(const DBusProxyTimeline &other)
+{
+    this->mPriv = other.mPriv;
+    return *this;
+}
+
+/**
+ * Return the name of the class of the proxy, e.g. "Tp::Connection".
+ *
+ * \return The class name.
+ */
+QString DBusProxyTimeline::className() const
+{
+    return isValid() ? mPriv->className : QString();
+}
+
+/**
+ * Return the bus name of the proxy.
+ *
+ * \return The bus name.
+ * \sa DBusProxy::busName()
+ */
+QString DBusProxyTimeline::busName() const
+{
+    return isValid() ? mPriv->busName : QString();
+}
+
+/**
+ * Return the object path of the proxy.
+ *
+ * \return The object path.
+ * \sa DBusProxy::objectPath()
+ */
+QString DBusProxyTimeline::objectPath() const
+{
+    return isValid() ? mPriv->objectPath : QString();
+}
+
+/**
+ * Return when recording started, which all other times are relative to.
+ *
+ * \return The start time.
+ */
+QDateTime DBusProxyTimeline::startTime() const
+{
+    return isValid() ? mPriv->startTime : QDateTime();
+}
+
+/**
+ * Return the recorded D-Bus method calls, in the order they were made.
+ *
+ * \return A list of calls.
+ */
+QList<DBusProxyTimeline::Call> DBusProxyTimeline::calls() const
+{
+    return isValid() ? mPriv->calls : QList<Call>();
+}
+
+/**
+ * Return the recorded feature introspections, in the order they were started.
+ *
+ * \return A list of introspections.
+ */
+QList<DBusProxyTimeline::Introspection> DBusProxyTimeline::introspections() const
+{
+    return isValid() ? mPriv->introspections : QList<Introspection>();
+}
+
+/**
+ * Return this timeline as a JSON object, e.g. to be written to a log file.
+ *
+ * The object has the \c "class", \c "busName", \c "objectPath" and \c "startTime" (in ISO 8601
+ * format) members, and \c "calls" and \c "introspections" arrays with a member for each field
+ * of Call and Introspection. Features are represented by their \c "featureClass" and
+ * \c "featureId".
+ *
+ * \return The UTF-8 encoded JSON object, or an empty byte array if this timeline is invalid.
+ */
+QByteArray DBusProxyTimeline::toJson() const
+{
+    if (!isValid()) {
+        return QByteArray();
+    }
+
+    QString json;
+    json += QLatin1String("{\"class\":") + jsonString(mPriv->className);
+    json += QLatin1String(",\"busName\":") + jsonString(mPriv->busName);
+    json += QLatin1String(",\"objectPath\":") + jsonString(mPriv->objectPath);
+    json += QLatin1String(",\"startTime\":") +
+        jsonString(mPriv->startTime.toString(Qt::ISODate));
+
+    json += QLatin1String(",\"calls\":[");
+    for (int i = 0; i < mPriv->calls.size(); ++i) {
+        const Call &call = mPriv->calls.at(i);
+        if (i > 0) {
+            json += QLatin1Char(',');
+        }
+        json += QString(QLatin1String(
+                    "{\"interface\":%1,\"member\":%2,\"requestSize\":%3,"
+                    "\"startTime\":%4,\"latency\":%5,\"errorName\":%6}"))
+            .arg(jsonString(call.interface))
+            .arg(jsonString(call.member))
+            .arg(call.requestSize)
+            .arg(call.startTime)
+            .arg(call.latency)
+            .arg(jsonString(call.errorName));
+    }
+
+    json += QLatin1String("],\"introspections\":[");
+    for (int i = 0; i < mPriv->introspections.size(); ++i) {
+        const Introspection &introspection = mPriv->introspections.at(i);
+        if (i > 0) {
+            json += QLatin1Char(',');
+        }
+        json += QString(QLatin1String(
+                    "{\"featureClass\":%1,\"featureId\":%2,\"startTime\":%3,"
+                    "\"finishTime\":%4,\"success\":%5}"))
+            .arg(jsonString(introspection.feature.first))
+            .arg(introspection.feature.second)
+            .arg(introspection.startTime)
+            .arg(introspection.finishTime)
+            .arg(introspection.success ? QLatin1String("true") : QLatin1String("false"));
+    }
+    json += QLatin1String("]}");
+
+    return json.toUtf8();
+}
+
+// ==== DBusNameOwnerCache =============================================
+
+DBusNameOwnerCache *DBusNameOwnerCache::forBus(const QDBusConnection &bus)
+{
+    DBusNameOwnerCache *cache = nameOwnerCaches.value(bus.name());
+    if (cache && cache->mBus.baseService() != bus.baseService()) {
+        // The bus was disconnected and a new connection made under the same name, so none of the
+        // owners we know about can be trusted anymore
+        cache->abortResolving();
+        delete cache;
+        cache = 0;
+    }
+
+    if (!cache) {
+        cache = new DBusNameOwnerCache(bus);
+        nameOwnerCaches.insert(bus.name(), cache);
+    }
+    return cache;
+}
+
+DBusNameOwnerCache::DBusNameOwnerCache(const QDBusConnection &bus)
+    : QObject(),
+      mBus(bus),
+      mWatcher(new QDBusServiceWatcher(this))
+{
+    mWatcher->setConnection(bus);
+    mWatcher->setWatchMode(QDBusServiceWatcher::WatchForOwnerChange);
+    connect(mWatcher,
+            SIGNAL(serviceOwnerChanged(QString,QString,QString)),
+            SLOT(onServiceOwnerChanged(QString,QString,QString)));
+}
+
+DBusNameOwnerCache::~DBusNameOwnerCache()
+{
+    if (nameOwnerCaches.value(mBus.name()) == this) {
+        nameOwnerCaches.remove(mBus.name());
+    }
+}
+
+void DBusNameOwnerCache::resolve(const QString &name)
+{
+    if (mResolving.contains(name)) {
+        // Everyone interested will be told when the call in flight finishes
+        return;
+    }
+
+    // Start watching before asking, so that any owner change happening after the bus daemon
+    // answers us is also seen
+    watch(name);
+    mResolving.insert(name);
+
+    QDBusPendingCall call = mBus.interface()->asyncCall(QLatin1String("GetNameOwner"), name);
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(call, this);
+    watcher->setProperty("name", name);
+    connect(watcher,
+            SIGNAL(finished(QDBusPendingCallWatcher*)),
+            SLOT(onGetNameOwnerFinished(QDBusPendingCallWatcher*)));
+}
+
+void DBusNameOwnerCache::onServiceOwnerChanged(const QString &name, const QString &oldOwner,
+        const QString &newOwner)
+{
+    Q_UNUSED(oldOwner);
+
+    if (newOwner.isEmpty()) {
+        mOwners.remove(name);
+        if (!mResolving.contains(name)) {
+            // Well-known names of services that went away are rarely reused, stop watching them
+            mWatcher->removeWatchedService(name);
+        }
+    } else {
+        mOwners.insert(name, newOwner);
+    }
+}
+
+void DBusNameOwnerCache::onGetNameOwnerFinished(QDBusPendingCallWatcher *watcher)
+{
+    QString name = watcher->property("name").toString();
+    QDBusPendingReply<QString> reply = *watcher;
+
+    mResolving.remove(name);
+
+    // The bus daemon sends the reply and NameOwnerChanged in order, so the reply is the most
+    // recent information we have
+    if (reply.isError()) {
+        mOwners.remove(name);
+        mWatcher->removeWatchedService(name);
+        emit resolved(name, QString(), reply.error().name(), reply.error().message());
+    } else {
+        mOwners.insert(name, reply.value());
+        emit resolved(name, reply.value(), QString(), QString());
+    }
+
+    watcher->deleteLater();
+}
+
+void DBusNameOwnerCache::abortResolving()
+{
+    // The bus these lookups were made on went away, and the proxies waiting for them with it
+    QSet<QString> names = mResolving;
+    mResolving.clear();
+    foreach (const QString &name, names) {
+        emit resolved(name, QString(), TP_QT_ERROR_DISCONNECTED,
+                QLatin1String("DBus connection disconnected"));
+    }
+}
+
+void DBusNameOwnerCache::watch(const QString &name)
+{
+    if (!mWatcher->watchedServices().contains(name)) {
+        mWatcher->addWatchedService(name);
+    }
+}
+
 // ==== DBusProxy ======================================================
 
 // Features in TpProxy but not here:
@@ -59,13 +479,18 @@ struct TP_QT_NO_EXPORT DBusProxy::Private
     QString objectPath;
     QString invalidationReason;
     QString invalidationMessage;
+
+    bool profiling;
+    // Never shared, as timeline() hands out copies of it, so recording into it doesn't detach
+    DBusProxyTimeline timeline;
 };
 
 DBusProxy::Private::Private(const QDBusConnection &dbusConnection,
             const QString &busName, const QString &objectPath)
     : dbusConnection(dbusConnection),
       busName(busName),
-      objectPath(objectPath)
+      objectPath(objectPath),
+      profiling(false)
 {
     debug() << "Creating new DBusProxy";
 }
@@ -96,6 +521,10 @@ DBusProxy::DBusProxy(const QDBusConnection &dbusConnection,
       ReadyObject(this, featureCore),
       mPriv(new Private(dbusConnection, busName, objectPath))
 {
+    if (profileByDefault) {
+        setProfilingEnabled(true);
+    }
+
     if (!dbusConnection.isConnected()) {
         invalidate(TP_QT_ERROR_DISCONNECTED,
                 QLatin1String("DBus connection disconnected"));
@@ -230,6 +659,158 @@ void DBusProxy::emitInvalidated()
     emit invalidated(this, mPriv->invalidationReason, mPriv->invalidationMessage);
 }
 
+/**
+ * Return whether the D-Bus calls made by this proxy and the introspection of its features are being
+ * recorded.
+ *
+ * \return \c true if profiling is enabled, \c false otherwise.
+ * \sa setProfilingEnabled(), timeline()
+ */
+bool DBusProxy::isProfilingEnabled() const
+{
+    return mPriv->profiling;
+}
+
+/**
+ * Set whether the D-Bus calls made by this proxy and the introspection of its features are
+ * recorded.
+ *
+ * Only the calls made through interfaces constructed with this proxy are recorded. Disabling
+ * profiling keeps what has been recorded so far, and enabling it again carries on with the same
+ * timeline.
+ *
+ * \param enabled Whether to enable profiling.
+ * \sa timeline(), setProfilingEnabledByDefault()
+ */
+void DBusProxy::setProfilingEnabled(bool enabled)
+{
+    mPriv->profiling = enabled;
+    if (enabled && !mPriv->timeline.isValid()) {
+        mPriv->timeline.mPriv = new DBusProxyTimeline::Private(mPriv->busName, mPriv->objectPath);
+    }
+}
+
+/**
+ * Return what has been recorded while profiling was enabled.
+ *
+ * The returned timeline is a snapshot: calls and introspections which are still running have no
+ * latency or finish time in it, and what happens afterwards is only in timelines returned later.
+ *
+ * \return The timeline of this proxy, which is invalid if profiling was never enabled.
+ * \sa setProfilingEnabled()
+ */
+DBusProxyTimeline DBusProxy::timeline() const
+{
+    DBusProxyTimeline ret;
+    if (mPriv->timeline.isValid()) {
+        ret.mPriv = new DBusProxyTimeline::Private(*mPriv->timeline.mPriv.constData());
+        // Only now is the most derived class known, and the bus name might have changed
+        ret.mPriv->className = QLatin1String(metaObject()->className());
+        ret.mPriv->busName = mPriv->busName;
+    }
+    return ret;
+}
+
+/**
+ * Return whether profiling is enabled for new proxies.
+ *
+ * \return \c true if new proxies record their timeline, \c false otherwise.
+ * \sa setProfilingEnabledByDefault()
+ */
+bool DBusProxy::isProfilingEnabledByDefault()
+{
+    return profileByDefault;
+}
+
+/**
+ * Set whether profiling is enabled for proxies constructed from now on, which makes it possible
+ * to profile proxies which are constructed by factories and made ready straight away.
+ *
+ * \param enabled Whether to enable profiling for new proxies.
+ * \sa setProfilingEnabled()
+ */
+void DBusProxy::setProfilingEnabledByDefault(bool enabled)
+{
+    profileByDefault = enabled;
+}
+
+void DBusProxy::profileCall(const QDBusMessage &message, const QDBusPendingCall &call)
+{
+    Q_ASSERT(mPriv->profiling);
+
+    DBusProxyTimeline::Call record;
+    record.interface = message.interface();
+    record.member = message.member();
+    record.requestSize = 0;
+    foreach (const QVariant &argument, message.arguments()) {
+        record.requestSize += estimatedSize(argument);
+    }
+    record.startTime = mPriv->timeline.mPriv->clock.elapsed();
+    record.latency = -1;
+
+    mPriv->timeline.mPriv->calls.append(record);
+
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(call, this);
+    watcher->setProperty("callIndex", mPriv->timeline.mPriv->calls.size() - 1);
+    connect(watcher,
+            SIGNAL(finished(QDBusPendingCallWatcher*)),
+            SLOT(onProfiledCallFinished(QDBusPendingCallWatcher*)));
+}
+
+void DBusProxy::onProfiledCallFinished(QDBusPendingCallWatcher *watcher)
+{
+    DBusProxyTimeline::Private *timeline = mPriv->timeline.mPriv.data();
+    int index = watcher->property("callIndex").toInt();
+
+    DBusProxyTimeline::Call &record = timeline->calls[index];
+    record.latency = timeline->clock.elapsed() - record.startTime;
+    if (watcher->isError()) {
+        record.errorName = watcher->error().name();
+    }
+
+    watcher->deleteLater();
+}
+
+void DBusProxy::profileIntrospectionStarted(const Feature &feature)
+{
+    Q_ASSERT(mPriv->profiling);
+
+    DBusProxyTimeline::Private *timeline = mPriv->timeline.mPriv.data();
+
+    DBusProxyTimeline::Introspection record;
+    record.feature = feature;
+    record.startTime = timeline->clock.elapsed();
+    record.finishTime = -1;
+    record.success = false;
+
+    timeline->runningIntrospections.insert(feature, timeline->introspections.size());
+    timeline->introspections.append(record);
+}
+
+void DBusProxy::profileIntrospectionFinished(const Feature &feature, bool success)
+{
+    Q_ASSERT(mPriv->profiling);
+
+    DBusProxyTimeline::Private *timeline = mPriv->timeline.mPriv.data();
+    int now = timeline->clock.elapsed();
+
+    int index;
+    if (timeline->runningIntrospections.contains(feature)) {
+        index = timeline->runningIntrospections.take(feature);
+    } else {
+        // Started before profiling was enabled
+        DBusProxyTimeline::Introspection record;
+        record.feature = feature;
+        record.startTime = now;
+        index = timeline->introspections.size();
+        timeline->introspections.append(record);
+    }
+
+    DBusProxyTimeline::Introspection &record = timeline->introspections[index];
+    record.finishTime = now;
+    record.success = success;
+}
+
 /**
  * \fn void DBusProxy::invalidated(Tp::DBusProxy *proxy,
  *          const QString &errorName, const QString &errorMessage)
@@ -250,9 +831,13 @@ void DBusProxy::emitInvalidated()
 struct TP_QT_NO_EXPORT StatefulDBusProxy::Private
 {
     Private(const QString &originalName)
-        : originalName(originalName) {}
+        : originalName(originalName),
+          resolvingUniqueName(false) {}
 
     QString originalName;
+    bool resolvingUniqueName;
+    // Only set when resolved after construction, in which case busName() stays the well-known name
+    QString resolvedUniqueName;
 };
 
 /**
@@ -267,6 +852,10 @@ struct TP_QT_NO_EXPORT StatefulDBusProxy::Private
  * crashes, so they emit invalidated() if this happens.
  *
  * Examples include the Connection and Channel classes.
+ *
+ * When constructed with a well-known name, the proxy binds to the unique name currently owning it.
+ * By default that is looked up with a blocking call in the constructor; see
+ * setAsyncUniqueNameResolution() for how to avoid that.
  */
 
 /**
@@ -288,6 +877,26 @@ StatefulDBusProxy::StatefulDBusProxy(const QDBusConnection &dbusConnection,
             SIGNAL(serviceOwnerChanged(QString,QString,QString)),
             SLOT(onServiceOwnerChanged(QString,QString,QString)));
 
+    if (resolveUniqueNamesAsync && !busName.startsWith(QLatin1String(":"))) {
+        DBusNameOwnerCache *cache = DBusNameOwnerCache::forBus(dbusConnection);
+        QString uniqueName = cache->owner(busName);
+        if (!uniqueName.isEmpty()) {
+            setBusName(uniqueName);
+            return;
+        }
+
+        // Keep using the well-known name, which the interfaces of subclasses will be built with
+        // before we know better, and be invalidated if the owner we resolve it to goes away or is
+        // replaced
+        serviceWatcher->setWatchMode(QDBusServiceWatcher::WatchForOwnerChange);
+        mPriv->resolvingUniqueName = true;
+        connect(cache,
+                SIGNAL(resolved(QString,QString,QString,QString)),
+                SLOT(onUniqueNameResolved(QString,QString,QString,QString)));
+        cache->resolve(busName);
+        return;
+    }
+
     QString error, message;
     QString uniqueName = uniqueNameFrom(dbusConnection, busName, error, message);
 
@@ -307,6 +916,59 @@ StatefulDBusProxy::~StatefulDBusProxy()
     delete mPriv;
 }
 
+/**
+ * Return whether StatefulDBusProxy objects constructed with a well-known name resolve it to a unique
+ * name asynchronously.
+ *
+ * \return \c true if unique names are resolved asynchronously, \c false otherwise.
+ * \sa setAsyncUniqueNameResolution()
+ */
+bool StatefulDBusProxy::asyncUniqueNameResolution()
+{
+    return resolveUniqueNamesAsync;
+}
+
+/**
+ * Set whether StatefulDBusProxy objects constructed with a well-known name resolve it to a unique
+ * name asynchronously.
+ *
+ * By default, the constructor makes a blocking GetNameOwner call to the bus daemon. When this is
+ * enabled, owners are remembered per bus and kept up to date as names change owner, so only the
+ * first proxy for a given well-known name needs to ask the bus daemon, and it does so without
+ * blocking.
+ *
+ * Such a proxy talks to the service through the well-known name, and busName() returns it, as its
+ * interfaces are built before the owner is known. isUniqueNameResolved() starts returning \c true
+ * once the owner is known. If the name turns out to have no owner, or later changes owner, the
+ * proxy is invalidated. Proxies constructed once the owner is known bind to the unique name as
+ * usual.
+ *
+ * This only affects proxies constructed afterwards. The static uniqueNameFrom() methods, which
+ * the factories use to look up cached proxies, then don't block either: until the owner is known,
+ * they start looking it up and return the well-known name itself, which is what the proxies
+ * constructed meanwhile are known by.
+ *
+ * \param enabled Whether to resolve unique names asynchronously.
+ * \sa asyncUniqueNameResolution()
+ */
+void StatefulDBusProxy::setAsyncUniqueNameResolution(bool enabled)
+{
+    resolveUniqueNamesAsync = enabled;
+}
+
+/**
+ * Return whether busName() is the unique name of the service providing the remote object.
+ *
+ * This is always \c true unless asyncUniqueNameResolution() was enabled when this proxy was
+ * constructed, and the owner of the well-known name it was given is still being looked up.
+ *
+ * \return \c true if the unique name is known, \c false otherwise.
+ */
+bool StatefulDBusProxy::isUniqueNameResolved() const
+{
+    return !mPriv->resolvingUniqueName;
+}
+
 QString StatefulDBusProxy::uniqueNameFrom(const QDBusConnection &bus, const QString &name)
 {
     QString error, message;
@@ -328,6 +990,19 @@ QString StatefulDBusProxy::uniqueNameFrom(const QDBusConnection &bus, const QStr
 
     // For a stateful interface, it makes no sense to follow name-owner
     // changes, so we want to bind to the unique name.
+    if (resolveUniqueNamesAsync) {
+        DBusNameOwnerCache *cache = DBusNameOwnerCache::forBus(bus);
+        QString owner = cache->owner(name);
+        if (!owner.isEmpty()) {
+            return owner;
+        }
+
+        // Proxies constructed meanwhile keep the well-known name, see the constructor, so that
+        // is what they are known by until the owner is
+        cache->resolve(name);
+        return name;
+    }
+
     QDBusReply<QString> reply = bus.interface()->serviceOwner(name);
     if (reply.isValid()) {
         return reply.value();
@@ -342,12 +1017,46 @@ void StatefulDBusProxy::onServiceOwnerChanged(const QString &name, const QString
 {
     // We only want to invalidate this object if it is not already invalidated,
     // and its (not any other object's) name owner changed signal is emitted.
-    if (isValid() && name == mPriv->originalName && newOwner.isEmpty()) {
+    if (!isValid() || name != mPriv->originalName) {
+        return;
+    }
+
+    if (newOwner.isEmpty()) {
         invalidate(TP_QT_DBUS_ERROR_NAME_HAS_NO_OWNER,
                 QLatin1String("Name owner lost (service crashed?)"));
+    } else if (!mPriv->resolvedUniqueName.isEmpty() && newOwner != mPriv->resolvedUniqueName) {
+        // Still talking through the well-known name, which now reaches another service
+        invalidate(TP_QT_DBUS_ERROR_NAME_HAS_NO_OWNER,
+                QLatin1String("Name owner replaced (service restarted?)"));
     }
 }
 
+void StatefulDBusProxy::onUniqueNameResolved(const QString &name, const QString &owner,
+        const QString &errorName, const QString &errorMessage)
+{
+    if (name != mPriv->originalName) {
+        return;
+    }
+
+    disconnect(sender(),
+            SIGNAL(resolved(QString,QString,QString,QString)),
+            this,
+            SLOT(onUniqueNameResolved(QString,QString,QString,QString)));
+    mPriv->resolvingUniqueName = false;
+
+    if (!isValid()) {
+        return;
+    }
+
+    if (owner.isEmpty()) {
+        invalidate(errorName, errorMessage);
+        return;
+    }
+
+    debug() << "Resolved" << name << "to" << owner;
+    mPriv->resolvedUniqueName = owner;
+}
+
 // ==== StatelessDBusProxy =============================================
 
 /**
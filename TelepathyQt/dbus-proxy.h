@@ -27,18 +27,77 @@
 #error IN_TP_QT_HEADER
 #endif
 
+#include <TelepathyQt/Feature>
 #include <TelepathyQt/Global>
 #include <TelepathyQt/Object>
 #include <TelepathyQt/ReadyObject>
 
+#include <QList>
+#include <QSharedDataPointer>
+#include <QString>
+
+class QByteArray;
+class QDateTime;
 class QDBusConnection;
 class QDBusError;
+class QDBusMessage;
+class QDBusPendingCall;
+class QDBusPendingCallWatcher;
 
 namespace Tp
 {
 
+class AbstractInterface;
+class ReadinessHelper;
 class TestBackdoors;
 
+class TP_QT_EXPORT DBusProxyTimeline
+{
+public:
+    struct Call
+    {
+        QString interface;
+        QString member;
+        int requestSize;
+        int startTime;
+        int latency;
+        QString errorName;
+    };
+
+    struct Introspection
+    {
+        Feature feature;
+        int startTime;
+        int finishTime;
+        bool success;
+    };
+
+    DBusProxyTimeline();
+    DBusProxyTimeline(const DBusProxyTimeline &other);
+    ~DBusProxyTimeline();
+
+    DBusProxyTimeline &operator=(const DBusProxyTimeline &other);
+
+    bool isValid() const { return mPriv.constData() != 0; }
+
+    QString className() const;
+    QString busName() const;
+    QString objectPath() const;
+    QDateTime startTime() const;
+
+    QList<Call> calls() const;
+    QList<Introspection> introspections() const;
+
+    QByteArray toJson() const;
+
+private:
+    friend class DBusProxy;
+
+    struct Private;
+    friend struct Private;
+    QSharedDataPointer<Private> mPriv;
+};
+
 class TP_QT_EXPORT DBusProxy : public Object, public ReadyObject
 {
     Q_OBJECT
@@ -57,6 +116,13 @@ public:
     QString invalidationReason() const;
     QString invalidationMessage() const;
 
+    bool isProfilingEnabled() const;
+    void setProfilingEnabled(bool enabled);
+    DBusProxyTimeline timeline() const;
+
+    static bool isProfilingEnabledByDefault();
+    static void setProfilingEnabledByDefault(bool enabled);
+
 Q_SIGNALS:
     void invalidated(Tp::DBusProxy *proxy,
             const QString &errorName, const QString &errorMessage);
@@ -68,10 +134,17 @@ protected:
 
 private Q_SLOTS:
     TP_QT_NO_EXPORT void emitInvalidated();
+    TP_QT_NO_EXPORT void onProfiledCallFinished(QDBusPendingCallWatcher *watcher);
 
 private:
+    friend class AbstractInterface;
+    friend class ReadinessHelper;
     friend class TestBackdoors;
 
+    TP_QT_NO_EXPORT void profileCall(const QDBusMessage &message, const QDBusPendingCall &call);
+    TP_QT_NO_EXPORT void profileIntrospectionStarted(const Feature &feature);
+    TP_QT_NO_EXPORT void profileIntrospectionFinished(const Feature &feature, bool success);
+
     struct Private;
     friend struct Private;
     Private *mPriv;
@@ -107,9 +180,16 @@ public:
     static QString uniqueNameFrom(const QDBusConnection &bus, const QString &wellKnownOrUnique,
             QString &error, QString &message);
 
+    static bool asyncUniqueNameResolution();
+    static void setAsyncUniqueNameResolution(bool enabled);
+
+    bool isUniqueNameResolved() const;
+
 private Q_SLOTS:
     TP_QT_NO_EXPORT void onServiceOwnerChanged(const QString &name, const QString &oldOwner,
             const QString &newOwner);
+    TP_QT_NO_EXPORT void onUniqueNameResolved(const QString &name, const QString &owner,
+            const QString &errorName, const QString &errorMessage);
 
 private:
     struct Private;
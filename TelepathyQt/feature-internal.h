@@ -0,0 +1,85 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _TelepathyQt_feature_internal_h_HEADER_GUARD_
+#define _TelepathyQt_feature_internal_h_HEADER_GUARD_
+
+#ifndef BUILDING_TP_QT
+#error "This file is a TpQt internal header not to be included by applications"
+#endif
+
+#include <TelepathyQt/Feature>
+
+#include <QList>
+#include <QVarLengthArray>
+
+namespace Tp
+{
+
+// A set of features, stored as a bitmap indexed by the process-wide index every valid Feature is
+// given when constructed. This makes set operations on features word-wise bit operations instead of
+// hashing and comparing class name strings. Invalid features can't be stored.
+class TP_QT_NO_EXPORT FeatureBits
+{
+public:
+    FeatureBits() { }
+    FeatureBits(const Feature &feature) { insert(feature); }
+    FeatureBits(const Features &features);
+
+    static int indexOf(const Feature &feature);
+
+    bool isEmpty() const;
+    int count() const;
+
+    bool contains(const Feature &feature) const;
+    // Whether every feature in other is also in this set
+    bool contains(const FeatureBits &other) const;
+    bool intersects(const FeatureBits &other) const;
+
+    void insert(const Feature &feature);
+    void remove(const Feature &feature);
+    void clear() { mWords.clear(); }
+
+    FeatureBits &operator|=(const FeatureBits &other);
+    FeatureBits &operator&=(const FeatureBits &other);
+    FeatureBits &operator-=(const FeatureBits &other);
+
+    FeatureBits operator|(const FeatureBits &other) const { return FeatureBits(*this) |= other; }
+    FeatureBits operator&(const FeatureBits &other) const { return FeatureBits(*this) &= other; }
+    FeatureBits operator-(const FeatureBits &other) const { return FeatureBits(*this) -= other; }
+
+    bool operator==(const FeatureBits &other) const;
+    bool operator!=(const FeatureBits &other) const { return !operator==(other); }
+
+    QList<Feature> toList() const;
+    Features toFeatures() const;
+
+private:
+    typedef quint64 Word;
+    enum { BitsPerWord = 64 };
+
+    // Most helpers only know about a few dozen features, which then fit without allocating
+    QVarLengthArray<Word, 2> mWords;
+};
+
+} // Tp
+
+#endif
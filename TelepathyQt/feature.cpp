@@ -21,17 +21,57 @@
  */
 
 #include <TelepathyQt/Feature>
+#include "TelepathyQt/feature-internal.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
 
 namespace Tp
 {
 
 struct TP_QT_NO_EXPORT Feature::Private : public QSharedData
 {
-    Private(bool critical) : critical(critical) {}
+    Private(bool critical, int index) : critical(critical), index(index) {}
 
     bool critical;
+    int index;
+};
+
+namespace
+{
+
+// Every distinct (class name, id) pair ever constructed gets the next free index. Features are
+// nearly always static objects, so this stays small and is only written to during startup.
+struct FeatureRegistry
+{
+    QMutex mutex;
+    QHash<QPair<QString, uint>, int> indices;
+    QList<Feature> features;
 };
 
+FeatureRegistry &featureRegistry()
+{
+    static FeatureRegistry registry;
+    return registry;
+}
+
+inline int lowestBitSet(quint64 word)
+{
+#if defined(Q_CC_GNU)
+    return __builtin_ctzll(word);
+#else
+    int ret = 0;
+    while (!(word & 1)) {
+        word >>= 1;
+        ++ret;
+    }
+    return ret;
+#endif
+}
+
+}
+
 /**
  * \class Feature
  * \ingroup utils
@@ -47,9 +87,26 @@ Feature::Feature()
 }
 
 Feature::Feature(const QString &className, uint id, bool critical)
-    : QPair<QString, uint>(className, id),
-      mPriv(new Private(critical))
+    : QPair<QString, uint>(className, id)
 {
+    FeatureRegistry &registry = featureRegistry();
+    QMutexLocker locker(&registry.mutex);
+
+    QHash<QPair<QString, uint>, int>::const_iterator i = registry.indices.constFind(*this);
+    if (i != registry.indices.constEnd()) {
+        const Feature &registered = registry.features.at(i.value());
+        if (registered.mPriv->critical == critical) {
+            mPriv = registered.mPriv;
+        } else {
+            mPriv = new Private(critical, i.value());
+        }
+        return;
+    }
+
+    int index = registry.features.size();
+    mPriv = new Private(critical, index);
+    registry.indices.insert(*this, index);
+    registry.features.append(*this);
 }
 
 Feature::Feature(const Feature &other)
@@ -64,7 +121,7 @@ Feature::~Feature()
 
 Feature &Feature::operator=(const Feature &other)
 {
-    *this = other;
+    QPair<QString, uint>::operator=(other);
     this->mPriv = other.mPriv;
     return *this;
 }
@@ -86,4 +143,166 @@ bool Feature::isCritical() const
  * \brief The Features class represents a list of Feature.
  */
 
+FeatureBits::FeatureBits(const Features &features)
+{
+    foreach (const Feature &feature, features) {
+        insert(feature);
+    }
+}
+
+int FeatureBits::indexOf(const Feature &feature)
+{
+    return feature.isValid() ? feature.mPriv->index : -1;
+}
+
+bool FeatureBits::isEmpty() const
+{
+    for (int i = 0; i < mWords.size(); ++i) {
+        if (mWords[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int FeatureBits::count() const
+{
+    int ret = 0;
+    for (int i = 0; i < mWords.size(); ++i) {
+        for (Word word = mWords[i]; word; word &= word - 1) {
+            ++ret;
+        }
+    }
+    return ret;
+}
+
+bool FeatureBits::contains(const Feature &feature) const
+{
+    int index = indexOf(feature);
+    if (index < 0 || index / BitsPerWord >= mWords.size()) {
+        return false;
+    }
+    return mWords[index / BitsPerWord] & (Word(1) << (index % BitsPerWord));
+}
+
+bool FeatureBits::contains(const FeatureBits &other) const
+{
+    for (int i = 0; i < other.mWords.size(); ++i) {
+        Word word = i < mWords.size() ? mWords[i] : 0;
+        if (other.mWords[i] & ~word) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FeatureBits::intersects(const FeatureBits &other) const
+{
+    int size = qMin(mWords.size(), other.mWords.size());
+    for (int i = 0; i < size; ++i) {
+        if (mWords[i] & other.mWords[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void FeatureBits::insert(const Feature &feature)
+{
+    int index = indexOf(feature);
+    if (index < 0) {
+        return;
+    }
+
+    int word = index / BitsPerWord;
+    if (word >= mWords.size()) {
+        int oldSize = mWords.size();
+        mWords.resize(word + 1);
+        for (int i = oldSize; i < mWords.size(); ++i) {
+            mWords[i] = 0;
+        }
+    }
+    mWords[word] |= Word(1) << (index % BitsPerWord);
+}
+
+void FeatureBits::remove(const Feature &feature)
+{
+    int index = indexOf(feature);
+    if (index < 0 || index / BitsPerWord >= mWords.size()) {
+        return;
+    }
+    mWords[index / BitsPerWord] &= ~(Word(1) << (index % BitsPerWord));
+}
+
+FeatureBits &FeatureBits::operator|=(const FeatureBits &other)
+{
+    if (other.mWords.size() > mWords.size()) {
+        int oldSize = mWords.size();
+        mWords.resize(other.mWords.size());
+        for (int i = oldSize; i < mWords.size(); ++i) {
+            mWords[i] = 0;
+        }
+    }
+    for (int i = 0; i < other.mWords.size(); ++i) {
+        mWords[i] |= other.mWords[i];
+    }
+    return *this;
+}
+
+FeatureBits &FeatureBits::operator&=(const FeatureBits &other)
+{
+    for (int i = 0; i < mWords.size(); ++i) {
+        mWords[i] &= i < other.mWords.size() ? other.mWords[i] : 0;
+    }
+    return *this;
+}
+
+FeatureBits &FeatureBits::operator-=(const FeatureBits &other)
+{
+    int size = qMin(mWords.size(), other.mWords.size());
+    for (int i = 0; i < size; ++i) {
+        mWords[i] &= ~other.mWords[i];
+    }
+    return *this;
+}
+
+bool FeatureBits::operator==(const FeatureBits &other) const
+{
+    int size = qMax(mWords.size(), other.mWords.size());
+    for (int i = 0; i < size; ++i) {
+        Word word = i < mWords.size() ? mWords[i] : 0;
+        Word otherWord = i < other.mWords.size() ? other.mWords[i] : 0;
+        if (word != otherWord) {
+            return false;
+        }
+    }
+    return true;
+}
+
+QList<Feature> FeatureBits::toList() const
+{
+    QList<Feature> ret;
+    if (isEmpty()) {
+        return ret;
+    }
+
+    FeatureRegistry &registry = featureRegistry();
+    QMutexLocker locker(&registry.mutex);
+    for (int i = 0; i < mWords.size(); ++i) {
+        for (Word word = mWords[i]; word; word &= word - 1) {
+            ret.append(registry.features.at(i * BitsPerWord + lowestBitSet(word)));
+        }
+    }
+    return ret;
+}
+
+Features FeatureBits::toFeatures() const
+{
+    Features ret;
+    foreach (const Feature &feature, toList()) {
+        ret.insert(feature);
+    }
+    return ret;
+}
+
 } // Tp
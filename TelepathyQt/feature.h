@@ -38,6 +38,8 @@
 namespace Tp
 {
 
+class FeatureBits;
+
 class TP_QT_EXPORT Feature : public QPair<QString, uint>
 {
 public:
@@ -53,6 +55,8 @@ public:
     bool isCritical() const;
 
 private:
+    friend class FeatureBits;
+
     struct Private;
     friend struct Private;
     QSharedDataPointer<Private> mPriv;
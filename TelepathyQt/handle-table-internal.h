@@ -0,0 +1,110 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _TelepathyQt_handle_table_internal_h_HEADER_GUARD_
+#define _TelepathyQt_handle_table_internal_h_HEADER_GUARD_
+
+#include <TelepathyQt/Global>
+#include <TelepathyQt/Types>
+
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <QList>
+
+namespace Tp
+{
+
+// Reference counts for the handles of one type, in an open-addressing table.
+//
+// Growing the table publishes a new index over the same entries, so tryRef() and tryUnref() can
+// find and update the count of a handle without any locking. Everything else, including the ref()
+// and unref() fallbacks, must be called with the lock of the owner held, which also serializes
+// them with each other.
+//
+// Entries left without references are dropped whenever the index is rebuilt, either to grow it
+// or by reclaim(). Their memory and the old indexes are only reused or freed by reclaim() when no
+// tryRef() or tryUnref() is running, as those may still be looking at them.
+class TP_QT_NO_EXPORT HandleTable
+{
+    Q_DISABLE_COPY(HandleTable)
+
+public:
+    HandleTable();
+    ~HandleTable();
+
+    // Add a reference to a handle which is already referenced; returns false if that isn't the
+    // case, and the caller must use ref() instead
+    bool tryRef(uint handle);
+    // Remove a reference to a handle which has others left; returns false if that isn't the case,
+    // and the caller must use unref() instead
+    bool tryUnref(uint handle);
+
+    void ref(uint handle);
+    // Returns true if that was the last reference to the handle
+    bool unref(uint handle);
+
+    bool isReferenced(uint handle) const;
+    UIntList referencedHandles() const;
+
+    // Drop the entries of handles which aren't referenced anymore, if there are enough of them
+    void reclaim();
+
+    uint size() const { return mSize; }
+    uint capacity() const;
+
+private:
+    struct Entry
+    {
+        uint handle;
+        QAtomicInt count;
+    };
+
+    struct Index
+    {
+        Index(uint size);
+        ~Index();
+
+        uint mask;
+        QAtomicPointer<Entry> *buckets;
+    };
+
+    Entry *find(uint handle) const;
+    Entry *insert(uint handle);
+    void grow();
+    void rebuild(uint size);
+    void freeRetired();
+
+    QAtomicPointer<Index> mIndex;
+    // Number of entries in the index, and how many of them have no references left
+    uint mSize;
+    uint mUnreferenced;
+    // Number of tryRef() and tryUnref() calls in progress
+    QAtomicInt mReaders;
+    QList<Index *> mRetiredIndexes;
+    QList<Entry *> mRetiredEntries;
+    QList<Entry *> mFreeEntries;
+    QList<Entry *> mChunks;
+    uint mChunkUsed;
+};
+
+} // Tp
+
+#endif
@@ -0,0 +1,309 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "TelepathyQt/handle-table-internal.h"
+
+#include <QtGlobal>
+
+namespace Tp
+{
+
+namespace
+{
+
+const uint initialIndexSize = 64;
+const uint chunkSize = 256;
+
+inline uint hashHandle(uint handle)
+{
+    // Handles are usually allocated sequentially, but spread them anyway in case a CM uses some
+    // bits of them for something else
+    handle ^= handle >> 16;
+    handle *= 0x45d9f3bu;
+    handle ^= handle >> 16;
+    return handle;
+}
+
+template <typename T>
+inline T *loadAcquire(const QAtomicPointer<T> &pointer)
+{
+    // Qt 4 has no load with acquire semantics, but adding nothing atomically does the same
+    return const_cast<QAtomicPointer<T> &>(pointer).fetchAndAddAcquire(0);
+}
+
+class ReaderGuard
+{
+public:
+    ReaderGuard(QAtomicInt &readers) : mReaders(readers) { mReaders.ref(); }
+    ~ReaderGuard() { mReaders.deref(); }
+
+private:
+    QAtomicInt &mReaders;
+};
+
+}
+
+HandleTable::Index::Index(uint size)
+    : mask(size - 1),
+      buckets(new QAtomicPointer<Entry>[size])
+{
+}
+
+HandleTable::Index::~Index()
+{
+    delete [] buckets;
+}
+
+HandleTable::HandleTable()
+    : mIndex(new Index(initialIndexSize)),
+      mSize(0),
+      mUnreferenced(0),
+      mReaders(0),
+      mChunkUsed(chunkSize)
+{
+}
+
+HandleTable::~HandleTable()
+{
+    delete loadAcquire(mIndex);
+    qDeleteAll(mRetiredIndexes);
+    foreach (Entry *chunk, mChunks) {
+        delete [] chunk;
+    }
+}
+
+bool HandleTable::tryRef(uint handle)
+{
+    // Announced before looking anything up, so reclaim() doesn't reuse what we may find
+    ReaderGuard guard(mReaders);
+
+    Entry *entry = find(handle);
+    if (!entry) {
+        return false;
+    }
+
+    // Only go up from a count which is already positive: reviving a handle which has lost its
+    // last reference must be serialized with the release sweep by the owner's lock
+    int count = entry->count.fetchAndAddOrdered(0);
+    while (count > 0) {
+        if (entry->count.testAndSetOrdered(count, count + 1)) {
+            return true;
+        }
+        count = entry->count.fetchAndAddOrdered(0);
+    }
+    return false;
+}
+
+bool HandleTable::tryUnref(uint handle)
+{
+    ReaderGuard guard(mReaders);
+
+    Entry *entry = find(handle);
+    if (!entry) {
+        return false;
+    }
+
+    int count = entry->count.fetchAndAddOrdered(0);
+    while (count > 1) {
+        if (entry->count.testAndSetOrdered(count, count - 1)) {
+            return true;
+        }
+        count = entry->count.fetchAndAddOrdered(0);
+    }
+    return false;
+}
+
+void HandleTable::ref(uint handle)
+{
+    Entry *entry = find(handle);
+    if (!entry) {
+        entry = insert(handle);
+    }
+
+    // Only we can make a count go up from or down to zero, so this can't race with tryRef()
+    if (entry->count.fetchAndAddOrdered(1) == 0) {
+        --mUnreferenced;
+    }
+}
+
+bool HandleTable::unref(uint handle)
+{
+    Entry *entry = find(handle);
+    Q_ASSERT(entry != 0);
+
+    // A lock-free tryRef() or tryUnref() may race with us, so this still needs to be a CAS loop
+    int count = entry->count.fetchAndAddOrdered(0);
+    forever {
+        Q_ASSERT(count > 0);
+        if (entry->count.testAndSetOrdered(count, count - 1)) {
+            break;
+        }
+        count = entry->count.fetchAndAddOrdered(0);
+    }
+
+    if (count == 1) {
+        ++mUnreferenced;
+        return true;
+    }
+    return false;
+}
+
+bool HandleTable::isReferenced(uint handle) const
+{
+    Entry *entry = find(handle);
+    return entry && entry->count.fetchAndAddOrdered(0) > 0;
+}
+
+UIntList HandleTable::referencedHandles() const
+{
+    UIntList ret;
+    Index *index = loadAcquire(mIndex);
+    for (uint i = 0; i <= index->mask; ++i) {
+        Entry *entry = loadAcquire(index->buckets[i]);
+        if (entry && entry->count.fetchAndAddOrdered(0) > 0) {
+            ret << entry->handle;
+        }
+    }
+    return ret;
+}
+
+void HandleTable::reclaim()
+{
+    // Rebuilding the index costs as much as walking it, so leave it alone while most of its
+    // entries are still in use. That still bounds it to a small multiple of the referenced handles.
+    if (mUnreferenced > 0 && mUnreferenced * 4 >= mSize) {
+        uint size = initialIndexSize;
+        while ((mSize - mUnreferenced + 1) * 2 > size) {
+            size *= 2;
+        }
+        rebuild(size);
+    }
+
+    freeRetired();
+}
+
+uint HandleTable::capacity() const
+{
+    return loadAcquire(mIndex)->mask + 1;
+}
+
+HandleTable::Entry *HandleTable::find(uint handle) const
+{
+    // The index is never more than half full, so there is always an empty bucket to stop at
+    Index *index = loadAcquire(mIndex);
+    for (uint i = hashHandle(handle) & index->mask; ; i = (i + 1) & index->mask) {
+        Entry *entry = loadAcquire(index->buckets[i]);
+        if (!entry) {
+            return 0;
+        }
+        if (entry->handle == handle) {
+            return entry;
+        }
+    }
+}
+
+HandleTable::Entry *HandleTable::insert(uint handle)
+{
+    if ((mSize + 1) * 2 > capacity()) {
+        grow();
+    }
+
+    // Entries are allocated in chunks, which are only freed with the table, and only reused once
+    // no lock-free lookup can still see them
+    Entry *entry;
+    if (!mFreeEntries.isEmpty()) {
+        entry = mFreeEntries.takeLast();
+    } else {
+        if (mChunkUsed == chunkSize) {
+            mChunks << new Entry[chunkSize];
+            mChunkUsed = 0;
+        }
+        entry = &mChunks.last()[mChunkUsed++];
+    }
+    entry->handle = handle;
+    Q_ASSERT(entry->count.fetchAndAddOrdered(0) == 0);
+    ++mUnreferenced;
+
+    Index *index = loadAcquire(mIndex);
+    uint i = hashHandle(handle) & index->mask;
+    while (loadAcquire(index->buckets[i])) {
+        i = (i + 1) & index->mask;
+    }
+    index->buckets[i].fetchAndStoreOrdered(entry);
+    ++mSize;
+    return entry;
+}
+
+void HandleTable::grow()
+{
+    rebuild(capacity() * 2);
+}
+
+void HandleTable::rebuild(uint size)
+{
+    // Entries without references are left out. Nothing but ref() can bring them back, and as that
+    // is serialized with us, they can be dropped safely.
+    Index *old = loadAcquire(mIndex);
+    Index *index = new Index(size);
+    for (uint i = 0; i <= old->mask; ++i) {
+        Entry *entry = loadAcquire(old->buckets[i]);
+        if (!entry) {
+            continue;
+        }
+
+        if (entry->count.fetchAndAddOrdered(0) == 0) {
+            mRetiredEntries << entry;
+            --mUnreferenced;
+            --mSize;
+            continue;
+        }
+
+        uint j = hashHandle(entry->handle) & index->mask;
+        while (loadAcquire(index->buckets[j])) {
+            j = (j + 1) & index->mask;
+        }
+        index->buckets[j].fetchAndStoreRelaxed(entry);
+    }
+
+    mIndex.fetchAndStoreOrdered(index);
+    mRetiredIndexes << old;
+}
+
+void HandleTable::freeRetired()
+{
+    if (mRetiredIndexes.isEmpty() && mRetiredEntries.isEmpty()) {
+        return;
+    }
+
+    // A lookup which started after the index was replaced can only find the new one, so once none
+    // are in progress nothing can be using the retired index or entries anymore. Otherwise, try
+    // again next time.
+    if (mReaders.fetchAndAddOrdered(0) != 0) {
+        return;
+    }
+
+    qDeleteAll(mRetiredIndexes);
+    mRetiredIndexes.clear();
+    mFreeEntries << mRetiredEntries;
+    mRetiredEntries.clear();
+}
+
+} // Tp
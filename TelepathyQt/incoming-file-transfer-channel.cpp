@@ -32,12 +32,31 @@
 #include <TelepathyQt/Types>
 #include <TelepathyQt/types-internal.h>
 
+#include <QFile>
 #include <QIODevice>
 #include <QTcpSocket>
+#include <QTime>
+
+#ifdef Q_OS_LINUX
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#endif
 
 namespace Tp
 {
 
+static const int FT_BLOCK_SIZE = 16 * 1024;
+// How much is read ahead from the socket; once this is buffered, the kernel socket buffer fills up
+// and TCP flow control slows the sender down
+static const qint64 FT_READ_BUFFER_SIZE = 256 * 1024;
+// Reading from the socket is paused while the output device has this much data pending
+static const qint64 FT_MAX_PENDING_WRITE_SIZE = 1024 * 1024;
+// When splicing, QTcpSocket only needs to read enough to tell us there is data
+static const qint64 FT_ZERO_COPY_READ_BUFFER_SIZE = 4 * 1024;
+static const int FT_ZERO_COPY_BLOCK_SIZE = 1024 * 1024;
+
 struct TP_QT_NO_EXPORT IncomingFileTransferChannel::Private
 {
     Private(IncomingFileTransferChannel *parent);
@@ -54,6 +73,19 @@ struct TP_QT_NO_EXPORT IncomingFileTransferChannel::Private
 
     qulonglong requestedOffset;
     qint64 pos;
+
+    bool socketClosed;
+    bool waitingForOutput;
+
+    // Set when output is a regular file written by splicing from the socket
+    bool zeroCopyChecked;
+    bool zeroCopy;
+    int pipeFds[2];
+
+    // Rate accounting
+    QTime rateTimer;
+    qint64 rateBytes;
+    qint64 transferRate;
 };
 
 IncomingFileTransferChannel::Private::Private(IncomingFileTransferChannel *parent)
@@ -62,8 +94,16 @@ IncomingFileTransferChannel::Private::Private(IncomingFileTransferChannel *paren
       output(0),
       socket(0),
       requestedOffset(0),
-      pos(0)
+      pos(0),
+      socketClosed(false),
+      waitingForOutput(false),
+      zeroCopyChecked(false),
+      zeroCopy(false),
+      rateBytes(0),
+      transferRate(0)
 {
+    pipeFds[0] = pipeFds[1] = -1;
+
     parent->connect(fileTransferInterface,
             SIGNAL(URIDefined(QString)),
             SLOT(onUriDefined(QString)));
@@ -74,6 +114,12 @@ IncomingFileTransferChannel::Private::Private(IncomingFileTransferChannel *paren
 
 IncomingFileTransferChannel::Private::~Private()
 {
+#ifdef Q_OS_LINUX
+    if (pipeFds[0] != -1) {
+        ::close(pipeFds[0]);
+        ::close(pipeFds[1]);
+    }
+#endif
 }
 
 /**
@@ -147,6 +193,42 @@ IncomingFileTransferChannel::~IncomingFileTransferChannel()
     delete mPriv;
 }
 
+/**
+ * Return the rate at which data has recently been written to the output device.
+ *
+ * This is measured locally, as opposed to FileTransferChannel::transferredBytes(),
+ * which is reported by the connection manager.
+ *
+ * \return The number of bytes written per second, averaged over about the last second.
+ * \sa bufferedBytes()
+ */
+qint64 IncomingFileTransferChannel::transferRate() const
+{
+    return mPriv->transferRate;
+}
+
+/**
+ * Return the number of bytes received but not yet written by the output device.
+ *
+ * This includes data read from the socket and pending in the output device, if it
+ * buffers writes. Reading from the socket is paused when the output device falls too far
+ * behind, so this stays bounded however slow the output device is.
+ *
+ * \return The number of buffered bytes.
+ * \sa transferRate()
+ */
+qint64 IncomingFileTransferChannel::bufferedBytes() const
+{
+    qint64 buffered = 0;
+    if (mPriv->socket && !isFinished()) {
+        buffered += mPriv->socket->bytesAvailable();
+    }
+    if (mPriv->output && mPriv->output->isOpen()) {
+        buffered += mPriv->output->bytesToWrite();
+    }
+    return buffered;
+}
+
 /**
  * Set the URI where the file will be saved.
  *
@@ -206,7 +288,12 @@ PendingOperation *IncomingFileTransferChannel::setUri(const QString& uri)
  *               #FileTransferStateCompleted.
  *               If the transfer is cancelled, state() becomes
  *               #FileTransferStateCancelled, the data in \a output should be
- *               ignored
+ *               ignored.
+ *               If it is a QFile backed by a file descriptor, on platforms
+ *               supporting it the data is moved from the socket to the file
+ *               by the kernel, without being copied through this process.
+ *               Otherwise, if it buffers writes, reading is paused while too
+ *               much data is waiting to be written.
  * \return A PendingOperation object which will emit PendingOperation::finished
  *         when the call has finished.
  * \sa FileTransferChannel::stateChanged(), FileTransferChannel::state(),
@@ -298,6 +385,7 @@ void IncomingFileTransferChannel::connectToHost()
     mPriv->pos = initialOffset();
 
     mPriv->socket = new QTcpSocket(this);
+    mPriv->socket->setReadBufferSize(FT_READ_BUFFER_SIZE);
 
     connect(mPriv->socket, SIGNAL(connected()),
             SLOT(onSocketConnected()));
@@ -318,38 +406,228 @@ void IncomingFileTransferChannel::onSocketConnected()
     debug() << "Connected to host";
     setConnected();
 
+    mPriv->rateTimer.start();
     doTransfer();
 }
 
 void IncomingFileTransferChannel::onSocketDisconnected()
 {
     debug() << "Disconnected from host";
-    setFinished();
+    mPriv->socketClosed = true;
+
+    // data may still be buffered if we were waiting for the output device
+    doTransfer();
+    if (!mPriv->waitingForOutput) {
+        setFinished();
+    }
 }
 
 void IncomingFileTransferChannel::onSocketError(QAbstractSocket::SocketError error)
 {
+    if (error == QAbstractSocket::RemoteHostClosedError) {
+        // handled by onSocketDisconnected, after the buffered data is written
+        return;
+    }
+
     setFinished();
 }
 
+void IncomingFileTransferChannel::onOutputBytesWritten()
+{
+    if (mPriv->output->bytesToWrite() >= FT_MAX_PENDING_WRITE_SIZE) {
+        return;
+    }
+
+    disconnect(mPriv->output, SIGNAL(bytesWritten(qint64)),
+               this, SLOT(onOutputBytesWritten()));
+    mPriv->waitingForOutput = false;
+
+    debug() << "Output device caught up, resuming transfer";
+    doTransfer();
+
+    if (mPriv->socketClosed && !mPriv->waitingForOutput) {
+        setFinished();
+    }
+}
+
 void IncomingFileTransferChannel::doTransfer()
 {
-    QByteArray data;
-    while (mPriv->socket->bytesAvailable()) {
-        data = mPriv->socket->readAll();
+    if (isFinished() || mPriv->waitingForOutput) {
+        return;
+    }
 
-        // skip until we reach requetedOffset and start writing from there
+    // read FT_BLOCK_SIZE each time, only as long as the output device keeps up
+    char buffer[FT_BLOCK_SIZE];
+    while (mPriv->socket->bytesAvailable() > 0) {
+        if (mPriv->output->bytesToWrite() >= FT_MAX_PENDING_WRITE_SIZE) {
+            // leave the data in the socket until there is room for it
+            debug() << "Output device is lagging behind, pausing transfer";
+            mPriv->waitingForOutput = true;
+            connect(mPriv->output, SIGNAL(bytesWritten(qint64)),
+                    SLOT(onOutputBytesWritten()));
+            return;
+        }
+
+        qint64 len = mPriv->socket->read(buffer, sizeof(buffer));
+        if (len <= 0) {
+            break;
+        }
+
+        // skip until we reach requestedOffset and start writing from there
+        qint64 skip = 0;
         if ((qulonglong) mPriv->pos < mPriv->requestedOffset) {
-            if ((qulonglong) data.length() <= (mPriv->requestedOffset - mPriv->pos)) {
-                break;
+            skip = (qint64) qMin(mPriv->requestedOffset - mPriv->pos, (qulonglong) len);
+        }
+
+        if (len > skip) {
+            mPriv->output->write(buffer + skip, len - skip); // never fails
+            updateTransferRate(len - skip);
+        }
+
+        mPriv->pos += len;
+    }
+
+    if (!mPriv->socketClosed && (qulonglong) mPriv->pos >= mPriv->requestedOffset) {
+        if (!mPriv->zeroCopyChecked) {
+            mPriv->zeroCopyChecked = true;
+            startZeroCopyTransfer();
+        }
+        if (mPriv->zeroCopy) {
+            doZeroCopyTransfer();
+        }
+    }
+}
+
+void IncomingFileTransferChannel::startZeroCopyTransfer()
+{
+#ifdef Q_OS_LINUX
+    QFile *file = qobject_cast<QFile *>(mPriv->output);
+    if (!file || file->handle() == -1 || mPriv->socket->socketDescriptor() == -1 ||
+        (mPriv->output->openMode() & QIODevice::Append)) {
+        return;
+    }
+
+    // splice() can only move data to or from a pipe, so the data goes through one in between
+    if (pipe(mPriv->pipeFds) == -1) {
+        warning() << "Unable to create pipe, not splicing:" << strerror(errno);
+        mPriv->pipeFds[0] = mPriv->pipeFds[1] = -1;
+        return;
+    }
+    fcntl(mPriv->pipeFds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(mPriv->pipeFds[1], F_SETFD, FD_CLOEXEC);
+    fcntl(mPriv->pipeFds[0], F_SETFL, O_NONBLOCK);
+    fcntl(mPriv->pipeFds[1], F_SETFL, O_NONBLOCK);
+
+    debug() << "Starting zero-copy transfer...";
+    mPriv->zeroCopy = true;
+    mPriv->socket->setReadBufferSize(FT_ZERO_COPY_READ_BUFFER_SIZE);
+#endif
+}
+
+void IncomingFileTransferChannel::stopZeroCopyTransfer()
+{
+#ifdef Q_OS_LINUX
+    if (mPriv->pipeFds[0] != -1) {
+        ::close(mPriv->pipeFds[0]);
+        ::close(mPriv->pipeFds[1]);
+        mPriv->pipeFds[0] = mPriv->pipeFds[1] = -1;
+    }
+#endif
+
+    if (mPriv->zeroCopy && mPriv->socket) {
+        mPriv->socket->setReadBufferSize(FT_READ_BUFFER_SIZE);
+    }
+    mPriv->zeroCopy = false;
+}
+
+void IncomingFileTransferChannel::doZeroCopyTransfer()
+{
+#ifdef Q_OS_LINUX
+    QFile *file = static_cast<QFile *>(mPriv->output);
+    int socketFd = mPriv->socket->socketDescriptor();
+    if (socketFd == -1) {
+        return;
+    }
+
+    // what QTcpSocket read itself was written above and must reach the file first
+    file->flush();
+    loff_t offset = file->pos();
+
+    while (true) {
+        ssize_t len = splice(socketFd, NULL, mPriv->pipeFds[1], NULL, FT_ZERO_COPY_BLOCK_SIZE,
+                SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (len == 0) {
+            // EOF, QTcpSocket will notice too
+            break;
+        } else if (len == -1) {
+            if (errno == EINVAL) {
+                // nothing was moved yet, so QTcpSocket can simply read it instead
+                debug() << "splice() not supported for the socket - falling back to buffered "
+                    "transfer";
+                stopZeroCopyTransfer();
+            } else if (errno != EAGAIN && errno != EINTR) {
+                // QTcpSocket will report socket errors
+                debug() << "Error splicing from socket:" << strerror(errno);
             }
-            data = data.mid(mPriv->requestedOffset - mPriv->pos);
+            break;
         }
 
-        mPriv->output->write(data); // never fails
+        mPriv->pos += len;
+        updateTransferRate(len);
+
+        // the pipe now holds data which can only go to the file
+        while (len > 0) {
+            ssize_t written = splice(mPriv->pipeFds[0], NULL, file->handle(), &offset,
+                    len, SPLICE_F_MOVE);
+            if (written == -1 && errno == EINTR) {
+                continue;
+            } else if (written == -1 && errno == EINVAL) {
+                // the file system doesn't support it, or the file is in append mode behind
+                // QFile's back: write what is left in the pipe ourselves and carry on copying
+                debug() << "splice() not supported for" << file->fileName() <<
+                    "- falling back to buffered transfer";
+                file->seek(offset);
+                char buffer[FT_BLOCK_SIZE];
+                while (len > 0) {
+                    ssize_t got = ::read(mPriv->pipeFds[0], buffer,
+                            qMin((ssize_t) sizeof(buffer), len));
+                    if (got == -1 && errno == EINTR) {
+                        continue;
+                    }
+                    if (got <= 0 || file->write(buffer, got) != got) {
+                        warning() << "Error writing to" << file->fileName();
+                        setFinished();
+                        return;
+                    }
+                    len -= got;
+                }
+                stopZeroCopyTransfer();
+                return;
+            } else if (written <= 0) {
+                warning() << "Error writing to" << file->fileName() << ":" << strerror(errno);
+                file->seek(offset);
+                setFinished();
+                return;
+            }
+            len -= written;
+        }
     }
 
-    mPriv->pos += data.length();
+    // keep QFile in sync, so anything written through it afterwards goes after the spliced data
+    file->seek(offset);
+#endif
+}
+
+void IncomingFileTransferChannel::updateTransferRate(qint64 written)
+{
+    mPriv->rateBytes += written;
+
+    int elapsed = mPriv->rateTimer.elapsed();
+    if (elapsed >= 1000) {
+        mPriv->transferRate = mPriv->rateBytes * 1000 / elapsed;
+        mPriv->rateBytes = 0;
+        mPriv->rateTimer.restart();
+    }
 }
 
 void IncomingFileTransferChannel::setFinished()
@@ -371,7 +649,16 @@ void IncomingFileTransferChannel::setFinished()
         mPriv->socket->close();
     }
 
+    stopZeroCopyTransfer();
+
+    if (mPriv->transferRate == 0 && mPriv->rateTimer.isValid()) {
+        // finished within the first second
+        mPriv->transferRate = mPriv->rateBytes * 1000 / qMax(mPriv->rateTimer.elapsed(), 1);
+    }
+
     if (mPriv->output) {
+        disconnect(mPriv->output, SIGNAL(bytesWritten(qint64)),
+                   this, SLOT(onOutputBytesWritten()));
         mPriv->output->close();
     }
 
@@ -50,6 +50,9 @@ public:
     PendingOperation *setUri(const QString& uri);
     PendingOperation *acceptFile(qulonglong offset, QIODevice *output);
 
+    qint64 transferRate() const;
+    qint64 bufferedBytes() const;
+
 Q_SIGNALS:
     void uriDefined(const QString &uri);
 
@@ -65,10 +68,15 @@ private Q_SLOTS:
     TP_QT_NO_EXPORT void onSocketConnected();
     TP_QT_NO_EXPORT void onSocketDisconnected();
     TP_QT_NO_EXPORT void onSocketError(QAbstractSocket::SocketError error);
+    TP_QT_NO_EXPORT void onOutputBytesWritten();
     TP_QT_NO_EXPORT void doTransfer();
 
 private:
     TP_QT_NO_EXPORT void connectToHost();
+    TP_QT_NO_EXPORT void startZeroCopyTransfer();
+    TP_QT_NO_EXPORT void stopZeroCopyTransfer();
+    TP_QT_NO_EXPORT void doZeroCopyTransfer();
+    TP_QT_NO_EXPORT void updateTransferRate(qint64 written);
     TP_QT_NO_EXPORT void setFinished();
 
     struct Private;
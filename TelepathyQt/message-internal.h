@@ -0,0 +1,73 @@
+/**
+ * This file is part of TelepathyQt
+ *
+ * @copyright Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ * @license LGPL 2.1
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _TelepathyQt_message_internal_h_HEADER_GUARD_
+#define _TelepathyQt_message_internal_h_HEADER_GUARD_
+
+#ifndef BUILDING_TP_QT
+#error "This file is a TpQt internal header not to be included by applications"
+#endif
+
+#include <TelepathyQt/Global>
+
+#include <QString>
+
+namespace Tp
+{
+
+// Well-known Message_Part keys. Building and decoding parts with these, rather than with
+// QLatin1String literals, doesn't allocate a new key string for every insertion and lookup, and
+// all parts built by us share the key data.
+struct TP_QT_NO_EXPORT MessagePartKeys
+{
+    // Header
+    static const QString messageSent;
+    static const QString messageReceived;
+    static const QString messageType;
+    static const QString messageSender;
+    static const QString messageSenderId;
+    static const QString senderNickname;
+    static const QString pendingMessageId;
+    static const QString messageToken;
+    static const QString supersedes;
+    static const QString scrollback;
+    static const QString rescued;
+    static const QString dbusInterface;
+    static const QString deliveryStatus;
+    static const QString deliveryToken;
+    static const QString deliveryError;
+    static const QString deliveryErrorMessage;
+    static const QString deliveryDBusError;
+    static const QString deliveryEcho;
+
+    // Body
+    static const QString contentType;
+    static const QString content;
+    static const QString alternative;
+    static const QString truncated;
+
+    // The content type of nearly every message part there is
+    static const QString textPlain;
+};
+
+} // Tp
+
+#endif
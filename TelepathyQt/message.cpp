@@ -24,6 +24,7 @@
 #include <TelepathyQt/ReceivedMessage>
 
 #include "TelepathyQt/debug-internal.h"
+#include "TelepathyQt/message-internal.h"
 
 #include <TelepathyQt/TextChannel>
 
@@ -33,20 +34,44 @@
 namespace Tp
 {
 
+const QString MessagePartKeys::messageSent(QLatin1String("message-sent"));
+const QString MessagePartKeys::messageReceived(QLatin1String("message-received"));
+const QString MessagePartKeys::messageType(QLatin1String("message-type"));
+const QString MessagePartKeys::messageSender(QLatin1String("message-sender"));
+const QString MessagePartKeys::messageSenderId(QLatin1String("message-sender-id"));
+const QString MessagePartKeys::senderNickname(QLatin1String("sender-nickname"));
+const QString MessagePartKeys::pendingMessageId(QLatin1String("pending-message-id"));
+const QString MessagePartKeys::messageToken(QLatin1String("message-token"));
+const QString MessagePartKeys::supersedes(QLatin1String("supersedes"));
+const QString MessagePartKeys::scrollback(QLatin1String("scrollback"));
+const QString MessagePartKeys::rescued(QLatin1String("rescued"));
+const QString MessagePartKeys::dbusInterface(QLatin1String("interface"));
+const QString MessagePartKeys::deliveryStatus(QLatin1String("delivery-status"));
+const QString MessagePartKeys::deliveryToken(QLatin1String("delivery-token"));
+const QString MessagePartKeys::deliveryError(QLatin1String("delivery-error"));
+const QString MessagePartKeys::deliveryErrorMessage(QLatin1String("delivery-error-message"));
+const QString MessagePartKeys::deliveryDBusError(QLatin1String("delivery-dbus-error"));
+const QString MessagePartKeys::deliveryEcho(QLatin1String("delivery-echo"));
+const QString MessagePartKeys::contentType(QLatin1String("content-type"));
+const QString MessagePartKeys::content(QLatin1String("content"));
+const QString MessagePartKeys::alternative(QLatin1String("alternative"));
+const QString MessagePartKeys::truncated(QLatin1String("truncated"));
+const QString MessagePartKeys::textPlain(QLatin1String("text/plain"));
+
 namespace
 {
 
-QVariant valueFromPart(const MessagePartList &parts, uint index, const char *key)
+QVariant valueFromPart(const MessagePartList &parts, uint index, const QString &key)
 {
-    return parts.at(index).value(QLatin1String(key)).variant();
+    return parts.at(index).value(key).variant();
 }
 
-uint uintOrZeroFromPart(const MessagePartList &parts, uint index, const char *key)
+uint uintOrZeroFromPart(const MessagePartList &parts, uint index, const QString &key)
 {
     return valueFromPart(parts, index, key).toUInt();
 }
 
-QString stringOrEmptyFromPart(const MessagePartList &parts, uint index, const char *key)
+QString stringOrEmptyFromPart(const MessagePartList &parts, uint index, const QString &key)
 {
     QString s = valueFromPart(parts, index, key).toString();
     if (s.isNull()) {
@@ -55,7 +80,7 @@ QString stringOrEmptyFromPart(const MessagePartList &parts, uint index, const ch
     return s;
 }
 
-bool booleanFromPart(const MessagePartList &parts, uint index, const char *key,
+bool booleanFromPart(const MessagePartList &parts, uint index, const QString &key,
             bool assumeIfAbsent)
 {
     QVariant v = valueFromPart(parts, index, key);
@@ -65,14 +90,69 @@ bool booleanFromPart(const MessagePartList &parts, uint index, const char *key,
     return assumeIfAbsent;
 }
 
-MessagePartList partsFromPart(const MessagePartList &parts, uint index, const char *key)
+MessagePartList partsFromPart(const MessagePartList &parts, uint index, const QString &key)
 {
     return qdbus_cast<MessagePartList>(valueFromPart(parts, index, key));
 }
 
-bool partContains(const MessagePartList &parts, uint index, const char *key)
+bool partContains(const MessagePartList &parts, uint index, const QString &key)
+{
+    return parts.at(index).contains(key);
+}
+
+// The estimates below don't try to match what the allocator really hands out, only to grow
+// with the amount of data a message holds, which is what bounding a message queue needs
+
+qint64 estimatedStringSize(const QString &s)
+{
+    return sizeof(QString) + sizeof(void *) + 2 * sizeof(int) + s.size() * sizeof(QChar);
+}
+
+qint64 estimatedPartsSize(const MessagePartList &parts);
+
+qint64 estimatedValueSize(const QVariant &value)
+{
+    qint64 size = sizeof(QVariant);
+
+    switch (value.type()) {
+        case QVariant::String:
+            return size + estimatedStringSize(value.toString());
+        case QVariant::ByteArray:
+            return size + sizeof(QByteArray) + sizeof(void *) + 2 * sizeof(int) +
+                value.toByteArray().size();
+        case QVariant::StringList:
+            foreach (const QString &s, value.toStringList()) {
+                size += sizeof(void *) + estimatedStringSize(s);
+            }
+            return size;
+        default:
+            break;
+    }
+
+    if (value.userType() == qMetaTypeId<QDBusArgument>()) {
+        // Nested parts, such as the echoed message of a delivery report, are only demarshalled
+        // on demand; anything else is small enough to only count the variant itself
+        QDBusArgument arg = qvariant_cast<QDBusArgument>(value);
+        if (arg.currentSignature() == QLatin1String("aa{sv}")) {
+            size += estimatedPartsSize(qdbus_cast<MessagePartList>(arg));
+        }
+    } else if (value.userType() == qMetaTypeId<MessagePartList>()) {
+        size += estimatedPartsSize(qvariant_cast<MessagePartList>(value));
+    }
+    return size;
+}
+
+qint64 estimatedPartsSize(const MessagePartList &parts)
 {
-    return parts.at(index).contains(QLatin1String(key));
+    qint64 size = sizeof(MessagePartList) + parts.size() * (sizeof(void *) + sizeof(MessagePart));
+    foreach (const MessagePart &part, parts) {
+        for (MessagePart::const_iterator i = part.constBegin(); i != part.constEnd(); ++i) {
+            // map node links, then the key and the value
+            size += 3 * sizeof(void *) + estimatedStringSize(i.key()) +
+                estimatedValueSize(i.value().variant());
+        }
+    }
+    return size;
 }
 
 }
@@ -85,9 +165,47 @@ struct TP_QT_NO_EXPORT Message::Private : public QSharedData
     uint senderHandle() const;
     QString senderId() const;
     uint pendingId() const;
+    qint64 memoryUsage() const;
     void clearSenderHandle();
 
+    // The accessors are typically called over and over, e.g. whenever a message is painted, so
+    // the parts are only decoded once, the first time they're needed
+    struct Header
+    {
+        Header() : decoded(false) { }
+
+        bool decoded;
+        uint sent;
+        uint received;
+        uint messageType;
+        uint senderHandle;
+        uint pendingId;
+        bool scrollback;
+        bool rescued;
+        QString messageToken;
+        QString dbusInterface;
+        QString senderId;
+        QString senderNickname;
+        QString supersededToken;
+    };
+
+    struct Body
+    {
+        Body() : decoded(false) { }
+
+        bool decoded;
+        bool truncated;
+        bool nonTextContent;
+        QString text;
+    };
+
+    const Header &header() const;
+    const Body &body() const;
+    void decodeBody() const;
+
     MessagePartList parts;
+    mutable Header decodedHeader;
+    mutable Body decodedBody;
 
     // if the Text interface says "non-text" we still only have the text,
     // because the interface can't tell us anything else...
@@ -96,12 +214,16 @@ struct TP_QT_NO_EXPORT Message::Private : public QSharedData
     // for received messages only
     WeakPtr<TextChannel> textChannel;
     ContactPtr sender;
+
+    // estimated the first time it's needed, or -1
+    mutable qint64 cachedMemoryUsage;
 };
 
 Message::Private::Private(const MessagePartList &parts)
     : parts(parts),
       forceNonText(false),
-      sender(0)
+      sender(0),
+      cachedMemoryUsage(-1)
 {
 }
 
@@ -111,22 +233,154 @@ Message::Private::~Private()
 
 inline uint Message::Private::senderHandle() const
 {
-    return uintOrZeroFromPart(parts, 0, "message-sender");
+    return header().senderHandle;
 }
 
 inline QString Message::Private::senderId() const
 {
-    return stringOrEmptyFromPart(parts, 0, "message-sender-id");
+    return header().senderId;
 }
 
 inline uint Message::Private::pendingId() const
 {
-    return uintOrZeroFromPart(parts, 0, "pending-message-id");
+    return header().pendingId;
+}
+
+qint64 Message::Private::memoryUsage() const
+{
+    // Not recomputed when the sender handle is cleared, as the difference is negligible and
+    // callers keeping a running total need the same value back when the message goes away
+    if (cachedMemoryUsage < 0) {
+        cachedMemoryUsage = sizeof(Private) + estimatedPartsSize(parts);
+    }
+    return cachedMemoryUsage;
 }
 
 void Message::Private::clearSenderHandle()
 {
-    parts[0].remove(QLatin1String("message-sender"));
+    parts[0].remove(MessagePartKeys::messageSender);
+    decodedHeader.senderHandle = 0;
+}
+
+const Message::Private::Header &Message::Private::header() const
+{
+    if (decodedHeader.decoded) {
+        return decodedHeader;
+    }
+
+    Header &h = decodedHeader;
+    if (parts.isEmpty()) {
+        // default constructed message
+        h.sent = h.received = h.messageType = h.senderHandle = h.pendingId = 0;
+        h.scrollback = h.rescued = false;
+        h.decoded = true;
+        return h;
+    }
+
+    // FIXME See http://bugs.freedesktop.org/show_bug.cgi?id=21690
+    h.sent = valueFromPart(parts, 0, MessagePartKeys::messageSent).toUInt();
+    h.received = valueFromPart(parts, 0, MessagePartKeys::messageReceived).toUInt();
+    h.messageType = valueFromPart(parts, 0, MessagePartKeys::messageType).toUInt();
+    h.senderHandle = uintOrZeroFromPart(parts, 0, MessagePartKeys::messageSender);
+    h.pendingId = uintOrZeroFromPart(parts, 0, MessagePartKeys::pendingMessageId);
+    h.scrollback = booleanFromPart(parts, 0, MessagePartKeys::scrollback, false);
+    h.rescued = booleanFromPart(parts, 0, MessagePartKeys::rescued, false);
+    h.messageToken = stringOrEmptyFromPart(parts, 0, MessagePartKeys::messageToken);
+    h.dbusInterface = stringOrEmptyFromPart(parts, 0, MessagePartKeys::dbusInterface);
+    h.senderId = stringOrEmptyFromPart(parts, 0, MessagePartKeys::messageSenderId);
+    h.senderNickname = stringOrEmptyFromPart(parts, 0, MessagePartKeys::senderNickname);
+    h.supersededToken = stringOrEmptyFromPart(parts, 0, MessagePartKeys::supersedes);
+    h.decoded = true;
+    return h;
+}
+
+const Message::Private::Body &Message::Private::body() const
+{
+    if (!decodedBody.decoded) {
+        decodeBody();
+    }
+    return decodedBody;
+}
+
+void Message::Private::decodeBody() const
+{
+    Body &b = decodedBody;
+    b.decoded = true;
+    b.truncated = false;
+    b.text = QString();
+
+    for (int i = 1; i < parts.size(); i++) {
+        if (booleanFromPart(parts, i, MessagePartKeys::truncated, false)) {
+            b.truncated = true;
+            break;
+        }
+    }
+
+    if (parts.size() <= 1 || !header().dbusInterface.isEmpty()) {
+        b.nonTextContent = true;
+    }
+
+    // Fast path for the overwhelmingly common case of a single text/plain part
+    if (parts.size() == 2 && !partContains(parts, 1, MessagePartKeys::alternative) &&
+            stringOrEmptyFromPart(parts, 1, MessagePartKeys::contentType) ==
+                MessagePartKeys::textPlain) {
+        QVariant content = valueFromPart(parts, 1, MessagePartKeys::content);
+        if (content.type() == QVariant::String) {
+            b.text = content.toString();
+        } else {
+            // O RLY?
+            debug() << "allegedly text/plain part wasn't";
+        }
+        if (header().dbusInterface.isEmpty()) {
+            b.nonTextContent = false;
+        }
+        return;
+    }
+
+    // Alternative-groups for which we've already emitted an alternative
+    QSet<QString> altGroupsUsed;
+    QSet<QString> texts;
+    QSet<QString> textNeeded;
+    bool unrescuable = false;
+
+    for (int i = 1; i < parts.size(); i++) {
+        QString altGroup = stringOrEmptyFromPart(parts, i, MessagePartKeys::alternative);
+        QString contentType = stringOrEmptyFromPart(parts, i, MessagePartKeys::contentType);
+
+        if (contentType == MessagePartKeys::textPlain) {
+            if (!altGroup.isEmpty()) {
+                // we can use this as an alternative for a non-text part
+                // with the same altGroup
+                texts << altGroup;
+
+                if (altGroupsUsed.contains(altGroup)) {
+                    continue;
+                } else {
+                    altGroupsUsed << altGroup;
+                }
+            }
+
+            QVariant content = valueFromPart(parts, i, MessagePartKeys::content);
+            if (content.type() == QVariant::String) {
+                b.text += content.toString();
+            } else {
+                // O RLY?
+                debug() << "allegedly text/plain part wasn't";
+            }
+        } else if (altGroup.isEmpty()) {
+            // we can't possibly rescue this part by using a text/plain
+            // alternative, because it's not in any alternative group
+            unrescuable = true;
+        } else {
+            // maybe we'll find a text/plain alternative for this
+            textNeeded << altGroup;
+        }
+    }
+
+    if (parts.size() > 1 && header().dbusInterface.isEmpty()) {
+        textNeeded -= texts;
+        b.nonTextContent = unrescuable || !textNeeded.isEmpty();
+    }
 }
 
 /**
@@ -169,14 +423,14 @@ Message::Message(const MessagePartList &parts)
 Message::Message(uint timestamp, uint type, const QString &text)
     : mPriv(new Private(MessagePartList() << MessagePart() << MessagePart()))
 {
-    mPriv->parts[0].insert(QLatin1String("message-sent"),
+    mPriv->parts[0].insert(MessagePartKeys::messageSent,
             QDBusVariant(static_cast<qlonglong>(timestamp)));
-    mPriv->parts[0].insert(QLatin1String("message-type"),
+    mPriv->parts[0].insert(MessagePartKeys::messageType,
             QDBusVariant(type));
 
-    mPriv->parts[1].insert(QLatin1String("content-type"),
-            QDBusVariant(QLatin1String("text/plain")));
-    mPriv->parts[1].insert(QLatin1String("content"), QDBusVariant(text));
+    mPriv->parts[1].insert(MessagePartKeys::contentType,
+            QDBusVariant(MessagePartKeys::textPlain));
+    mPriv->parts[1].insert(MessagePartKeys::content, QDBusVariant(text));
 }
 
 /**
@@ -188,12 +442,12 @@ Message::Message(uint timestamp, uint type, const QString &text)
 Message::Message(ChannelTextMessageType type, const QString &text)
     : mPriv(new Private(MessagePartList() << MessagePart() << MessagePart()))
 {
-    mPriv->parts[0].insert(QLatin1String("message-type"),
+    mPriv->parts[0].insert(MessagePartKeys::messageType,
             QDBusVariant(static_cast<uint>(type)));
 
-    mPriv->parts[1].insert(QLatin1String("content-type"),
-            QDBusVariant(QLatin1String("text/plain")));
-    mPriv->parts[1].insert(QLatin1String("content"), QDBusVariant(text));
+    mPriv->parts[1].insert(MessagePartKeys::contentType,
+            QDBusVariant(MessagePartKeys::textPlain));
+    mPriv->parts[1].insert(MessagePartKeys::content, QDBusVariant(text));
 }
 
 /**
@@ -239,8 +493,7 @@ Message::~Message()
  */
 QDateTime Message::sent() const
 {
-    // FIXME See http://bugs.freedesktop.org/show_bug.cgi?id=21690
-    uint stamp = valueFromPart(mPriv->parts, 0, "message-sent").toUInt();
+    uint stamp = mPriv->header().sent;
     if (stamp != 0) {
         return QDateTime::fromTime_t(stamp);
     } else {
@@ -256,7 +509,7 @@ QDateTime Message::sent() const
  */
 ChannelTextMessageType Message::messageType() const
 {
-    uint raw = valueFromPart(mPriv->parts, 0, "message-type").toUInt();
+    uint raw = mPriv->header().messageType;
 
     if (raw < static_cast<uint>(NUM_CHANNEL_TEXT_MESSAGE_TYPES)) {
         return ChannelTextMessageType(raw);
@@ -272,12 +525,7 @@ ChannelTextMessageType Message::messageType() const
  */
 bool Message::isTruncated() const
 {
-    for (int i = 1; i < size(); i++) {
-        if (booleanFromPart(mPriv->parts, i, "truncated", false)) {
-            return true;
-        }
-    }
-    return false;
+    return mPriv->body().truncated;
 }
 
 /**
@@ -289,38 +537,7 @@ bool Message::isTruncated() const
  */
 bool Message::hasNonTextContent() const
 {
-    if (mPriv->forceNonText || size() <= 1 || isSpecificToDBusInterface()) {
-        return true;
-    }
-
-    QSet<QString> texts;
-    QSet<QString> textNeeded;
-
-    for (int i = 1; i < size(); i++) {
-        QString altGroup = stringOrEmptyFromPart(mPriv->parts, i, "alternative");
-        QString contentType = stringOrEmptyFromPart(mPriv->parts, i, "content-type");
-
-        if (contentType == QLatin1String("text/plain")) {
-            if (!altGroup.isEmpty()) {
-                // we can use this as an alternative for a non-text part
-                // with the same altGroup
-                texts << altGroup;
-            }
-        } else {
-            QString alt = stringOrEmptyFromPart(mPriv->parts, i, "alternative");
-            if (altGroup.isEmpty()) {
-                // we can't possibly rescue this part by using a text/plain
-                // alternative, because it's not in any alternative group
-                return true;
-            } else {
-                // maybe we'll find a text/plain alternative for this
-                textNeeded << altGroup;
-            }
-        }
-    }
-
-    textNeeded -= texts;
-    return !textNeeded.isEmpty();
+    return mPriv->forceNonText || mPriv->body().nonTextContent;
 }
 
 /**
@@ -331,7 +548,7 @@ bool Message::hasNonTextContent() const
  */
 QString Message::messageToken() const
 {
-    return stringOrEmptyFromPart(mPriv->parts, 0, "message-token");
+    return mPriv->header().messageToken;
 }
 
 /**
@@ -361,7 +578,7 @@ bool Message::isSpecificToDBusInterface() const
  */
 QString Message::dbusInterface() const
 {
-    return stringOrEmptyFromPart(mPriv->parts, 0, "interface");
+    return mPriv->header().dbusInterface;
 }
 
 /**
@@ -371,34 +588,7 @@ QString Message::dbusInterface() const
  */
 QString Message::text() const
 {
-    // Alternative-groups for which we've already emitted an alternative
-    QSet<QString> altGroupsUsed;
-    QString text;
-
-    for (int i = 1; i < size(); i++) {
-        QString altGroup = stringOrEmptyFromPart(mPriv->parts, i, "alternative");
-        QString contentType = stringOrEmptyFromPart(mPriv->parts, i, "content-type");
-
-        if (contentType == QLatin1String("text/plain")) {
-            if (!altGroup.isEmpty()) {
-                if (altGroupsUsed.contains(altGroup)) {
-                    continue;
-                } else {
-                    altGroupsUsed << altGroup;
-                }
-            }
-
-            QVariant content = valueFromPart(mPriv->parts, i, "content");
-            if (content.type() == QVariant::String) {
-                text += content.toString();
-            } else {
-                // O RLY?
-                debug() << "allegedly text/plain part wasn't";
-            }
-        }
-    }
-
-    return text;
+    return mPriv->body().text;
 }
 
 /**
@@ -533,7 +723,8 @@ DeliveryStatus ReceivedMessage::DeliveryDetails::status() const
     if (!isValid()) {
         return DeliveryStatusUnknown;
     }
-    return static_cast<DeliveryStatus>(uintOrZeroFromPart(mPriv->parts, 0, "delivery-status"));
+    return static_cast<DeliveryStatus>(uintOrZeroFromPart(mPriv->parts, 0,
+                MessagePartKeys::deliveryStatus));
 }
 
 /**
@@ -548,7 +739,7 @@ bool ReceivedMessage::DeliveryDetails::hasOriginalToken() const
     if (!isValid()) {
         return false;
     }
-    return partContains(mPriv->parts, 0, "delivery-token");
+    return partContains(mPriv->parts, 0, MessagePartKeys::deliveryToken);
 }
 
 /**
@@ -568,7 +759,7 @@ QString ReceivedMessage::DeliveryDetails::originalToken() const
     if (!isValid()) {
         return QString();
     }
-    return stringOrEmptyFromPart(mPriv->parts, 0, "delivery-token");
+    return stringOrEmptyFromPart(mPriv->parts, 0, MessagePartKeys::deliveryToken);
 }
 
 /**
@@ -597,7 +788,8 @@ ChannelTextSendError ReceivedMessage::DeliveryDetails::error() const
     if (!isValid()) {
         return ChannelTextSendErrorUnknown;
     }
-    return static_cast<ChannelTextSendError>(uintOrZeroFromPart(mPriv->parts, 0, "delivery-error"));
+    return static_cast<ChannelTextSendError>(uintOrZeroFromPart(mPriv->parts, 0,
+                MessagePartKeys::deliveryError));
 }
 
 /**
@@ -612,7 +804,7 @@ bool ReceivedMessage::DeliveryDetails::hasDebugMessage() const
     if (!isValid()) {
         return false;
     }
-    return partContains(mPriv->parts, 0, "delivery-error-message");
+    return partContains(mPriv->parts, 0, MessagePartKeys::deliveryErrorMessage);
 }
 
 /**
@@ -627,7 +819,7 @@ QString ReceivedMessage::DeliveryDetails::debugMessage() const
     if (!isValid()) {
         return QString();
     }
-    return stringOrEmptyFromPart(mPriv->parts, 0, "delivery-error-message");
+    return stringOrEmptyFromPart(mPriv->parts, 0, MessagePartKeys::deliveryErrorMessage);
 }
 
 /**
@@ -641,7 +833,7 @@ QString ReceivedMessage::DeliveryDetails::dbusError() const
     if (!isValid()) {
         return QString();
     }
-    QString ret = stringOrEmptyFromPart(mPriv->parts, 0, "delivery-dbus-error");
+    QString ret = stringOrEmptyFromPart(mPriv->parts, 0, MessagePartKeys::deliveryDBusError);
     if (ret.isEmpty()) {
         switch (error()) {
             case ChannelTextSendErrorOffline:
@@ -677,7 +869,7 @@ bool ReceivedMessage::DeliveryDetails::hasEchoedMessage() const
     if (!isValid()) {
         return false;
     }
-    return partContains(mPriv->parts, 0, "delivery-echo");
+    return partContains(mPriv->parts, 0, MessagePartKeys::deliveryEcho);
 }
 
 /**
@@ -701,7 +893,7 @@ Message ReceivedMessage::DeliveryDetails::echoedMessage() const
     if (!isValid()) {
         return Message();
     }
-    return Message(partsFromPart(mPriv->parts, 0, "delivery-echo"));
+    return Message(partsFromPart(mPriv->parts, 0, MessagePartKeys::deliveryEcho));
 }
 
 /**
@@ -722,8 +914,11 @@ ReceivedMessage::ReceivedMessage(const MessagePartList &parts,
         const TextChannelPtr &channel)
     : Message(parts)
 {
-    if (!mPriv->parts[0].contains(QLatin1String("message-received"))) {
-        mPriv->parts[0].insert(QLatin1String("message-received"),
+    // Only detach the parts, which are usually still shared with the D-Bus signal argument, if
+    // there really is something to add
+    const Private *priv = mPriv.constData();
+    if (!priv->parts.at(0).contains(MessagePartKeys::messageReceived)) {
+        mPriv->parts[0].insert(MessagePartKeys::messageReceived,
                 QDBusVariant(static_cast<qlonglong>(
                         QDateTime::currentDateTime().toTime_t())));
     }
@@ -764,8 +959,7 @@ ReceivedMessage::~ReceivedMessage()
  */
 QDateTime ReceivedMessage::received() const
 {
-    // FIXME See http://bugs.freedesktop.org/show_bug.cgi?id=21690
-    uint stamp = valueFromPart(mPriv->parts, 0, "message-received").toUInt();
+    uint stamp = mPriv->header().received;
     if (stamp != 0) {
         return QDateTime::fromTime_t(stamp);
     } else {
@@ -793,7 +987,7 @@ ContactPtr ReceivedMessage::sender() const
  */
 QString ReceivedMessage::senderNickname() const
 {
-    QString ret = stringOrEmptyFromPart(mPriv->parts, 0, "sender-nickname");
+    QString ret = mPriv->header().senderNickname;
     if (ret.isEmpty() && mPriv->sender) {
         ret = mPriv->sender->alias();
     }
@@ -811,7 +1005,7 @@ QString ReceivedMessage::senderNickname() const
  */
 QString ReceivedMessage::supersededToken() const
 {
-    return stringOrEmptyFromPart(mPriv->parts, 0, "supersedes");
+    return mPriv->header().supersededToken;
 }
 
 /**
@@ -826,7 +1020,7 @@ QString ReceivedMessage::supersededToken() const
  */
 bool ReceivedMessage::isScrollback() const
 {
-    return booleanFromPart(mPriv->parts, 0, "scrollback", false);
+    return mPriv->header().scrollback;
 }
 
 /**
@@ -840,7 +1034,7 @@ bool ReceivedMessage::isScrollback() const
  */
 bool ReceivedMessage::isRescued() const
 {
-    return booleanFromPart(mPriv->parts, 0, "rescued", false);
+    return mPriv->header().rescued;
 }
 
 /**
@@ -892,6 +1086,11 @@ QString ReceivedMessage::senderId() const
     return mPriv->senderId();
 }
 
+qint64 ReceivedMessage::memoryUsage() const
+{
+    return mPriv->memoryUsage();
+}
+
 void ReceivedMessage::setForceNonText()
 {
     mPriv->forceNonText = true;
@@ -162,6 +162,7 @@ private:
     TP_QT_NO_EXPORT uint senderHandle() const;
     TP_QT_NO_EXPORT QString senderId() const;
     TP_QT_NO_EXPORT uint pendingId() const;
+    TP_QT_NO_EXPORT qint64 memoryUsage() const;
 
     TP_QT_NO_EXPORT void setForceNonText();
     TP_QT_NO_EXPORT void clearSenderHandle();
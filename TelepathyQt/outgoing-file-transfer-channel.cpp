@@ -32,13 +32,24 @@
 #include <TelepathyQt/Types>
 #include <TelepathyQt/types-internal.h>
 
+#include <QFile>
 #include <QIODevice>
+#include <QSocketNotifier>
 #include <QTcpSocket>
 
+#ifdef Q_OS_LINUX
+#include <errno.h>
+#include <string.h>
+#include <sys/sendfile.h>
+#endif
+
 namespace Tp
 {
 
 static const int FT_BLOCK_SIZE = 16 * 1024;
+// sendfile() is called at most this many bytes at a time, so that a fast local socket doesn't
+// starve the event loop
+static const qint64 FT_ZERO_COPY_BLOCK_SIZE = 1024 * 1024;
 
 struct TP_QT_NO_EXPORT OutgoingFileTransferChannel::Private
 {
@@ -56,6 +67,10 @@ struct TP_QT_NO_EXPORT OutgoingFileTransferChannel::Private
     SocketAddressIPv4 addr;
 
     qint64 pos;
+
+    // Set when input is a regular file sent straight from the page cache to the socket
+    bool zeroCopy;
+    QSocketNotifier *socketNotifier;
 };
 
 OutgoingFileTransferChannel::Private::Private(OutgoingFileTransferChannel *parent)
@@ -63,7 +78,9 @@ OutgoingFileTransferChannel::Private::Private(OutgoingFileTransferChannel *paren
       fileTransferInterface(parent->interface<Client::ChannelTypeFileTransferInterface>()),
       input(0),
       socket(0),
-      pos(0)
+      pos(0),
+      zeroCopy(false),
+      socketNotifier(0)
 {
 }
 
@@ -152,6 +169,10 @@ OutgoingFileTransferChannel::~OutgoingFileTransferChannel()
  * If input is a sequential device QIODevice::isSequential(), it should be
  * closed when no more data is available, so that it's known when to stop reading.
  *
+ * If input is a QFile backed by a file descriptor, on platforms supporting it
+ * the data is sent directly from the file to the socket by the kernel, without
+ * being copied through this process.
+ *
  * Only the primary handler of a file transfer channel may call this method.
  *
  * This method requires FileTransferChannel::FeatureCore to be ready.
@@ -251,9 +272,6 @@ void OutgoingFileTransferChannel::onSocketConnected()
     debug() << "Connected to host";
     setConnected();
 
-    connect(mPriv->input, SIGNAL(readyRead()),
-            SLOT(doTransfer()));
-
     // for non sequential devices, let's seek to the initialOffset
     if (!mPriv->input->isSequential()) {
         if (mPriv->input->seek(initialOffset())) {
@@ -261,6 +279,15 @@ void OutgoingFileTransferChannel::onSocketConnected()
         }
     }
 
+    if (startZeroCopyTransfer()) {
+        debug() << "Starting zero-copy transfer...";
+        doZeroCopyTransfer();
+        return;
+    }
+
+    connect(mPriv->input, SIGNAL(readyRead()),
+            SLOT(doTransfer()));
+
     debug() << "Starting transfer...";
     doTransfer();
 }
@@ -283,6 +310,11 @@ void OutgoingFileTransferChannel::onInputAboutToClose()
 
     // read all remaining data from input device and write to output device
     if (isConnected()) {
+        if (mPriv->zeroCopy) {
+            // the device position was never advanced by sendfile()
+            mPriv->input->seek(mPriv->pos);
+        }
+
         QByteArray data;
         data = mPriv->input->readAll();
         mPriv->socket->write(data); // never fails
@@ -338,6 +370,93 @@ end:
     }
 }
 
+bool OutgoingFileTransferChannel::startZeroCopyTransfer()
+{
+#ifdef Q_OS_LINUX
+    QFile *file = qobject_cast<QFile *>(mPriv->input);
+    if (!file || file->handle() == -1 || mPriv->socket->socketDescriptor() == -1) {
+        return false;
+    }
+
+    // the offset must have been reached by seeking, and off_t may be 32 bits wide
+    if ((qulonglong) mPriv->pos != initialOffset() || (qint64) (off_t) file->size() != file->size()) {
+        return false;
+    }
+
+    mPriv->zeroCopy = true;
+    mPriv->socketNotifier = new QSocketNotifier(mPriv->socket->socketDescriptor(),
+            QSocketNotifier::Write, this);
+    connect(mPriv->socketNotifier, SIGNAL(activated(int)),
+            SLOT(doZeroCopyTransfer()));
+    return true;
+#else
+    return false;
+#endif
+}
+
+void OutgoingFileTransferChannel::stopZeroCopyTransfer()
+{
+    mPriv->zeroCopy = false;
+    if (mPriv->socketNotifier) {
+        mPriv->socketNotifier->setEnabled(false);
+        mPriv->socketNotifier->deleteLater();
+        mPriv->socketNotifier = 0;
+    }
+}
+
+void OutgoingFileTransferChannel::doZeroCopyTransfer()
+{
+#ifdef Q_OS_LINUX
+    if (!mPriv->zeroCopy) {
+        return;
+    }
+
+    QFile *file = static_cast<QFile *>(mPriv->input);
+    qint64 remaining = file->size() - mPriv->pos;
+    if (remaining <= 0) {
+        // EOF
+        setFinished();
+        return;
+    }
+
+    // sendfile() takes the offset explicitly, so the device position is left untouched and
+    // nothing ever goes through the QTcpSocket write buffer
+    off_t offset = (off_t) mPriv->pos;
+    ssize_t len = ::sendfile(mPriv->socket->socketDescriptor(), file->handle(), &offset,
+            (size_t) qMin(remaining, FT_ZERO_COPY_BLOCK_SIZE));
+    if (len == -1) {
+        if (errno == EAGAIN || errno == EINTR) {
+            // the notifier will fire again once the socket can take more data
+            return;
+        }
+
+        if (errno == EINVAL || errno == ENOSYS) {
+            // the file system doesn't support it, carry on copying
+            debug() << "sendfile() not supported for" << file->fileName() <<
+                "- falling back to buffered transfer";
+            stopZeroCopyTransfer();
+            file->seek(mPriv->pos);
+            connect(mPriv->input, SIGNAL(readyRead()),
+                    SLOT(doTransfer()));
+            doTransfer();
+            return;
+        }
+
+        warning() << "Error sending file:" << strerror(errno);
+        setFinished();
+        return;
+    }
+
+    if (len == 0) {
+        // the file was truncated while sending it
+        setFinished();
+        return;
+    }
+
+    mPriv->pos += len;
+#endif
+}
+
 void OutgoingFileTransferChannel::setFinished()
 {
     if (isFinished()) {
@@ -345,6 +464,8 @@ void OutgoingFileTransferChannel::setFinished()
         return;
     }
 
+    stopZeroCopyTransfer();
+
     if (mPriv->socket) {
         disconnect(mPriv->socket, SIGNAL(connected()),
                    this, SLOT(onSocketConnected()));
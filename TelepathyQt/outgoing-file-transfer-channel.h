@@ -63,9 +63,12 @@ private Q_SLOTS:
     TP_QT_NO_EXPORT void onSocketError(QAbstractSocket::SocketError error);
     TP_QT_NO_EXPORT void onInputAboutToClose();
     TP_QT_NO_EXPORT void doTransfer();
+    TP_QT_NO_EXPORT void doZeroCopyTransfer();
 
 private:
     TP_QT_NO_EXPORT void connectToHost();
+    TP_QT_NO_EXPORT bool startZeroCopyTransfer();
+    TP_QT_NO_EXPORT void stopZeroCopyTransfer();
     TP_QT_NO_EXPORT void setFinished();
 
     struct Private;
@@ -26,6 +26,7 @@
 #include "TelepathyQt/_gen/pending-contacts.moc.hpp"
 #include "TelepathyQt/_gen/pending-contacts-internal.moc.hpp"
 
+#include "TelepathyQt/contact-manager-internal.h"
 #include "TelepathyQt/debug-internal.h"
 
 #include <TelepathyQt/Connection>
@@ -54,7 +55,11 @@ struct TP_QT_NO_EXPORT PendingContacts::Private
           satisfyingContacts(satisfyingContacts),
           requestType(PendingContacts::ForHandles),
           handles(handles),
-          nested(0)
+          nested(0),
+          maxChunksInFlight(0),
+          chunksInFlight(0),
+          handlesProcessed(0),
+          handlesTotal(0)
     {
     }
 
@@ -66,7 +71,11 @@ struct TP_QT_NO_EXPORT PendingContacts::Private
           missingFeatures(features),
           requestType(type),
           addresses(list),
-          nested(0)
+          nested(0),
+          maxChunksInFlight(0),
+          chunksInFlight(0),
+          handlesProcessed(0),
+          handlesTotal(0)
     {
         if (type != PendingContacts::ForIdentifiers &&
             type != PendingContacts::ForUris) {
@@ -83,7 +92,11 @@ struct TP_QT_NO_EXPORT PendingContacts::Private
           requestType(PendingContacts::ForVCardAddresses),
           addresses(vcardAddresses),
           vcardField(vcardField),
-          nested(0)
+          nested(0),
+          maxChunksInFlight(0),
+          chunksInFlight(0),
+          handlesProcessed(0),
+          handlesTotal(0)
     {
     }
 
@@ -95,12 +108,20 @@ struct TP_QT_NO_EXPORT PendingContacts::Private
           features(features),
           requestType(PendingContacts::Upgrade),
           contactsToUpgrade(contactsToUpgrade),
-          nested(0)
+          nested(0),
+          maxChunksInFlight(0),
+          chunksInFlight(0),
+          handlesProcessed(0),
+          handlesTotal(0)
     {
     }
 
     void setFinished();
 
+    QList<ContactPtr> processAttributes(const UIntList &requested,
+            const ReferencedHandles &validHandles, const ContactAttributesMap &attributes);
+    void startChunks();
+
     bool checkRequestTypeAndState(const char *methodName, const char *debug, RequestType type);
 
     // Public object
@@ -129,6 +150,14 @@ struct TP_QT_NO_EXPORT PendingContacts::Private
     QStringList invalidAddresses;
 
     ReferencedHandles handlesToInspect;
+
+    // Chunked attribute fetching
+    QStringList interfaces;
+    QList<UIntList> chunksToRequest;
+    uint maxChunksInFlight;
+    uint chunksInFlight;
+    int handlesProcessed;
+    int handlesTotal;
 };
 
 void PendingContacts::Private::setFinished()
@@ -146,6 +175,45 @@ void PendingContacts::Private::setFinished()
     parent->setFinished();
 }
 
+QList<ContactPtr> PendingContacts::Private::processAttributes(const UIntList &requested,
+        const ReferencedHandles &validHandles, const ContactAttributesMap &attributes)
+{
+    QList<ContactPtr> ret;
+    foreach (uint handle, requested) {
+        if (!satisfyingContacts.contains(handle)) {
+            int indexInValid = validHandles.indexOf(handle);
+            if (indexInValid >= 0) {
+                ReferencedHandles referencedHandle = validHandles.mid(indexInValid, 1);
+                QVariantMap handleAttributes = attributes.value(handle);
+                ContactPtr contact = manager->ensureContact(referencedHandle,
+                        missingFeatures, handleAttributes);
+                satisfyingContacts.insert(handle, contact);
+                ret.append(contact);
+            } else {
+                invalidHandles.push_back(handle);
+            }
+        }
+    }
+    return ret;
+}
+
+void PendingContacts::Private::startChunks()
+{
+    ConnectionLowlevelPtr connLowlevel = manager->connection()->lowlevel();
+    while (chunksInFlight < maxChunksInFlight && !chunksToRequest.isEmpty()) {
+        UIntList chunk = chunksToRequest.takeFirst();
+        debug() << "Requesting attributes chunk of" << chunk.size() << "contacts," <<
+            chunksToRequest.size() << "chunks left";
+
+        PendingContactAttributes *attributes =
+            connLowlevel->contactAttributes(chunk, interfaces, true);
+        parent->connect(attributes,
+                SIGNAL(finished(Tp::PendingOperation*)),
+                SLOT(onAttributesChunkFinished(Tp::PendingOperation*)));
+        ++chunksInFlight;
+    }
+}
+
 bool PendingContacts::Private::checkRequestTypeAndState(const char *methodName,
         const char *debug,
         RequestType type)
@@ -195,10 +263,36 @@ PendingContacts::PendingContacts(const ContactManagerPtr &manager,
 
     if (!otherContacts.isEmpty()) {
         ConnectionPtr conn = manager->connection();
-        if (conn->interfaces().contains(TP_QT_IFACE_CONNECTION_INTERFACE_CONTACTS)) {
-            PendingContactAttributes *attributes =
-                conn->lowlevel()->contactAttributes(otherContacts.toList(),
-                        interfaces, true);
+        uint chunkSize = manager->contactAttributesChunkSize();
+        if (conn->interfaces().contains(TP_QT_IFACE_CONNECTION_INTERFACE_CONTACTS) &&
+            chunkSize > 0 && (uint) otherContacts.size() > chunkSize) {
+            // Split the request, keeping the order in which the handles were requested so the
+            // first contacts asked for are also the first ones to become available
+            UIntList chunk;
+            QSet<uint> queued;
+            foreach (uint handle, handles) {
+                if (!otherContacts.contains(handle) || queued.contains(handle)) {
+                    continue;
+                }
+
+                queued.insert(handle);
+                chunk.append(handle);
+                if ((uint) chunk.size() == chunkSize) {
+                    mPriv->chunksToRequest.append(chunk);
+                    chunk.clear();
+                }
+            }
+            if (!chunk.isEmpty()) {
+                mPriv->chunksToRequest.append(chunk);
+            }
+
+            mPriv->interfaces = interfaces;
+            mPriv->maxChunksInFlight = manager->maxContactAttributesChunksInFlight();
+            mPriv->handlesTotal = queued.size();
+            mPriv->startChunks();
+        } else if (conn->interfaces().contains(TP_QT_IFACE_CONNECTION_INTERFACE_CONTACTS)) {
+            ContactManager::PendingCoalescedAttributes *attributes =
+                manager->requestContactAttributes(otherContacts.toList(), interfaces);
 
             connect(attributes,
                     SIGNAL(finished(Tp::PendingOperation*)),
@@ -479,36 +573,84 @@ QStringList PendingContacts::invalidUris() const
     return mPriv->invalidAddresses;
 }
 
+/**
+ * \fn void PendingContacts::contactsRetrieved(const QList<Tp::ContactPtr> &contacts,
+ *         int handlesProcessed, int handlesTotal)
+ *
+ * Emitted when a chunk of the requested contacts has been retrieved.
+ *
+ * This is only emitted for requests made through ContactManager::contactsForHandles() while
+ * chunked attribute fetching is enabled using ContactManager::setContactAttributesChunking(), and
+ * only when the request is large enough to be split. The complete result is still available
+ * through contacts() once the operation has finished.
+ *
+ * \param contacts The contacts built from this chunk.
+ * \param handlesProcessed The number of handles processed so far, including this chunk.
+ * \param handlesTotal The total number of handles being fetched in chunks.
+ */
+
 void PendingContacts::onAttributesFinished(PendingOperation *operation)
+{
+    ContactManager::PendingCoalescedAttributes *pendingAttributes =
+        qobject_cast<ContactManager::PendingCoalescedAttributes *>(operation);
+
+    if (pendingAttributes->isError()) {
+        debug() << "PendingAttrs error" << pendingAttributes->errorName()
+                << "message" << pendingAttributes->errorMessage();
+        setFinishedWithError(pendingAttributes->errorName(), pendingAttributes->errorMessage());
+        return;
+    }
+
+    // The attributes may have been fetched together with other requests, so only look at the
+    // handles asked for here
+    mPriv->processAttributes(mPriv->handles, pendingAttributes->validHandles(),
+            pendingAttributes->attributes());
+
+    allAttributesFetched();
+}
+
+void PendingContacts::onAttributesChunkFinished(PendingOperation *operation)
 {
     PendingContactAttributes *pendingAttributes =
         qobject_cast<PendingContactAttributes *>(operation);
 
+    --mPriv->chunksInFlight;
+
+    if (isFinished()) {
+        // An earlier chunk failed, nothing left to do
+        return;
+    }
+
     if (pendingAttributes->isError()) {
         debug() << "PendingAttrs error" << pendingAttributes->errorName()
                 << "message" << pendingAttributes->errorMessage();
+        mPriv->chunksToRequest.clear();
         setFinishedWithError(pendingAttributes->errorName(), pendingAttributes->errorMessage());
         return;
     }
 
-    ReferencedHandles validHandles = pendingAttributes->validHandles();
-    ContactAttributesMap attributes = pendingAttributes->attributes();
+    const UIntList &chunk = pendingAttributes->contactsRequested();
+    QList<ContactPtr> chunkContacts = mPriv->processAttributes(chunk,
+            pendingAttributes->validHandles(), pendingAttributes->attributes());
+    mPriv->handlesProcessed += chunk.size();
 
-    foreach (uint handle, mPriv->handles) {
-        if (!mPriv->satisfyingContacts.contains(handle)) {
-            int indexInValid = validHandles.indexOf(handle);
-            if (indexInValid >= 0) {
-                ReferencedHandles referencedHandle = validHandles.mid(indexInValid, 1);
-                QVariantMap handleAttributes = attributes[handle];
-                mPriv->satisfyingContacts.insert(handle, manager()->ensureContact(referencedHandle,
-                            mPriv->missingFeatures, handleAttributes));
-            } else {
+    // Request the next chunks before handing out the contacts, so the CM can work on them while
+    // the application processes this batch
+    mPriv->startChunks();
+
+    emit contactsRetrieved(chunkContacts, mPriv->handlesProcessed, mPriv->handlesTotal);
+
+    if (mPriv->chunksInFlight == 0 && mPriv->chunksToRequest.isEmpty()) {
+        // Chunks may complete out of order, so report invalid handles in request order
+        mPriv->invalidHandles.clear();
+        foreach (uint handle, mPriv->handles) {
+            if (!mPriv->satisfyingContacts.contains(handle)) {
                 mPriv->invalidHandles.push_back(handle);
             }
         }
-    }
 
-    allAttributesFetched();
+        allAttributesFetched();
+    }
 }
 
 void PendingContacts::onRequestHandlesFinished(PendingOperation *operation)
@@ -79,8 +79,13 @@ public:
     QStringList validUris() const;
     QStringList invalidUris() const;
 
+Q_SIGNALS:
+    void contactsRetrieved(const QList<Tp::ContactPtr> &contacts,
+            int handlesProcessed, int handlesTotal);
+
 private Q_SLOTS:
     TP_QT_NO_EXPORT void onAttributesFinished(Tp::PendingOperation *);
+    TP_QT_NO_EXPORT void onAttributesChunkFinished(Tp::PendingOperation *);
     TP_QT_NO_EXPORT void onRequestHandlesFinished(Tp::PendingOperation *);
     TP_QT_NO_EXPORT void onAddressingGetContactsFinished(Tp::PendingOperation *);
     TP_QT_NO_EXPORT void onReferenceHandlesFinished(Tp::PendingOperation *);
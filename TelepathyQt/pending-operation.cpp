@@ -130,20 +130,9 @@ void PendingOperation::emitFinished()
  */
 void PendingOperation::setFinished()
 {
-    if (mPriv->finished) {
-        if (!mPriv->errorName.isEmpty()) {
-            warning() << this << "trying to finish with success, but already"
-                " failed with" << mPriv->errorName << ":" << mPriv->errorMessage;
-        } else {
-            warning() << this << "trying to finish with success, but already"
-                " succeeded";
-        }
-        return;
+    if (markFinished(true)) {
+        QTimer::singleShot(0, this, SLOT(emitFinished()));
     }
-
-    mPriv->finished = true;
-    Q_ASSERT(isValid());
-    QTimer::singleShot(0, this, SLOT(emitFinished()));
 }
 
 /**
@@ -155,30 +144,58 @@ void PendingOperation::setFinished()
  */
 void PendingOperation::setFinishedWithError(const QString &name,
         const QString &message)
+{
+    if (markFinished(false, name, message)) {
+        QTimer::singleShot(0, this, SLOT(emitFinished()));
+    }
+}
+
+/**
+ * \internal
+ *
+ * Record that this pending operation has finished, without arranging for finished() to be emitted.
+ * Used by setFinished() and setFinishedWithError(), and by ReadinessHelper, which emits finished()
+ * for all the PendingReady objects it finished at once.
+ *
+ * \return \c true if the operation was still pending, \c false otherwise.
+ */
+bool PendingOperation::markFinished(bool success, const QString &name, const QString &message)
 {
     if (mPriv->finished) {
-        if (mPriv->errorName.isEmpty()) {
-            warning() << this << "trying to fail with" << name <<
-                "but already failed with" << errorName() << ":" <<
-                errorMessage();
+        if (success) {
+            if (!mPriv->errorName.isEmpty()) {
+                warning() << this << "trying to finish with success, but already"
+                    " failed with" << mPriv->errorName << ":" << mPriv->errorMessage;
+            } else {
+                warning() << this << "trying to finish with success, but already"
+                    " succeeded";
+            }
         } else {
-            warning() << this << "trying to fail with" << name <<
-                "but already succeeded";
+            if (mPriv->errorName.isEmpty()) {
+                warning() << this << "trying to fail with" << name <<
+                    "but already failed with" << errorName() << ":" <<
+                    errorMessage();
+            } else {
+                warning() << this << "trying to fail with" << name <<
+                    "but already succeeded";
+            }
         }
-        return;
+        return false;
     }
 
-    if (name.isEmpty()) {
-        warning() << this << "should be given a non-empty error name";
-        mPriv->errorName = QLatin1String("org.freedesktop.Telepathy.Qt.ErrorHandlingError");
-    } else {
-        mPriv->errorName = name;
+    if (!success) {
+        if (name.isEmpty()) {
+            warning() << this << "should be given a non-empty error name";
+            mPriv->errorName = QLatin1String("org.freedesktop.Telepathy.Qt.ErrorHandlingError");
+        } else {
+            mPriv->errorName = name;
+        }
+        mPriv->errorMessage = message;
     }
 
-    mPriv->errorMessage = message;
     mPriv->finished = true;
-    Q_ASSERT(isError());
-    QTimer::singleShot(0, this, SLOT(emitFinished()));
+    Q_ASSERT(success ? isValid() : isError());
+    return true;
 }
 
 /**
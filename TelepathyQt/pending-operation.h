@@ -77,6 +77,9 @@ private:
     friend class ContactManager;
     friend class ReadinessHelper;
 
+    TP_QT_NO_EXPORT bool markFinished(bool success, const QString &errorName = QString(),
+            const QString &errorMessage = QString());
+
     struct Private;
     friend struct Private;
     Private *mPriv;
@@ -25,6 +25,7 @@
 #include "TelepathyQt/_gen/readiness-helper.moc.hpp"
 
 #include "TelepathyQt/debug-internal.h"
+#include "TelepathyQt/feature-internal.h"
 
 #include <TelepathyQt/Constants>
 #include <TelepathyQt/DBusProxy>
@@ -34,6 +35,7 @@
 
 #include <QDBusError>
 #include <QSharedData>
+#include <QTime>
 #include <QTimer>
 
 namespace Tp
@@ -52,7 +54,8 @@ struct TP_QT_NO_EXPORT ReadinessHelper::Introspectable::Private : public QShared
         dependsOnInterfaces(dependsOnInterfaces),
         introspectFunc(introspectFunc),
         introspectFuncData(introspectFuncData),
-        critical(critical) {}
+        critical(critical),
+        dependsOnFeatureBits(dependsOnFeatures) {}
 
     QSet<uint> makesSenseForStatuses;
     Features dependsOnFeatures;
@@ -60,6 +63,7 @@ struct TP_QT_NO_EXPORT ReadinessHelper::Introspectable::Private : public QShared
     IntrospectFunc introspectFunc;
     void *introspectFuncData;
     bool critical;
+    FeatureBits dependsOnFeatureBits;
 };
 
 ReadinessHelper::Introspectable::Introspectable()
@@ -107,8 +111,18 @@ struct TP_QT_NO_EXPORT ReadinessHelper::Private
     void setIntrospectCompleted(const Feature &feature, bool success,
             const QString &errorName = QString(),
             const QString &errorMessage = QString());
+    void completeFeature(const Feature &feature, bool success,
+            const QString &errorName = QString(),
+            const QString &errorMessage = QString());
+    void scheduleIteration();
     void iterateIntrospection();
-    Features depsFor(const Feature &feature); // Recursive dependencies for a feature
+    bool iterateIntrospectionOnce();
+    void finishOperation(PendingReady *operation);
+    void emitFinishedOperations();
+    FeatureBits depsFor(const Feature &feature); // Recursive dependencies for a feature
+
+    void addIntrospectable(const Feature &feature, const Introspectable &introspectable);
+    Introspectable introspectableFor(const Feature &feature) const;
 
     void abortOperations(const QString &errorName, const QString &errorMessage);
 
@@ -118,20 +132,38 @@ struct TP_QT_NO_EXPORT ReadinessHelper::Private
     uint currentStatus;
     QStringList interfaces;
     Introspectables introspectables;
+    // The feature sets are bitmaps indexed by FeatureBits::indexOf(), as are these, as the sets and
+    // introspectables are looked up over and over again while iterating
+    QHash<int, Introspectable> introspectablesByIndex;
+    QHash<int, FeatureBits> depsCache;
     QSet<uint> supportedStatuses;
-    Features supportedFeatures;
-    Features satisfiedFeatures;
-    Features requestedFeatures;
-    Features missingFeatures;
-    Features pendingFeatures;
-    Features inFlightFeatures;
+    FeatureBits supportedFeatures;
+    FeatureBits satisfiedFeatures;
+    FeatureBits requestedFeatures;
+    FeatureBits missingFeatures;
+    FeatureBits pendingFeatures;
+    FeatureBits inFlightFeatures;
     QHash<Feature, QPair<QString, QString> > missingFeaturesErrors;
-    QList<PendingReady *> pendingOperations;
+    typedef QPair<PendingReady *, FeatureBits> Operation;
+    QList<Operation> pendingOperations;
+    // Finished, but finished() not emitted yet
+    QList<PendingReady *> finishedOperations;
+    QHash<int, QTime> introspectionStartTimes;
 
     bool pendingStatusChange;
     uint pendingStatus;
+
+    bool iterationScheduled;
+    bool iterating;
+    bool completedWhileIterating;
+
+    static IntrospectionHook introspectionHook;
+    static void *introspectionHookData;
 };
 
+ReadinessHelper::IntrospectionHook ReadinessHelper::Private::introspectionHook = 0;
+void *ReadinessHelper::Private::introspectionHookData = 0;
+
 ReadinessHelper::Private::Private(
         ReadinessHelper *parent,
         RefCounted *object,
@@ -141,17 +173,16 @@ ReadinessHelper::Private::Private(
       object(object),
       proxy(0),
       currentStatus(currentStatus),
-      introspectables(introspectables),
       pendingStatusChange(false),
-      pendingStatus(-1)
+      pendingStatus(-1),
+      iterationScheduled(false),
+      iterating(false),
+      completedWhileIterating(false)
 {
     for (Introspectables::const_iterator i = introspectables.constBegin();
             i != introspectables.constEnd(); ++i) {
-        Feature feature = i.key();
-        Introspectable introspectable = i.value();
-        Q_ASSERT(introspectable.mPriv->introspectFunc != 0);
-        supportedStatuses += introspectable.mPriv->makesSenseForStatuses;
-        supportedFeatures += feature;
+        Q_ASSERT(i.value().mPriv->introspectFunc != 0);
+        addIntrospectable(i.key(), i.value());
     }
 }
 
@@ -164,19 +195,18 @@ ReadinessHelper::Private::Private(
       object(proxy),
       proxy(proxy),
       currentStatus(currentStatus),
-      introspectables(introspectables),
       pendingStatusChange(false),
-      pendingStatus(-1)
+      pendingStatus(-1),
+      iterationScheduled(false),
+      iterating(false),
+      completedWhileIterating(false)
 {
     Q_ASSERT(proxy != 0);
 
     for (Introspectables::const_iterator i = introspectables.constBegin();
             i != introspectables.constEnd(); ++i) {
-        Feature feature = i.key();
-        Introspectable introspectable = i.value();
-        Q_ASSERT(introspectable.mPriv->introspectFunc != 0);
-        supportedStatuses += introspectable.mPriv->makesSenseForStatuses;
-        supportedFeatures += feature;
+        Q_ASSERT(i.value().mPriv->introspectFunc != 0);
+        addIntrospectable(i.key(), i.value());
     }
 }
 
@@ -185,6 +215,11 @@ ReadinessHelper::Private::~Private()
     const static QString messageDestroyed(QLatin1String("Destroyed"));
 
     abortOperations(TP_QT_ERROR_CANCELLED, messageDestroyed);
+
+    // These won't be emitted by us anymore, but they are finished already
+    foreach (PendingReady *operation, finishedOperations) {
+        QTimer::singleShot(0, operation, SLOT(emitFinished()));
+    }
 }
 
 void ReadinessHelper::Private::setCurrentStatus(uint newStatus)
@@ -205,7 +240,7 @@ void ReadinessHelper::Private::setCurrentStatus(uint newStatus)
         // in the requested set, so we don't have to re-add them here
 
         if (supportedStatuses.contains(currentStatus)) {
-            QTimer::singleShot(0, parent, SLOT(iterateIntrospection()));
+            scheduleIteration();
         } else {
             emit parent->statusReady(currentStatus);
         }
@@ -236,9 +271,31 @@ void ReadinessHelper::Private::setIntrospectCompleted(const Feature &feature,
         return;
     }
 
+    completeFeature(feature, success, errorName, errorMessage);
+
+    if (iterating) {
+        // Completed synchronously by an introspect function, the ongoing iteration will carry on
+        completedWhileIterating = true;
+    } else {
+        scheduleIteration();
+    }
+}
+
+void ReadinessHelper::Private::completeFeature(const Feature &feature,
+        bool success, const QString &errorName, const QString &errorMessage)
+{
     Q_ASSERT(pendingFeatures.contains(feature));
     Q_ASSERT(inFlightFeatures.contains(feature));
 
+    if (introspectionHook) {
+        QTime started = introspectionStartTimes.take(FeatureBits::indexOf(feature));
+        (*introspectionHook)(object, feature, success,
+                started.isValid() ? started.elapsed() : 0, introspectionHookData);
+    }
+    if (proxy && proxy->isProfilingEnabled()) {
+        proxy->profileIntrospectionFinished(feature, success);
+    }
+
     if (success) {
         satisfiedFeatures.insert(feature);
     }
@@ -254,15 +311,38 @@ void ReadinessHelper::Private::setIntrospectCompleted(const Feature &feature,
 
     pendingFeatures.remove(feature);
     inFlightFeatures.remove(feature);
+}
 
-    QTimer::singleShot(0, parent, SLOT(iterateIntrospection()));
+void ReadinessHelper::Private::scheduleIteration()
+{
+    // However many features complete before the event loop gets to it, one iteration handles them
+    if (!iterationScheduled) {
+        iterationScheduled = true;
+        QTimer::singleShot(0, parent, SLOT(iterateIntrospection()));
+    }
 }
 
 void ReadinessHelper::Private::iterateIntrospection()
 {
+    if (iterating) {
+        return;
+    }
+
+    // Keep going as long as features complete synchronously, so that everything which can be
+    // resolved without waiting for a D-Bus reply is done within this one call
+    iterating = true;
+    while (iterateIntrospectionOnce()) {
+    }
+    iterating = false;
+}
+
+bool ReadinessHelper::Private::iterateIntrospectionOnce()
+{
+    completedWhileIterating = false;
+
     if (proxy && !proxy->isValid()) {
         debug() << "ReadinessHelper: not iterating as the proxy is invalidated";
-        return;
+        return false;
     }
 
     // When there's a pending status change, we MUST NOT
@@ -277,51 +357,47 @@ void ReadinessHelper::Private::iterateIntrospection()
     //  So we can safely skip the rest of this function here.
     if (pendingStatusChange) {
         debug() << "ReadinessHelper: not iterating as a status change is pending";
-        return;
+        return false;
     }
 
     // Flag the currently pending reverse dependencies of any previously discovered missing features
     // as missing
-    foreach (const Feature &feature, pendingFeatures) {
-        if (!depsFor(feature).intersect(missingFeatures).isEmpty()) {
-            missingFeatures.insert(feature);
-            missingFeaturesErrors.insert(feature,
-                    QPair<QString, QString>(TP_QT_ERROR_NOT_AVAILABLE,
-                        QLatin1String("Feature depends on other features that are not available")));
+    if (!missingFeatures.isEmpty()) {
+        foreach (const Feature &feature, pendingFeatures.toList()) {
+            if (depsFor(feature).intersects(missingFeatures)) {
+                missingFeatures.insert(feature);
+                missingFeaturesErrors.insert(feature,
+                        QPair<QString, QString>(TP_QT_ERROR_NOT_AVAILABLE,
+                            QLatin1String("Feature depends on other features that are not available")));
+            }
         }
     }
 
-    const Features completedFeatures = satisfiedFeatures + missingFeatures;
+    const FeatureBits completedFeatures = satisfiedFeatures | missingFeatures;
 
     // check if any pending operations for becomeReady should finish now
     // based on their requested features having nothing more than what
     // satisfiedFeatures + missingFeatures has
-    QString errorName;
-    QString errorMessage;
-    foreach (PendingReady *operation, pendingOperations) {
-        if ((operation->requestedFeatures() - completedFeatures).isEmpty()) {
-            if (parent->isReady(operation->requestedFeatures(), &errorName, &errorMessage)) {
-                operation->setFinished();
-            } else {
-                operation->setFinishedWithError(errorName, errorMessage);
-            }
-
+    QList<Operation>::iterator i = pendingOperations.begin();
+    while (i != pendingOperations.end()) {
+        if (completedFeatures.contains(i->second)) {
             // Remove the operation from tracking, so we don't double-finish it
-            //
-            // Qt foreach makes a copy of the container, which will be detached at this point, so
-            // this is perfectly safe
-            pendingOperations.removeOne(operation);
+            PendingReady *operation = i->first;
+            i = pendingOperations.erase(i);
+            finishOperation(operation);
+        } else {
+            ++i;
         }
     }
 
-    if ((requestedFeatures - completedFeatures).isEmpty()) {
+    if (completedFeatures.contains(requestedFeatures)) {
         // Otherwise, we'd emit statusReady with currentStatus although we are supposed to be
         // introspecting the pendingStatus and only when that is complete, emit statusReady
         Q_ASSERT(!pendingStatusChange);
 
         // all requested features satisfied or missing
         emit parent->statusReady(currentStatus);
-        return;
+        return false;
     }
 
     // update pendingFeatures with the difference of requested and
@@ -329,32 +405,44 @@ void ReadinessHelper::Private::iterateIntrospection()
     pendingFeatures -= completedFeatures;
 
     // find out which features don't have dependencies that are still pending
-    Features readyToIntrospect;
-    foreach (const Feature &feature, pendingFeatures) {
+    QList<Feature> readyToIntrospect;
+    foreach (const Feature &feature, pendingFeatures.toList()) {
         // missing doesn't have to be considered here anymore
-        if ((introspectables[feature].mPriv->dependsOnFeatures - satisfiedFeatures).isEmpty()) {
-            readyToIntrospect.insert(feature);
+        if (!inFlightFeatures.contains(feature) &&
+                satisfiedFeatures.contains(introspectableFor(feature).mPriv->dependsOnFeatureBits)) {
+            readyToIntrospect.append(feature);
         }
     }
 
     // now readyToIntrospect should contain all the features which have
     // all their feature dependencies satisfied
+    bool completedSynchronously = false;
     foreach (const Feature &feature, readyToIntrospect) {
-        if (inFlightFeatures.contains(feature)) {
-            continue;
+        if (pendingStatusChange || (proxy && !proxy->isValid())) {
+            // An introspect function changed the status or invalidated the proxy, so anything else
+            // we'd start now would be thrown away
+            break;
         }
 
         inFlightFeatures.insert(feature);
+        if (introspectionHook) {
+            introspectionStartTimes[FeatureBits::indexOf(feature)].start();
+        }
+        if (proxy && proxy->isProfilingEnabled()) {
+            proxy->profileIntrospectionStarted(feature);
+        }
 
-        Introspectable introspectable = introspectables[feature];
+        Introspectable introspectable = introspectableFor(feature);
 
         if (!introspectable.mPriv->makesSenseForStatuses.contains(currentStatus)) {
             // No-op satisfy features for which nothing has to be done in
             // the current state
-            setIntrospectCompleted(feature, true);
-            return; // will be called with a single-shot soon again
+            completeFeature(feature, true);
+            completedSynchronously = true;
+            continue;
         }
 
+        bool interfacesPresent = true;
         foreach (const QString &interface, introspectable.mPriv->dependsOnInterfaces) {
             if (!interfaces.contains(interface)) {
                 // If a feature is ready to introspect and depends on a interface
@@ -362,37 +450,88 @@ void ReadinessHelper::Private::iterateIntrospection()
                 debug() << "feature" << feature << "depends on interfaces" <<
                     introspectable.mPriv->dependsOnInterfaces << ", but interface" << interface <<
                     "is not present";
-                setIntrospectCompleted(feature, false,
+                completeFeature(feature, false,
                         TP_QT_ERROR_NOT_AVAILABLE,
                         QLatin1String("Feature depend on interfaces that are not available"));
-                return; // will be called with a single-shot soon again
+                interfacesPresent = false;
+                break;
             }
         }
+        if (!interfacesPresent) {
+            completedSynchronously = true;
+            continue;
+        }
 
         // yes, with the dependency info, we can even parallelize
         // introspection of several features at once, reducing total round trip
         // time considerably with many independent features!
         (*(introspectable.mPriv->introspectFunc))(introspectable.mPriv->introspectFuncData);
     }
+
+    // Anything completed synchronously may have made more features ready to introspect, or
+    // finished some operations
+    return completedSynchronously || completedWhileIterating;
 }
 
-Features ReadinessHelper::Private::depsFor(const Feature &feature)
+void ReadinessHelper::Private::finishOperation(PendingReady *operation)
 {
-    Features deps;
+    QString errorName;
+    QString errorMessage;
+    if (parent->isReady(operation->requestedFeatures(), &errorName, &errorMessage)) {
+        operation->markFinished(true);
+    } else {
+        operation->markFinished(false, errorName, errorMessage);
+    }
+
+    // Emit finished() for everything finished by this and the following iterations at once
+    if (finishedOperations.isEmpty()) {
+        QTimer::singleShot(0, parent, SLOT(emitFinishedOperations()));
+    }
+    finishedOperations.append(operation);
+}
 
-    foreach (Feature dep, introspectables[feature].mPriv->dependsOnFeatures) {
-        deps += dep;
-        deps += depsFor(dep);
+FeatureBits ReadinessHelper::Private::depsFor(const Feature &feature)
+{
+    int index = FeatureBits::indexOf(feature);
+    QHash<int, FeatureBits>::const_iterator i = depsCache.constFind(index);
+    if (i != depsCache.constEnd()) {
+        return i.value();
     }
 
+    FeatureBits deps;
+
+    foreach (const Feature &dep, introspectableFor(feature).mPriv->dependsOnFeatures) {
+        deps.insert(dep);
+        deps |= depsFor(dep);
+    }
+
+    depsCache.insert(index, deps);
     return deps;
 }
 
+void ReadinessHelper::Private::addIntrospectable(const Feature &feature,
+        const Introspectable &introspectable)
+{
+    introspectables.insert(feature, introspectable);
+    introspectablesByIndex.insert(FeatureBits::indexOf(feature), introspectable);
+    supportedStatuses += introspectable.mPriv->makesSenseForStatuses;
+    supportedFeatures.insert(feature);
+
+    // The recursive dependencies of anything could have changed
+    depsCache.clear();
+}
+
+ReadinessHelper::Introspectable ReadinessHelper::Private::introspectableFor(
+        const Feature &feature) const
+{
+    return introspectablesByIndex.value(FeatureBits::indexOf(feature));
+}
+
 void ReadinessHelper::Private::abortOperations(const QString &errorName,
         const QString &errorMessage)
 {
-    foreach (PendingReady *operation, pendingOperations) {
-        operation->setFinishedWithError(errorName, errorMessage);
+    foreach (const Operation &operation, pendingOperations) {
+        operation.first->setFinishedWithError(errorName, errorMessage);
     }
     pendingOperations.clear();
 }
@@ -450,15 +589,12 @@ void ReadinessHelper::addIntrospectables(const Introspectables &introspectables)
                 "introspectable for feature" << feature << "but introspectable "
                 "for this feature already exists";
         } else {
-            Introspectable introspectable = i.value();
-            mPriv->introspectables.insert(feature, introspectable);
-            mPriv->supportedStatuses += introspectable.mPriv->makesSenseForStatuses;
-            mPriv->supportedFeatures += feature;
+            mPriv->addIntrospectable(feature, i.value());
         }
     }
 
     debug() << "ReadinessHelper: new supportedStatuses =" << mPriv->supportedStatuses;
-    debug() << "ReadinessHelper: new supportedFeatures =" << mPriv->supportedFeatures;
+    debug() << "ReadinessHelper: new supportedFeatures =" << mPriv->supportedFeatures.toFeatures();
 }
 
 uint ReadinessHelper::currentStatus() const
@@ -500,17 +636,17 @@ void ReadinessHelper::setInterfaces(const QStringList &interfaces)
 
 Features ReadinessHelper::requestedFeatures() const
 {
-    return mPriv->requestedFeatures;
+    return mPriv->requestedFeatures.toFeatures();
 }
 
 Features ReadinessHelper::actualFeatures() const
 {
-    return mPriv->satisfiedFeatures;
+    return mPriv->satisfiedFeatures.toFeatures();
 }
 
 Features ReadinessHelper::missingFeatures() const
 {
-    return mPriv->missingFeatures;
+    return mPriv->missingFeatures.toFeatures();
 }
 
 bool ReadinessHelper::isReady(const Feature &feature,
@@ -604,10 +740,11 @@ PendingReady *ReadinessHelper::becomeReady(const Features &requestedFeatures)
         }
     }
 
-    Features supportedFeatures = mPriv->supportedFeatures;
-    if (supportedFeatures.intersect(requestedFeatures) != requestedFeatures) {
+    FeatureBits requestedFeatureBits(requestedFeatures);
+    if (!mPriv->supportedFeatures.contains(requestedFeatureBits) ||
+            requestedFeatureBits.count() != requestedFeatures.size()) {
         warning() << "ReadinessHelper::becomeReady called with invalid features: requestedFeatures =" <<
-            requestedFeatures << "- supportedFeatures =" << mPriv->supportedFeatures;
+            requestedFeatures << "- supportedFeatures =" << mPriv->supportedFeatures.toFeatures();
         PendingReady *operation = new PendingReady(SharedPtr<RefCounted>(mPriv->object),
                 requestedFeatures);
         operation->setFinishedWithError(
@@ -624,28 +761,28 @@ PendingReady *ReadinessHelper::becomeReady(const Features &requestedFeatures)
         return operation;
     }
 
-    PendingReady *operation;
-    foreach (operation, mPriv->pendingOperations) {
-        if (operation->requestedFeatures() == requestedFeatures) {
-            return operation;
+    foreach (const Private::Operation &operation, mPriv->pendingOperations) {
+        if (operation.second == requestedFeatureBits) {
+            return operation.first;
         }
     }
 
     // Insert the dependencies of the requested features too
-    Features requestedWithDeps = requestedFeatures;
+    FeatureBits requestedWithDeps = requestedFeatureBits;
     foreach (const Feature &feature, requestedFeatures) {
-        requestedWithDeps.unite(mPriv->depsFor(feature));
+        requestedWithDeps |= mPriv->depsFor(feature);
     }
 
-    mPriv->requestedFeatures += requestedWithDeps;
-    mPriv->pendingFeatures += requestedWithDeps; // will be updated in iterateIntrospection
+    mPriv->requestedFeatures |= requestedWithDeps;
+    mPriv->pendingFeatures |= requestedWithDeps; // will be updated in iterateIntrospection
 
-    operation = new PendingReady(SharedPtr<RefCounted>(mPriv->object), requestedFeatures);
-    mPriv->pendingOperations.append(operation);
+    PendingReady *operation = new PendingReady(SharedPtr<RefCounted>(mPriv->object),
+            requestedFeatures);
+    mPriv->pendingOperations.append(Private::Operation(operation, requestedFeatureBits));
     // Only we finish these PendingReadys, so we don't need destroyed or finished handling for them
     // - we already know when that happens, as we caused it!
 
-    QTimer::singleShot(0, this, SLOT(iterateIntrospection()));
+    mPriv->scheduleIteration();
 
     return operation;
 }
@@ -668,9 +805,40 @@ void ReadinessHelper::setIntrospectCompleted(const Feature &feature, bool succes
 
 void ReadinessHelper::iterateIntrospection()
 {
+    mPriv->iterationScheduled = false;
     mPriv->iterateIntrospection();
 }
 
+void ReadinessHelper::emitFinishedOperations()
+{
+    // A slot connected to finished() may well destroy us, so don't rely on mPriv while emitting
+    QList<PendingReady *> operations = mPriv->finishedOperations;
+    mPriv->finishedOperations.clear();
+
+    foreach (PendingReady *operation, operations) {
+        operation->emitFinished();
+    }
+}
+
+/**
+ * Set a function to be called whenever introspection of a feature finishes, on any object.
+ *
+ * This is meant for instrumentation: \a hook is given the object the feature belongs to, the
+ * feature, whether introspecting it succeeded, and the number of milliseconds it took,
+ * and \a data. Features with nothing to introspect in the current status are reported as well,
+ * as taking no time.
+ *
+ * Only one hook can be set at a time. Pass \c 0 to remove it.
+ *
+ * \param hook The function to call, or \c 0.
+ * \param data Passed as is to \a hook.
+ */
+void ReadinessHelper::setIntrospectionHook(IntrospectionHook hook, void *data)
+{
+    Private::introspectionHook = hook;
+    Private::introspectionHookData = data;
+}
+
 void ReadinessHelper::onProxyInvalidated(DBusProxy *proxy,
         const QString &errorName, const QString &errorMessage)
 {
@@ -51,6 +51,8 @@ class TP_QT_EXPORT ReadinessHelper : public QObject
 
 public:
     typedef void (*IntrospectFunc)(void *data);
+    typedef void (*IntrospectionHook)(RefCounted *object, const Feature &feature, bool success,
+            int elapsedMsecs, void *data);
 
     struct Introspectable {
     public:
@@ -110,11 +112,14 @@ public:
     void setIntrospectCompleted(const Feature &feature, bool success,
             const QDBusError &error);
 
+    static void setIntrospectionHook(IntrospectionHook hook, void *data = 0);
+
 Q_SIGNALS:
     void statusReady(uint status);
 
 private Q_SLOTS:
     TP_QT_NO_EXPORT void iterateIntrospection();
+    TP_QT_NO_EXPORT void emitFinishedOperations();
 
     TP_QT_NO_EXPORT void onProxyInvalidated(Tp::DBusProxy *proxy,
         const QString &errorName, const QString &errorMessage);
@@ -25,6 +25,7 @@
 #include "TelepathyQt/_gen/text-channel.moc.hpp"
 
 #include "TelepathyQt/debug-internal.h"
+#include "TelepathyQt/message-internal.h"
 
 #include <TelepathyQt/Connection>
 #include <TelepathyQt/ConnectionLowlevel>
@@ -37,6 +38,7 @@
 #include <TelepathyQt/ReferencedHandles>
 
 #include <QDateTime>
+#include <QLinkedList>
 
 namespace Tp
 {
@@ -57,6 +59,11 @@ struct TP_QT_NO_EXPORT TextChannel::Private
     void processMessageQueue();
     void processChatStateQueue();
 
+    void appendMessage(const ReceivedMessage &message);
+    bool removeMessage(const ReceivedMessage &message);
+    QList<ReceivedMessage> takeMessages(uint pendingId);
+    void trimMessages();
+
     void contactLost(uint handle);
     void contactFound(ContactPtr contact);
 
@@ -95,7 +102,16 @@ struct TP_QT_NO_EXPORT TextChannel::Private
         ReceivedMessage message;
         uint removed;
     };
-    QList<ReceivedMessage> messages;
+    // The message queue, indexed by pending message ID so that removing k messages is O(k);
+    // the IDs are unique under normal circumstances but this isn't guaranteed
+    typedef QLinkedList<ReceivedMessage> MessageList;
+    MessageList messages;
+    QMultiHash<uint, MessageList::iterator> messagesByPendingId;
+    mutable QList<ReceivedMessage> messageQueue;
+    mutable bool messageQueueChanged;
+    qint64 messagesMemoryUsage;
+    int maxMessages;
+    qint64 maxMessagesMemoryUsage;
     QList<MessageEvent *> incompleteMessages;
     QHash<QDBusPendingCallWatcher *, UIntList> acknowledgeBatches;
 
@@ -125,7 +141,11 @@ TextChannel::Private::Private(TextChannel *parent)
       gotProperties(false),
       messagePartSupport(0),
       deliveryReportingSupport(0),
-      initialMessagesReceived(false)
+      initialMessagesReceived(false),
+      messageQueueChanged(false),
+      messagesMemoryUsage(0),
+      maxMessages(0),
+      maxMessagesMemoryUsage(0)
 {
     ReadinessHelper::Introspectables introspectables;
 
@@ -359,20 +379,14 @@ void TextChannel::Private::processMessageQueue()
 
             // if we reach here, the message is ready
             debug() << "Message is usable, copying to main queue";
-            messages << e->message;
+            appendMessage(e->message);
             emit parent->messageReceived(e->message);
+            trimMessages();
         } else {
             // forget about the message(s) with ID e->removed (there should be
             // at most one under normal circumstances)
-            int i = 0;
-            while (i < messages.size()) {
-                if (messages.at(i).pendingId() == e->removed) {
-                    ReceivedMessage removedMessage = messages.at(i);
-                    messages.removeAt(i);
-                    emit parent->pendingMessageRemoved(removedMessage);
-                } else {
-                    i++;
-                }
+            foreach (const ReceivedMessage &removedMessage, takeMessages(e->removed)) {
+                emit parent->pendingMessageRemoved(removedMessage);
             }
         }
 
@@ -418,6 +432,74 @@ void TextChannel::Private::processMessageQueue()
     awaitingContacts |= contactsRequired.keys().toSet();
 }
 
+void TextChannel::Private::appendMessage(const ReceivedMessage &message)
+{
+    MessageList::iterator it = messages.insert(messages.end(), message);
+    messagesByPendingId.insert(message.pendingId(), it);
+    messagesMemoryUsage += message.memoryUsage();
+    messageQueueChanged = true;
+}
+
+bool TextChannel::Private::removeMessage(const ReceivedMessage &message)
+{
+    QMultiHash<uint, MessageList::iterator>::iterator i =
+        messagesByPendingId.find(message.pendingId());
+    while (i != messagesByPendingId.end() && i.key() == message.pendingId()) {
+        if (*i.value() == message) {
+            messagesMemoryUsage -= message.memoryUsage();
+            messages.erase(i.value());
+            messagesByPendingId.erase(i);
+            messageQueueChanged = true;
+            return true;
+        }
+        ++i;
+    }
+    return false;
+}
+
+QList<ReceivedMessage> TextChannel::Private::takeMessages(uint pendingId)
+{
+    // values() returns the most recently received message first
+    QList<MessageList::iterator> its = messagesByPendingId.values(pendingId);
+    QList<ReceivedMessage> ret;
+    for (int i = its.size() - 1; i >= 0; --i) {
+        ret << *its.at(i);
+        messagesMemoryUsage -= its.at(i)->memoryUsage();
+        messages.erase(its.at(i));
+    }
+
+    if (!ret.isEmpty()) {
+        messagesByPendingId.remove(pendingId);
+        messageQueueChanged = true;
+    }
+    return ret;
+}
+
+void TextChannel::Private::trimMessages()
+{
+    // Forget the oldest messages until the queue is within its limits again, but always keep the
+    // most recent one, even if it's over the memory limit on its own
+    QList<ReceivedMessage> forgotten;
+    while (messages.size() > 1 &&
+            ((maxMessages > 0 && messages.size() > maxMessages) ||
+             (maxMessagesMemoryUsage > 0 && messagesMemoryUsage > maxMessagesMemoryUsage))) {
+        ReceivedMessage message = messages.first();
+        removeMessage(message);
+        forgotten << message;
+    }
+
+    if (forgotten.isEmpty()) {
+        return;
+    }
+
+    debug() << "Message queue over its limits, forgetting the" << forgotten.size() <<
+        "oldest messages";
+    foreach (const ReceivedMessage &message, forgotten) {
+        emit parent->pendingMessageRemoved(message);
+    }
+    emit parent->messageQueueOverflowed(forgotten);
+}
+
 void TextChannel::Private::processChatStateQueue()
 {
     while (!chatStateQueue.isEmpty()) {
@@ -607,6 +689,20 @@ const Feature TextChannel::FeatureChatState = Feature(QLatin1String(TextChannel:
  * \sa messageQueue(), acknowledge(), forget()
  */
 
+/**
+ * \fn void TextChannel::messageQueueOverflowed(
+ *      const QList<Tp::ReceivedMessage> &forgottenMessages)
+ *
+ * Emitted when messages are forgotten because messageQueue() went over the limits set with
+ * setMessageQueueLengthLimit() or setMessageQueueMemoryLimit().
+ *
+ * pendingMessageRemoved() has already been emitted for each of the messages when this signal is
+ * emitted. The messages have not been acknowledged.
+ *
+ * \param forgottenMessages The messages removed from the queue, oldest first.
+ * \sa messageQueue(), forget()
+ */
+
 /**
  * \fn void TextChannel::chatStateChanged(const Tp::ContactPtr &contact,
  *      ChannelChatState state)
@@ -816,7 +912,9 @@ DeliveryReportingSupportFlags TextChannel::deliveryReportingSupport() const
  * Messages are removed from this list when they are acknowledged with the
  * acknowledge() or forget() methods. On channels where hasMessagesInterface()
  * returns \c true, they will also be removed when acknowledged by a different
- * client. In either case, the pendingMessageRemoved() signal is emitted.
+ * client. If limits have been set with setMessageQueueLengthLimit() or
+ * setMessageQueueMemoryLimit(), the oldest messages are also forgotten when the
+ * queue goes over them. In all cases, the pendingMessageRemoved() signal is emitted.
  *
  * This method requires TextChannel::FeatureMessageQueue to be ready.
  *
@@ -825,7 +923,90 @@ DeliveryReportingSupportFlags TextChannel::deliveryReportingSupport() const
  */
 QList<ReceivedMessage> TextChannel::messageQueue() const
 {
-    return mPriv->messages;
+    if (mPriv->messageQueueChanged) {
+        mPriv->messageQueue.clear();
+        foreach (const ReceivedMessage &message, mPriv->messages) {
+            mPriv->messageQueue << message;
+        }
+        mPriv->messageQueueChanged = false;
+    }
+    return mPriv->messageQueue;
+}
+
+/**
+ * Return an estimate of the memory used by the messages in messageQueue(), in bytes.
+ *
+ * This method requires TextChannel::FeatureMessageQueue to be ready.
+ *
+ * \return The estimated memory usage of the message queue in bytes.
+ * \sa setMessageQueueMemoryLimit()
+ */
+qint64 TextChannel::messageQueueMemoryUsage() const
+{
+    return mPriv->messagesMemoryUsage;
+}
+
+/**
+ * Return the maximum number of messages kept in messageQueue(), or 0 if the
+ * number of messages is not limited.
+ *
+ * \return The message queue length limit.
+ * \sa setMessageQueueLengthLimit()
+ */
+int TextChannel::messageQueueLengthLimit() const
+{
+    return mPriv->maxMessages;
+}
+
+/**
+ * Set the maximum number of messages kept in messageQueue().
+ *
+ * When a message is received while the queue already holds \a maxMessages messages, the oldest
+ * messages are removed from the queue as if forget() had been called for them, and
+ * messageQueueOverflowed() is emitted. This is meant for clients that are not the main handler
+ * of the channel, such as loggers or SimpleTextObserver users, that would otherwise have to
+ * forget() every message themselves to avoid the queue growing without bound.
+ *
+ * Lowering the limit trims the queue immediately. The number of messages is not limited by
+ * default.
+ *
+ * \param maxMessages The message queue length limit, or 0 to not limit the number of messages.
+ * \sa messageQueueLengthLimit(), setMessageQueueMemoryLimit()
+ */
+void TextChannel::setMessageQueueLengthLimit(int maxMessages)
+{
+    mPriv->maxMessages = qMax(maxMessages, 0);
+    mPriv->trimMessages();
+}
+
+/**
+ * Return the maximum estimated memory usage of messageQueue() in bytes, or 0 if the
+ * memory usage is not limited.
+ *
+ * \return The message queue memory limit in bytes.
+ * \sa setMessageQueueMemoryLimit(), messageQueueMemoryUsage()
+ */
+qint64 TextChannel::messageQueueMemoryLimit() const
+{
+    return mPriv->maxMessagesMemoryUsage;
+}
+
+/**
+ * Set the maximum estimated memory usage of messageQueue() in bytes.
+ *
+ * This works like setMessageQueueLengthLimit(), using the estimate returned by
+ * messageQueueMemoryUsage() instead of the number of messages. The most recently received message
+ * is always kept, even if it is bigger than \a maxBytes on its own.
+ *
+ * Lowering the limit trims the queue immediately. The memory usage is not limited by default.
+ *
+ * \param maxBytes The message queue memory limit in bytes, or 0 to not limit the memory usage.
+ * \sa messageQueueMemoryLimit(), messageQueueMemoryUsage(), setMessageQueueLengthLimit()
+ */
+void TextChannel::setMessageQueueMemoryLimit(qint64 maxBytes)
+{
+    mPriv->maxMessagesMemoryUsage = qMax(maxBytes, Q_INT64_C(0));
+    mPriv->trimMessages();
 }
 
 /**
@@ -936,7 +1117,7 @@ void TextChannel::forget(const QList<ReceivedMessage> &messages)
     foreach (const ReceivedMessage &m, messages) {
         if (!m.isFromChannel(TextChannelPtr(this))) {
             warning() << "message did not come from this channel, ignoring";
-        } else if (mPriv->messages.removeOne(m)) {
+        } else if (mPriv->removeMessage(m)) {
             emit pendingMessageRemoved(m);
         }
     }
@@ -1142,28 +1323,28 @@ void TextChannel::onTextReceived(uint id, uint timestamp, uint sender,
     if (timestamp == 0) {
         timestamp = QDateTime::currentDateTime().toTime_t();
     }
-    header.insert(QLatin1String("message-received"),
+    header.insert(MessagePartKeys::messageReceived,
             QDBusVariant(static_cast<qlonglong>(timestamp)));
 
-    header.insert(QLatin1String("pending-message-id"), QDBusVariant(id));
-    header.insert(QLatin1String("message-sender"), QDBusVariant(sender));
-    header.insert(QLatin1String("message-type"), QDBusVariant(type));
+    header.insert(MessagePartKeys::pendingMessageId, QDBusVariant(id));
+    header.insert(MessagePartKeys::messageSender, QDBusVariant(sender));
+    header.insert(MessagePartKeys::messageType, QDBusVariant(type));
 
     if (flags & ChannelTextMessageFlagScrollback) {
-        header.insert(QLatin1String("scrollback"), QDBusVariant(true));
+        header.insert(MessagePartKeys::scrollback, QDBusVariant(true));
     }
     if (flags & ChannelTextMessageFlagRescued) {
-        header.insert(QLatin1String("rescued"), QDBusVariant(true));
+        header.insert(MessagePartKeys::rescued, QDBusVariant(true));
     }
 
     MessagePart body;
 
-    body.insert(QLatin1String("content-type"),
-            QDBusVariant(QLatin1String("text/plain")));
-    body.insert(QLatin1String("content"), QDBusVariant(text));
+    body.insert(MessagePartKeys::contentType,
+            QDBusVariant(MessagePartKeys::textPlain));
+    body.insert(MessagePartKeys::content, QDBusVariant(text));
 
     if (flags & ChannelTextMessageFlagTruncated) {
-        header.insert(QLatin1String("truncated"), QDBusVariant(true));
+        header.insert(MessagePartKeys::truncated, QDBusVariant(true));
     }
 
     MessagePartList parts;
@@ -1190,10 +1371,10 @@ void TextChannel::onTextSendError(uint error, uint timestamp, uint type,
 
     MessagePart header;
 
-    header.insert(QLatin1String("message-received"),
+    header.insert(MessagePartKeys::messageReceived,
             QDBusVariant(static_cast<qlonglong>(
                     QDateTime::currentDateTime().toTime_t())));
-    header.insert(QLatin1String("message-type"),
+    header.insert(MessagePartKeys::messageType,
             QDBusVariant(static_cast<uint>(
                     ChannelTextMessageTypeDeliveryReport)));
 
@@ -1218,25 +1399,25 @@ void TextChannel::onTextSendError(uint error, uint timestamp, uint type,
             break;
     }
 
-    header.insert(QLatin1String("delivery-status"),
+    header.insert(MessagePartKeys::deliveryStatus,
             QDBusVariant(deliveryStatus));
-    header.insert(QLatin1String("delivery-error"), QDBusVariant(error));
+    header.insert(MessagePartKeys::deliveryError, QDBusVariant(error));
 
     MessagePart echoHeader;
-    echoHeader.insert(QLatin1String("message-sent"),
+    echoHeader.insert(MessagePartKeys::messageSent,
             QDBusVariant(timestamp));
-    echoHeader.insert(QLatin1String("message-type"),
+    echoHeader.insert(MessagePartKeys::messageType,
             QDBusVariant(type));
 
     MessagePart echoBody;
-    echoBody.insert(QLatin1String("content-type"),
-            QDBusVariant(QLatin1String("text/plain")));
-    echoBody.insert(QLatin1String("content"), QDBusVariant(text));
+    echoBody.insert(MessagePartKeys::contentType,
+            QDBusVariant(MessagePartKeys::textPlain));
+    echoBody.insert(MessagePartKeys::content, QDBusVariant(text));
 
     MessagePartList echo;
     echo << echoHeader;
     echo << echoBody;
-    header.insert(QLatin1String("delivery-echo"),
+    header.insert(MessagePartKeys::deliveryEcho,
             QDBusVariant(QVariant::fromValue(echo)));
 
     MessagePartList parts;
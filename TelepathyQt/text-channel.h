@@ -67,6 +67,12 @@ public:
 
     // requires FeatureMessageQueue
     QList<ReceivedMessage> messageQueue() const;
+    qint64 messageQueueMemoryUsage() const;
+
+    int messageQueueLengthLimit() const;
+    void setMessageQueueLengthLimit(int maxMessages);
+    qint64 messageQueueMemoryLimit() const;
+    void setMessageQueueMemoryLimit(qint64 maxBytes);
 
     // requires FeatureChatState
     ChannelChatState chatState(const ContactPtr &contact) const;
@@ -102,6 +108,8 @@ Q_SIGNALS:
     void messageReceived(const Tp::ReceivedMessage &message);
     void pendingMessageRemoved(
             const Tp::ReceivedMessage &message);
+    void messageQueueOverflowed(
+            const QList<Tp::ReceivedMessage> &forgottenMessages);
 
     // FeatureChatState
     void chatStateChanged(const Tp::ContactPtr &contact,
@@ -0,0 +1,256 @@
+#include <tests/lib/test.h>
+
+#include <tests/lib/glib-helpers/test-conn-helper.h>
+
+#include <tests/lib/glib/contacts-conn.h>
+#include <tests/lib/glib/echo/chan.h>
+
+#include <TelepathyQt/Account>
+#include <TelepathyQt/AccountManager>
+#include <TelepathyQt/AbstractClientObserver>
+#include <TelepathyQt/Channel>
+#include <TelepathyQt/ChannelClassSpec>
+#include <TelepathyQt/ClientObserverInterface>
+#include <TelepathyQt/ClientRegistrar>
+#include <TelepathyQt/Connection>
+#include <TelepathyQt/Debug>
+#include <TelepathyQt/MethodInvocationContext>
+#include <TelepathyQt/PendingAccount>
+#include <TelepathyQt/PendingReady>
+#include <TelepathyQt/TextChannel>
+
+#include <telepathy-glib/telepathy-glib.h>
+
+using namespace Tp;
+using namespace Tp::Client;
+
+class CountingObserver : public QObject, public AbstractClientObserver
+{
+    Q_OBJECT
+
+public:
+    static SharedPtr<CountingObserver> create(const ChannelClassSpecList &channelFilter)
+    {
+        return SharedPtr<CountingObserver>(new CountingObserver(channelFilter));
+    }
+
+    CountingObserver(const ChannelClassSpecList &channelFilter)
+        : AbstractClientObserver(channelFilter),
+          mObserved(0)
+    {
+    }
+
+    void observeChannels(const MethodInvocationContextPtr<> &context,
+            const AccountPtr &account,
+            const ConnectionPtr &connection,
+            const QList<ChannelPtr> &channels,
+            const ChannelDispatchOperationPtr &dispatchOperation,
+            const QList<ChannelRequestPtr> &requestsSatisfied,
+            const AbstractClientObserver::ObserverInfo &observerInfo)
+    {
+        Q_UNUSED(account);
+        Q_UNUSED(connection);
+        Q_UNUSED(dispatchOperation);
+        Q_UNUSED(requestsSatisfied);
+        Q_UNUSED(observerInfo);
+
+        mObserved += channels.size();
+        mLastChannel = channels.last();
+        context->setFinished();
+        Q_EMIT channelsObserved();
+    }
+
+    int mObserved;
+    ChannelPtr mLastChannel;
+
+Q_SIGNALS:
+    void channelsObserved();
+};
+
+// Measures how many ObserveChannels calls ClientRegistrar gets through per second, from the call
+// arriving on the bus to the observer being invoked with ready proxies
+class BenchmarkClientRegistrar : public Test
+{
+    Q_OBJECT
+
+public:
+    BenchmarkClientRegistrar(QObject *parent = 0)
+        : Test(parent),
+          mConn(0), mChanService(0), mExpected(0)
+    { }
+
+protected Q_SLOTS:
+    void onChannelsObserved();
+
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+
+    void benchmarkObserveChannels_data();
+    void benchmarkObserveChannels();
+
+    void cleanup();
+    void cleanupTestCase();
+
+private:
+    AccountManagerPtr mAM;
+    AccountPtr mAccount;
+    TestConnHelper *mConn;
+    ExampleEchoChannel *mChanService;
+    QString mChanPath;
+    QVariantMap mChanProps;
+    ClientRegistrarPtr mClientRegistrar;
+    SharedPtr<CountingObserver> mObserver;
+    ClientObserverInterface *mObserverIface;
+    int mExpected;
+};
+
+void BenchmarkClientRegistrar::onChannelsObserved()
+{
+    if (mObserver->mObserved == mExpected) {
+        mLoop->exit(0);
+    }
+}
+
+void BenchmarkClientRegistrar::initTestCase()
+{
+    initTestCaseImpl();
+
+    // Debug output would be what's measured otherwise
+    Tp::enableDebug(false);
+
+    g_type_init();
+    g_set_prgname("benchmark-client-registrar");
+    dbus_g_bus_get(DBUS_BUS_STARTER, 0);
+
+    mAM = AccountManager::create();
+    QVERIFY(connect(mAM->becomeReady(),
+                    SIGNAL(finished(Tp::PendingOperation*)),
+                    SLOT(expectSuccessfulCall(Tp::PendingOperation*))));
+    QCOMPARE(mLoop->exec(), 0);
+
+    QVariantMap parameters;
+    parameters[QLatin1String("account")] = QLatin1String("foobar");
+    PendingAccount *pacc = mAM->createAccount(QLatin1String("foo"),
+            QLatin1String("bar"), QLatin1String("foobar"), parameters);
+    QVERIFY(connect(pacc,
+                    SIGNAL(finished(Tp::PendingOperation*)),
+                    SLOT(expectSuccessfulCall(Tp::PendingOperation*))));
+    QCOMPARE(mLoop->exec(), 0);
+    QVERIFY(pacc->account());
+    mAccount = pacc->account();
+
+    mConn = new TestConnHelper(this,
+            TP_TESTS_TYPE_CONTACTS_CONNECTION,
+            "account", "me@example.com",
+            "protocol", "example",
+            NULL);
+    QCOMPARE(mConn->connect(), true);
+
+    TpHandleRepoIface *contactRepo = tp_base_connection_get_handles(
+            TP_BASE_CONNECTION(mConn->service()), TP_HANDLE_TYPE_CONTACT);
+    guint handle = tp_handle_ensure(contactRepo, "someone@localhost", 0, 0);
+
+    // create a Channel by magic, rather than doing D-Bus round-trips for it
+    mChanPath = mConn->objectPath() + QLatin1String("/TextChannel");
+    QByteArray chanPath(mChanPath.toLatin1());
+    mChanService = EXAMPLE_ECHO_CHANNEL(g_object_new(
+                EXAMPLE_TYPE_ECHO_CHANNEL,
+                "connection", mConn->service(),
+                "object-path", chanPath.data(),
+                "handle", handle,
+                NULL));
+
+    // What the channel dispatcher would pass along, so that the channel factory builds a
+    // TextChannel for it like it would for a real observer
+    mChanProps.insert(TP_QT_IFACE_CHANNEL + QLatin1String(".ChannelType"),
+            TP_QT_IFACE_CHANNEL_TYPE_TEXT);
+    mChanProps.insert(TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandleType"),
+            (uint) Tp::HandleTypeContact);
+    mChanProps.insert(TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandle"), handle);
+    mChanProps.insert(TP_QT_IFACE_CHANNEL + QLatin1String(".TargetID"),
+            QLatin1String("someone@localhost"));
+    mChanProps.insert(TP_QT_IFACE_CHANNEL + QLatin1String(".Requested"), false);
+    mChanProps.insert(TP_QT_IFACE_CHANNEL + QLatin1String(".InitiatorHandle"), handle);
+    mChanProps.insert(TP_QT_IFACE_CHANNEL + QLatin1String(".InitiatorID"),
+            QLatin1String("someone@localhost"));
+
+    mClientRegistrar = ClientRegistrar::create();
+    mObserver = CountingObserver::create(ChannelClassSpecList() << ChannelClassSpec::textChat());
+    QVERIFY(connect(mObserver.data(),
+                    SIGNAL(channelsObserved()),
+                    SLOT(onChannelsObserved())));
+    QVERIFY(mClientRegistrar->registerClient(AbstractClientPtr::dynamicCast(mObserver),
+                QLatin1String("benchmark")));
+
+    mObserverIface = new ClientObserverInterface(mClientRegistrar->dbusConnection(),
+            QLatin1String("org.freedesktop.Telepathy.Client.benchmark"),
+            QLatin1String("/org/freedesktop/Telepathy/Client/benchmark"), this);
+}
+
+void BenchmarkClientRegistrar::init()
+{
+    initImpl();
+
+    mObserver->mObserved = 0;
+}
+
+void BenchmarkClientRegistrar::benchmarkObserveChannels_data()
+{
+    QTest::addColumn<int>("numCalls");
+
+    QTest::newRow("1") << 1;
+    QTest::newRow("100") << 100;
+}
+
+void BenchmarkClientRegistrar::benchmarkObserveChannels()
+{
+    QFETCH(int, numCalls);
+
+    ChannelDetailsList channelDetailsList;
+    ChannelDetails channelDetails = { QDBusObjectPath(mChanPath), mChanProps };
+    channelDetailsList.append(channelDetails);
+
+    QBENCHMARK {
+        mObserver->mObserved = 0;
+        mExpected = numCalls;
+
+        // The calls are all in flight at once, like a dispatcher busy with many channels would be
+        for (int i = 0; i < numCalls; ++i) {
+            mObserverIface->ObserveChannels(QDBusObjectPath(mAccount->objectPath()),
+                    QDBusObjectPath(mConn->objectPath()),
+                    channelDetailsList,
+                    QDBusObjectPath("/"),
+                    ObjectPathList(),
+                    QVariantMap());
+        }
+        QCOMPARE(mLoop->exec(), 0);
+    }
+
+    // The channel factory matched the immutable properties to the text channel class
+    QVERIFY(!TextChannelPtr::qObjectCast(mObserver->mLastChannel).isNull());
+}
+
+void BenchmarkClientRegistrar::cleanup()
+{
+    cleanupImpl();
+}
+
+void BenchmarkClientRegistrar::cleanupTestCase()
+{
+    mClientRegistrar->unregisterClients();
+    mClientRegistrar.reset();
+
+    QCOMPARE(mConn->disconnect(), true);
+    delete mConn;
+
+    if (mChanService != 0) {
+        g_object_unref(mChanService);
+        mChanService = 0;
+    }
+
+    cleanupTestCaseImpl();
+}
+
+QTEST_MAIN(BenchmarkClientRegistrar)
+#include "_gen/client-registrar.cpp.moc.hpp"
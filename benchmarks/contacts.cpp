@@ -0,0 +1,159 @@
+#include <tests/lib/test.h>
+
+#include <tests/lib/glib-helpers/test-conn-helper.h>
+
+#include <tests/lib/glib/contacts-conn.h>
+
+#include <TelepathyQt/Connection>
+#include <TelepathyQt/Contact>
+#include <TelepathyQt/ContactManager>
+#include <TelepathyQt/Debug>
+#include <TelepathyQt/PendingContacts>
+
+#include <telepathy-glib/telepathy-glib.h>
+
+using namespace Tp;
+
+// Measures the latency of ContactManager::contactsForHandles(), both for contacts the manager has
+// never seen and for contacts it already holds with the requested features
+class BenchmarkContacts : public Test
+{
+    Q_OBJECT
+
+public:
+    BenchmarkContacts(QObject *parent = 0)
+        : Test(parent), mConn(0), mContactRepo(0)
+    { }
+
+protected Q_SLOTS:
+    void expectPendingContactsFinished(Tp::PendingOperation *op);
+
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+
+    void benchmarkForHandles_data();
+    void benchmarkForHandles();
+
+    void cleanup();
+    void cleanupTestCase();
+
+private:
+    UIntList ensureHandles(const QString &prefix, int count);
+
+    TestConnHelper *mConn;
+    TpHandleRepoIface *mContactRepo;
+    QList<ContactPtr> mContacts;
+};
+
+void BenchmarkContacts::expectPendingContactsFinished(Tp::PendingOperation *op)
+{
+    TEST_VERIFY_OP(op);
+
+    PendingContacts *pending = qobject_cast<PendingContacts *>(op);
+    mContacts = pending->contacts();
+    mLoop->exit(0);
+}
+
+UIntList BenchmarkContacts::ensureHandles(const QString &prefix, int count)
+{
+    UIntList handles;
+    for (int i = 0; i < count; ++i) {
+        QByteArray id = QString(QLatin1String("%1-%2@example.com")).arg(prefix).arg(i).toLatin1();
+        handles << tp_handle_ensure(mContactRepo, id.constData(), NULL, NULL);
+    }
+    return handles;
+}
+
+void BenchmarkContacts::initTestCase()
+{
+    initTestCaseImpl();
+
+    // Debug output would be what's measured otherwise
+    Tp::enableDebug(false);
+
+    g_type_init();
+    g_set_prgname("benchmark-contacts");
+    dbus_g_bus_get(DBUS_BUS_STARTER, 0);
+
+    mConn = new TestConnHelper(this,
+            TP_TESTS_TYPE_CONTACTS_CONNECTION,
+            "account", "me@example.com",
+            "protocol", "example",
+            NULL);
+    QCOMPARE(mConn->connect(), true);
+
+    mContactRepo = tp_base_connection_get_handles(TP_BASE_CONNECTION(mConn->service()),
+            TP_HANDLE_TYPE_CONTACT);
+}
+
+void BenchmarkContacts::init()
+{
+    initImpl();
+}
+
+void BenchmarkContacts::benchmarkForHandles_data()
+{
+    QTest::addColumn<int>("numContacts");
+    QTest::addColumn<bool>("cached");
+
+    QTest::newRow("1 cold") << 1 << false;
+    QTest::newRow("1 cached") << 1 << true;
+    QTest::newRow("100 cold") << 100 << false;
+    QTest::newRow("100 cached") << 100 << true;
+    QTest::newRow("1000 cold") << 1000 << false;
+    QTest::newRow("1000 cached") << 1000 << true;
+}
+
+void BenchmarkContacts::benchmarkForHandles()
+{
+    QFETCH(int, numContacts);
+    QFETCH(bool, cached);
+
+    UIntList handles = ensureHandles(QString(QLatin1String("%1-%2"))
+            .arg(QLatin1String(cached ? "cached" : "cold")).arg(numContacts), numContacts);
+    Features features = Features()
+        << Contact::FeatureAlias
+        << Contact::FeatureAvatarToken
+        << Contact::FeatureSimplePresence;
+
+    QList<ContactPtr> held;
+    if (cached) {
+        held = mConn->contacts(handles, features);
+        QCOMPARE(held.size(), numContacts);
+    }
+
+    ContactManagerPtr manager = mConn->client()->contactManager();
+    QBENCHMARK {
+        QVERIFY(connect(manager->contactsForHandles(handles, features),
+                    SIGNAL(finished(Tp::PendingOperation*)),
+                    SLOT(expectPendingContactsFinished(Tp::PendingOperation*))));
+        QCOMPARE(mLoop->exec(), 0);
+        QCOMPARE(mContacts.size(), numContacts);
+
+        if (!cached) {
+            // Drop the contacts so the next iteration builds them again
+            mContacts.clear();
+            QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+        }
+    }
+
+    mContacts.clear();
+    held.clear();
+}
+
+void BenchmarkContacts::cleanup()
+{
+    cleanupImpl();
+}
+
+void BenchmarkContacts::cleanupTestCase()
+{
+    QCOMPARE(mConn->disconnect(), true);
+    delete mConn;
+
+    cleanupTestCaseImpl();
+}
+
+QTEST_MAIN(BenchmarkContacts)
+#include "_gen/contacts.cpp.moc.hpp"
@@ -0,0 +1,291 @@
+#include <tests/lib/test.h>
+
+#include <tests/lib/glib-helpers/test-conn-helper.h>
+
+#include <tests/lib/glib/file-transfer-chan.h>
+#include <tests/lib/glib/simple-conn.h>
+
+#include <TelepathyQt/Connection>
+#include <TelepathyQt/Debug>
+#include <TelepathyQt/IncomingFileTransferChannel>
+#include <TelepathyQt/OutgoingFileTransferChannel>
+#include <TelepathyQt/PendingReady>
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#include <QBuffer>
+#include <QFile>
+#include <QFileInfo>
+#include <QTemporaryFile>
+
+using namespace Tp;
+
+// Measures file transfer throughput in both directions. Each iteration moves the whole file, so
+// the throughput is the data size divided by the reported time per iteration.
+//
+// Transfers from and to a real file take the zero-copy paths (sendfile() and splice()), while
+// the in-memory buffer rows measure the copying fallback for comparison.
+class BenchmarkFileTransfer : public Test
+{
+    Q_OBJECT
+
+public:
+    BenchmarkFileTransfer(QObject *parent = 0)
+        : Test(parent),
+          mConn(0), mChanService(0)
+    { }
+
+protected Q_SLOTS:
+    void onStateChanged(Tp::FileTransferState state);
+
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+
+    void benchmarkSend_data();
+    void benchmarkSend();
+    void benchmarkReceive_data();
+    void benchmarkReceive();
+
+    void cleanup();
+    void cleanupTestCase();
+
+private:
+    void createOutgoingChannel(qulonglong size);
+    void createIncomingChannel(const QByteArray &content);
+    QByteArray testData(int size) const;
+
+    TestConnHelper *mConn;
+    TpTestsFileTransferChannel *mChanService;
+    OutgoingFileTransferChannelPtr mChan;
+    IncomingFileTransferChannelPtr mIncomingChan;
+};
+
+void BenchmarkFileTransfer::onStateChanged(Tp::FileTransferState state)
+{
+    if (state == FileTransferStateCompleted || state == FileTransferStateCancelled) {
+        mLoop->exit(0);
+    }
+}
+
+QByteArray BenchmarkFileTransfer::testData(int size) const
+{
+    QByteArray data(size, '\0');
+    for (int i = 0; i < size; ++i) {
+        data[i] = (char) (i * 7 + i / 251);
+    }
+    return data;
+}
+
+void BenchmarkFileTransfer::createOutgoingChannel(qulonglong size)
+{
+    mChan.reset();
+    mIncomingChan.reset();
+    mLoop->processEvents();
+    tp_clear_object(&mChanService);
+
+    QString chanPath = QString(QLatin1String("%1/FileTransferChannel")).arg(mConn->objectPath());
+
+    TpHandleRepoIface *contactRepo = tp_base_connection_get_handles(
+            TP_BASE_CONNECTION(mConn->service()), TP_HANDLE_TYPE_CONTACT);
+    TpHandle handle = tp_handle_ensure(contactRepo, "bob", NULL, NULL);
+    TpHandle selfHandle = tp_base_connection_get_self_handle(
+            TP_BASE_CONNECTION(mConn->service()));
+
+    mChanService = TP_TESTS_FILE_TRANSFER_CHANNEL(g_object_new(
+            TP_TESTS_TYPE_FILE_TRANSFER_CHANNEL,
+            "connection", mConn->service(),
+            "handle", handle,
+            "requested", TRUE,
+            "object-path", chanPath.toLatin1().constData(),
+            "initiator-handle", selfHandle,
+            "filename", "benchmark.bin",
+            "size", (guint64) size,
+            NULL));
+
+    mChan = OutgoingFileTransferChannel::create(mConn->client(), chanPath, QVariantMap());
+    QVERIFY(connect(mChan->becomeReady(OutgoingFileTransferChannel::FeatureCore),
+                SIGNAL(finished(Tp::PendingOperation*)),
+                SLOT(expectSuccessfulCall(Tp::PendingOperation*))));
+    QCOMPARE(mLoop->exec(), 0);
+    QVERIFY(connect(mChan.data(),
+                SIGNAL(stateChanged(Tp::FileTransferState,Tp::FileTransferStateChangeReason)),
+                SLOT(onStateChanged(Tp::FileTransferState))));
+}
+
+void BenchmarkFileTransfer::createIncomingChannel(const QByteArray &content)
+{
+    mChan.reset();
+    mIncomingChan.reset();
+    mLoop->processEvents();
+    tp_clear_object(&mChanService);
+
+    QString chanPath = QString(QLatin1String("%1/FileTransferChannel")).arg(mConn->objectPath());
+
+    TpHandleRepoIface *contactRepo = tp_base_connection_get_handles(
+            TP_BASE_CONNECTION(mConn->service()), TP_HANDLE_TYPE_CONTACT);
+    TpHandle handle = tp_handle_ensure(contactRepo, "bob", NULL, NULL);
+
+    mChanService = TP_TESTS_FILE_TRANSFER_CHANNEL(g_object_new(
+            TP_TESTS_TYPE_FILE_TRANSFER_CHANNEL,
+            "connection", mConn->service(),
+            "handle", handle,
+            "requested", FALSE,
+            "object-path", chanPath.toLatin1().constData(),
+            "initiator-handle", handle,
+            "filename", "benchmark.bin",
+            "size", (guint64) content.size(),
+            NULL));
+    tp_tests_file_transfer_channel_set_content(mChanService,
+            (const guint8 *) content.constData(), content.size());
+
+    mIncomingChan = IncomingFileTransferChannel::create(mConn->client(), chanPath, QVariantMap());
+    QVERIFY(connect(mIncomingChan->becomeReady(IncomingFileTransferChannel::FeatureCore),
+                SIGNAL(finished(Tp::PendingOperation*)),
+                SLOT(expectSuccessfulCall(Tp::PendingOperation*))));
+    QCOMPARE(mLoop->exec(), 0);
+    QVERIFY(connect(mIncomingChan.data(),
+                SIGNAL(stateChanged(Tp::FileTransferState,Tp::FileTransferStateChangeReason)),
+                SLOT(onStateChanged(Tp::FileTransferState))));
+}
+
+void BenchmarkFileTransfer::initTestCase()
+{
+    initTestCaseImpl();
+
+    // Debug output would be what's measured otherwise
+    Tp::enableDebug(false);
+
+    g_type_init();
+    g_set_prgname("benchmark-file-transfer");
+    dbus_g_bus_get(DBUS_BUS_STARTER, 0);
+
+    mConn = new TestConnHelper(this,
+            TP_TESTS_TYPE_SIMPLE_CONNECTION,
+            "account", "me@example.com",
+            "protocol", "example",
+            NULL);
+    QCOMPARE(mConn->connect(), true);
+}
+
+void BenchmarkFileTransfer::init()
+{
+    initImpl();
+}
+
+void BenchmarkFileTransfer::benchmarkSend_data()
+{
+    QTest::addColumn<int>("size");
+    QTest::addColumn<bool>("useFile");
+
+    QTest::newRow("1 MiB, buffer") << 1024 * 1024 << false;
+    QTest::newRow("1 MiB, file") << 1024 * 1024 << true;
+    QTest::newRow("16 MiB, buffer") << 16 * 1024 * 1024 << false;
+    QTest::newRow("16 MiB, file") << 16 * 1024 * 1024 << true;
+}
+
+void BenchmarkFileTransfer::benchmarkSend()
+{
+    QFETCH(int, size);
+    QFETCH(bool, useFile);
+
+    QByteArray data = testData(size);
+    QBuffer buffer(&data);
+
+    QTemporaryFile source;
+    QVERIFY(source.open());
+    QCOMPARE(source.write(data), (qint64) size);
+    source.close();
+    QFile file(source.fileName());
+
+    QIODevice *input = useFile ? static_cast<QIODevice *>(&file) : &buffer;
+
+    QBENCHMARK {
+        // Setting up the channel is part of each iteration, but cheap next to the transfer itself
+        createOutgoingChannel(size);
+        QVERIFY(input->open(QIODevice::ReadOnly));
+
+        QVERIFY(connect(mChan->provideFile(input),
+                    SIGNAL(finished(Tp::PendingOperation*)),
+                    SLOT(expectSuccessfulCall(Tp::PendingOperation*))));
+        QCOMPARE(mLoop->exec(), 0);
+        while (mChan->state() != FileTransferStateCompleted) {
+            QCOMPARE(mLoop->exec(), 0);
+        }
+
+        input->close();
+    }
+
+    QCOMPARE((int) tp_tests_file_transfer_channel_get_received_data(mChanService)->len, size);
+}
+
+void BenchmarkFileTransfer::benchmarkReceive_data()
+{
+    QTest::addColumn<int>("size");
+    QTest::addColumn<bool>("useFile");
+
+    QTest::newRow("1 MiB, buffer") << 1024 * 1024 << false;
+    QTest::newRow("1 MiB, file") << 1024 * 1024 << true;
+    QTest::newRow("16 MiB, buffer") << 16 * 1024 * 1024 << false;
+    QTest::newRow("16 MiB, file") << 16 * 1024 * 1024 << true;
+}
+
+void BenchmarkFileTransfer::benchmarkReceive()
+{
+    QFETCH(int, size);
+    QFETCH(bool, useFile);
+
+    QByteArray data = testData(size);
+    QByteArray received;
+    QBuffer buffer(&received);
+
+    QTemporaryFile target;
+    QVERIFY(target.open());
+    target.close();
+    QFile file(target.fileName());
+
+    QIODevice *output = useFile ? static_cast<QIODevice *>(&file) : &buffer;
+
+    QBENCHMARK {
+        createIncomingChannel(data);
+        received.clear();
+        QVERIFY(output->open(QIODevice::WriteOnly | QIODevice::Truncate));
+
+        QVERIFY(connect(mIncomingChan->acceptFile(0, output),
+                    SIGNAL(finished(Tp::PendingOperation*)),
+                    SLOT(expectSuccessfulCall(Tp::PendingOperation*))));
+        QCOMPARE(mLoop->exec(), 0);
+        while (mIncomingChan->state() != FileTransferStateCompleted) {
+            QCOMPARE(mLoop->exec(), 0);
+        }
+
+        output->close();
+    }
+
+    if (useFile) {
+        QCOMPARE(QFileInfo(file.fileName()).size(), (qint64) size);
+    } else {
+        QCOMPARE(received.size(), size);
+    }
+}
+
+void BenchmarkFileTransfer::cleanup()
+{
+    mChan.reset();
+    mIncomingChan.reset();
+    mLoop->processEvents();
+    tp_clear_object(&mChanService);
+
+    cleanupImpl();
+}
+
+void BenchmarkFileTransfer::cleanupTestCase()
+{
+    QCOMPARE(mConn->disconnect(), true);
+    delete mConn;
+
+    cleanupTestCaseImpl();
+}
+
+QTEST_MAIN(BenchmarkFileTransfer)
+#include "_gen/file-transfer.cpp.moc.hpp"
@@ -0,0 +1,124 @@
+#include <tests/lib/test.h>
+
+#include <tests/lib/glib-helpers/test-conn-helper.h>
+
+#include <tests/lib/glib/contact-list-manager.h>
+#include <tests/lib/glib/contacts-conn.h>
+
+#include <TelepathyQt/ChannelFactory>
+#include <TelepathyQt/Connection>
+#include <TelepathyQt/ContactFactory>
+#include <TelepathyQt/ContactManager>
+#include <TelepathyQt/Debug>
+#include <TelepathyQt/PendingReady>
+
+#include <telepathy-glib/telepathy-glib.h>
+
+using namespace Tp;
+
+// Measures how long a client takes to load a roster, from creating the Connection proxy to having
+// it ready with FeatureRoster
+class BenchmarkRoster : public Test
+{
+    Q_OBJECT
+
+public:
+    BenchmarkRoster(QObject *parent = 0)
+        : Test(parent)
+    { }
+
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+
+    void benchmarkLoad_data();
+    void benchmarkLoad();
+
+    void cleanup();
+    void cleanupTestCase();
+};
+
+void BenchmarkRoster::initTestCase()
+{
+    initTestCaseImpl();
+
+    // Debug output would be what's measured otherwise
+    Tp::enableDebug(false);
+
+    g_type_init();
+    g_set_prgname("benchmark-roster");
+    dbus_g_bus_get(DBUS_BUS_STARTER, 0);
+}
+
+void BenchmarkRoster::init()
+{
+    initImpl();
+}
+
+void BenchmarkRoster::benchmarkLoad_data()
+{
+    QTest::addColumn<int>("numContacts");
+
+    QTest::newRow("1k") << 1000;
+    QTest::newRow("10k") << 10000;
+    QTest::newRow("50k") << 50000;
+}
+
+void BenchmarkRoster::benchmarkLoad()
+{
+    QFETCH(int, numContacts);
+
+    TestConnHelper *conn = new TestConnHelper(this,
+            TP_TESTS_TYPE_CONTACTS_CONNECTION,
+            "account", "me@example.com",
+            "protocol", "example",
+            NULL);
+    QCOMPARE(conn->connect(), true);
+
+    TpHandleRepoIface *contactRepo = tp_base_connection_get_handles(
+            TP_BASE_CONNECTION(conn->service()), TP_HANDLE_TYPE_CONTACT);
+    QVector<TpHandle> handles(numContacts);
+    for (int i = 0; i < numContacts; ++i) {
+        QByteArray id = QString(QLatin1String("contact%1@example.com")).arg(i).toLatin1();
+        handles[i] = tp_handle_ensure(contactRepo, id.constData(), NULL, NULL);
+        QVERIFY(handles[i] != 0);
+    }
+
+    TestContactListManager *listManager = tp_tests_contacts_connection_get_contact_list_manager(
+            TP_TESTS_CONTACTS_CONNECTION(conn->service()));
+    test_contact_list_manager_request_subscription(listManager, numContacts, handles.data(),
+            "benchmark");
+
+    QString busName = conn->client()->busName();
+    QString objectPath = conn->objectPath();
+    int rosterSize = 0;
+
+    QBENCHMARK {
+        ConnectionPtr client = Connection::create(busName, objectPath,
+                ChannelFactory::create(QDBusConnection::sessionBus()),
+                ContactFactory::create());
+        QVERIFY(connect(client->becomeReady(Connection::FeatureRoster),
+                    SIGNAL(finished(Tp::PendingOperation*)),
+                    SLOT(expectSuccessfulCall(Tp::PendingOperation*))));
+        QCOMPARE(mLoop->exec(), 0);
+        rosterSize = client->contactManager()->allKnownContacts().size();
+    }
+
+    QVERIFY(rosterSize >= numContacts);
+
+    QCOMPARE(conn->disconnect(), true);
+    delete conn;
+}
+
+void BenchmarkRoster::cleanup()
+{
+    cleanupImpl();
+}
+
+void BenchmarkRoster::cleanupTestCase()
+{
+    cleanupTestCaseImpl();
+}
+
+QTEST_MAIN(BenchmarkRoster)
+#include "_gen/roster.cpp.moc.hpp"
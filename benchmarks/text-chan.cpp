@@ -0,0 +1,209 @@
+#include <tests/lib/test.h>
+
+#include <tests/lib/glib-helpers/test-conn-helper.h>
+
+#include <tests/lib/glib/contacts-conn.h>
+#include <tests/lib/glib/echo2/chan.h>
+
+#include <TelepathyQt/Connection>
+#include <TelepathyQt/Debug>
+#include <TelepathyQt/PendingReady>
+#include <TelepathyQt/ReceivedMessage>
+#include <TelepathyQt/TextChannel>
+
+#include <telepathy-glib/telepathy-glib.h>
+
+using namespace Tp;
+
+// Measures how fast a TextChannel takes in incoming messages and gets them acknowledged, as seen
+// by a client catching up with a busy conversation
+class BenchmarkTextChan : public Test
+{
+    Q_OBJECT
+
+public:
+    BenchmarkTextChan(QObject *parent = 0)
+        : Test(parent),
+          mConn(0), mChanService(0), mHandle(0), mReceived(0), mExpected(0)
+    { }
+
+protected Q_SLOTS:
+    void onMessageReceived(const Tp::ReceivedMessage &message);
+
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+
+    void benchmarkReceive_data();
+    void benchmarkReceive();
+    void benchmarkReceiveAndAcknowledge_data();
+    void benchmarkReceiveAndAcknowledge();
+
+    void cleanup();
+    void cleanupTestCase();
+
+private:
+    void injectMessages(int count);
+    void waitForMessages(int count);
+    void waitForServiceQueueEmpty();
+
+    TestConnHelper *mConn;
+    ExampleEcho2Channel *mChanService;
+    QString mChanPath;
+    TpHandle mHandle;
+    TextChannelPtr mChan;
+    int mReceived;
+    int mExpected;
+};
+
+void BenchmarkTextChan::onMessageReceived(const Tp::ReceivedMessage &message)
+{
+    Q_UNUSED(message);
+
+    if (++mReceived == mExpected) {
+        mLoop->exit(0);
+    }
+}
+
+void BenchmarkTextChan::injectMessages(int count)
+{
+    for (int i = 0; i < count; ++i) {
+        TpMessage *msg = tp_cm_message_new(TP_BASE_CONNECTION(mConn->service()), 2);
+        tp_cm_message_set_sender(msg, mHandle);
+        tp_message_set_uint32(msg, 0, "message-type", TP_CHANNEL_TEXT_MESSAGE_TYPE_NORMAL);
+        tp_message_set_string(msg, 1, "content-type", "text/plain");
+        tp_message_set_string(msg, 1, "content", "The quick brown fox jumps over the lazy dog");
+        tp_message_mixin_take_received(G_OBJECT(mChanService), msg);
+    }
+}
+
+void BenchmarkTextChan::waitForMessages(int count)
+{
+    mReceived = 0;
+    mExpected = count;
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(mReceived, count);
+}
+
+void BenchmarkTextChan::waitForServiceQueueEmpty()
+{
+    while (tp_message_mixin_has_pending_messages(G_OBJECT(mChanService), 0)) {
+        mLoop->processEvents(QEventLoop::WaitForMoreEvents);
+    }
+}
+
+void BenchmarkTextChan::initTestCase()
+{
+    initTestCaseImpl();
+
+    // Debug output would be what's measured otherwise
+    Tp::enableDebug(false);
+
+    g_type_init();
+    g_set_prgname("benchmark-text-chan");
+    dbus_g_bus_get(DBUS_BUS_STARTER, 0);
+
+    mConn = new TestConnHelper(this,
+            TP_TESTS_TYPE_CONTACTS_CONNECTION,
+            "account", "me@example.com",
+            "protocol", "example",
+            NULL);
+    QCOMPARE(mConn->connect(), true);
+
+    TpHandleRepoIface *contactRepo = tp_base_connection_get_handles(
+            TP_BASE_CONNECTION(mConn->service()), TP_HANDLE_TYPE_CONTACT);
+    mHandle = tp_handle_ensure(contactRepo, "someone@localhost", 0, 0);
+
+    // create a Channel by magic, rather than doing D-Bus round-trips for it
+    mChanPath = mConn->objectPath() + QLatin1String("/MessagesChannel");
+    QByteArray chanPath(mChanPath.toLatin1());
+    mChanService = EXAMPLE_ECHO_2_CHANNEL(g_object_new(
+                EXAMPLE_TYPE_ECHO_2_CHANNEL,
+                "connection", mConn->service(),
+                "object-path", chanPath.data(),
+                "handle", mHandle,
+                NULL));
+}
+
+void BenchmarkTextChan::init()
+{
+    initImpl();
+
+    mChan = TextChannel::create(mConn->client(), mChanPath, QVariantMap());
+    QVERIFY(connect(mChan.data(),
+                    SIGNAL(messageReceived(Tp::ReceivedMessage)),
+                    SLOT(onMessageReceived(Tp::ReceivedMessage))));
+    QVERIFY(connect(mChan->becomeReady(TextChannel::FeatureMessageQueue),
+                SIGNAL(finished(Tp::PendingOperation*)),
+                SLOT(expectSuccessfulCall(Tp::PendingOperation*))));
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(mChan->messageQueue().size(), 0);
+}
+
+void BenchmarkTextChan::benchmarkReceive_data()
+{
+    QTest::addColumn<int>("numMessages");
+
+    QTest::newRow("100") << 100;
+    QTest::newRow("1000") << 1000;
+}
+
+void BenchmarkTextChan::benchmarkReceive()
+{
+    QFETCH(int, numMessages);
+
+    // The messages are only acknowledged in cleanup(), so the queue grows with each iteration
+    QBENCHMARK {
+        injectMessages(numMessages);
+        waitForMessages(numMessages);
+    }
+}
+
+void BenchmarkTextChan::benchmarkReceiveAndAcknowledge_data()
+{
+    QTest::addColumn<int>("numMessages");
+
+    QTest::newRow("100") << 100;
+    QTest::newRow("1000") << 1000;
+}
+
+void BenchmarkTextChan::benchmarkReceiveAndAcknowledge()
+{
+    QFETCH(int, numMessages);
+
+    QBENCHMARK {
+        injectMessages(numMessages);
+        waitForMessages(numMessages);
+
+        mChan->acknowledge(mChan->messageQueue());
+        QCOMPARE(mChan->messageQueue().size(), 0);
+        waitForServiceQueueEmpty();
+    }
+}
+
+void BenchmarkTextChan::cleanup()
+{
+    if (mChan) {
+        mChan->acknowledge(mChan->messageQueue());
+        waitForServiceQueueEmpty();
+        mChan.reset();
+    }
+
+    cleanupImpl();
+}
+
+void BenchmarkTextChan::cleanupTestCase()
+{
+    QCOMPARE(mConn->disconnect(), true);
+    delete mConn;
+
+    if (mChanService != 0) {
+        g_object_unref(mChanService);
+        mChanService = 0;
+    }
+
+    cleanupTestCaseImpl();
+}
+
+QTEST_MAIN(BenchmarkTextChan)
+#include "_gen/text-chan.cpp.moc.hpp"
@@ -113,6 +113,14 @@
 #          This function MUST be called before calling TPQT_ADD_DBUS_UNIT_TEST. It takes care of preparing the test
 #          environment for DBus tests and generating the needed files.
 #
+# macro TPQT_ADD_BENCHMARK (name [libraries ...])
+#       This macro takes care of building a benchmark contained in a single source file named ${name}.cpp, which
+#       is run with DBus emulation just like TPQT_ADD_DBUS_UNIT_TEST tests. Benchmarks are not added to the CTest
+#       suite: a run-benchmark-${name} target runs it and saves the QTestLib XML results to
+#       results/${name}.xml, and the benchmark target runs all of them. You can specify as a second and optional
+#       argument a set of additional libraries the target will link to. TPQT_SETUP_DBUS_TEST_ENVIRONMENT must
+#       have been called BEFORE you call this macro.
+#
 # macro MAKE_INSTALL_PATH_ABSOLUTE (out in)
 #       This macro makes the path given in the "in" variable absolute (or leaves it unchanged
 #       if it's absolute already) by prefixing it with TELEPATHY_QT_INSTALL_DIR,
@@ -424,6 +432,19 @@ macro(tpqt_add_dbus_unit_test _fancyName _name)
     _tpqt_add_check_targets(${_fancyName} ${_name} ${with_session_bus} ${CMAKE_CURRENT_BINARY_DIR}/test-${_name})
 endmacro(tpqt_add_dbus_unit_test _fancyName _name)
 
+macro(tpqt_add_benchmark _name)
+    tpqt_generate_moc_i(${_name}.cpp ${CMAKE_CURRENT_BINARY_DIR}/_gen/${_name}.cpp.moc.hpp)
+    add_executable(benchmark-${_name} ${_name}.cpp ${CMAKE_CURRENT_BINARY_DIR}/_gen/${_name}.cpp.moc.hpp)
+    target_link_libraries(benchmark-${_name} ${QT_QTCORE_LIBRARY} ${QT_QTDBUS_LIBRARY} ${QT_QTNETWORK_LIBRARY} ${QT_QTXML_LIBRARY} ${QT_QTTEST_LIBRARY} telepathy-qt${QT_VERSION_MAJOR} tp-qt-tests ${TP_QT_EXECUTABLE_LINKER_FLAGS} ${ARGN})
+
+    add_custom_target(run-benchmark-${_name}
+        COMMAND ${SH} ${CMAKE_CURRENT_BINARY_DIR}/runDbusTest.sh ${CMAKE_CURRENT_BINARY_DIR}/benchmark-${_name}
+                -xml -o ${CMAKE_CURRENT_BINARY_DIR}/results/${_name}.xml
+        COMMENT "Running benchmark ${_name}")
+    add_dependencies(run-benchmark-${_name} benchmark-${_name})
+    add_dependencies(benchmark run-benchmark-${_name})
+endmacro(tpqt_add_benchmark _name)
+
 macro(_tpqt_add_check_targets _fancyName _name _runnerScript)
     set_tests_properties(${_fancyName}
         PROPERTIES
@@ -0,0 +1,285 @@
+#include <QtTest/QtTest>
+#include <QtCore/QDataStream>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+
+#include "TelepathyQt/avatar-cache-internal.h"
+
+using namespace Tp;
+
+namespace
+{
+
+struct IndexEntry
+{
+    IndexEntry(const QString &key, qint64 size, uint lastUsed)
+        : key(key), size(size), lastUsed(lastUsed) {}
+
+    QString key;
+    qint64 size;
+    uint lastUsed;
+};
+
+void writeFile(const QString &fileName, const QByteArray &data)
+{
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    QCOMPARE(file.write(data), (qint64) data.size());
+}
+
+}
+
+class TestAvatarCache : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+    void cleanup();
+
+    void testImport();
+    void testLruEviction();
+    void testSizeLimit();
+    void testMissingFile();
+    void testSharedIndex();
+
+private:
+    void writeAvatar(const QString &key, qint64 size);
+    void writeIndex(const QList<IndexEntry> &entries);
+    AvatarCachePtr load();
+    void waitForStored(QSignalSpy *spy, int count);
+
+    QString mPath;
+};
+
+void TestAvatarCache::initTestCase()
+{
+    qRegisterMetaType<Tp::AvatarData>("Tp::AvatarData");
+}
+
+void TestAvatarCache::init()
+{
+    mPath = QDir::tempPath() + QString(QLatin1String("/tpqt-avatar-cache-%1"))
+        .arg(QCoreApplication::applicationPid());
+    QVERIFY(QDir().mkpath(mPath));
+}
+
+void TestAvatarCache::cleanup()
+{
+    QDir dir(mPath);
+    Q_FOREACH (const QString &fileName, dir.entryList(QDir::Files | QDir::Hidden)) {
+        dir.remove(fileName);
+    }
+    QDir().rmdir(mPath);
+}
+
+void TestAvatarCache::writeAvatar(const QString &key, qint64 size)
+{
+    QString fileName = mPath + QLatin1Char('/') + key;
+    writeFile(fileName, QByteArray(size, 'x'));
+    writeFile(fileName + QLatin1String(".mime"), QByteArray("image/png"));
+}
+
+void TestAvatarCache::writeIndex(const QList<IndexEntry> &entries)
+{
+    QByteArray index;
+    QDataStream stream(&index, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_4_6);
+    stream << (quint32) 0x54504156 << (quint32) 1 << (quint32) entries.size();
+    Q_FOREACH (const IndexEntry &entry, entries) {
+        stream << entry.key << QString(QLatin1String("image/png")) << entry.size <<
+            entry.lastUsed;
+    }
+    writeFile(mPath + QLatin1String("/.index"), index);
+}
+
+AvatarCachePtr TestAvatarCache::load()
+{
+    AvatarCachePtr cache = AvatarCache::forDirectory(mPath);
+    for (int i = 0; i < 500 && !cache->isLoaded(); ++i) {
+        QTest::qWait(10);
+    }
+    return cache;
+}
+
+void TestAvatarCache::waitForStored(QSignalSpy *spy, int count)
+{
+    for (int i = 0; i < 500 && spy->count() < count; ++i) {
+        QTest::qWait(10);
+    }
+}
+
+void TestAvatarCache::testImport()
+{
+    writeAvatar(QLatin1String("alice"), 10);
+    writeAvatar(QLatin1String("bob"), 20);
+    // A .mime file left behind without its avatar is not imported
+    writeFile(mPath + QLatin1String("/carol.mime"), QByteArray("image/png"));
+
+    AvatarCachePtr cache = load();
+    QVERIFY(cache->isLoaded());
+    QCOMPARE(cache->size(), (qint64) 30);
+
+    AvatarData avatar;
+    QVERIFY(cache->lookup(QLatin1String("alice"), &avatar));
+    QCOMPARE(avatar.fileName, QString(mPath + QLatin1String("/alice")));
+    QCOMPARE(avatar.mimeType, QString(QLatin1String("image/png")));
+    QVERIFY(cache->lookup(QLatin1String("bob"), &avatar));
+    QVERIFY(!cache->lookup(QLatin1String("carol"), &avatar));
+
+    // The imported entries are written to the index when the cache goes away
+    cache.reset();
+    QVERIFY(QFile::exists(mPath + QLatin1String("/.index")));
+
+    QFile::remove(mPath + QLatin1String("/bob.mime"));
+    cache = load();
+    QCOMPARE(cache->size(), (qint64) 30);
+    QVERIFY(cache->lookup(QLatin1String("bob"), &avatar));
+}
+
+void TestAvatarCache::testLruEviction()
+{
+    writeAvatar(QLatin1String("old"), 10);
+    writeAvatar(QLatin1String("middle"), 10);
+    writeAvatar(QLatin1String("recent"), 10);
+    writeIndex(QList<IndexEntry>() <<
+            IndexEntry(QLatin1String("old"), 10, 100) <<
+            IndexEntry(QLatin1String("middle"), 10, 200) <<
+            IndexEntry(QLatin1String("recent"), 10, 300));
+
+    AvatarCachePtr cache = load();
+    QVERIFY(cache->isLoaded());
+    QCOMPARE(cache->size(), (qint64) 30);
+
+    // The least recently used avatar goes first
+    cache->setSizeLimit(25);
+    QCOMPARE(cache->size(), (qint64) 20);
+    AvatarData avatar;
+    QVERIFY(!cache->lookup(QLatin1String("old"), &avatar));
+
+    // Using an avatar makes it the most recently used one
+    QVERIFY(cache->lookup(QLatin1String("middle"), &avatar));
+    cache->setSizeLimit(15);
+    QCOMPARE(cache->size(), (qint64) 10);
+    QVERIFY(!cache->lookup(QLatin1String("recent"), &avatar));
+    QVERIFY(cache->lookup(QLatin1String("middle"), &avatar));
+
+    // Evicted avatars are removed from the disk once the index is written
+    cache.reset();
+    QVERIFY(!QFile::exists(mPath + QLatin1String("/old")));
+    QVERIFY(!QFile::exists(mPath + QLatin1String("/old.mime")));
+    QVERIFY(!QFile::exists(mPath + QLatin1String("/recent")));
+    QVERIFY(QFile::exists(mPath + QLatin1String("/middle")));
+
+    cache = load();
+    QCOMPARE(cache->size(), (qint64) 10);
+    QVERIFY(cache->lookup(QLatin1String("middle"), &avatar));
+}
+
+void TestAvatarCache::testSizeLimit()
+{
+    AvatarCachePtr cache = load();
+    QVERIFY(cache->isLoaded());
+    QCOMPARE(cache->size(), (qint64) 0);
+    cache->setSizeLimit(25);
+
+    QSignalSpy spy(cache.data(), SIGNAL(avatarStored(QString,Tp::AvatarData)));
+    QStringList tokens;
+    tokens << QLatin1String("first") << QLatin1String("second") << QLatin1String("third");
+    int stored = 0;
+    Q_FOREACH (const QString &token, tokens) {
+        QVERIFY(!cache->isStoring(token));
+        cache->store(token, QByteArray(10, 'x'), QLatin1String("image/png"));
+        QVERIFY(cache->isStoring(token));
+        waitForStored(&spy, ++stored);
+        QCOMPARE(spy.count(), stored);
+        QVERIFY(!cache->isStoring(token));
+        QVERIFY(cache->size() <= 25);
+    }
+
+    // The avatar just stored is never the one evicted to make room
+    QCOMPARE(cache->size(), (qint64) 20);
+    AvatarData avatar;
+    QVERIFY(cache->lookup(QLatin1String("third"), &avatar));
+    QVERIFY(QFile::exists(avatar.fileName));
+    QCOMPARE(avatar.mimeType, QString(QLatin1String("image/png")));
+}
+
+void TestAvatarCache::testMissingFile()
+{
+    writeAvatar(QLatin1String("alice"), 10);
+    writeAvatar(QLatin1String("bob"), 20);
+
+    AvatarCachePtr cache = load();
+    QVERIFY(cache->isLoaded());
+    QCOMPARE(cache->size(), (qint64) 30);
+
+    // Another process evicted the avatar. Lookups don't touch the disk, so this is only noticed
+    // when the index is next written.
+    QFile::remove(mPath + QLatin1String("/bob"));
+    AvatarData avatar;
+    QVERIFY(cache->lookup(QLatin1String("bob"), &avatar));
+    for (int i = 0; i < 500 && cache->size() != 10; ++i) {
+        QTest::qWait(10);
+    }
+    QCOMPARE(cache->size(), (qint64) 10);
+    QVERIFY(!cache->lookup(QLatin1String("bob"), &avatar));
+    QVERIFY(cache->lookup(QLatin1String("alice"), &avatar));
+
+    // Storing it again brings it back
+    QSignalSpy spy(cache.data(), SIGNAL(avatarStored(QString,Tp::AvatarData)));
+    cache->store(QLatin1String("bob"), QByteArray(20, 'x'), QLatin1String("image/png"));
+    waitForStored(&spy, 1);
+    QCOMPARE(spy.count(), 1);
+    QCOMPARE(cache->size(), (qint64) 30);
+    QVERIFY(cache->lookup(QLatin1String("bob"), &avatar));
+    QVERIFY(QFile::exists(avatar.fileName));
+
+    // Entries whose avatar is gone are also dropped when the index is loaded
+    cache.reset();
+    QFile::remove(mPath + QLatin1String("/alice"));
+    cache = load();
+    QVERIFY(cache->isLoaded());
+    QCOMPARE(cache->size(), (qint64) 20);
+    QVERIFY(!cache->lookup(QLatin1String("alice"), &avatar));
+}
+
+void TestAvatarCache::testSharedIndex()
+{
+    writeAvatar(QLatin1String("old"), 10);
+    writeAvatar(QLatin1String("recent"), 10);
+    writeIndex(QList<IndexEntry>() <<
+            IndexEntry(QLatin1String("old"), 10, 100) <<
+            IndexEntry(QLatin1String("recent"), 10, 200));
+
+    AvatarCachePtr cache = load();
+    QVERIFY(cache->isLoaded());
+    cache->setSizeLimit(15);
+    QCOMPARE(cache->size(), (qint64) 10);
+
+    // Meanwhile another process used the avatar we evicted, and added one of its own
+    writeAvatar(QLatin1String("other"), 5);
+    writeIndex(QList<IndexEntry>() <<
+            IndexEntry(QLatin1String("old"), 10, 1000) <<
+            IndexEntry(QLatin1String("recent"), 10, 200) <<
+            IndexEntry(QLatin1String("other"), 5, 300));
+
+    cache.reset();
+
+    // Neither is lost when the index is written
+    QVERIFY(QFile::exists(mPath + QLatin1String("/old")));
+    QVERIFY(QFile::exists(mPath + QLatin1String("/other")));
+
+    cache = load();
+    QVERIFY(cache->isLoaded());
+    QCOMPARE(cache->size(), (qint64) 25);
+    AvatarData avatar;
+    QVERIFY(cache->lookup(QLatin1String("old"), &avatar));
+    QVERIFY(cache->lookup(QLatin1String("recent"), &avatar));
+    QVERIFY(cache->lookup(QLatin1String("other"), &avatar));
+}
+
+QTEST_MAIN(TestAvatarCache)
+
+#include "_gen/avatar-cache.cpp.moc.hpp"
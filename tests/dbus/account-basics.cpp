@@ -17,6 +17,10 @@
 
 #include <telepathy-glib/debug.h>
 
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+
 using namespace Tp;
 
 class TestAccountBasics : public Test
@@ -49,6 +53,7 @@ private Q_SLOTS:
     void init();
 
     void testBasics();
+    void testSnapshot();
 
     void cleanup();
     void cleanupTestCase();
@@ -581,6 +586,111 @@ void TestAccountBasics::testBasics()
     processDBusQueue(mConn->client().data());
 }
 
+void TestAccountBasics::testSnapshot()
+{
+    QString fileName = QDir::tempPath() + QString(QLatin1String("/account-basics-snapshot-%1"))
+        .arg(QCoreApplication::applicationPid());
+    QFile::remove(fileName);
+
+    // Cold start, which saves the snapshot once ready
+    AccountManagerPtr am = AccountManager::create(AccountFactory::create(
+                QDBusConnection::sessionBus(), Account::FeatureCore));
+    am->setSnapshotFileName(fileName);
+    QCOMPARE(am->snapshotFileName(), fileName);
+    QVERIFY(connect(am->becomeReady(),
+                    SIGNAL(finished(Tp::PendingOperation *)),
+                    SLOT(expectSuccessfulCall(Tp::PendingOperation *))));
+    QCOMPARE(mLoop->exec(), 0);
+    QVERIFY(QFile::exists(fileName));
+    QCOMPARE(QFile::permissions(fileName) & (QFile::ReadGroup | QFile::WriteGroup |
+                QFile::ReadOther | QFile::WriteOther), QFile::Permissions(0));
+
+    QStringList paths = pathsForAccounts(am->allAccounts());
+    QVERIFY(!paths.isEmpty());
+    paths.sort();
+    QString path = paths.first();
+    AccountPtr acc = am->accountForObjectPath(path);
+    QString displayName = acc->displayName();
+    QString nickname = acc->nickname();
+    QStringList parameterNames = acc->parameters().keys();
+    QVERIFY(!parameterNames.isEmpty());
+    acc.reset();
+    am.reset();
+
+    // Make the snapshot differ from the account manager: one account has a stale display name,
+    // and another one was removed while we weren't running
+    QFile file(fileName);
+    QVERIFY(file.open(QIODevice::ReadOnly));
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_4_6);
+    quint32 magic, version;
+    QStringList interfaces, supportedProperties;
+    QMap<QString, QVariantMap> accountProperties;
+    in >> magic >> version >> interfaces >> supportedProperties >> accountProperties;
+    QCOMPARE(in.status(), QDataStream::Ok);
+    QVERIFY(accountProperties.contains(path));
+    file.close();
+
+    QString stalePath = path + QLatin1String("_gone");
+    QString staleDisplayName = displayName + QLatin1String(" (stale)");
+    accountProperties.insert(stalePath, accountProperties.value(path));
+    accountProperties[path].insert(QLatin1String("DisplayName"), staleDisplayName);
+
+    QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_4_6);
+    out << magic << version << interfaces << supportedProperties << accountProperties;
+    QCOMPARE(out.status(), QDataStream::Ok);
+    file.close();
+
+    // Warm start, with a new factory so that the accounts are new proxies as well
+    am = AccountManager::create(AccountFactory::create(
+                QDBusConnection::sessionBus(), Account::FeatureCore));
+    am->setSnapshotFileName(fileName);
+    QVERIFY(connect(am->becomeReady(),
+                    SIGNAL(finished(Tp::PendingOperation *)),
+                    SLOT(expectSuccessfulCall(Tp::PendingOperation *))));
+    QCOMPARE(mLoop->exec(), 0);
+
+    // FeatureCore is ready with what the snapshot says, before GetAll(Account) got a reply
+    QStringList snapshotPaths = QStringList(paths) << stalePath;
+    snapshotPaths.sort();
+    QStringList warmPaths = pathsForAccounts(am->allAccounts());
+    warmPaths.sort();
+    QCOMPARE(warmPaths, snapshotPaths);
+
+    acc = am->accountForObjectPath(path);
+    QVERIFY(acc->isReady(Account::FeatureCore));
+    QCOMPARE(acc->displayName(), staleDisplayName);
+    QCOMPARE(acc->nickname(), nickname);
+    QVERIFY(acc->parameters().isEmpty());
+    AccountPtr staleAcc = am->accountForObjectPath(stalePath);
+    QVERIFY(staleAcc->isReady(Account::FeatureCore));
+
+    // The revalidation signals what changed, and removes what is gone
+    QSignalSpy displayNameSpy(acc.data(), SIGNAL(displayNameChanged(QString)));
+    QSignalSpy removedSpy(staleAcc.data(), SIGNAL(removed()));
+    for (int i = 0; i < 100 && (displayNameSpy.isEmpty() || removedSpy.isEmpty()); ++i) {
+        processDBusQueue(acc.data());
+    }
+    QCOMPARE(displayNameSpy.count(), 1);
+    QCOMPARE(displayNameSpy.first().first().toString(), displayName);
+    QCOMPARE(acc->displayName(), displayName);
+    QCOMPARE(removedSpy.count(), 1);
+    QVERIFY(!staleAcc->isValid());
+    warmPaths = pathsForAccounts(am->allAccounts());
+    warmPaths.sort();
+    QCOMPARE(warmPaths, paths);
+
+    // The parameters are never saved, they come with the revalidation
+    QCOMPARE(acc->parameters().keys(), parameterNames);
+
+    staleAcc.reset();
+    acc.reset();
+    am.reset();
+    QFile::remove(fileName);
+}
+
 void TestAccountBasics::cleanup()
 {
     cleanupImpl();
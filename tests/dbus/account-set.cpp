@@ -395,6 +395,83 @@ void TestAccountSet::testFilters()
         QVERIFY(mAM->accountsByProtocol(QLatin1String("normal"))->accounts().contains(spuriousAcc));
         QCOMPARE(mAM->accountsByProtocol(QLatin1String("noname"))->accounts().size(), 0);
     }
+
+    {
+        // the predefined views are shared for as long as they are held
+        AccountSetPtr enabledAccounts = mAM->enabledAccounts();
+        QVERIFY(mAM->enabledAccounts() == enabledAccounts);
+        QVERIFY(mAM->disabledAccounts() != enabledAccounts);
+        AccountSetPtr textChatAccounts = mAM->textChatAccounts();
+        QVERIFY(mAM->textChatAccounts() == textChatAccounts);
+        AccountSetPtr barAccounts = mAM->accountsByProtocol(QLatin1String("bar"));
+        QVERIFY(mAM->accountsByProtocol(QLatin1String("bar")) == barAccounts);
+        QVERIFY(mAM->accountsByProtocol(QLatin1String("normal")) != barAccounts);
+
+        // but the ones for filters given by the user never are
+        QVariantMap filter;
+        filter.insert(QLatin1String("enabled"), true);
+        QVERIFY(mAM->filterAccounts(filter) != enabledAccounts);
+        QCOMPARE(mAM->filterAccounts(filter)->accounts().size(), enabledAccounts->accounts().size());
+    }
+
+    {
+        // property filters keep up with properties being added after they were first used
+        AccountPropertyFilterPtr filter = AccountPropertyFilter::create();
+        filter->addProperty(QLatin1String("protocolName"), QLatin1String("bar"));
+        QVERIFY(filter->matches(fooAcc));
+        QVERIFY(!filter->matches(spuriousAcc));
+        filter->addProperty(QLatin1String("enabled"), true);
+        QVERIFY(!filter->matches(fooAcc));
+        filter->addProperty(QLatin1String("enabled"), false);
+        QVERIFY(filter->matches(fooAcc));
+    }
+
+    {
+        // sets follow properties added to their filter after they were created
+        AccountPropertyFilterPtr filter = AccountPropertyFilter::create();
+        filter->addProperty(QLatin1String("protocolName"), QLatin1String("bar"));
+        AccountSetPtr barAccounts = AccountSetPtr(new AccountSet(mAM, filter));
+        QCOMPARE(barAccounts->accounts().size(), 1);
+        QVERIFY(barAccounts->accounts().contains(fooAcc));
+
+        filter->addProperty(QLatin1String("enabled"), false);
+        QVERIFY(connect(fooAcc->setEnabled(true),
+                    SIGNAL(finished(Tp::PendingOperation*)),
+                    SLOT(expectSuccessfulCall(Tp::PendingOperation*))));
+        QCOMPARE(mLoop->exec(), 0);
+
+        while (fooAcc->isEnabled() != true) {
+            mLoop->processEvents();
+        }
+
+        processDBusQueue(mConn->client().data());
+
+        QCOMPARE(barAccounts->accounts().size(), 0);
+    }
+
+    {
+        // but changes to properties their filter doesn't look at don't re-run it
+        AccountPropertyFilterPtr filter = AccountPropertyFilter::create();
+        filter->addProperty(QLatin1String("enabled"), true);
+        AccountSetPtr enabledAccounts = AccountSetPtr(new AccountSet(mAM, filter));
+        QCOMPARE(enabledAccounts->accounts().size(), 2);
+
+        // the set only drops the accounts this no longer matches once the filter is re-run
+        filter->addProperty(QLatin1String("enabled"), false);
+        QVERIFY(connect(spuriousAcc->setNickname(QLatin1String("Spurious")),
+                    SIGNAL(finished(Tp::PendingOperation*)),
+                    SLOT(expectSuccessfulCall(Tp::PendingOperation*))));
+        QCOMPARE(mLoop->exec(), 0);
+
+        while (spuriousAcc->nickname() != QLatin1String("Spurious")) {
+            mLoop->processEvents();
+        }
+
+        processDBusQueue(mConn->client().data());
+
+        QCOMPARE(enabledAccounts->accounts().size(), 2);
+        QVERIFY(enabledAccounts->accounts().contains(spuriousAcc));
+    }
 }
 
 void TestAccountSet::cleanup()
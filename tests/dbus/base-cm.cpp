@@ -3,6 +3,8 @@
 
 #define TP_QT_ENABLE_LOWLEVEL_API
 
+#include <TelepathyQt/BaseChannel>
+#include <TelepathyQt/BaseConnection>
 #include <TelepathyQt/BaseConnectionManager>
 #include <TelepathyQt/BaseProtocol>
 #include <TelepathyQt/ConnectionManager>
@@ -13,6 +15,40 @@
 
 using namespace Tp;
 
+class ChannelCallbacks
+{
+public:
+    ChannelCallbacks(BaseConnection *connection)
+        : mConnection(connection), mInspectedHandles(0)
+    { }
+
+    BaseChannelPtr createChannel(const QString &channelType, uint targetHandleType,
+            uint targetHandle, DBusError *error)
+    {
+        Q_UNUSED(error);
+        return BaseChannel::create(mConnection, channelType, targetHandle, targetHandleType);
+    }
+
+    QStringList inspectHandles(uint handleType, const UIntList &handles, DBusError *error)
+    {
+        Q_UNUSED(handleType);
+        Q_UNUSED(error);
+
+        QStringList ids;
+        Q_FOREACH (uint handle, handles) {
+            ids << QString(QLatin1String("contact%1")).arg(handle);
+            ++mInspectedHandles;
+        }
+        return ids;
+    }
+
+    int inspectedHandles() const { return mInspectedHandles; }
+
+private:
+    BaseConnection *mConnection;
+    int mInspectedHandles;
+};
+
 class TestBaseCM : public Test
 {
     Q_OBJECT
@@ -27,6 +63,7 @@ private Q_SLOTS:
 
     void testNoProtocols();
     void testProtocols();
+    void testEnsureChannel();
 
     void cleanup();
     void cleanupTestCase();
@@ -157,6 +194,72 @@ void TestBaseCM::testProtocols()
     QCOMPARE(mLastError, TP_QT_ERROR_NOT_IMPLEMENTED);
 }
 
+void TestBaseCM::testEnsureChannel()
+{
+    BaseConnectionPtr conn = BaseConnection::create(QLatin1String("testcm"),
+            QLatin1String("myprotocol"), QVariantMap());
+    ChannelCallbacks callbacks(conn.data());
+    conn->setCreateChannelCallback(memFun(&callbacks, &ChannelCallbacks::createChannel));
+    conn->setInspectHandlesCallback(memFun(&callbacks, &ChannelCallbacks::inspectHandles));
+
+    Tp::DBusError err;
+    QVERIFY(conn->registerObject(&err));
+    QVERIFY(!err.isValid());
+
+    bool yours = false;
+    BaseChannelPtr textChan = conn->ensureChannel(TP_QT_IFACE_CHANNEL_TYPE_TEXT,
+            HandleTypeContact, 1, yours, 0, false, &err);
+    QVERIFY(!err.isValid());
+    QVERIFY(!textChan.isNull());
+    QVERIFY(yours);
+    QCOMPARE(textChan->targetID(), QString(QLatin1String("contact1")));
+    QCOMPARE(conn->channelLookups(), (quint64) 1);
+    QCOMPARE(conn->channelLookupHits(), (quint64) 0);
+    QCOMPARE(conn->handleIdLookups(), (quint64) 1);
+    QCOMPARE(conn->handleIdLookupHits(), (quint64) 0);
+    QCOMPARE(callbacks.inspectedHandles(), 1);
+
+    // The existing channel is found in the index
+    BaseChannelPtr existingChan = conn->ensureChannel(TP_QT_IFACE_CHANNEL_TYPE_TEXT,
+            HandleTypeContact, 1, yours, 0, false, &err);
+    QVERIFY(!err.isValid());
+    QCOMPARE(existingChan, textChan);
+    QVERIFY(!yours);
+    QCOMPARE(conn->channelLookups(), (quint64) 2);
+    QCOMPARE(conn->channelLookupHits(), (quint64) 1);
+    QCOMPARE(conn->handleIdLookups(), (quint64) 1);
+
+    // Another channel with the same target gets its identifier from the cache
+    BaseChannelPtr otherChan = conn->ensureChannel(TP_QT_IFACE_CHANNEL_TYPE_FILE_TRANSFER,
+            HandleTypeContact, 1, yours, 0, false, &err);
+    QVERIFY(!err.isValid());
+    QVERIFY(otherChan != textChan);
+    QVERIFY(yours);
+    QCOMPARE(otherChan->targetID(), QString(QLatin1String("contact1")));
+    QCOMPARE(conn->channelLookups(), (quint64) 3);
+    QCOMPARE(conn->channelLookupHits(), (quint64) 1);
+    QCOMPARE(conn->handleIdLookups(), (quint64) 2);
+    QCOMPARE(conn->handleIdLookupHits(), (quint64) 1);
+    QCOMPARE(callbacks.inspectedHandles(), 1);
+    QCOMPARE(conn->channelsInfo().size(), 2);
+
+    // Once closed, a channel is no longer found
+    QVERIFY(QMetaObject::invokeMethod(textChan.data(), "closed"));
+    QCOMPARE(conn->channelsInfo().size(), 1);
+    BaseChannelPtr newChan = conn->ensureChannel(TP_QT_IFACE_CHANNEL_TYPE_TEXT,
+            HandleTypeContact, 1, yours, 0, false, &err);
+    QVERIFY(!err.isValid());
+    QVERIFY(!newChan.isNull());
+    QVERIFY(newChan != textChan);
+    QVERIFY(yours);
+    QCOMPARE(conn->channelLookups(), (quint64) 4);
+    QCOMPARE(conn->channelLookupHits(), (quint64) 1);
+    QCOMPARE(conn->handleIdLookups(), (quint64) 3);
+    QCOMPARE(conn->handleIdLookupHits(), (quint64) 2);
+    QCOMPARE(callbacks.inspectedHandles(), 1);
+    QCOMPARE(conn->channelsInfo().size(), 2);
+}
+
 void TestBaseCM::cleanup()
 {
     cleanupImpl();
@@ -25,6 +25,7 @@ class TestChanGroup : public Test
 public:
     TestChanGroup(QObject *parent = 0)
         : Test(parent), mConn(0), mChanService(0),
+          mGroupMembersChangedCount(0),
           mGotGroupFlagsChanged(false),
           mGroupFlags((ChannelGroupFlags) 0),
           mGroupFlagsAdded((ChannelGroupFlags) 0),
@@ -51,6 +52,8 @@ private Q_SLOTS:
     void testLeave();
     void testLeaveWithFallback();
     void testGroupFlagsChange();
+    void testMembersChangedBurst();
+    void testMembersChangedRejoinBurst();
 
     void cleanup();
     void cleanupTestCase();
@@ -70,6 +73,7 @@ private:
     Contacts mChangedRP;
     Contacts mChangedRemoved;
     Channel::GroupMemberChangeDetails mDetails;
+    int mGroupMembersChangedCount;
     UIntList mInitialMembers;
     bool mGotGroupFlagsChanged;
     ChannelGroupFlags mGroupFlags;
@@ -90,6 +94,7 @@ void TestChanGroup::onGroupMembersChanged(
     mChangedRP = groupRemotePendingMembersAdded;
     mChangedRemoved = groupMembersRemoved;
     mDetails = details;
+    ++mGroupMembersChangedCount;
     debugContacts();
     mLoop->exit(0);
 }
@@ -157,6 +162,7 @@ void TestChanGroup::init()
     mChangedRP.clear();
     mChangedRemoved.clear();
     mDetails = Channel::GroupMemberChangeDetails();
+    mGroupMembersChangedCount = 0;
     mGotGroupFlagsChanged = false;
     mGroupFlags = (ChannelGroupFlags) 0;
     mGroupFlagsAdded = (ChannelGroupFlags) 0;
@@ -484,6 +490,170 @@ void TestChanGroup::testGroupFlagsChange()
     QCOMPARE(mGroupFlagsRemoved, (ChannelGroupFlags) 0);
 }
 
+void TestChanGroup::testMembersChangedBurst()
+{
+    mChanObjectPath = QString(QLatin1String("%1/ChannelForTpQtBurstTest"))
+        .arg(mConn->objectPath());
+    QByteArray chanPathLatin1(mChanObjectPath.toLatin1());
+
+    mChanService = TP_TESTS_TEXT_CHANNEL_GROUP(g_object_new(
+                TP_TESTS_TYPE_TEXT_CHANNEL_GROUP,
+                "connection", mConn->service(),
+                "object-path", chanPathLatin1.data(),
+                "detailed", TRUE,
+                "properties", TRUE,
+                NULL));
+    QVERIFY(mChanService != 0);
+
+    TpIntSet *members = tp_intset_new_containing(mConn->client()->selfHandle());
+    QVERIFY(tp_group_mixin_change_members(G_OBJECT(mChanService), "",
+                members, NULL, NULL, NULL, 0, TP_CHANNEL_GROUP_CHANGE_REASON_NONE));
+    tp_intset_destroy(members);
+
+    mChan = Channel::create(mConn->client(), mChanObjectPath, QVariantMap());
+    QVERIFY(connect(mChan->becomeReady(),
+                    SIGNAL(finished(Tp::PendingOperation*)),
+                    SLOT(expectSuccessfulCall(Tp::PendingOperation*))));
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(mChan->groupContacts().size(), 1);
+
+    QVERIFY(connect(mChan.data(),
+                    SIGNAL(groupMembersChanged(
+                            const Tp::Contacts &,
+                            const Tp::Contacts &,
+                            const Tp::Contacts &,
+                            const Tp::Contacts &,
+                            const Tp::Channel::GroupMemberChangeDetails &)),
+                    SLOT(onGroupMembersChanged(
+                            const Tp::Contacts &,
+                            const Tp::Contacts &,
+                            const Tp::Contacts &,
+                            const Tp::Contacts &,
+                            const Tp::Channel::GroupMemberChangeDetails &))));
+
+    // A join storm: one MembersChanged signal per contact, all with the same details
+    TpHandleRepoIface *contactRepo = tp_base_connection_get_handles(
+            TP_BASE_CONNECTION(mConn->service()), TP_HANDLE_TYPE_CONTACT);
+    const int numContacts = 50;
+    UIntList handles;
+    for (int i = 0; i < numContacts; ++i) {
+        QByteArray id = QString(QLatin1String("burst%1@localhost")).arg(i).toLatin1();
+        handles << tp_handle_ensure(contactRepo, id.constData(), 0, 0);
+
+        TpIntSet *add = tp_intset_new_containing(handles.last());
+        QVERIFY(tp_group_mixin_change_members(G_OBJECT(mChanService), "",
+                    add, NULL, NULL, NULL, 0, TP_CHANNEL_GROUP_CHANGE_REASON_NONE));
+        tp_intset_destroy(add);
+    }
+
+    // ...followed by the first of them leaving again, which must not be merged with its joining
+    TpIntSet *remove = tp_intset_new_containing(handles.first());
+    QVERIFY(tp_group_mixin_change_members(G_OBJECT(mChanService), "bye",
+                NULL, remove, NULL, NULL, 0, TP_CHANNEL_GROUP_CHANGE_REASON_NONE));
+    tp_intset_destroy(remove);
+
+    while (mChangedRemoved.isEmpty()) {
+        QCOMPARE(mLoop->exec(), 0);
+    }
+
+    // The removal is signalled last, and with its own details
+    QCOMPARE(mChangedRemoved.size(), 1);
+    QCOMPARE((*mChangedRemoved.begin())->handle()[0], handles.first());
+    QCOMPARE(mDetails.message(), QString(QLatin1String("bye")));
+
+    QCOMPARE(mChan->groupContacts().size(), numContacts);
+    Q_FOREACH (const ContactPtr &contact, mChan->groupContacts()) {
+        QVERIFY(contact->handle()[0] != handles.first());
+    }
+
+    // The joins were merged rather than signalled one at a time
+    QVERIFY(mGroupMembersChangedCount < numContacts);
+}
+
+void TestChanGroup::testMembersChangedRejoinBurst()
+{
+    mChanObjectPath = QString(QLatin1String("%1/ChannelForTpQtRejoinBurstTest"))
+        .arg(mConn->objectPath());
+    QByteArray chanPathLatin1(mChanObjectPath.toLatin1());
+
+    mChanService = TP_TESTS_TEXT_CHANNEL_GROUP(g_object_new(
+                TP_TESTS_TYPE_TEXT_CHANNEL_GROUP,
+                "connection", mConn->service(),
+                "object-path", chanPathLatin1.data(),
+                "detailed", TRUE,
+                "properties", TRUE,
+                NULL));
+    QVERIFY(mChanService != 0);
+
+    TpHandleRepoIface *contactRepo = tp_base_connection_get_handles(
+            TP_BASE_CONNECTION(mConn->service()), TP_HANDLE_TYPE_CONTACT);
+    uint rejoining = tp_handle_ensure(contactRepo, "rejoin@localhost", 0, 0);
+    uint joining = tp_handle_ensure(contactRepo, "join@localhost", 0, 0);
+    uint marker = tp_handle_ensure(contactRepo, "marker@localhost", 0, 0);
+
+    TpIntSet *members = tp_intset_new_containing(mConn->client()->selfHandle());
+    tp_intset_add(members, rejoining);
+    QVERIFY(tp_group_mixin_change_members(G_OBJECT(mChanService), "",
+                members, NULL, NULL, NULL, 0, TP_CHANNEL_GROUP_CHANGE_REASON_NONE));
+    tp_intset_destroy(members);
+
+    mChan = Channel::create(mConn->client(), mChanObjectPath, QVariantMap());
+    QVERIFY(connect(mChan->becomeReady(),
+                    SIGNAL(finished(Tp::PendingOperation*)),
+                    SLOT(expectSuccessfulCall(Tp::PendingOperation*))));
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(mChan->groupContacts().size(), 2);
+
+    ContactPtr rejoiningContact;
+    Q_FOREACH (const ContactPtr &contact, mChan->groupContacts()) {
+        if (contact->handle()[0] == rejoining) {
+            rejoiningContact = contact;
+        }
+    }
+    QVERIFY(rejoiningContact);
+
+    QVERIFY(connect(mChan.data(),
+                    SIGNAL(groupMembersChanged(
+                            const Tp::Contacts &,
+                            const Tp::Contacts &,
+                            const Tp::Contacts &,
+                            const Tp::Contacts &,
+                            const Tp::Channel::GroupMemberChangeDetails &)),
+                    SLOT(onGroupMembersChanged(
+                            const Tp::Contacts &,
+                            const Tp::Contacts &,
+                            const Tp::Contacts &,
+                            const Tp::Contacts &,
+                            const Tp::Channel::GroupMemberChangeDetails &))));
+
+    // Someone joins, which needs a contact to be built, and meanwhile a member leaves and comes
+    // back, so both of those end up in the same batch
+    TpIntSet *set = tp_intset_new_containing(joining);
+    QVERIFY(tp_group_mixin_change_members(G_OBJECT(mChanService), "hi",
+                set, NULL, NULL, NULL, 0, TP_CHANNEL_GROUP_CHANGE_REASON_NONE));
+    tp_intset_destroy(set);
+
+    set = tp_intset_new_containing(rejoining);
+    QVERIFY(tp_group_mixin_change_members(G_OBJECT(mChanService), "bye",
+                NULL, set, NULL, NULL, 0, TP_CHANNEL_GROUP_CHANGE_REASON_NONE));
+    QVERIFY(tp_group_mixin_change_members(G_OBJECT(mChanService), "back",
+                set, NULL, NULL, NULL, 0, TP_CHANNEL_GROUP_CHANGE_REASON_NONE));
+    tp_intset_destroy(set);
+
+    set = tp_intset_new_containing(marker);
+    QVERIFY(tp_group_mixin_change_members(G_OBJECT(mChanService), "done",
+                set, NULL, NULL, NULL, 0, TP_CHANNEL_GROUP_CHANGE_REASON_NONE));
+    tp_intset_destroy(set);
+
+    while (mDetails.message() != QLatin1String("done")) {
+        QCOMPARE(mLoop->exec(), 0);
+    }
+
+    // The member which came back is still there, with the contact it had before leaving
+    QCOMPARE(mChan->groupContacts().size(), 4);
+    QVERIFY(mChan->groupContacts().contains(rejoiningContact));
+}
+
 void TestChanGroup::cleanup()
 {
     if (mChanService) {
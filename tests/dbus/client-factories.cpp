@@ -1166,6 +1166,24 @@ void TestClientFactories::testChannelFactoryAccessors()
     QCOMPARE(chanFact->featuresFor(ChannelClassSpec::unnamedStreamedMediaAudioCall()), unnamedStreamedMediaAudioFeatures);
     QCOMPARE(chanFact->featuresFor(ChannelClassSpec::unnamedStreamedMediaVideoCall()), streamedMediaFeatures);
     QCOMPARE(chanFact->featuresFor(ChannelClassSpec::unnamedStreamedMediaVideoCallWithAudio()), unnamedStreamedMediaAudioFeatures);
+
+    // Classes without a TargetHandleType apply to channels with any
+    ChannelClassSpec anyTextChannel;
+    anyTextChannel.setChannelType(TP_QT_IFACE_CHANNEL_TYPE_TEXT);
+    Features anyTextFeatures;
+    anyTextFeatures.insert(TextChannel::FeatureChatState);
+    chanFact->addFeaturesFor(anyTextChannel, anyTextFeatures);
+
+    QCOMPARE(chanFact->featuresForTextChats(), textChatFeatures | anyTextFeatures);
+    QCOMPARE(chanFact->featuresForTextChatrooms(), textChatroomFeatures | anyTextFeatures);
+    QCOMPARE(chanFact->featuresForRoomLists(), roomListFeatures);
+
+    // Channels whose TargetHandleType is not a uint still match the classes it compares equal to
+    ChannelClassSpec intTextChat;
+    intTextChat.setChannelType(TP_QT_IFACE_CHANNEL_TYPE_TEXT);
+    intTextChat.setProperty(TP_QT_IFACE_CHANNEL + QLatin1String(".TargetHandleType"),
+            (int) HandleTypeContact);
+    QCOMPARE(chanFact->featuresFor(intTextChat), textChatFeatures | anyTextFeatures);
 }
 
 void TestClientFactories::cleanup()
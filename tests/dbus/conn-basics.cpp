@@ -11,8 +11,11 @@
 #include <TelepathyQt/Connection>
 #include <TelepathyQt/ConnectionLowlevel>
 #include <TelepathyQt/ContactFactory>
+#include <TelepathyQt/DBusProxyTimeline>
 #include <TelepathyQt/PendingChannel>
+#include <TelepathyQt/PendingHandles>
 #include <TelepathyQt/PendingReady>
+#include <TelepathyQt/ReadinessHelper>
 #include <TelepathyQt/Debug>
 
 #include <telepathy-glib/dbus.h>
@@ -23,6 +26,26 @@
 
 using namespace Tp;
 
+namespace
+{
+
+struct IntrospectedFeature
+{
+    RefCounted *object;
+    Feature feature;
+    bool success;
+    int elapsed;
+};
+
+void recordIntrospection(RefCounted *object, const Feature &feature, bool success,
+        int elapsedMsecs, void *data)
+{
+    IntrospectedFeature introspected = { object, feature, success, elapsedMsecs };
+    static_cast<QList<IntrospectedFeature> *>(data)->append(introspected);
+}
+
+}
+
 class TestConnBasics : public Test
 {
     Q_OBJECT
@@ -44,6 +67,8 @@ private Q_SLOTS:
 
     void testBasics();
     void testSimplePresence();
+    void testIntrospectionHook();
+    void testProfiling();
 
     void cleanup();
     void cleanupTestCase();
@@ -233,6 +258,93 @@ void TestConnBasics::testSimplePresence()
     QCOMPARE(mConn->lowlevel()->maxPresenceStatusMessageLength(), (uint) 512);
 }
 
+void TestConnBasics::testIntrospectionHook()
+{
+    QList<IntrospectedFeature> introspected;
+    ReadinessHelper::setIntrospectionHook(recordIntrospection, &introspected);
+
+    Features features = Features() << Connection::FeatureSimplePresence;
+    QVERIFY(connect(mConn->becomeReady(features),
+                    SIGNAL(finished(Tp::PendingOperation*)),
+                    SLOT(expectSuccessfulCall(Tp::PendingOperation*))));
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(mConn->isReady(features), true);
+
+    ReadinessHelper::setIntrospectionHook(0);
+
+    bool found = false;
+    Q_FOREACH (const IntrospectedFeature &i, introspected) {
+        if (i.feature == Connection::FeatureSimplePresence) {
+            QVERIFY(!found);
+            QCOMPARE(i.object, static_cast<RefCounted *>(mConn.data()));
+            QVERIFY(i.success);
+            QVERIFY(i.elapsed >= 0);
+            found = true;
+        }
+    }
+    QVERIFY(found);
+}
+
+void TestConnBasics::testProfiling()
+{
+    QVERIFY(!mConn->isProfilingEnabled());
+    QVERIFY(!mConn->timeline().isValid());
+
+    mConn->setProfilingEnabled(true);
+
+    Features features = Features() << Connection::FeatureSimplePresence;
+    QVERIFY(connect(mConn->becomeReady(features),
+                    SIGNAL(finished(Tp::PendingOperation*)),
+                    SLOT(expectSuccessfulCall(Tp::PendingOperation*))));
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(mConn->isReady(features), true);
+
+    DBusProxyTimeline timeline = mConn->timeline();
+    QVERIFY(timeline.isValid());
+    QCOMPARE(timeline.className(), QLatin1String("Tp::Connection"));
+    QCOMPARE(timeline.objectPath(), mConnPath);
+    QCOMPARE(timeline.busName(), mConn->busName());
+
+    bool foundCall = false;
+    Q_FOREACH (const DBusProxyTimeline::Call &call, timeline.calls()) {
+        if (call.member == QLatin1String("GetAll")) {
+            QCOMPARE(call.interface, QLatin1String("org.freedesktop.DBus.Properties"));
+            QVERIFY(call.requestSize > 0);
+            foundCall = true;
+        }
+    }
+    QVERIFY(foundCall);
+
+    QCOMPARE(timeline.introspections().size(), 1);
+    DBusProxyTimeline::Introspection introspection = timeline.introspections().first();
+    QCOMPARE(introspection.feature, Connection::FeatureSimplePresence);
+    QVERIFY(introspection.success);
+    QVERIFY(introspection.finishTime >= introspection.startTime);
+
+    QByteArray json = timeline.toJson();
+    QVERIFY(json.startsWith("{"));
+    QVERIFY(json.contains("\"introspections\":[{"));
+
+    // A timeline is a snapshot, which doesn't keep the proxy from recording what comes next
+    int numCalls = timeline.calls().size();
+    QVERIFY(connect(mConn->lowlevel()->requestHandles(HandleTypeContact,
+                        QStringList() << QLatin1String("alice")),
+                    SIGNAL(finished(Tp::PendingOperation*)),
+                    SLOT(expectSuccessfulCall(Tp::PendingOperation*))));
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(timeline.calls().size(), numCalls);
+
+    DBusProxyTimeline laterTimeline = mConn->timeline();
+    QVERIFY(laterTimeline.calls().size() > numCalls);
+    DBusProxyTimeline::Call requestHandles = laterTimeline.calls().last();
+    QCOMPARE(requestHandles.member, QLatin1String("RequestHandles"));
+    QVERIFY(requestHandles.latency >= 0);
+
+    // Disabling it keeps what was recorded
+    mConn->setProfilingEnabled(false);
+    QCOMPARE(mConn->timeline().introspections().size(), 1);
+}
+
 void TestConnBasics::cleanup()
 {
     if (mConn) {
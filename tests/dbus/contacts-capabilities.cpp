@@ -99,6 +99,11 @@ static GHashTable *createContactCapabilities(TpHandle *handles)
     GPtrArray *caps3 = g_ptr_array_sized_new(0);
     g_hash_table_insert(capabilities, GUINT_TO_POINTER(handles[2]), caps3);
 
+    /* Support private text chats, like the first one */
+    GPtrArray *caps4 = g_ptr_array_sized_new(1);
+    addTextChatClass(caps4, TP_HANDLE_TYPE_CONTACT);
+    g_hash_table_insert(capabilities, GUINT_TO_POINTER(handles[3]), caps4);
+
     return capabilities;
 }
 
@@ -109,15 +114,15 @@ void TestContactsCapabilities::testCapabilities()
     QVERIFY(contactManager->supportedFeatures().contains(Contact::FeatureCapabilities));
 
     QStringList ids = QStringList() << QLatin1String("alice")
-        << QLatin1String("bob") << QLatin1String("chris");
+        << QLatin1String("bob") << QLatin1String("chris") << QLatin1String("dave");
 
-    gboolean supportTextChat[] = { TRUE, FALSE, FALSE };
+    gboolean supportTextChat[] = { TRUE, FALSE, FALSE, TRUE };
 
     TpHandleRepoIface *serviceRepo =
         tp_base_connection_get_handles(TP_BASE_CONNECTION(mConn->service()),
                 TP_HANDLE_TYPE_CONTACT);
-    TpHandle handles[] = { 0, 0, 0 };
-    for (int i = 0; i < 3; i++) {
+    TpHandle handles[] = { 0, 0, 0, 0 };
+    for (int i = 0; i < 4; i++) {
         handles[i] = tp_handle_ensure(serviceRepo, ids[i].toLatin1().constData(),
                 NULL, NULL);
     }
@@ -135,6 +140,7 @@ void TestContactsCapabilities::testCapabilities()
         QCOMPARE(contact->requestedFeatures().contains(Contact::FeatureCapabilities), true);
         QCOMPARE(contact->actualFeatures().contains(Contact::FeatureCapabilities), true);
 
+        QCOMPARE(contact->capabilities().isSpecificToContact(), true);
         QCOMPARE(contact->capabilities().textChats(), supportTextChat[i]);
         QCOMPARE(contact->capabilities().streamedMediaCalls(), false);
         QCOMPARE(contact->capabilities().streamedMediaAudioCalls(), false);
@@ -142,6 +148,11 @@ void TestContactsCapabilities::testCapabilities()
         QCOMPARE(contact->capabilities().streamedMediaVideoCallsWithAudio(), false);
         QCOMPARE(contact->capabilities().upgradingStreamedMediaCalls(), false);
     }
+
+    QVERIFY(contacts[0]->capabilities().allClassSpecs() ==
+            contacts[3]->capabilities().allClassSpecs());
+    QVERIFY(contacts[0]->capabilities().allClassSpecs() !=
+            contacts[1]->capabilities().allClassSpecs());
 }
 
 void TestContactsCapabilities::cleanup()
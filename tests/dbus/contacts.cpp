@@ -35,7 +35,7 @@ class TestContacts : public Test
 
 public:
     TestContacts(QObject *parent = 0)
-        : Test(parent), mConnService(0)
+        : Test(parent), mConnService(0), mChunksRetrieved(0), mHandlesProcessed(0)
     {
     }
 
@@ -43,6 +43,7 @@ protected Q_SLOTS:
     void expectConnReady(Tp::ConnectionStatus, Tp::ConnectionStatusReason);
     void expectConnInvalidated();
     void expectPendingContactsFinished(Tp::PendingOperation *);
+    void onContactsRetrieved(const QList<Tp::ContactPtr> &, int, int);
 
 private Q_SLOTS:
     void initTestCase();
@@ -51,6 +52,8 @@ private Q_SLOTS:
     void testSupport();
     void testSelfContact();
     void testForHandles();
+    void testForHandlesChunked();
+    void testForHandlesCoalesced();
     void testForIdentifiers();
     void testFeatures();
     void testFeaturesNotRequested();
@@ -66,6 +69,9 @@ private:
     ConnectionPtr mConn;
     QList<ContactPtr> mContacts;
     Tp::UIntList mInvalidHandles;
+    QList<ContactPtr> mRetrievedContacts;
+    int mChunksRetrieved;
+    int mHandlesProcessed;
 };
 
 void TestContacts::expectConnReady(Tp::ConnectionStatus newStatus,
@@ -110,6 +116,17 @@ void TestContacts::expectPendingContactsFinished(PendingOperation *op)
     mLoop->exit(0);
 }
 
+void TestContacts::onContactsRetrieved(const QList<Tp::ContactPtr> &contacts,
+        int handlesProcessed, int handlesTotal)
+{
+    QVERIFY(handlesProcessed > mHandlesProcessed);
+    QVERIFY(handlesProcessed <= handlesTotal);
+
+    mRetrievedContacts << contacts;
+    mHandlesProcessed = handlesProcessed;
+    mChunksRetrieved++;
+}
+
 void TestContacts::initTestCase()
 {
     initTestCaseImpl();
@@ -335,6 +352,140 @@ void TestContacts::testForHandles()
     processDBusQueue(mConn.data());
 }
 
+void TestContacts::testForHandlesChunked()
+{
+    const char *ids[] = {
+        "chunk-alice",
+        "chunk-bob",
+        "chunk-chris",
+        "chunk-dora",
+        "chunk-eve"
+    };
+    Tp::UIntList handles;
+    TpHandleRepoIface *serviceRepo =
+        tp_base_connection_get_handles(TP_BASE_CONNECTION(mConnService), TP_HANDLE_TYPE_CONTACT);
+
+    for (int i = 0; i < 5; i++) {
+        handles << tp_handle_ensure(serviceRepo, ids[i], NULL, NULL);
+        QVERIFY(handles[i] != 0);
+    }
+    // Put an invalid one in the middle of the second chunk
+    handles.insert(3, 31337);
+    QVERIFY(!tp_handle_is_valid(serviceRepo, handles[3], NULL));
+
+    ContactManagerPtr manager = mConn->contactManager();
+    QCOMPARE(manager->contactAttributesChunkSize(), 0U);
+    manager->setContactAttributesChunking(2, 1);
+    QCOMPARE(manager->contactAttributesChunkSize(), 2U);
+    QCOMPARE(manager->maxContactAttributesChunksInFlight(), 1U);
+
+    mRetrievedContacts.clear();
+    mChunksRetrieved = 0;
+    mHandlesProcessed = 0;
+
+    PendingContacts *pending = manager->contactsForHandles(handles);
+    QVERIFY(connect(pending,
+                SIGNAL(contactsRetrieved(QList<Tp::ContactPtr>,int,int)),
+                SLOT(onContactsRetrieved(QList<Tp::ContactPtr>,int,int))));
+    QVERIFY(connect(pending,
+                SIGNAL(finished(Tp::PendingOperation*)),
+                SLOT(expectPendingContactsFinished(Tp::PendingOperation*))));
+    QCOMPARE(mLoop->exec(), 0);
+
+    // 6 handles in chunks of 2
+    QCOMPARE(mChunksRetrieved, 3);
+    QCOMPARE(mHandlesProcessed, 6);
+
+    // The result should be the same as for a single request
+    QCOMPARE(mContacts.size(), 5);
+    QCOMPARE(mRetrievedContacts, mContacts);
+    QCOMPARE(mInvalidHandles, Tp::UIntList() << 31337);
+
+    int j = 0;
+    for (int i = 0; i < handles.size(); i++) {
+        if (i == 3) {
+            continue;
+        }
+        QCOMPARE(mContacts[j]->handle()[0], handles[i]);
+        QCOMPARE(mContacts[j]->id(), QString(QLatin1String(ids[j])));
+        j++;
+    }
+
+    manager->setContactAttributesChunking(0);
+    QCOMPARE(manager->contactAttributesChunkSize(), 0U);
+
+    // Make the contacts go out of scope, starting releasing their handles, and finish that
+    mRetrievedContacts.clear();
+    mContacts.clear();
+    mLoop->processEvents();
+    processDBusQueue(mConn.data());
+}
+
+void TestContacts::testForHandlesCoalesced()
+{
+    Tp::UIntList handles;
+    TpHandleRepoIface *serviceRepo =
+        tp_base_connection_get_handles(TP_BASE_CONNECTION(mConnService), TP_HANDLE_TYPE_CONTACT);
+
+    handles << tp_handle_ensure(serviceRepo, "merge-alice", NULL, NULL);
+    handles << tp_handle_ensure(serviceRepo, "merge-bob", NULL, NULL);
+    handles << tp_handle_ensure(serviceRepo, "merge-chris", NULL, NULL);
+    QVERIFY(handles[0] != 0 && handles[1] != 0 && handles[2] != 0);
+
+    const char *aliases[] = {
+        "Alice Merged",
+        "Bob Merged",
+        "Chris Merged"
+    };
+    tp_tests_contacts_connection_change_aliases(mConnService, 3, handles.toVector().constData(),
+            aliases);
+
+    // Two overlapping requests made in the same main loop iteration, with different features
+    PendingContacts *first = mConn->contactManager()->contactsForHandles(
+            Tp::UIntList() << handles[0] << handles[1]);
+    PendingContacts *second = mConn->contactManager()->contactsForHandles(
+            Tp::UIntList() << handles[1] << handles[2] << 31337,
+            Features() << Contact::FeatureAlias);
+
+    QVERIFY(connect(first,
+                SIGNAL(finished(Tp::PendingOperation*)),
+                SLOT(expectPendingContactsFinished(Tp::PendingOperation*))));
+    QCOMPARE(mLoop->exec(), 0);
+    QList<ContactPtr> firstContacts = mContacts;
+    QCOMPARE(firstContacts.size(), 2);
+    QVERIFY(mInvalidHandles.isEmpty());
+
+    if (!second->isFinished()) {
+        QVERIFY(connect(second,
+                    SIGNAL(finished(Tp::PendingOperation*)),
+                    SLOT(expectPendingContactsFinished(Tp::PendingOperation*))));
+        QCOMPARE(mLoop->exec(), 0);
+    } else {
+        QVERIFY(second->isValid());
+        mContacts = second->contacts();
+        mInvalidHandles = second->invalidHandles();
+    }
+    QCOMPARE(mContacts.size(), 2);
+    QCOMPARE(mInvalidHandles, Tp::UIntList() << 31337);
+
+    // Each request gets its own handles, and the shared one maps to the same object
+    QCOMPARE(firstContacts[0]->id(), QString(QLatin1String("merge-alice")));
+    QCOMPARE(firstContacts[1]->id(), QString(QLatin1String("merge-bob")));
+    QCOMPARE(mContacts[0], firstContacts[1]);
+    QCOMPARE(mContacts[1]->id(), QString(QLatin1String("merge-chris")));
+
+    // Only the second request asked for aliases
+    QCOMPARE(firstContacts[0]->requestedFeatures(), Features());
+    QVERIFY(mContacts[1]->actualFeatures().contains(Contact::FeatureAlias));
+    QCOMPARE(mContacts[1]->alias(), QString(QLatin1String("Chris Merged")));
+
+    // Make the contacts go out of scope, starting releasing their handles, and finish that
+    firstContacts.clear();
+    mContacts.clear();
+    mLoop->processEvents();
+    processDBusQueue(mConn.data());
+}
+
 void TestContacts::testForIdentifiers()
 {
     QStringList validIDs = QStringList() << QLatin1String("Alice")
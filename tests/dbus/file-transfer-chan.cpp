@@ -0,0 +1,451 @@
+#include <tests/lib/test.h>
+
+#include <tests/lib/glib-helpers/test-conn-helper.h>
+
+#include <tests/lib/glib/file-transfer-chan.h>
+#include <tests/lib/glib/simple-conn.h>
+
+#include <TelepathyQt/Connection>
+#include <TelepathyQt/IncomingFileTransferChannel>
+#include <TelepathyQt/OutgoingFileTransferChannel>
+#include <TelepathyQt/PendingReady>
+
+#include <telepathy-glib/telepathy-glib.h>
+
+#include <QBuffer>
+#include <QTemporaryFile>
+#include <QTimer>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace Tp;
+
+// An output device that buffers writes and only slowly gets rid of them, like a socket to a slow
+// peer would
+class SlowDevice : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    SlowDevice(QObject *parent = 0)
+        : QIODevice(parent)
+    {
+        connect(&mTimer, SIGNAL(timeout()), SLOT(drain()));
+        mTimer.start(1);
+    }
+
+    QByteArray writtenData() const { return mData; }
+
+    bool isSequential() const { return true; }
+    qint64 bytesToWrite() const { return mPending.size(); }
+
+    void close()
+    {
+        mData += mPending;
+        mPending.clear();
+        QIODevice::close();
+    }
+
+protected:
+    qint64 readData(char *data, qint64 maxSize)
+    {
+        Q_UNUSED(data);
+        Q_UNUSED(maxSize);
+        return -1;
+    }
+
+    qint64 writeData(const char *data, qint64 size)
+    {
+        mPending.append(data, size);
+        return size;
+    }
+
+private Q_SLOTS:
+    void drain()
+    {
+        if (mPending.isEmpty()) {
+            return;
+        }
+
+        int len = qMin(mPending.size(), 32 * 1024);
+        mData += mPending.left(len);
+        mPending.remove(0, len);
+        Q_EMIT bytesWritten(len);
+    }
+
+private:
+    QTimer mTimer;
+    QByteArray mPending;
+    QByteArray mData;
+};
+
+class TestFileTransferChan : public Test
+{
+    Q_OBJECT
+
+public:
+    TestFileTransferChan(QObject *parent = 0)
+        : Test(parent),
+          mConn(0), mChanService(0), mMaxBufferedBytes(0)
+    { }
+
+protected Q_SLOTS:
+    void onStateChanged(Tp::FileTransferState state);
+    void onSampleBufferedBytes();
+
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+
+    void testProvideFile();
+    void testProvideFileWithOffset();
+    void testProvideBuffer();
+    void testAcceptFile();
+    void testAcceptFileWithOffset();
+    void testAcceptFileWithoutSplice();
+    void testAcceptSlowDevice();
+
+    void cleanup();
+    void cleanupTestCase();
+
+private:
+    void createChannel(qulonglong size, qulonglong initialOffset);
+    void createIncomingChannel(const QByteArray &content);
+    void sendData(QIODevice *input);
+    void receiveData(qulonglong offset, QIODevice *output);
+    QByteArray receivedData() const;
+
+    TestConnHelper *mConn;
+    TpTestsFileTransferChannel *mChanService;
+    OutgoingFileTransferChannelPtr mChan;
+    IncomingFileTransferChannelPtr mIncomingChan;
+
+    QByteArray mData;
+    qint64 mMaxBufferedBytes;
+};
+
+void TestFileTransferChan::onStateChanged(Tp::FileTransferState state)
+{
+    if (state == FileTransferStateCompleted || state == FileTransferStateCancelled) {
+        mLoop->exit(0);
+    }
+}
+
+void TestFileTransferChan::onSampleBufferedBytes()
+{
+    mMaxBufferedBytes = qMax(mMaxBufferedBytes, mIncomingChan->bufferedBytes());
+}
+
+void TestFileTransferChan::createChannel(qulonglong size, qulonglong initialOffset)
+{
+    mChan.reset();
+    mIncomingChan.reset();
+    mLoop->processEvents();
+    tp_clear_object(&mChanService);
+
+    /* Create service-side file transfer channel object */
+    QString chanPath = QString(QLatin1String("%1/FileTransferChannel")).arg(mConn->objectPath());
+
+    TpHandleRepoIface *contactRepo = tp_base_connection_get_handles(
+            TP_BASE_CONNECTION(mConn->service()), TP_HANDLE_TYPE_CONTACT);
+    TpHandle handle = tp_handle_ensure(contactRepo, "bob", NULL, NULL);
+    TpHandle selfHandle = tp_base_connection_get_self_handle(
+            TP_BASE_CONNECTION(mConn->service()));
+
+    mChanService = TP_TESTS_FILE_TRANSFER_CHANNEL(g_object_new(
+            TP_TESTS_TYPE_FILE_TRANSFER_CHANNEL,
+            "connection", mConn->service(),
+            "handle", handle,
+            "requested", TRUE,
+            "object-path", chanPath.toLatin1().constData(),
+            "initiator-handle", selfHandle,
+            "filename", "test.bin",
+            "size", (guint64) size,
+            "initial-offset", (guint64) initialOffset,
+            NULL));
+
+    /* Create client-side file transfer channel object */
+    mChan = OutgoingFileTransferChannel::create(mConn->client(), chanPath, QVariantMap());
+    QVERIFY(connect(mChan->becomeReady(OutgoingFileTransferChannel::FeatureCore),
+                SIGNAL(finished(Tp::PendingOperation *)),
+                SLOT(expectSuccessfulCall(Tp::PendingOperation *))));
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(mChan->isReady(OutgoingFileTransferChannel::FeatureCore), true);
+    QCOMPARE(mChan->state(), FileTransferStatePending);
+    QCOMPARE(mChan->size(), size);
+    QCOMPARE(mChan->initialOffset(), initialOffset);
+}
+
+void TestFileTransferChan::createIncomingChannel(const QByteArray &content)
+{
+    mChan.reset();
+    mIncomingChan.reset();
+    mLoop->processEvents();
+    tp_clear_object(&mChanService);
+
+    /* Create service-side file transfer channel object */
+    QString chanPath = QString(QLatin1String("%1/FileTransferChannel")).arg(mConn->objectPath());
+
+    TpHandleRepoIface *contactRepo = tp_base_connection_get_handles(
+            TP_BASE_CONNECTION(mConn->service()), TP_HANDLE_TYPE_CONTACT);
+    TpHandle handle = tp_handle_ensure(contactRepo, "bob", NULL, NULL);
+
+    mChanService = TP_TESTS_FILE_TRANSFER_CHANNEL(g_object_new(
+            TP_TESTS_TYPE_FILE_TRANSFER_CHANNEL,
+            "connection", mConn->service(),
+            "handle", handle,
+            "requested", FALSE,
+            "object-path", chanPath.toLatin1().constData(),
+            "initiator-handle", handle,
+            "filename", "test.bin",
+            "size", (guint64) content.size(),
+            NULL));
+    tp_tests_file_transfer_channel_set_content(mChanService,
+            (const guint8 *) content.constData(), content.size());
+
+    /* Create client-side file transfer channel object */
+    mIncomingChan = IncomingFileTransferChannel::create(mConn->client(), chanPath, QVariantMap());
+    QVERIFY(connect(mIncomingChan->becomeReady(IncomingFileTransferChannel::FeatureCore),
+                SIGNAL(finished(Tp::PendingOperation *)),
+                SLOT(expectSuccessfulCall(Tp::PendingOperation *))));
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(mIncomingChan->isReady(IncomingFileTransferChannel::FeatureCore), true);
+    QCOMPARE(mIncomingChan->state(), FileTransferStatePending);
+    QCOMPARE(mIncomingChan->size(), (qulonglong) content.size());
+}
+
+void TestFileTransferChan::sendData(QIODevice *input)
+{
+    QVERIFY(connect(mChan.data(),
+                SIGNAL(stateChanged(Tp::FileTransferState,Tp::FileTransferStateChangeReason)),
+                SLOT(onStateChanged(Tp::FileTransferState))));
+    QVERIFY(connect(mChan->provideFile(input),
+                SIGNAL(finished(Tp::PendingOperation *)),
+                SLOT(expectSuccessfulCall(Tp::PendingOperation *))));
+    QCOMPARE(mLoop->exec(), 0);
+
+    // Wait for the remote side to have seen EOF
+    while (mChan->state() != FileTransferStateCompleted) {
+        QCOMPARE(mLoop->exec(), 0);
+    }
+}
+
+void TestFileTransferChan::receiveData(qulonglong offset, QIODevice *output)
+{
+    QVERIFY(connect(mIncomingChan.data(),
+                SIGNAL(stateChanged(Tp::FileTransferState,Tp::FileTransferStateChangeReason)),
+                SLOT(onStateChanged(Tp::FileTransferState))));
+    QVERIFY(connect(mIncomingChan->acceptFile(offset, output),
+                SIGNAL(finished(Tp::PendingOperation *)),
+                SLOT(expectSuccessfulCall(Tp::PendingOperation *))));
+    QCOMPARE(mLoop->exec(), 0);
+
+    while (mIncomingChan->state() != FileTransferStateCompleted) {
+        QCOMPARE(mLoop->exec(), 0);
+    }
+
+    QCOMPARE(mIncomingChan->initialOffset(), offset);
+    QCOMPARE(mIncomingChan->bufferedBytes(), (qint64) 0);
+    QVERIFY(mIncomingChan->transferRate() > 0);
+}
+
+QByteArray TestFileTransferChan::receivedData() const
+{
+    const GByteArray *received = tp_tests_file_transfer_channel_get_received_data(mChanService);
+    return QByteArray((const char *) received->data, received->len);
+}
+
+void TestFileTransferChan::initTestCase()
+{
+    initTestCaseImpl();
+
+    g_type_init();
+    g_set_prgname("file-transfer-chan");
+    tp_debug_set_flags("all");
+    dbus_g_bus_get(DBUS_BUS_STARTER, 0);
+
+    mConn = new TestConnHelper(this,
+            TP_TESTS_TYPE_SIMPLE_CONNECTION,
+            "account", "me@example.com",
+            "protocol", "example",
+            NULL);
+    QCOMPARE(mConn->connect(), true);
+
+    // Not a multiple of any block size, to catch off-by-one errors at the end of the transfer
+    mData.resize(1024 * 1024 + 4321);
+    for (int i = 0; i < mData.size(); ++i) {
+        mData[i] = (char) (i * 7 + i / 251);
+    }
+}
+
+void TestFileTransferChan::init()
+{
+    initImpl();
+}
+
+void TestFileTransferChan::testProvideFile()
+{
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QCOMPARE(file.write(mData), (qint64) mData.size());
+    QVERIFY(file.seek(0));
+
+    createChannel(mData.size(), 0);
+    sendData(&file);
+
+    QCOMPARE(receivedData().size(), mData.size());
+    QVERIFY(receivedData() == mData);
+}
+
+void TestFileTransferChan::testProvideFileWithOffset()
+{
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QCOMPARE(file.write(mData), (qint64) mData.size());
+    QVERIFY(file.seek(0));
+
+    qulonglong offset = 100 * 1024 + 17;
+    createChannel(mData.size(), offset);
+    sendData(&file);
+
+    QCOMPARE(receivedData().size(), mData.size() - (int) offset);
+    QVERIFY(receivedData() == mData.mid(offset));
+}
+
+void TestFileTransferChan::testProvideBuffer()
+{
+    // Not a QFile, so this goes through the buffered path
+    QBuffer buffer(&mData);
+    QVERIFY(buffer.open(QIODevice::ReadOnly));
+
+    qulonglong offset = 100 * 1024 + 17;
+    createChannel(mData.size(), offset);
+    sendData(&buffer);
+
+    QVERIFY(receivedData() == mData.mid(offset));
+}
+
+void TestFileTransferChan::testAcceptFile()
+{
+    createIncomingChannel(mData);
+
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    receiveData(0, &file);
+
+    QVERIFY(file.open());
+    QCOMPARE(file.size(), (qint64) mData.size());
+    QVERIFY(file.readAll() == mData);
+}
+
+void TestFileTransferChan::testAcceptFileWithOffset()
+{
+    createIncomingChannel(mData);
+
+    // Resuming a previous transfer, the first part is already there
+    qulonglong offset = 100 * 1024 + 17;
+    QTemporaryFile file;
+    QVERIFY(file.open());
+    QCOMPARE(file.write(mData.left(offset)), (qint64) offset);
+
+    receiveData(offset, &file);
+
+    QVERIFY(file.open());
+    QVERIFY(file.readAll() == mData);
+}
+
+void TestFileTransferChan::testAcceptFileWithoutSplice()
+{
+    createIncomingChannel(mData);
+
+    // splice() refuses to write to a descriptor in append mode, which QFile doesn't know about when
+    // given one, so the transfer has to fall back to copying once the first block was spliced
+    QTemporaryFile tmpFile;
+    QVERIFY(tmpFile.open());
+    int fd = ::open(QFile::encodeName(tmpFile.fileName()).constData(), O_WRONLY | O_APPEND);
+    QVERIFY(fd != -1);
+
+    QFile file;
+    QVERIFY(file.open(fd, QIODevice::WriteOnly));
+    receiveData(0, &file);
+    ::close(fd);
+
+    QCOMPARE(tmpFile.size(), (qint64) mData.size());
+    QVERIFY(tmpFile.readAll() == mData);
+}
+
+void TestFileTransferChan::testAcceptSlowDevice()
+{
+    QByteArray data;
+    for (int i = 0; i < 8; ++i) {
+        data += mData;
+    }
+
+    createIncomingChannel(data);
+
+    SlowDevice device;
+    QVERIFY(device.open(QIODevice::WriteOnly));
+
+    mMaxBufferedBytes = 0;
+    QTimer sampleTimer;
+    QVERIFY(connect(&sampleTimer, SIGNAL(timeout()), SLOT(onSampleBufferedBytes())));
+    sampleTimer.start(1);
+
+    receiveData(0, &device);
+
+    // Reading from the socket should have been paused rather than buffering the whole file
+    qDebug() << "At most" << mMaxBufferedBytes << "bytes were buffered";
+    QVERIFY(mMaxBufferedBytes > 0);
+    QVERIFY(mMaxBufferedBytes < 2 * 1024 * 1024);
+
+    QCOMPARE(device.writtenData().size(), data.size());
+    QVERIFY(device.writtenData() == data);
+}
+
+void TestFileTransferChan::cleanup()
+{
+    cleanupImpl();
+
+    if (mIncomingChan && mIncomingChan->isValid()) {
+        QVERIFY(connect(mIncomingChan.data(),
+                SIGNAL(invalidated(Tp::DBusProxy*,QString,QString)),
+                mLoop,
+                SLOT(quit())));
+        tp_base_channel_close(TP_BASE_CHANNEL(mChanService));
+        QCOMPARE(mLoop->exec(), 0);
+    }
+
+    mIncomingChan.reset();
+
+    if (mChan && mChan->isValid()) {
+        qDebug() << "waiting for the channel to become invalidated";
+
+        QVERIFY(connect(mChan.data(),
+                SIGNAL(invalidated(Tp::DBusProxy*,QString,QString)),
+                mLoop,
+                SLOT(quit())));
+        tp_base_channel_close(TP_BASE_CHANNEL(mChanService));
+        QCOMPARE(mLoop->exec(), 0);
+    }
+
+    mChan.reset();
+
+    if (mChanService != 0) {
+        g_object_unref(mChanService);
+        mChanService = 0;
+    }
+
+    mLoop->processEvents();
+}
+
+void TestFileTransferChan::cleanupTestCase()
+{
+    QCOMPARE(mConn->disconnect(), true);
+    delete mConn;
+
+    cleanupTestCaseImpl();
+}
+
+QTEST_MAIN(TestFileTransferChan)
+#include "_gen/file-transfer-chan.cpp.moc.hpp"
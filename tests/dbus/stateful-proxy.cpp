@@ -23,10 +23,15 @@
 #include <QEventLoop>
 #include <QtTest>
 
+#include <TelepathyQt/ChannelFactory>
+#include <TelepathyQt/Connection>
+#include <TelepathyQt/ConnectionFactory>
 #include <TelepathyQt/Constants>
+#include <TelepathyQt/ContactFactory>
 #include <TelepathyQt/Debug>
 #include <TelepathyQt/Types>
 #include <TelepathyQt/DBus>
+#include <TelepathyQt/PendingReady>
 #include <TelepathyQt/StatefulDBusProxy>
 
 #include "tests/lib/test.h"
@@ -73,6 +78,8 @@ private Q_SLOTS:
 
     void testBasics();
     void testNameOwnerChanged();
+    void testAsyncResolution();
+    void testAsyncFactoryResolution();
 
     void cleanup();
     void cleanupTestCase();
@@ -94,6 +101,8 @@ private:
     QString mSignalledInvalidationMessage;
 
     static QString wellKnownName();
+    static QString asyncWellKnownName();
+    static QString factoryWellKnownName();
     static QString objectPath();
     static QString uniqueName();
 };
@@ -103,6 +112,16 @@ QString TestStatefulProxy::wellKnownName()
     return QLatin1String("org.freedesktop.Telepathy.Qt.TestStatefulProxy");
 }
 
+QString TestStatefulProxy::asyncWellKnownName()
+{
+    return QLatin1String("org.freedesktop.Telepathy.Qt.TestStatefulProxy.Async");
+}
+
+QString TestStatefulProxy::factoryWellKnownName()
+{
+    return QLatin1String("org.freedesktop.Telepathy.Qt.TestStatefulProxy.Factory");
+}
+
 QString TestStatefulProxy::objectPath()
 {
     return QLatin1String("/org/freedesktop/Telepathy/Qt/TestStatefulProxy/Object");
@@ -125,6 +144,8 @@ void TestStatefulProxy::initTestCase()
     initTestCaseImpl();
 
     QVERIFY(QDBusConnection::sessionBus().registerService(wellKnownName()));
+    QVERIFY(QDBusConnection::sessionBus().registerService(asyncWellKnownName()));
+    QVERIFY(QDBusConnection::sessionBus().registerService(factoryWellKnownName()));
     QDBusConnection::sessionBus().registerObject(objectPath(), this);
 }
 
@@ -293,6 +314,87 @@ void TestStatefulProxy::testNameOwnerChanged()
     QCOMPARE(mProxy->invalidationMessage(), mSignalledInvalidationMessage);
 }
 
+void TestStatefulProxy::testAsyncResolution()
+{
+    StatefulDBusProxy::setAsyncUniqueNameResolution(true);
+    QVERIFY(StatefulDBusProxy::asyncUniqueNameResolution());
+
+    // Nothing looked up this name yet, so the constructor can't know its owner
+    mProxy = new MyStatefulDBusProxy(QDBusConnection::sessionBus(),
+            asyncWellKnownName(), objectPath());
+    QVERIFY(mProxy->isValid());
+    QVERIFY(!mProxy->isUniqueNameResolved());
+    QCOMPARE(mProxy->busName(), asyncWellKnownName());
+
+    while (!mProxy->isUniqueNameResolved()) {
+        mLoop->processEvents();
+    }
+    QVERIFY(mProxy->isValid());
+    // Its interfaces could already have been built with the well-known name, so it sticks to it
+    QCOMPARE(mProxy->busName(), asyncWellKnownName());
+
+    // Now it's cached
+    MyStatefulDBusProxy *other = new MyStatefulDBusProxy(QDBusConnection::sessionBus(),
+            asyncWellKnownName(), objectPath());
+    QVERIFY(other->isUniqueNameResolved());
+    QCOMPARE(other->busName(), uniqueName());
+    QCOMPARE(StatefulDBusProxy::uniqueNameFrom(QDBusConnection::sessionBus(),
+                asyncWellKnownName()), uniqueName());
+    delete other;
+
+    // A name nobody owns
+    delete mProxy;
+    mProxy = new MyStatefulDBusProxy(QDBusConnection::sessionBus(),
+            QLatin1String("org.freedesktop.Telepathy.Qt.TestStatefulProxy.Nobody"),
+            objectPath());
+    QVERIFY(mProxy->isValid());
+    QVERIFY(!mProxy->isUniqueNameResolved());
+
+    QVERIFY(connect(mProxy, SIGNAL(invalidated(
+                        Tp::DBusProxy *,
+                        const QString &, const QString &)),
+                this, SLOT(expectInvalidated(
+                        Tp::DBusProxy *,
+                        const QString &, const QString &))));
+    QCOMPARE(mLoop->exec(), EXPECT_INVALIDATED_SUCCESS);
+    QCOMPARE(mInvalidated, 1);
+    QVERIFY(mProxy->isUniqueNameResolved());
+    QVERIFY(!mProxy->isValid());
+    QCOMPARE(mProxy->invalidationReason(), TP_QT_DBUS_ERROR_NAME_HAS_NO_OWNER);
+}
+
+void TestStatefulProxy::testAsyncFactoryResolution()
+{
+    StatefulDBusProxy::setAsyncUniqueNameResolution(true);
+
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    ConnectionFactoryPtr factory = ConnectionFactory::create(bus);
+    ChannelFactoryPtr chanFactory = ChannelFactory::create(bus);
+    ContactFactoryPtr contactFactory = ContactFactory::create();
+
+    // Nothing knows the owner yet, so looking up a cached proxy doesn't block on it, and the proxy
+    // is built and cached with the well-known name
+    QCOMPARE(StatefulDBusProxy::uniqueNameFrom(bus, factoryWellKnownName()),
+            factoryWellKnownName());
+    ConnectionPtr conn = ConnectionPtr::qObjectCast(factory->proxy(factoryWellKnownName(),
+                objectPath(), chanFactory, contactFactory)->proxy());
+    QVERIFY(!conn.isNull());
+    QVERIFY(!conn->isUniqueNameResolved());
+    QCOMPARE(conn->busName(), factoryWellKnownName());
+    QVERIFY(factory->proxy(factoryWellKnownName(), objectPath(), chanFactory,
+                contactFactory)->proxy() == conn.data());
+
+    while (!conn->isUniqueNameResolved()) {
+        mLoop->processEvents();
+    }
+    QVERIFY(conn->isValid());
+
+    // Once the owner is known, the same proxy is still found by the name it was cached with
+    QCOMPARE(StatefulDBusProxy::uniqueNameFrom(bus, factoryWellKnownName()), uniqueName());
+    QVERIFY(factory->proxy(factoryWellKnownName(), objectPath(), chanFactory,
+                contactFactory)->proxy() == conn.data());
+}
+
 void TestStatefulProxy::cleanup()
 {
     if (mProxy) {
@@ -300,6 +402,8 @@ void TestStatefulProxy::cleanup()
         mProxy = 0;
     }
 
+    StatefulDBusProxy::setAsyncUniqueNameResolution(false);
+
     cleanupImpl();
 }
 
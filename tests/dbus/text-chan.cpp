@@ -46,6 +46,7 @@ public:
 protected Q_SLOTS:
     void onMessageReceived(const Tp::ReceivedMessage &);
     void onMessageRemoved(const Tp::ReceivedMessage &);
+    void onMessageQueueOverflowed(const QList<Tp::ReceivedMessage> &);
     void onMessageSent(const Tp::Message &,
             Tp::MessageSendingFlags, const QString &);
     void onChatStateChanged(const Tp::ContactPtr &contact,
@@ -57,6 +58,8 @@ private Q_SLOTS:
 
     void testMessages();
     void testLegacyText();
+    void testAcknowledgeBacklog();
+    void testMessageQueueLimits();
 
     void cleanup();
     void cleanupTestCase();
@@ -76,6 +79,7 @@ private:
     QList<SentMessageDetails> sent;
     QList<ReceivedMessage> received;
     QList<ReceivedMessage> removed;
+    QList<QList<ReceivedMessage> > overflowed;
     bool mGotChatStateChanged;
     ContactPtr mChatStateChangedContact;
     ChannelChatState mChatStateChangedState;
@@ -94,6 +98,12 @@ void TestTextChan::onMessageRemoved(const ReceivedMessage &message)
     removed << message;
 }
 
+void TestTextChan::onMessageQueueOverflowed(const QList<ReceivedMessage> &messages)
+{
+    qDebug() << "message queue overflowed";
+    overflowed << messages;
+}
+
 void TestTextChan::onMessageSent(const Tp::Message &message,
         Tp::MessageSendingFlags flags, const QString &token)
 {
@@ -534,10 +544,165 @@ void TestTextChan::testLegacyText()
     commonTest(false);
 }
 
+void TestTextChan::testAcknowledgeBacklog()
+{
+    mChan = TextChannel::create(mConn->client(), mMessagesChanPath, QVariantMap());
+    QVERIFY(connect(mChan.data(),
+                    SIGNAL(messageReceived(Tp::ReceivedMessage)),
+                    SLOT(onMessageReceived(Tp::ReceivedMessage))));
+    QVERIFY(connect(mChan.data(),
+                    SIGNAL(pendingMessageRemoved(Tp::ReceivedMessage)),
+                    SLOT(onMessageRemoved(Tp::ReceivedMessage))));
+    QVERIFY(connect(mChan->becomeReady(TextChannel::FeatureMessageQueue),
+                SIGNAL(finished(Tp::PendingOperation *)),
+                SLOT(expectSuccessfulCall(Tp::PendingOperation *))));
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(mChan->messageQueue().size(), 0);
+
+    // A backlog, like the one a client finds after reconnecting
+    const int numMessages = 2000;
+    guint handle = tp_handle_ensure(mContactRepo, "someone@localhost", 0, 0);
+    for (int i = 0; i < numMessages; ++i) {
+        TpMessage *msg = tp_cm_message_new(TP_BASE_CONNECTION(mConn->service()), 2);
+        tp_cm_message_set_sender(msg, handle);
+        tp_message_set_uint32(msg, 0, "message-type", TP_CHANNEL_TEXT_MESSAGE_TYPE_NORMAL);
+        tp_message_set_string(msg, 1, "content-type", "text/plain");
+        tp_message_set_string(msg, 1, "content",
+                QByteArray::number(i).constData());
+        tp_message_mixin_take_received(G_OBJECT(mMessagesChanService), msg);
+    }
+
+    while (received.size() != numMessages) {
+        QCOMPARE(mLoop->exec(), 0);
+    }
+    QCOMPARE(mChan->messageQueue().size(), numMessages);
+
+    // Forgetting every other message keeps the rest in order
+    QList<ReceivedMessage> toForget;
+    for (int i = 0; i < numMessages; i += 2) {
+        toForget << received.at(i);
+    }
+    mChan->forget(toForget);
+    QCOMPARE(removed.size(), numMessages / 2);
+
+    QList<ReceivedMessage> queue = mChan->messageQueue();
+    QCOMPARE(queue.size(), numMessages / 2);
+    for (int i = 0; i < queue.size(); ++i) {
+        QVERIFY(queue.at(i) == received.at(i * 2 + 1));
+        QCOMPARE(queue.at(i).text(), QString::number(i * 2 + 1));
+    }
+
+    // Forgetting a message twice is harmless
+    mChan->forget(QList<ReceivedMessage>() << received.at(0));
+    QCOMPARE(removed.size(), numMessages / 2);
+
+    // Acknowledge everything, including the messages we only forgot about
+    mChan->acknowledge(received);
+    QCOMPARE(removed.size(), numMessages);
+    QCOMPARE(mChan->messageQueue().size(), 0);
+
+    while (tp_message_mixin_has_pending_messages(
+                G_OBJECT(mMessagesChanService), 0)) {
+        QTest::qWait(1);
+    }
+
+    // PendingMessagesRemoved for messages already removed locally must not remove anything else
+    processDBusQueue(mChan.data());
+    QCOMPARE(removed.size(), numMessages);
+}
+
+void TestTextChan::testMessageQueueLimits()
+{
+    mChan = TextChannel::create(mConn->client(), mMessagesChanPath, QVariantMap());
+    QVERIFY(connect(mChan.data(),
+                    SIGNAL(messageReceived(Tp::ReceivedMessage)),
+                    SLOT(onMessageReceived(Tp::ReceivedMessage))));
+    QVERIFY(connect(mChan.data(),
+                    SIGNAL(pendingMessageRemoved(Tp::ReceivedMessage)),
+                    SLOT(onMessageRemoved(Tp::ReceivedMessage))));
+    QVERIFY(connect(mChan.data(),
+                    SIGNAL(messageQueueOverflowed(QList<Tp::ReceivedMessage>)),
+                    SLOT(onMessageQueueOverflowed(QList<Tp::ReceivedMessage>))));
+    QVERIFY(connect(mChan->becomeReady(TextChannel::FeatureMessageQueue),
+                SIGNAL(finished(Tp::PendingOperation *)),
+                SLOT(expectSuccessfulCall(Tp::PendingOperation *))));
+    QCOMPARE(mLoop->exec(), 0);
+    QCOMPARE(mChan->messageQueue().size(), 0);
+    QCOMPARE(mChan->messageQueueMemoryUsage(), Q_INT64_C(0));
+    QCOMPARE(mChan->messageQueueLengthLimit(), 0);
+    QCOMPARE(mChan->messageQueueMemoryLimit(), Q_INT64_C(0));
+
+    const int maxMessages = 10;
+    mChan->setMessageQueueLengthLimit(maxMessages);
+    QCOMPARE(mChan->messageQueueLengthLimit(), maxMessages);
+
+    const int numMessages = 25;
+    guint handle = tp_handle_ensure(mContactRepo, "someone@localhost", 0, 0);
+    for (int i = 0; i < numMessages; ++i) {
+        TpMessage *msg = tp_cm_message_new(TP_BASE_CONNECTION(mConn->service()), 2);
+        tp_cm_message_set_sender(msg, handle);
+        tp_message_set_uint32(msg, 0, "message-type", TP_CHANNEL_TEXT_MESSAGE_TYPE_NORMAL);
+        tp_message_set_string(msg, 1, "content-type", "text/plain");
+        tp_message_set_string(msg, 1, "content",
+                QByteArray::number(i).constData());
+        tp_message_mixin_take_received(G_OBJECT(mMessagesChanService), msg);
+    }
+
+    while (received.size() != numMessages) {
+        QCOMPARE(mLoop->exec(), 0);
+    }
+
+    // Only the most recent messages are kept, and the others were forgotten oldest first
+    QList<ReceivedMessage> queue = mChan->messageQueue();
+    QCOMPARE(queue.size(), maxMessages);
+    for (int i = 0; i < queue.size(); ++i) {
+        QVERIFY(queue.at(i) == received.at(numMessages - maxMessages + i));
+    }
+    QCOMPARE(removed.size(), numMessages - maxMessages);
+    QCOMPARE(overflowed.size(), numMessages - maxMessages);
+    for (int i = 0; i < removed.size(); ++i) {
+        QVERIFY(removed.at(i) == received.at(i));
+        QCOMPARE(overflowed.at(i).size(), 1);
+        QVERIFY(overflowed.at(i).at(0) == received.at(i));
+    }
+    QVERIFY(mChan->messageQueueMemoryUsage() > 0);
+
+    // A memory limit for about half the queue trims it right away
+    qint64 usage = mChan->messageQueueMemoryUsage();
+    removed.clear();
+    overflowed.clear();
+    mChan->setMessageQueueMemoryLimit(usage / 2);
+    QCOMPARE(mChan->messageQueueMemoryLimit(), usage / 2);
+    QVERIFY(mChan->messageQueueMemoryUsage() <= usage / 2);
+    QVERIFY(mChan->messageQueue().size() < maxMessages);
+    QVERIFY(mChan->messageQueue().size() > 0);
+    QCOMPARE(overflowed.size(), 1);
+    QCOMPARE(overflowed.at(0).size(), removed.size());
+    QCOMPARE(mChan->messageQueue().size() + removed.size(), maxMessages);
+
+    // Even with a tiny limit, the most recent message is kept
+    mChan->setMessageQueueMemoryLimit(1);
+    QCOMPARE(mChan->messageQueue().size(), 1);
+    QVERIFY(mChan->messageQueue().at(0) == received.last());
+
+    // Forgetting the rest brings the accounting back to zero
+    mChan->forget(mChan->messageQueue());
+    QCOMPARE(mChan->messageQueue().size(), 0);
+    QCOMPARE(mChan->messageQueueMemoryUsage(), Q_INT64_C(0));
+
+    // The forgotten messages are still pending on the service side
+    mChan->acknowledge(received);
+    while (tp_message_mixin_has_pending_messages(
+                G_OBJECT(mMessagesChanService), 0)) {
+        QTest::qWait(1);
+    }
+}
+
 void TestTextChan::cleanup()
 {
     received.clear();
     removed.clear();
+    overflowed.clear();
     sent.clear();
 
     cleanupImpl();
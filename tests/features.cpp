@@ -29,6 +29,7 @@ public:
 
 private Q_SLOTS:
     void testFeaturesHash();
+    void testAssignment();
 };
 
 TestFeatures::TestFeatures(QObject *parent)
@@ -68,6 +69,31 @@ void TestFeatures::testFeaturesHash()
     QVERIFY(qHash(fs1.toSet()) != qHash(fs2.toSet()));
 }
 
+void TestFeatures::testAssignment()
+{
+    Feature critical(QLatin1String("Foo"), 1, true);
+    Feature feature;
+    QVERIFY(!feature.isValid());
+
+    feature = critical;
+    QVERIFY(feature.isValid());
+    QVERIFY(feature.isCritical());
+    QCOMPARE(feature, critical);
+
+    // The same feature constructed again is equal, whatever its criticality
+    Feature other(QLatin1String("Foo"), 1);
+    QCOMPARE(other, critical);
+    QVERIFY(!other.isCritical());
+
+    feature = other;
+    QCOMPARE(feature, critical);
+    QVERIFY(!feature.isCritical());
+
+    feature = Feature();
+    QVERIFY(!feature.isValid());
+    QVERIFY(!feature.isCritical());
+}
+
 QTEST_MAIN(TestFeatures)
 
 #include "_gen/features.cpp.moc.hpp"
@@ -0,0 +1,177 @@
+#include <QtTest/QtTest>
+#include <QtCore/QThread>
+
+#include "TelepathyQt/handle-table-internal.h"
+
+using namespace Tp;
+
+class TestHandleTable : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testRefUnref();
+    void testGrow();
+    void testReclaim();
+    void testThreadSafety();
+};
+
+void TestHandleTable::testRefUnref()
+{
+    HandleTable table;
+    QVERIFY(!table.isReferenced(1));
+    QVERIFY(!table.tryRef(1));
+    QVERIFY(!table.tryUnref(1));
+
+    table.ref(1);
+    QVERIFY(table.isReferenced(1));
+    QCOMPARE(table.referencedHandles(), UIntList() << 1);
+
+    // The last reference can only be dropped with unref()
+    QVERIFY(!table.tryUnref(1));
+
+    QVERIFY(table.tryRef(1));
+    table.ref(1);
+    QVERIFY(table.tryUnref(1));
+    QVERIFY(!table.unref(1));
+    QVERIFY(table.unref(1));
+    QVERIFY(!table.isReferenced(1));
+    QVERIFY(table.referencedHandles().isEmpty());
+
+    // Nor can a handle without references be revived without the lock
+    QVERIFY(!table.tryRef(1));
+    table.ref(1);
+    QVERIFY(table.isReferenced(1));
+    QVERIFY(table.unref(1));
+}
+
+void TestHandleTable::testGrow()
+{
+    HandleTable table;
+    const uint numHandles = 10000;
+    for (uint handle = 1; handle <= numHandles; ++handle) {
+        table.ref(handle);
+    }
+
+    QCOMPARE(table.size(), numHandles);
+    QVERIFY(table.capacity() >= numHandles * 2);
+    QCOMPARE((uint) table.referencedHandles().size(), numHandles);
+    for (uint handle = 1; handle <= numHandles; ++handle) {
+        QVERIFY(table.tryRef(handle));
+        QVERIFY(table.tryUnref(handle));
+    }
+    QVERIFY(!table.isReferenced(numHandles + 1));
+}
+
+void TestHandleTable::testReclaim()
+{
+    HandleTable table;
+    table.ref(1);
+    uint initialCapacity = table.capacity();
+
+    // Handles come and go, e.g. with the members of busy chat rooms, but only a few are kept
+    uint handle = 2;
+    for (int round = 0; round < 20; ++round) {
+        for (int i = 0; i < 1000; ++i) {
+            table.ref(handle + i);
+        }
+        for (int i = 0; i < 1000; ++i) {
+            QVERIFY(table.unref(handle + i));
+        }
+        handle += 1000;
+        table.reclaim();
+
+        QCOMPARE(table.size(), 1U);
+        QVERIFY(table.isReferenced(1));
+        QVERIFY(!table.isReferenced(handle - 1));
+    }
+
+    table.reclaim();
+    QCOMPARE(table.referencedHandles(), UIntList() << 1);
+
+    // Once only a few handles are left, the index goes back to its initial size
+    QCOMPARE(table.capacity(), initialCapacity);
+
+    // A handle which had been dropped can be referenced again
+    table.ref(2);
+    QVERIFY(table.tryRef(2));
+    QVERIFY(!table.unref(2));
+    QVERIFY(table.unref(2));
+}
+
+class Thread : public QThread
+{
+public:
+    Thread(HandleTable *table, const UIntList &handles, QAtomicInt *failures,
+            QObject *parent = 0)
+        : QThread(parent), mTable(table), mHandles(handles), mFailures(failures) {}
+
+    void run()
+    {
+        for (int i = 0; i < 20000; ++i) {
+            uint handle = mHandles.at(i % mHandles.size());
+            if (!mTable->tryRef(handle)) {
+                mFailures->ref();
+                continue;
+            }
+            if (!mTable->tryUnref(handle)) {
+                mFailures->ref();
+            }
+        }
+    }
+
+private:
+    HandleTable *mTable;
+    UIntList mHandles;
+    QAtomicInt *mFailures;
+};
+
+void TestHandleTable::testThreadSafety()
+{
+    HandleTable table;
+    UIntList held;
+    for (uint handle = 1; handle <= 16; ++handle) {
+        table.ref(handle);
+        held << handle;
+    }
+
+    QAtomicInt failures(0);
+    Thread *t[4];
+    for (int i = 0; i < 4; ++i) {
+        t[i] = new Thread(&table, held, &failures, this);
+        t[i]->start();
+    }
+
+    // Meanwhile, make the index grow and be rebuilt under the lock-free lookups, as the owner
+    // would with its lock held
+    uint handle = 100;
+    while (!t[0]->isFinished() || !t[1]->isFinished() ||
+            !t[2]->isFinished() || !t[3]->isFinished()) {
+        for (int i = 0; i < 200; ++i) {
+            table.ref(handle + i);
+        }
+        for (int i = 0; i < 200; ++i) {
+            table.unref(handle + i);
+        }
+        handle += 200;
+        table.reclaim();
+    }
+
+    for (int i = 0; i < 4; ++i) {
+        t[i]->wait();
+        delete t[i];
+    }
+
+    QCOMPARE(failures.fetchAndAddOrdered(0), 0);
+
+    // Every reference taken by the threads was dropped again
+    Q_FOREACH (uint heldHandle, held) {
+        QVERIFY(table.unref(heldHandle));
+    }
+    table.reclaim();
+    QCOMPARE(table.size(), 0U);
+}
+
+QTEST_MAIN(TestHandleTable)
+
+#include "_gen/handle-table.cpp.moc.hpp"
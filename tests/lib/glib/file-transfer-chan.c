@@ -0,0 +1,674 @@
+/*
+ * file-transfer-chan.c - Simple file transfer channel
+ *
+ * Copyright (C) 2013 Collabora Ltd. <http://www.collabora.co.uk/>
+ *
+ * Copying and distribution of this file, with or without modification,
+ * are permitted in any medium without royalty provided the copyright
+ * notice and this notice are preserved.
+ */
+
+#include "file-transfer-chan.h"
+
+#include <telepathy-glib/telepathy-glib.h>
+#include <telepathy-glib/channel-iface.h>
+#include <telepathy-glib/svc-channel.h>
+
+#include <gio/gio.h>
+
+#define READ_BUFFER_SIZE (64 * 1024)
+
+enum
+{
+  PROP_STATE = 1,
+  PROP_CONTENT_TYPE,
+  PROP_FILENAME,
+  PROP_SIZE,
+  PROP_CONTENT_HASH_TYPE,
+  PROP_CONTENT_HASH,
+  PROP_DESCRIPTION,
+  PROP_DATE,
+  PROP_AVAILABLE_SOCKET_TYPES,
+  PROP_TRANSFERRED_BYTES,
+  PROP_INITIAL_OFFSET,
+};
+
+struct _TpTestsFileTransferChannelPrivate {
+    TpFileTransferState state;
+    gchar *filename;
+    guint64 size;
+    guint64 initial_offset;
+    GHashTable *available_socket_types;
+
+    GSocketService *service;
+    GSocketConnection *connection;
+
+    /* Outgoing transfers */
+    guchar *read_buffer;
+    GByteArray *received;
+
+    /* Incoming transfers */
+    GByteArray *content;
+    gsize sent;
+};
+
+static void
+destroy_socket_control_list (gpointer data)
+{
+  GArray *tab = data;
+  g_array_free (tab, TRUE);
+}
+
+static void
+create_available_socket_types (TpTestsFileTransferChannel *self)
+{
+  TpSocketAccessControl access_control;
+  GArray *ipv4_tab;
+
+  self->priv->available_socket_types = g_hash_table_new_full (NULL, NULL,
+      NULL, destroy_socket_control_list);
+
+  /* Socket_Address_Type_IPv4 */
+  ipv4_tab = g_array_sized_new (FALSE, FALSE, sizeof (TpSocketAccessControl),
+      1);
+  access_control = TP_SOCKET_ACCESS_CONTROL_LOCALHOST;
+  g_array_append_val (ipv4_tab, access_control);
+
+  g_hash_table_insert (self->priv->available_socket_types,
+      GUINT_TO_POINTER (TP_SOCKET_ADDRESS_TYPE_IPV4), ipv4_tab);
+}
+
+static void
+tp_tests_file_transfer_channel_get_property (GObject *object,
+    guint property_id,
+    GValue *value,
+    GParamSpec *pspec)
+{
+  TpTestsFileTransferChannel *self = (TpTestsFileTransferChannel *) object;
+
+  switch (property_id)
+    {
+      case PROP_STATE:
+        g_value_set_uint (value, self->priv->state);
+        break;
+
+      case PROP_CONTENT_TYPE:
+        g_value_set_string (value, "application/octet-stream");
+        break;
+
+      case PROP_FILENAME:
+        g_value_set_string (value, self->priv->filename);
+        break;
+
+      case PROP_SIZE:
+        g_value_set_uint64 (value, self->priv->size);
+        break;
+
+      case PROP_CONTENT_HASH_TYPE:
+        g_value_set_uint (value, TP_FILE_HASH_TYPE_NONE);
+        break;
+
+      case PROP_CONTENT_HASH:
+        g_value_set_string (value, "");
+        break;
+
+      case PROP_DESCRIPTION:
+        g_value_set_string (value, "");
+        break;
+
+      case PROP_DATE:
+        g_value_set_uint64 (value, 0);
+        break;
+
+      case PROP_AVAILABLE_SOCKET_TYPES:
+        g_value_set_boxed (value, self->priv->available_socket_types);
+        break;
+
+      case PROP_TRANSFERRED_BYTES:
+        if (tp_base_channel_is_requested (TP_BASE_CHANNEL (self)))
+          g_value_set_uint64 (value, self->priv->received->len);
+        else
+          g_value_set_uint64 (value, self->priv->sent);
+        break;
+
+      case PROP_INITIAL_OFFSET:
+        g_value_set_uint64 (value, self->priv->initial_offset);
+        break;
+
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+        break;
+    }
+}
+
+static void
+tp_tests_file_transfer_channel_set_property (GObject *object,
+    guint property_id,
+    const GValue *value,
+    GParamSpec *pspec)
+{
+  TpTestsFileTransferChannel *self = (TpTestsFileTransferChannel *) object;
+
+  switch (property_id)
+    {
+      case PROP_FILENAME:
+        g_free (self->priv->filename);
+        self->priv->filename = g_value_dup_string (value);
+        break;
+
+      case PROP_SIZE:
+        self->priv->size = g_value_get_uint64 (value);
+        break;
+
+      case PROP_INITIAL_OFFSET:
+        self->priv->initial_offset = g_value_get_uint64 (value);
+        break;
+
+      default:
+        G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
+        break;
+    }
+}
+
+static void file_transfer_iface_init (gpointer iface, gpointer data);
+
+G_DEFINE_TYPE_WITH_CODE (TpTestsFileTransferChannel,
+    tp_tests_file_transfer_channel,
+    TP_TYPE_BASE_CHANNEL,
+    G_IMPLEMENT_INTERFACE (TP_TYPE_SVC_CHANNEL_TYPE_FILE_TRANSFER,
+      file_transfer_iface_init);
+    )
+
+/* type definition stuff */
+
+static const char * tp_tests_file_transfer_channel_interfaces[] = {
+    NULL
+};
+
+static void
+tp_tests_file_transfer_channel_init (TpTestsFileTransferChannel *self)
+{
+  self->priv = G_TYPE_INSTANCE_GET_PRIVATE ((self),
+      TP_TESTS_TYPE_FILE_TRANSFER_CHANNEL, TpTestsFileTransferChannelPrivate);
+
+  self->priv->received = g_byte_array_new ();
+  self->priv->content = g_byte_array_new ();
+}
+
+static GObject *
+constructor (GType type,
+             guint n_props,
+             GObjectConstructParam *props)
+{
+  GObject *object =
+      G_OBJECT_CLASS (tp_tests_file_transfer_channel_parent_class)->constructor (
+          type, n_props, props);
+  TpTestsFileTransferChannel *self = TP_TESTS_FILE_TRANSFER_CHANNEL (object);
+
+  self->priv->state = TP_FILE_TRANSFER_STATE_PENDING;
+  create_available_socket_types (self);
+
+  tp_base_channel_register (TP_BASE_CHANNEL (self));
+
+  return object;
+}
+
+static void
+dispose (GObject *object)
+{
+  TpTestsFileTransferChannel *self = (TpTestsFileTransferChannel *) object;
+
+  if (self->priv->service != NULL)
+    {
+      g_socket_service_stop (self->priv->service);
+      tp_clear_object (&self->priv->service);
+    }
+
+  tp_clear_object (&self->priv->connection);
+  tp_clear_pointer (&self->priv->available_socket_types, g_hash_table_unref);
+
+  ((GObjectClass *) tp_tests_file_transfer_channel_parent_class)->dispose (
+    object);
+}
+
+static void
+finalize (GObject *object)
+{
+  TpTestsFileTransferChannel *self = (TpTestsFileTransferChannel *) object;
+
+  g_free (self->priv->filename);
+  g_free (self->priv->read_buffer);
+  g_byte_array_free (self->priv->received, TRUE);
+  g_byte_array_free (self->priv->content, TRUE);
+
+  ((GObjectClass *) tp_tests_file_transfer_channel_parent_class)->finalize (
+    object);
+}
+
+static void
+channel_close (TpBaseChannel *channel)
+{
+  tp_base_channel_destroyed (channel);
+}
+
+static void
+fill_immutable_properties (TpBaseChannel *chan,
+    GHashTable *properties)
+{
+  TpBaseChannelClass *klass = TP_BASE_CHANNEL_CLASS (
+      tp_tests_file_transfer_channel_parent_class);
+
+  klass->fill_immutable_properties (chan, properties);
+
+  tp_dbus_properties_mixin_fill_properties_hash (
+      G_OBJECT (chan), properties,
+      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "ContentType",
+      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "Filename",
+      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "Size",
+      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "ContentHashType",
+      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "ContentHash",
+      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "Description",
+      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "Date",
+      TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER, "AvailableSocketTypes",
+      NULL);
+}
+
+static void
+tp_tests_file_transfer_channel_class_init (
+    TpTestsFileTransferChannelClass *klass)
+{
+  GObjectClass *object_class = (GObjectClass *) klass;
+  TpBaseChannelClass *base_class = TP_BASE_CHANNEL_CLASS (klass);
+  GParamSpec *param_spec;
+  static TpDBusPropertiesMixinPropImpl file_transfer_props[] = {
+      { "State", "state", NULL },
+      { "ContentType", "content-type", NULL },
+      { "Filename", "filename", NULL },
+      { "Size", "size", NULL },
+      { "ContentHashType", "content-hash-type", NULL },
+      { "ContentHash", "content-hash", NULL },
+      { "Description", "description", NULL },
+      { "Date", "date", NULL },
+      { "AvailableSocketTypes", "available-socket-types", NULL },
+      { "TransferredBytes", "transferred-bytes", NULL },
+      { "InitialOffset", "initial-offset", NULL },
+      { NULL }
+  };
+
+  object_class->constructor = constructor;
+  object_class->get_property = tp_tests_file_transfer_channel_get_property;
+  object_class->set_property = tp_tests_file_transfer_channel_set_property;
+  object_class->dispose = dispose;
+  object_class->finalize = finalize;
+
+  base_class->channel_type = TP_IFACE_CHANNEL_TYPE_FILE_TRANSFER;
+  base_class->target_handle_type = TP_HANDLE_TYPE_CONTACT;
+  base_class->interfaces = tp_tests_file_transfer_channel_interfaces;
+  base_class->close = channel_close;
+  base_class->fill_immutable_properties = fill_immutable_properties;
+
+  param_spec = g_param_spec_uint ("state", "TpFileTransferState",
+      "state of the transfer",
+      0, NUM_TP_FILE_TRANSFER_STATES - 1, 0,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_STATE, param_spec);
+
+  param_spec = g_param_spec_string ("content-type", "content type",
+      "the content type of the file",
+      "",
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_CONTENT_TYPE,
+      param_spec);
+
+  param_spec = g_param_spec_string ("filename", "file name",
+      "the name of the file",
+      "",
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_FILENAME, param_spec);
+
+  param_spec = g_param_spec_uint64 ("size", "file size",
+      "the size of the file",
+      0, G_MAXUINT64, 0,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_SIZE, param_spec);
+
+  param_spec = g_param_spec_uint ("content-hash-type", "content hash type",
+      "the type of the content hash",
+      0, NUM_TP_FILE_HASH_TYPES - 1, 0,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_CONTENT_HASH_TYPE,
+      param_spec);
+
+  param_spec = g_param_spec_string ("content-hash", "content hash",
+      "the hash of the file",
+      "",
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_CONTENT_HASH,
+      param_spec);
+
+  param_spec = g_param_spec_string ("description", "description",
+      "the description of the file",
+      "",
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_DESCRIPTION,
+      param_spec);
+
+  param_spec = g_param_spec_uint64 ("date", "date",
+      "the last modification time of the file",
+      0, G_MAXUINT64, 0,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_DATE, param_spec);
+
+  param_spec = g_param_spec_boxed (
+      "available-socket-types", "Available socket types",
+      "GHashTable containing available socket types.",
+      TP_HASH_TYPE_SUPPORTED_SOCKET_MAP,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_AVAILABLE_SOCKET_TYPES,
+      param_spec);
+
+  param_spec = g_param_spec_uint64 ("transferred-bytes", "transferred bytes",
+      "the number of bytes received by the remote side",
+      0, G_MAXUINT64, 0,
+      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_TRANSFERRED_BYTES,
+      param_spec);
+
+  param_spec = g_param_spec_uint64 ("initial-offset", "initial offset",
+      "the offset the remote side wants the transfer to start from",
+      0, G_MAXUINT64, 0,
+      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
+  g_object_class_install_property (object_class, PROP_INITIAL_OFFSET,
+      param_spec);
+
+  tp_dbus_properties_mixin_implement_interface (object_class,
+      TP_IFACE_QUARK_CHANNEL_TYPE_FILE_TRANSFER,
+      tp_dbus_properties_mixin_getter_gobject_properties, NULL,
+      file_transfer_props);
+
+  g_type_class_add_private (object_class,
+      sizeof (TpTestsFileTransferChannelPrivate));
+}
+
+static void
+change_state (TpTestsFileTransferChannel *self,
+  TpFileTransferState state)
+{
+  self->priv->state = state;
+
+  tp_svc_channel_type_file_transfer_emit_file_transfer_state_changed (self,
+      state, TP_FILE_TRANSFER_STATE_CHANGE_REASON_NONE);
+}
+
+static void
+read_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  TpTestsFileTransferChannel *self = user_data;
+  GError *error = NULL;
+  gssize len;
+
+  len = g_input_stream_read_finish (G_INPUT_STREAM (source), result, &error);
+  if (len <= 0)
+    {
+      /* The sender closes the socket once the whole file has been sent */
+      g_clear_error (&error);
+      tp_svc_channel_type_file_transfer_emit_transferred_bytes_changed (self,
+          self->priv->received->len);
+      change_state (self, TP_FILE_TRANSFER_STATE_COMPLETED);
+      g_object_unref (self);
+      return;
+    }
+
+  g_byte_array_append (self->priv->received, self->priv->read_buffer, len);
+
+  g_input_stream_read_async (G_INPUT_STREAM (source), self->priv->read_buffer,
+      READ_BUFFER_SIZE, G_PRIORITY_DEFAULT, NULL, read_cb, self);
+}
+
+static void
+close_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  TpTestsFileTransferChannel *self = user_data;
+
+  g_io_stream_close_finish (G_IO_STREAM (source), result, NULL);
+  change_state (self, TP_FILE_TRANSFER_STATE_COMPLETED);
+  g_object_unref (self);
+}
+
+static void
+write_cb (GObject *source,
+    GAsyncResult *result,
+    gpointer user_data)
+{
+  TpTestsFileTransferChannel *self = user_data;
+  GError *error = NULL;
+  gssize len;
+
+  len = g_output_stream_write_finish (G_OUTPUT_STREAM (source), result,
+      &error);
+  if (len > 0)
+    self->priv->sent += len;
+  g_clear_error (&error);
+
+  if (len <= 0 || self->priv->sent >= self->priv->content->len)
+    {
+      /* Closing the socket tells the receiver the whole file has been sent */
+      tp_svc_channel_type_file_transfer_emit_transferred_bytes_changed (self,
+          self->priv->sent);
+      g_io_stream_close_async (G_IO_STREAM (self->priv->connection),
+          G_PRIORITY_DEFAULT, NULL, close_cb, self);
+      return;
+    }
+
+  g_output_stream_write_async (G_OUTPUT_STREAM (source),
+      self->priv->content->data + self->priv->sent,
+      MIN (READ_BUFFER_SIZE, self->priv->content->len - self->priv->sent),
+      G_PRIORITY_DEFAULT, NULL, write_cb, self);
+}
+
+static void
+service_incoming_cb (GSocketService *service,
+    GSocketConnection *connection,
+    GObject *source_object,
+    gpointer user_data)
+{
+  TpTestsFileTransferChannel *self = user_data;
+
+  g_assert (self->priv->connection == NULL);
+  self->priv->connection = g_object_ref (connection);
+
+  /* Keep the channel alive until the read or write loop is over */
+  if (tp_base_channel_is_requested (TP_BASE_CHANNEL (self)))
+    {
+      GInputStream *input;
+
+      self->priv->read_buffer = g_malloc (READ_BUFFER_SIZE);
+
+      input = g_io_stream_get_input_stream (G_IO_STREAM (connection));
+      g_input_stream_read_async (input, self->priv->read_buffer,
+          READ_BUFFER_SIZE, G_PRIORITY_DEFAULT, NULL, read_cb,
+          g_object_ref (self));
+    }
+  else
+    {
+      GOutputStream *output;
+
+      self->priv->sent = self->priv->initial_offset;
+      if (self->priv->sent >= self->priv->content->len)
+        {
+          g_io_stream_close_async (G_IO_STREAM (connection),
+              G_PRIORITY_DEFAULT, NULL, close_cb, g_object_ref (self));
+          return;
+        }
+
+      output = g_io_stream_get_output_stream (G_IO_STREAM (connection));
+      g_output_stream_write_async (output,
+          self->priv->content->data + self->priv->sent,
+          MIN (READ_BUFFER_SIZE, self->priv->content->len - self->priv->sent),
+          G_PRIORITY_DEFAULT, NULL, write_cb, g_object_ref (self));
+    }
+}
+
+static GValue *
+create_local_socket (TpTestsFileTransferChannel *self)
+{
+  gboolean success;
+  GInetAddress *localhost;
+  GSocketAddress *address, *effective_address;
+  GValue *address_gvalue;
+
+  localhost = g_inet_address_new_loopback (G_SOCKET_FAMILY_IPV4);
+  address = g_inet_socket_address_new (localhost, 0);
+  g_object_unref (localhost);
+
+  self->priv->service = g_socket_service_new ();
+
+  success = g_socket_listener_add_address (
+      G_SOCKET_LISTENER (self->priv->service),
+      address, G_SOCKET_TYPE_STREAM,
+      G_SOCKET_PROTOCOL_DEFAULT,
+      NULL, &effective_address, NULL);
+  g_assert (success);
+
+  tp_g_signal_connect_object (self->priv->service, "incoming",
+      G_CALLBACK (service_incoming_cb), self, 0);
+
+  address_gvalue = tp_g_value_slice_new_take_boxed (
+      TP_STRUCT_TYPE_SOCKET_ADDRESS_IPV4,
+      dbus_g_type_specialized_construct (
+        TP_STRUCT_TYPE_SOCKET_ADDRESS_IPV4));
+
+  dbus_g_type_struct_set (address_gvalue,
+      0, "127.0.0.1",
+      1, g_inet_socket_address_get_port (
+        G_INET_SOCKET_ADDRESS (effective_address)),
+      G_MAXUINT);
+
+  g_object_unref (address);
+  g_object_unref (effective_address);
+  return address_gvalue;
+}
+
+static void
+file_transfer_provide_file (TpSvcChannelTypeFileTransfer *iface,
+    guint address_type,
+    guint access_control,
+    const GValue *access_control_param,
+    DBusGMethodInvocation *context)
+{
+  TpTestsFileTransferChannel *self = (TpTestsFileTransferChannel *) iface;
+  GError *error = NULL;
+  GValue *address;
+
+  if (!tp_base_channel_is_requested (TP_BASE_CHANNEL (self)) ||
+      self->priv->state != TP_FILE_TRANSFER_STATE_PENDING)
+    {
+      g_set_error (&error, TP_ERROR, TP_ERROR_NOT_AVAILABLE,
+          "File already provided");
+      goto fail;
+    }
+
+  if (address_type != TP_SOCKET_ADDRESS_TYPE_IPV4 ||
+      access_control != TP_SOCKET_ACCESS_CONTROL_LOCALHOST)
+    {
+      g_set_error (&error, TP_ERROR, TP_ERROR_NOT_IMPLEMENTED,
+          "Address type not supported with this access control");
+      goto fail;
+    }
+
+  address = create_local_socket (self);
+
+  tp_svc_channel_type_file_transfer_return_from_provide_file (context,
+      address);
+  tp_g_value_slice_free (address);
+
+  /* Pretend the remote side accepted the file right away */
+  if (self->priv->initial_offset != 0)
+    tp_svc_channel_type_file_transfer_emit_initial_offset_defined (self,
+        self->priv->initial_offset);
+  change_state (self, TP_FILE_TRANSFER_STATE_ACCEPTED);
+  change_state (self, TP_FILE_TRANSFER_STATE_OPEN);
+  return;
+
+fail:
+  dbus_g_method_return_error (context, error);
+  g_error_free (error);
+}
+
+static void
+file_transfer_accept_file (TpSvcChannelTypeFileTransfer *iface,
+    guint address_type,
+    guint access_control,
+    const GValue *access_control_param,
+    guint64 offset,
+    DBusGMethodInvocation *context)
+{
+  TpTestsFileTransferChannel *self = (TpTestsFileTransferChannel *) iface;
+  GError *error = NULL;
+  GValue *address;
+
+  if (tp_base_channel_is_requested (TP_BASE_CHANNEL (self)) ||
+      self->priv->state != TP_FILE_TRANSFER_STATE_PENDING)
+    {
+      g_set_error (&error, TP_ERROR, TP_ERROR_NOT_AVAILABLE,
+          "File already accepted");
+      goto fail;
+    }
+
+  if (address_type != TP_SOCKET_ADDRESS_TYPE_IPV4 ||
+      access_control != TP_SOCKET_ACCESS_CONTROL_LOCALHOST)
+    {
+      g_set_error (&error, TP_ERROR, TP_ERROR_NOT_IMPLEMENTED,
+          "Address type not supported with this access control");
+      goto fail;
+    }
+
+  address = create_local_socket (self);
+
+  tp_svc_channel_type_file_transfer_return_from_accept_file (context,
+      address);
+  tp_g_value_slice_free (address);
+
+  /* The sender supports starting anywhere */
+  self->priv->initial_offset = MIN (offset, self->priv->content->len);
+  tp_svc_channel_type_file_transfer_emit_initial_offset_defined (self,
+      self->priv->initial_offset);
+  change_state (self, TP_FILE_TRANSFER_STATE_OPEN);
+  return;
+
+fail:
+  dbus_g_method_return_error (context, error);
+  g_error_free (error);
+}
+
+static void
+file_transfer_iface_init (gpointer iface,
+    gpointer data)
+{
+  TpSvcChannelTypeFileTransferClass *klass = iface;
+
+#define IMPLEMENT(x) tp_svc_channel_type_file_transfer_implement_##x (klass, file_transfer_##x)
+  IMPLEMENT(provide_file);
+  IMPLEMENT(accept_file);
+#undef IMPLEMENT
+}
+
+void
+tp_tests_file_transfer_channel_set_content (TpTestsFileTransferChannel *self,
+    const guint8 *data,
+    guint len)
+{
+  g_byte_array_set_size (self->priv->content, 0);
+  g_byte_array_append (self->priv->content, data, len);
+}
+
+const GByteArray *
+tp_tests_file_transfer_channel_get_received_data (
+    TpTestsFileTransferChannel *self)
+{
+  return self->priv->received;
+}